@@ -16,17 +16,71 @@ extern "C"
 
 #include "cJSON.h"
 /* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_CB_PENDING 1	 //!< Callback return value: the response is sent later with k_ghost_io_complete
+
+/**
+ * @brief Describe an optional member of a command struct.
+ *
+ * @param struct_type Type of the command struct
+ * @param member Member to decode, named like the JSON key
+ * @param field_type Type of the JSON value, see k_ghost_io_field_type_t
+ * @param min Minimum accepted value of numeric fields
+ * @param max Maximum accepted value of numeric fields. The range is not checked if min and max are equal
+ */
+#define K_GHOST_IO_FIELD(struct_type, member, field_type, min, max) \
+	{#member, field_type, offsetof(struct_type, member), sizeof(((struct_type *)0)->member), min, max, 0}
+
+/**
+ * @brief Describe a mandatory member of a command struct. Same as K_GHOST_IO_FIELD, the request is rejected if the key is missing.
+ */
+#define K_GHOST_IO_REQUIRED_FIELD(struct_type, member, field_type, min, max) \
+	{#member, field_type, offsetof(struct_type, member), sizeof(((struct_type *)0)->member), min, max, 1}
+
+#define K_GHOST_IO_TIME_SCALE_UNBOUNDED 0.0	 //!< Time scale running the simulation as fast as possible, see k_ghost_io_set_time_scale
+
+#ifndef K_GHOST_IO_MAX_WORKERS
+#define K_GHOST_IO_MAX_WORKERS 64  //!< Maximum number of worker threads accepted by k_ghost_io_set_worker_count
+#endif
+
 /* Typedef -------------------------------------------------------------------*/
+/**
+ * @brief Token identifying a request whose response was deferred. 0 is never a valid token.
+ */
+typedef uint32_t k_ghost_io_token_t;
+
 /**
  * @brief Callback function type for handling specific interface requests.
  *
  * @param input_data_p Pointer to the input data for the callback, in cJSON format.
  * @param user_data_p Pointer to provided user data.
  *
- * @return int Returns 0 on success, or -1 on failure.
+ * @return int Returns 0 on success, -1 on failure, or K_GHOST_IO_CB_PENDING if the response was deferred with k_ghost_io_defer.
  */
 typedef int (*k_ghost_io_interface_callback_t)(const cJSON *input_data_p, void *user_data_p);
 
+/**
+ * @brief Callback function type for handling specific interface requests without building a cJSON tree.
+ *
+ * @param body_p Pointer to the raw request body, NUL terminated.
+ * @param body_len Length of the request body.
+ * @param user_data_p Pointer to provided user data.
+ *
+ * @return int Returns 0 on success, -1 on failure, or K_GHOST_IO_CB_PENDING if the response was deferred with k_ghost_io_defer.
+ */
+typedef int (*k_ghost_io_interface_raw_callback_t)(const char *body_p, size_t body_len, void *user_data_p);
+
+/**
+ * @brief Callback function type for handling specific interface requests and answering with a JSON body.
+ *
+ * @param input_data_p Pointer to the input data for the callback, in cJSON format.
+ * @param response_p Empty JSON object to be filled with the response. Owned by the library, must not be deleted.
+ * @param user_data_p Pointer to provided user data.
+ *
+ * @return int Returns 0 on success, -1 on failure, or K_GHOST_IO_CB_PENDING if the response was deferred with k_ghost_io_defer.
+ *         The response object is sent back in both the success (200) and the failure (500) case, unless it is left empty on failure.
+ */
+typedef int (*k_ghost_io_interface_response_callback_t)(const cJSON *input_data_p, cJSON *response_p, void *user_data_p);
+
 /**
  * @brief Callback function type for synchronizing the status of the system.
  *
@@ -34,6 +88,105 @@ typedef int (*k_ghost_io_interface_callback_t)(const cJSON *input_data_p, void *
  */
 typedef void (*k_ghost_io_sync_status_t)(void);
 
+/**
+ * @brief Callback function type for handling specific interface requests decoded into a command struct.
+ *
+ * @param command_p Pointer to the command struct, decoded and validated against the schema of the interface.
+ * @param user_data_p Pointer to provided user data.
+ *
+ * @return int Returns 0 on success, -1 on failure, or K_GHOST_IO_CB_PENDING if the response was deferred with k_ghost_io_defer.
+ */
+typedef int (*k_ghost_io_interface_typed_callback_t)(const void *command_p, void *user_data_p);
+
+/**
+ * @brief Handle of an armed timer. 0 is never a valid handle.
+ */
+typedef uint64_t k_ghost_io_timer_t;
+
+/**
+ * @brief Callback function type for timers.
+ *
+ * @param user_data_p Pointer to provided user data.
+ */
+typedef void (*k_ghost_io_timer_callback_t)(void *user_data_p);
+
+/**
+ * @brief Progress of an upload streamed to a callback.
+ */
+typedef struct
+{
+	size_t offset;	   //!< Number of body bytes delivered before the current chunk
+	size_t total_len;  //!< Length of the body announced by Content-Length, 0 if unknown (chunked transfer encoding)
+	int	   done;	   //!< 0 while the body is flowing. On the last call: 1 if the body is complete, -1 if the upload was aborted
+	void  *state_p;	   //!< Free for the callback, e.g. to keep the state of the upload across the calls. NULL on the first call
+} k_ghost_io_stream_t;
+
+/**
+ * @brief Callback function type for handling request bodies chunk by chunk, as they are received.
+ *
+ * Called once per chunk while the body is flowing, then a last time with chunk_p NULL and stream_p->done set.
+ *
+ * @param stream_p Progress of the upload, the same for all the calls of an upload.
+ * @param chunk_p Pointer to the body chunk, not NUL terminated. NULL on the last call.
+ * @param chunk_len Length of the body chunk, 0 on the last call.
+ * @param user_data_p Pointer to provided user data.
+ *
+ * @return int For a chunk, 0 to go on or -1 to abort the upload, which is answered with 500. On the last call of a
+ *         complete body, 0 on success, -1 on failure, or K_GHOST_IO_CB_PENDING if the response was deferred with
+ *         k_ghost_io_defer. Ignored on the last call of an aborted upload.
+ */
+typedef int (*k_ghost_io_interface_stream_callback_t)(k_ghost_io_stream_t *stream_p, const char *chunk_p, size_t chunk_len, void *user_data_p);
+
+typedef enum
+{
+	K_GHOST_IO_FIELD_BOOL,	  //!< JSON true/false into a bool
+	K_GHOST_IO_FIELD_INT,	  //!< JSON integer into a signed integer of 1, 2, 4 or 8 bytes
+	K_GHOST_IO_FIELD_DOUBLE,  //!< JSON number into a float or a double
+	K_GHOST_IO_FIELD_STRING,  //!< JSON string into a char array, NUL terminated
+} k_ghost_io_field_type_t;
+
+typedef struct
+{
+	const char			   *name;	   //!< JSON key of the field
+	k_ghost_io_field_type_t type;	   //!< Expected type of the JSON value
+	size_t					offset;	   //!< Offset of the member in the command struct
+	size_t					size;	   //!< Size of the member in the command struct
+	double					min;	   //!< Minimum accepted value of numeric fields
+	double					max;	   //!< Maximum accepted value of numeric fields, no range check if equal to min
+	int						required;  //!< Set if the request must contain the field
+} k_ghost_io_field_t;
+
+typedef struct
+{
+	const k_ghost_io_field_t *fields;		 //!< Fields of the command, usually built with K_GHOST_IO_FIELD
+	size_t					  fields_count;	 //!< Number of fields
+	size_t					  command_size;	 //!< Size of the command struct
+} k_ghost_io_schema_t;
+
+typedef struct
+{
+	double deadband;  //!< Numeric fields are published once they move further than this from their last published value, 0 on any change
+} k_ghost_io_state_field_t;
+
+typedef struct
+{
+	k_ghost_io_schema_t				schema;		   //!< Fields of the state struct, usually built with K_GHOST_IO_FIELD
+	const k_ghost_io_state_field_t *state_fields;  //!< Publication of each field, in the order of the fields. NULL publishes any change
+} k_ghost_io_state_schema_t;
+
+/**
+ * @brief Callback function type updating all the instances of a device farm at once, see k_ghost_io_add_farm.
+ *
+ * The values are stored as a structure of arrays: columns[f][i] is field f of the schema for instance i, each column an
+ * array of count values of the type of the field, starting on a cache line. Plain loops over a column vectorize.
+ *
+ * @param columns One array per field of the schema, in the order of the fields.
+ * @param count Number of instances
+ * @param elapsed_ns Time since the previous tick, on the library clock
+ * @param user_data_p Pointer to provided user data.
+ */
+typedef void (*k_ghost_io_farm_tick_t)(void *const *columns, size_t count, uint64_t elapsed_ns, void *user_data_p);
+
 typedef enum
 {
 	K_GHOST_REGISTER_RET_CODE_ERROR				 = -2,	//!< Error occurred during registration
@@ -41,6 +194,69 @@ typedef enum
 	K_GHOST_REGISTER_RET_CODE_OK				 = 0,	//!< Registration successful
 } k_ghost_io_register_ret_code_t;
 
+typedef struct
+{
+	unsigned int max_inflight_requests;	 //!< REST requests accepted and not answered yet, 0 for no limit
+	unsigned int max_interface_pending;	 //!< Commands to a single interface accepted and not answered yet, 0 for no limit
+	size_t		 max_sse_queued_bytes;	 //!< Event bytes waiting for slow SSE clients, all the clients together, 0 for no limit
+	unsigned int retry_after_s;			 //!< Retry-After value of the 503 responses, 0 for the default of 1 second
+} k_ghost_io_limits_t;
+
+typedef struct
+{
+	unsigned int inflight_requests;	 //!< REST requests accepted and not answered yet
+	size_t		 sse_queued_bytes;	 //!< Event bytes waiting for slow SSE clients
+	uint64_t	 shed_requests;		 //!< Requests and SSE subscriptions answered with 503 since the start
+	uint64_t	 dropped_events;	 //!< Events not delivered to a slow SSE client because its queue would exceed the limit
+} k_ghost_io_stats_t;
+
+typedef enum
+{
+	K_GHOST_IO_WAVE_CONSTANT,  //!< offset
+	K_GHOST_IO_WAVE_SINE,	   //!< offset + amplitude * sin(2 * pi * position)
+	K_GHOST_IO_WAVE_SQUARE,	   //!< offset + amplitude over the first half of the period, offset - amplitude over the second half
+	K_GHOST_IO_WAVE_TRIANGLE,  //!< From offset - amplitude up to offset + amplitude at mid period, and back
+	K_GHOST_IO_WAVE_RAMP,	   //!< Sawtooth from offset - amplitude up to offset + amplitude over each period
+	K_GHOST_IO_WAVE_GUST,	   //!< offset plus one raised cosine gust per period, of random height between 0 and amplitude
+} k_ghost_io_waveform_t;
+
+typedef enum
+{
+	K_GHOST_IO_NOISE_NONE,		//!< No noise
+	K_GHOST_IO_NOISE_UNIFORM,	//!< Uniform noise between -noise_amplitude and noise_amplitude
+	K_GHOST_IO_NOISE_GAUSSIAN,	//!< Normal noise of standard deviation noise_amplitude
+} k_ghost_io_noise_t;
+
+typedef struct
+{
+	const char			 *name;				//!< JSON key of the channel in the events, escaped like any JSON string
+	k_ghost_io_waveform_t waveform;			//!< Shape of the signal
+	double				  offset;			//!< Value the signal oscillates around
+	double				  amplitude;		//!< Peak deviation from the offset
+	double				  frequency_hz;		//!< Periods per second of the waveform
+	double				  phase;			//!< Position in the period at the first sample, as a fraction of the period
+	k_ghost_io_noise_t	  noise;			//!< Noise added to every sample
+	double				  noise_amplitude;	//!< Scale of the noise, see k_ghost_io_noise_t
+} k_ghost_io_channel_t;
+
+typedef struct
+{
+	uint64_t delay_us;		  //!< Delay added before every request is run, in microseconds
+	uint64_t jitter_us;		  //!< Random extra delay, uniformly distributed between 0 and this, in microseconds
+	double	 error_rate;	  //!< Probability of answering a request with 500 Internal Server Error without running it
+	double	 reset_rate;	  //!< Probability of resetting the connection of a request without answering it
+	double	 drop_rate;		  //!< Probability of not sending an event of the interface to a client
+	double	 duplicate_rate;  //!< Probability of sending an event of the interface twice to a client
+	uint64_t seed;			  //!< Seed of the random draws, 0 to derive it from the interface name
+} k_ghost_io_fault_profile_t;
+
+typedef struct
+{
+	uint64_t bytes_per_s;  //!< Bandwidth of the link, 0 for no limit
+	uint64_t latency_us;   //!< One-way latency added to every event, in microseconds
+	uint64_t jitter_us;	   //!< Random extra latency, uniformly distributed between 0 and this, in microseconds
+} k_ghost_io_link_profile_t;
+
 typedef struct
 {
 	int	  sse_client_fd;  //!< File descriptor for the SSE client
@@ -49,11 +265,16 @@ typedef struct
 
 typedef struct
 {
-	char						   *interface_name;	 //!< Interface name this callback is used for
-	k_ghost_io_interface_callback_t rest_cb;		 //!< Callback to be used for the specific hardware interface type
-	k_ghost_io_sync_status_t		sync_cb;		 //!< Callback to be used for synchronizing the status of the system with the SSE clients
-	void						   *user_data_p;	 //!< User data to be passed to the callback
-	void						   *next_cb;		 //!< Pointer to the next REST API callback in the list
+	char									*interface_name;  //!< Interface name this callback is used for
+	k_ghost_io_interface_callback_t			 rest_cb;		  //!< Callback to be used for the specific hardware interface type
+	k_ghost_io_interface_raw_callback_t		 raw_cb;		  //!< Callback receiving the raw body, used instead of rest_cb when set
+	k_ghost_io_interface_response_callback_t response_cb;	  //!< Callback filling a response body, used instead of rest_cb when set
+	k_ghost_io_interface_typed_callback_t	 typed_cb;		  //!< Callback receiving the decoded command, used instead of rest_cb when set
+	const k_ghost_io_schema_t				*schema_p;		  //!< Schema the commands of typed_cb are decoded with
+	k_ghost_io_interface_stream_callback_t	 stream_cb;		  //!< Callback receiving the body chunk by chunk, used instead of rest_cb when set
+	k_ghost_io_sync_status_t				 sync_cb;		  //!< Callback to be used for synchronizing the status of the system with the SSE clients
+	void									*user_data_p;	  //!< User data to be passed to the callback
+	void									*next_cb;		  //!< Pointer to the next REST API callback in the list
 } k_ghost_io_interface_t;
 
 /* Constant ------------------------------------------------------------------*/
@@ -66,6 +287,49 @@ typedef struct
  */
 int k_ghost_io_init(void);
 
+/**
+ * @brief Run the interface callbacks on a pool of worker threads instead of the I/O thread.
+ *
+ * Requests are sharded by interface: the commands to an interface are always run by the same worker, in the order they
+ * were received, while different interfaces run in parallel. Status synchronizations (sync_cb) and the commands of a
+ * batch follow the same path. Must be called before k_ghost_io_init.
+ *
+ * @param worker_count Number of worker threads, 0 (default) to run the callbacks on the I/O thread
+ *
+ * @return int Returns 0 on success, or -1 if the system is already initialized or worker_count exceeds K_GHOST_IO_MAX_WORKERS.
+ */
+int k_ghost_io_set_worker_count(unsigned int worker_count);
+
+/**
+ * @brief Set the admission limits of the server.
+ *
+ * Requests over a limit are answered right away with 503 Service Unavailable and a Retry-After header, so that the
+ * latency of the accepted traffic stays bounded. Events that would make the queue of a slow SSE client exceed the limit
+ * are dropped for that client. Can be called at any time, from any thread.
+ *
+ * @param limits_p Limits to apply, a zeroed struct to remove them all
+ *
+ * @return int Returns 0 on success, or -1 if limits_p is NULL.
+ */
+int k_ghost_io_set_limits(const k_ghost_io_limits_t *limits_p);
+
+/**
+ * @brief Read the load and load shedding counters of the server.
+ *
+ * @param stats_p Struct filled with the counters
+ */
+void k_ghost_io_get_stats(k_ghost_io_stats_t *stats_p);
+
+/**
+ * @brief Add the Date and Server headers to the responses.
+ *
+ * Off by default: the simulator usually talks to a local dashboard that has no use for them. The Date value is
+ * formatted at most once per second by each thread, never per response.
+ *
+ * @param enabled 1 to add the headers, 0 to leave them out
+ */
+void k_ghost_io_set_server_headers(int enabled);
+
 /**
  * @brief Register a new interface with the k_ghost_io system.
  *
@@ -79,9 +343,81 @@ int k_ghost_io_init(void);
 k_ghost_io_register_ret_code_t k_ghost_io_register_interface(const char *interface_name, k_ghost_io_interface_callback_t rest_cb,
 															 k_ghost_io_sync_status_t sync_cb, void *user_data_p);
 
+/**
+ * @brief Register a new interface whose requests are handed over as raw body, without building a cJSON tree.
+ *
+ * The interface is resolved with a pre-scan of the body (or from the URI path), so the handler is free to use its own parser.
+ *
+ * @param interface_name Name of the interface to register.
+ * @param raw_cb Callback function for handling the raw body of REST requests for this interface.
+ * @param sync_cb Optional. Callback function for synchronizing the status of the system with the SSE clients.
+ * @param user_data_p Optional. Pointer to user data to pass to callback.
+ *
+ * @return Returns registration status code. Refer to k_ghost_io_register_ret_code_t for possible values.
+ */
+k_ghost_io_register_ret_code_t k_ghost_io_register_raw_interface(const char *interface_name, k_ghost_io_interface_raw_callback_t raw_cb,
+																 k_ghost_io_sync_status_t sync_cb, void *user_data_p);
+
+/**
+ * @brief Register a new interface whose callback answers with a JSON body.
+ *
+ * The response object is serialized into a buffer reused across the requests of the serving thread, and sent in a single
+ * write together with the headers. Commands of a batch only report the status, the response body is discarded.
+ *
+ * @param interface_name Name of the interface to register.
+ * @param response_cb Callback function for handling REST requests for this interface and filling the response.
+ * @param sync_cb Optional. Callback function for synchronizing the status of the system with the SSE clients.
+ * @param user_data_p Optional. Pointer to user data to pass to callback.
+ *
+ * @return Returns registration status code. Refer to k_ghost_io_register_ret_code_t for possible values.
+ */
+k_ghost_io_register_ret_code_t k_ghost_io_register_response_interface(const char *interface_name, k_ghost_io_interface_response_callback_t response_cb,
+																	  k_ghost_io_sync_status_t sync_cb, void *user_data_p);
+
+/**
+ * @brief Register a new interface whose requests are decoded into a command struct described by a schema.
+ *
+ * The body is decoded and validated in a single pass, straight into a zeroed command struct, without building a cJSON tree.
+ * Keys that are not in the schema (e.g. "interface") are ignored. Requests with a missing required field, a value of the
+ * wrong type, out of range or a string longer than its member are answered with 400 without calling the callback.
+ *
+ * @param interface_name Name of the interface to register.
+ * @param schema_p Schema of the commands. Not copied: it must stay valid while the interface is registered.
+ * @param typed_cb Callback function for handling the decoded commands of this interface.
+ * @param sync_cb Optional. Callback function for synchronizing the status of the system with the SSE clients.
+ * @param user_data_p Optional. Pointer to user data to pass to callback.
+ *
+ * @return Returns registration status code. Refer to k_ghost_io_register_ret_code_t for possible values.
+ */
+k_ghost_io_register_ret_code_t k_ghost_io_register_typed_interface(const char *interface_name, const k_ghost_io_schema_t *schema_p,
+																   k_ghost_io_interface_typed_callback_t typed_cb, k_ghost_io_sync_status_t sync_cb,
+																   void *user_data_p);
+
+/**
+ * @brief Register a new interface whose request bodies are streamed to the callback as they are received.
+ *
+ * Meant for uploads that do not fit in memory (waveforms, scenario files): bodies sent with Content-Length or with the
+ * chunked transfer encoding go straight to the callback, chunk by chunk, without being buffered in full. Uploads must
+ * address the interface through the URI path (POST /api/simulate/<interface>). The callback always runs on the I/O
+ * thread, even with a worker pool, so it must not block.
+ *
+ * @param interface_name Name of the interface to register.
+ * @param stream_cb Callback function receiving the body chunks of the requests for this interface.
+ * @param sync_cb Optional. Callback function for synchronizing the status of the system with the SSE clients.
+ * @param user_data_p Optional. Pointer to user data to pass to callback.
+ *
+ * @return Returns registration status code. Refer to k_ghost_io_register_ret_code_t for possible values.
+ */
+k_ghost_io_register_ret_code_t k_ghost_io_register_stream_interface(const char *interface_name, k_ghost_io_interface_stream_callback_t stream_cb,
+																	k_ghost_io_sync_status_t sync_cb, void *user_data_p);
+
 /**
  * @brief Unregisters an interface from the ghost IO system.
  *
+ * Like the registration functions, it can be called from any thread while requests are being served: requests already
+ * dispatched to the interface complete normally, deferred ones included, and its memory is released once no request can
+ * reach it anymore.
+ *
  * @param interface_name Pointer to a string representing the name of the interface to be unregistered.
  */
 void k_ghost_io_unregister_interface(const char *interface_name);
@@ -91,6 +427,385 @@ void k_ghost_io_unregister_interface(const char *interface_name);
  * @param data Pointer to data to send in SSE data payload
  */
 void k_ghost_io_send_event(const char *data);
+
+/**
+ * @brief Send an event about an interface to the SSE clients subscribed to it.
+ *
+ * The event is named after the interface ("event: <interface_name>"), so that a client can multiplex the updates of
+ * several interfaces over a single connection (GET /api/sse?interface=a,b) and tell them apart, e.g. with
+ * EventSource.addEventListener. Clients that did not pass any interface in the query receive the events of all of them.
+ *
+ * @param interface_name Name of the interface the event is about
+ * @param data Pointer to data to send in SSE data payload
+ */
+void k_ghost_io_send_interface_event(const char *interface_name, const char *data);
+
+/**
+ * @brief Run a callback on the I/O thread after a delay, once or periodically.
+ *
+ * Timers are kept in a hierarchical timing wheel: arming and cancelling take constant time whatever the number of
+ * timers, and the I/O thread sleeps until the next one is due. Callbacks run on the I/O thread, in expiry order, at
+ * most one tick (K_GHOST_IO_TIMER_TICK_NS, 100 us by default) late; they must not block. Periodic timers keep their
+ * phase: runs missed because the thread was busy are skipped, not made up for. Can be called from any thread,
+ * callbacks included.
+ *
+ * @param delay_us Time from now to the first run, in microseconds. 0 to run at the next turn of the I/O thread
+ * @param period_us Time between two runs, in microseconds. 0 for a one-shot timer
+ * @param timer_cb Callback to run
+ * @param user_data_p Optional. Pointer to user data to pass to the callback
+ *
+ * @return Handle of the timer, 0 if timer_cb is NULL or in case of allocation failure.
+ */
+k_ghost_io_timer_t k_ghost_io_schedule(uint64_t delay_us, uint64_t period_us, k_ghost_io_timer_callback_t timer_cb, void *user_data_p);
+
+/**
+ * @brief Disarm a timer.
+ *
+ * When called from another thread while the callback of the timer runs, waits for the callback to return, so that the
+ * user data can be released right after. A timer can cancel itself from its own callback.
+ *
+ * @param timer Handle returned by k_ghost_io_schedule
+ *
+ * @return 0 if the timer was armed, -1 if the handle is unknown or the one-shot timer already ran.
+ */
+int k_ghost_io_cancel(k_ghost_io_timer_t timer);
+
+/**
+ * @brief Set the pace of the library clock, followed by the timers and the generators.
+ *
+ * The clock starts in step with the monotonic clock of the system. With a scale of 100, an hour of simulation takes 36
+ * seconds. With K_GHOST_IO_TIME_SCALE_UNBOUNDED, the clock only moves when the I/O thread has nothing left to do: it then
+ * jumps straight to the next timer, so scenarios run as fast as the CPU allows while every timer still runs at its time
+ * and in order. Can be called at any time, from any thread; the clock never goes backwards.
+ *
+ * @param scale Virtual seconds per real second, or K_GHOST_IO_TIME_SCALE_UNBOUNDED
+ *
+ * @return 0 on success, -1 if the scale is negative or not a number.
+ */
+int k_ghost_io_set_time_scale(double scale);
+
+/**
+ * @brief Stop the library clock. Timers are not run until the clock is resumed or stepped.
+ */
+void k_ghost_io_pause_clock(void);
+
+/**
+ * @brief Let the library clock run again at its scale, from where it was paused.
+ */
+void k_ghost_io_resume_clock(void);
+
+/**
+ * @brief Move the paused library clock forward. The timers due by then are run by the I/O thread.
+ *
+ * @param step_us Time to add, in microseconds
+ *
+ * @return 0 on success, -1 if the clock is not paused.
+ */
+int k_ghost_io_step_clock(uint64_t step_us);
+
+/**
+ * @brief Read the library clock, e.g. to timestamp the events of a model.
+ *
+ * @return Time in microseconds, with the origin of the monotonic clock of the system.
+ */
+uint64_t k_ghost_io_get_time_us(void);
+
+/**
+ * @brief Publish simulated sensor readings at a fixed rate, computed by the library.
+ *
+ * At every tick the I/O thread samples all the channels at the scheduled time and sends them as a single event about the
+ * interface, e.g. {"speed":3.2,"direction":181.5}. The ticks are driven by a timer of the I/O thread, so generators
+ * need no thread of their own. A tick missed because the thread was busy is not made up for: the next event carries the
+ * samples of the latest scheduled time. The noise is pseudo-random, seeded from the interface name so that runs repeat.
+ * The interface does not need to be registered.
+ *
+ * @param interface_name Name of the interface the events are about.
+ * @param channels_p Channels of the generator, copied.
+ * @param channels_count Number of channels.
+ * @param rate_hz Events per second, up to one per timer tick (10000 with the default tick).
+ *
+ * @return Returns registration status code. K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED if the interface already has a generator.
+ */
+k_ghost_io_register_ret_code_t k_ghost_io_add_generator(const char *interface_name, const k_ghost_io_channel_t *channels_p, size_t channels_count,
+														double rate_hz);
+
+/**
+ * @brief Stop the generator of an interface. Can be called from any thread, no event of the generator is sent once it returns.
+ *
+ * @param interface_name Name of the interface passed to k_ghost_io_add_generator.
+ */
+void k_ghost_io_remove_generator(const char *interface_name);
+
+/**
+ * @brief Replay a recorded time series as events of an interface.
+ *
+ * The file is mapped, not read: it is decoded one record ahead of the timeline, and the pages already played are given
+ * back, so recordings of any size start at once and keep a small resident footprint. Two formats are recognized:
+ * - CSV, with a header line naming the columns. The first column is the time in seconds, the others are channels;
+ *   empty lines and lines starting with '#' are skipped, empty or invalid values are sent as null.
+ * - Binary, starting with the 8 bytes "KGIOREC1", the number of channels and the size of their names as uint32_t, then
+ *   the NUL-terminated names. Records start at the next multiple of 8 bytes, each a double time in seconds followed by
+ *   a double per channel, all in the byte order of the host.
+ *
+ * Each record is sent as a single event, e.g. {"speed":3.2,"direction":181.5}, when its time comes on the library
+ * clock. The first record is sent right away; records late or out of order are sent without waiting.
+ *
+ * @param interface_name Name of the interface the events are about
+ * @param path Path of the recording
+ * @param speed Pace of the replay, 1.0 for the original timeline. Must be positive
+ * @param loop If non zero, the recording starts over right after its last record
+ *
+ * @return Returns registration status code. K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED if the interface already has a playback.
+ */
+k_ghost_io_register_ret_code_t k_ghost_io_add_playback(const char *interface_name, const char *path, double speed, int loop);
+
+/**
+ * @brief Stop the playback of an interface and unmap its recording. Can be called from any thread, no event of the
+ * playback is sent once it returns.
+ *
+ * @param interface_name Name of the interface passed to k_ghost_io_add_playback.
+ */
+void k_ghost_io_remove_playback(const char *interface_name);
+
+/**
+ * @brief Let the library publish the state of an interface, one event per period with only the fields that changed.
+ *
+ * The state is a struct described by a state schema, its fields usually built with K_GHOST_IO_FIELD. The model writes it with
+ * k_ghost_io_set_state as often as it likes; every period, the fields that moved further than their deadband from
+ * their last published value are sent as a single interface event, e.g. {"temperature":21.5}. Nothing is sent if no
+ * field moved. The whole state is sent at the first period and after an SSE client connects.
+ *
+ * @param interface_name Name of the interface the events are about
+ * @param schema_p Fields of the state. Not copied: it must stay valid until the state is removed.
+ * @param period_us Time between two publications, in microseconds
+ *
+ * @return Returns registration status code. K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED if the interface already has a state.
+ */
+k_ghost_io_register_ret_code_t k_ghost_io_add_state(const char *interface_name, const k_ghost_io_state_schema_t *schema_p, uint64_t period_us);
+
+/**
+ * @brief Update the state of an interface. Can be called from any thread, the changes are published at the next period.
+ *
+ * @param interface_name Name of the interface passed to k_ghost_io_add_state
+ * @param state_p State struct, copied
+ *
+ * @return 0 on success, -1 if the interface has no state.
+ */
+int k_ghost_io_set_state(const char *interface_name, const void *state_p);
+
+/**
+ * @brief Read the state of an interface as last set.
+ *
+ * @param interface_name Name of the interface passed to k_ghost_io_add_state
+ * @param state_p State struct to fill
+ *
+ * @return 0 on success, -1 if the interface has no state.
+ */
+int k_ghost_io_get_state(const char *interface_name, void *state_p);
+
+/**
+ * @brief Stop publishing the state of an interface. Can be called from any thread, no event of the state is sent once it returns.
+ *
+ * @param interface_name Name of the interface passed to k_ghost_io_add_state.
+ */
+void k_ghost_io_remove_state(const char *interface_name);
+
+/**
+ * @brief Simulate a fleet of identical devices with a single model, its instances stored as a structure of arrays.
+ *
+ * Instance 42 of the farm "anemometer" is addressed as "anemometer/0042" (at least 4 digits): a POST to
+ * /api/simulate/anemometer/0042 sets the fields present in its JSON body and is answered with the whole instance, and
+ * its events are named after it. Every period, tick_cb updates all the instances, then each instance whose fields moved
+ * further than their deadband is published like a state (see k_ghost_io_add_state), all of them after an SSE client
+ * connects. SSE clients subscribed to "anemometer" receive the events of all its instances.
+ *
+ * @param farm_name Name of the farm, prefix of the instance names
+ * @param schema_p Fields of an instance, decoded from the POST bodies with their range. Not copied: it must stay valid until the farm is removed.
+ * @param count Number of instances, all zeroed at the start
+ * @param period_us Time between two ticks, in microseconds
+ * @param tick_cb Model update of all the instances. Runs on the I/O thread, it must not call the farm functions.
+ * @param user_data_p User data passed to tick_cb
+ *
+ * @return Returns registration status code. K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED if the farm exists.
+ */
+k_ghost_io_register_ret_code_t k_ghost_io_add_farm(const char *farm_name, const k_ghost_io_state_schema_t *schema_p, size_t count, uint64_t period_us,
+												   k_ghost_io_farm_tick_t tick_cb, void *user_data_p);
+
+/**
+ * @brief Update an instance of a device farm. Can be called from any thread, the changes are published at the next tick.
+ *
+ * @param farm_name Name of the farm passed to k_ghost_io_add_farm
+ * @param index Index of the instance
+ * @param instance_p Instance struct described by the schema of the farm, copied
+ *
+ * @return 0 on success, -1 if there is no such instance.
+ */
+int k_ghost_io_set_farm_instance(const char *farm_name, size_t index, const void *instance_p);
+
+/**
+ * @brief Read an instance of a device farm as last set.
+ *
+ * @param farm_name Name of the farm passed to k_ghost_io_add_farm
+ * @param index Index of the instance
+ * @param instance_p Instance struct to fill
+ *
+ * @return 0 on success, -1 if there is no such instance.
+ */
+int k_ghost_io_get_farm_instance(const char *farm_name, size_t index, void *instance_p);
+
+/**
+ * @brief Stop simulating a device farm. Can be called from any thread, no tick runs once it returns.
+ *
+ * @param farm_name Name of the farm passed to k_ghost_io_add_farm.
+ */
+void k_ghost_io_remove_farm(const char *farm_name);
+
+/**
+ * @brief Inject faults into the requests and events of an interface, e.g. to tune the timeouts and retries of a client.
+ *
+ * Each request addressed to the interface is reset, answered with an error, or delayed on a timer of the I/O thread
+ * (never blocking it) before being run. Each event about the interface may be dropped or duplicated, independently for
+ * every SSE client. The draws are pseudo-random and repeat from one run to the next for the same seed. The profile can
+ * also be set at runtime with POST /api/faults and the same fields as JSON, plus "interface".
+ * The interface does not need to be registered.
+ *
+ * @param interface_name Name of the interface
+ * @param profile_p Faults to inject, copied. NULL or a profile without any fault removes the profile of the interface.
+ *
+ * @return 0 on success, -1 if a rate is not between 0 and 1.
+ */
+int k_ghost_io_set_faults(const char *interface_name, const k_ghost_io_fault_profile_t *profile_p);
+
+/**
+ * @brief Shape the SSE streams of the clients connecting from now on, e.g. to emulate a constrained field link.
+ *
+ * Each event is held back by the latency and jitter of the link, then by the time the link takes to carry it and the
+ * events before it at the given bandwidth, and is written to the client in one go once it has fully arrived. Events
+ * keep their order. The delays are timers of the I/O thread, so any number of clients can be shaped at once. A client
+ * can pick its own link in the query of its request, e.g. /api/sse?bytes_per_s=2000&latency_us=150000&jitter_us=50000;
+ * the parameters it leaves out are taken from this profile.
+ *
+ * @param link_p Link of the new clients, copied. NULL or a profile of zeros for no shaping.
+ */
+void k_ghost_io_set_sse_link(const k_ghost_io_link_profile_t *link_p);
+
+/**
+ * @brief Start capturing the traffic of the server to a file, replacing its content.
+ *
+ * Every REST request handed to an interface (body and routed interface name) and every event sent to the SSE clients
+ * is appended with the time of the library clock. Entries go through a lock-free buffer written to the file by a
+ * thread of the recorder, so the threads serving the traffic never wait for the disk; entries that do not fit in the
+ * buffer are dropped and counted. Streamed uploads are not captured.
+ *
+ * The file starts with the 8 bytes "KGIOTRC1". Each entry follows, in the byte order of the host: the time in
+ * nanoseconds as uint64_t, the length of the data as uint32_t, the length of the interface name as uint16_t, the kind
+ * of entry as uint8_t (1 for a request to the REST endpoint, 2 for a request routed by its path, 3 for an event) and a
+ * zero byte, then the name and the data.
+ *
+ * @param path Path of the capture
+ *
+ * @return 0 on success, -1 if a capture is already running or the file cannot be created.
+ */
+int k_ghost_io_start_recording(const char *path);
+
+/**
+ * @brief Stop the capture, once all the entries recorded so far are written.
+ *
+ * @return Number of entries dropped because the buffer was full, -1 if no capture is running.
+ */
+int64_t k_ghost_io_stop_recording(void);
+
+/**
+ * @brief Send the requests of a capture to a running server, for reproducible load tests. Blocks until done.
+ *
+ * The requests are sent one at a time, each on its own connection, and their responses are read through. Events of
+ * the capture are skipped, they were the output of the server.
+ *
+ * @param path Path of a capture written by k_ghost_io_start_recording
+ * @param host IPv4 address of the server, e.g. "127.0.0.1"
+ * @param port Port of the server
+ * @param speed Pace of the replay, 1.0 for the recorded timeline, 0 to send the requests as fast as possible
+ *
+ * @return Number of requests answered by the server, -1 if the capture or the address is invalid.
+ */
+int64_t k_ghost_io_replay_recording(const char *path, const char *host, uint16_t port, double speed);
+
+/**
+ * @brief Save the state of the simulation into a buffer, to go back to it later with k_ghost_io_restore.
+ *
+ * The snapshot holds what moves while the simulation runs: the values of the states and device farms and the time
+ * left until their next publication, the phase, random draws and gusts of the generators, and the random draws of the
+ * fault profiles. The setup itself (interfaces, states, farms, generators, profiles) is not saved, a snapshot is
+ * restored into the same setup. Each interface is read under the lock of its store: a snapshot taken while the models
+ * run is consistent per interface, not across interfaces.
+ *
+ * The snapshot starts with the 8 bytes "KGIOSNP1". Each record follows, in the byte order of the host: the length of
+ * the data as uint32_t, the length of the interface name as uint16_t, the kind of record as uint8_t (1 for a state, 2
+ * for a generator, 3 for a fault profile, 4 for a device farm) and a zero byte, then the name and the data.
+ *
+ * @param buffer Where to write the snapshot, NULL to only measure it
+ * @param size Size of the buffer
+ *
+ * @return Size of the snapshot. If larger than size, the snapshot did not fit and the buffer is incomplete.
+ */
+size_t k_ghost_io_snapshot(void *buffer, size_t size);
+
+/**
+ * @brief Bring the simulation back to a snapshot taken by k_ghost_io_snapshot.
+ *
+ * The clock is not moved back: the timers of the states, farms and generators are armed again with the time they had
+ * left, and the generators keep the phase they had. The states and farms are published in full at their next period.
+ *
+ * @param snapshot Snapshot to restore
+ * @param size Size of the snapshot
+ *
+ * @return 0 on success, -1 if the snapshot is malformed or holds a string without its terminator (nothing is restored)
+ * or if some of its records match no current state, farm, generator or profile (the other ones are restored).
+ */
+int k_ghost_io_restore(const void *snapshot, size_t size);
+
+/**
+ * @brief Save the state of the simulation into a file, written through a mapping of the file. See k_ghost_io_snapshot.
+ *
+ * The snapshot is written to a temporary file in the same directory, then renamed over the target: a save that fails
+ * leaves the previous file as it was.
+ *
+ * @param path Path of the file, replaced if it exists
+ *
+ * @return 0 on success, -1 if the file cannot be written.
+ */
+int k_ghost_io_save_snapshot(const char *path);
+
+/**
+ * @brief Bring the simulation back to a snapshot saved by k_ghost_io_save_snapshot, read through a mapping of the file.
+ *
+ * @param path Path of the file
+ *
+ * @return 0 on success, -1 if the file cannot be read or as returned by k_ghost_io_restore.
+ */
+int k_ghost_io_load_snapshot(const char *path);
+
+/**
+ * @brief Defer the response of the request being handled.
+ *
+ * To be called from a REST callback, which then returns K_GHOST_IO_CB_PENDING. The I/O thread goes on serving the other
+ * clients, and the response is sent when k_ghost_io_complete is called with the returned token, from any thread.
+ * Every deferred request must be completed. Commands of a batch cannot be deferred.
+ *
+ * @return Token of the request, 0 if called outside of a REST callback or within a batch.
+ */
+k_ghost_io_token_t k_ghost_io_defer(void);
+
+/**
+ * @brief Send the response of a deferred request and close the connection.
+ *
+ * @param token Token returned by k_ghost_io_defer
+ * @param status HTTP status code of the response (e.g. 200, 500)
+ * @param body Optional. JSON body of the response, NULL for an empty body
+ *
+ * @return 0 on success, -1 if the token is unknown or was already completed.
+ */
+int k_ghost_io_complete(k_ghost_io_token_t token, int status, const char *body);
 #ifdef __cplusplus
 }
 #endif
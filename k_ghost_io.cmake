@@ -2,6 +2,24 @@ cmake_minimum_required(VERSION 3.10)
 
 set(sources
     ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_admission.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_arena.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_clock.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_connection.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_faults.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_farm.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_generator.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_json.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_playback.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_recorder.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_registry.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_response.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_scan.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_shaper.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_snapshot.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_state.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_timer.c
+    ${CMAKE_CURRENT_LIST_DIR}/src/${TARGET_PLATFORM}/k_ghost_io_workers.c
 )
 
 set(public_includes
@@ -14,6 +32,7 @@ set(private_includes
 
 set(public_linked_libs
     k_cjson
+    m
 )
 
 set(private_linked_libs
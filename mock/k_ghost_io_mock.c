@@ -14,7 +14,50 @@
 /* Variable ------------------------------------------------------------------*/
 /* Function Definition -------------------------------------------------------*/
 DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_init)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_set_worker_count, unsigned int)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_set_limits, const k_ghost_io_limits_t *)
+DEFINE_FAKE_VOID_FUNC(k_ghost_io_get_stats, k_ghost_io_stats_t *)
+DEFINE_FAKE_VOID_FUNC(k_ghost_io_set_server_headers, int)
 DEFINE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_register_interface, const char *, k_ghost_io_interface_callback_t, k_ghost_io_sync_status_t,
 					   void *)
+DEFINE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_register_raw_interface, const char *, k_ghost_io_interface_raw_callback_t,
+					   k_ghost_io_sync_status_t, void *)
+DEFINE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_register_response_interface, const char *, k_ghost_io_interface_response_callback_t,
+					   k_ghost_io_sync_status_t, void *)
+DEFINE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_register_typed_interface, const char *, const k_ghost_io_schema_t *,
+					   k_ghost_io_interface_typed_callback_t, k_ghost_io_sync_status_t, void *)
+DEFINE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_register_stream_interface, const char *, k_ghost_io_interface_stream_callback_t,
+					   k_ghost_io_sync_status_t, void *)
 DEFINE_FAKE_VOID_FUNC(k_ghost_io_unregister_interface, const char *)
-DEFINE_FAKE_VOID_FUNC(k_ghost_io_send_event, const char *)
\ No newline at end of file
+DEFINE_FAKE_VOID_FUNC(k_ghost_io_send_event, const char *)
+DEFINE_FAKE_VOID_FUNC(k_ghost_io_send_interface_event, const char *, const char *)
+DEFINE_FAKE_VALUE_FUNC(k_ghost_io_timer_t, k_ghost_io_schedule, uint64_t, uint64_t, k_ghost_io_timer_callback_t, void *)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_cancel, k_ghost_io_timer_t)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_set_time_scale, double)
+DEFINE_FAKE_VOID_FUNC(k_ghost_io_pause_clock)
+DEFINE_FAKE_VOID_FUNC(k_ghost_io_resume_clock)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_step_clock, uint64_t)
+DEFINE_FAKE_VALUE_FUNC(uint64_t, k_ghost_io_get_time_us)
+DEFINE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_add_generator, const char *, const k_ghost_io_channel_t *, size_t, double)
+DEFINE_FAKE_VOID_FUNC(k_ghost_io_remove_generator, const char *)
+DEFINE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_add_playback, const char *, const char *, double, int)
+DEFINE_FAKE_VOID_FUNC(k_ghost_io_remove_playback, const char *)
+DEFINE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_add_state, const char *, const k_ghost_io_state_schema_t *, uint64_t)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_set_state, const char *, const void *)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_get_state, const char *, void *)
+DEFINE_FAKE_VOID_FUNC(k_ghost_io_remove_state, const char *)
+DEFINE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_add_farm, const char *, const k_ghost_io_state_schema_t *, size_t, uint64_t, k_ghost_io_farm_tick_t, void *)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_set_farm_instance, const char *, size_t, const void *)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_get_farm_instance, const char *, size_t, void *)
+DEFINE_FAKE_VOID_FUNC(k_ghost_io_remove_farm, const char *)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_set_faults, const char *, const k_ghost_io_fault_profile_t *)
+DEFINE_FAKE_VOID_FUNC(k_ghost_io_set_sse_link, const k_ghost_io_link_profile_t *)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_start_recording, const char *)
+DEFINE_FAKE_VALUE_FUNC(int64_t, k_ghost_io_stop_recording)
+DEFINE_FAKE_VALUE_FUNC(int64_t, k_ghost_io_replay_recording, const char *, const char *, uint16_t, double)
+DEFINE_FAKE_VALUE_FUNC(size_t, k_ghost_io_snapshot, void *, size_t)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_restore, const void *, size_t)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_save_snapshot, const char *)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_load_snapshot, const char *)
+DEFINE_FAKE_VALUE_FUNC(k_ghost_io_token_t, k_ghost_io_defer)
+DEFINE_FAKE_VALUE_FUNC(int, k_ghost_io_complete, k_ghost_io_token_t, int, const char *)
\ No newline at end of file
@@ -19,10 +19,53 @@ extern "C"
 /* Variable ------------------------------------------------------------------*/
 /* Function Declaration ------------------------------------------------------*/
 DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_init)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_set_worker_count, unsigned int)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_set_limits, const k_ghost_io_limits_t *)
+DECLARE_FAKE_VOID_FUNC(k_ghost_io_get_stats, k_ghost_io_stats_t *)
+DECLARE_FAKE_VOID_FUNC(k_ghost_io_set_server_headers, int)
 DECLARE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_register_interface, const char *, k_ghost_io_interface_callback_t, k_ghost_io_sync_status_t,
 						void *)
+DECLARE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_register_raw_interface, const char *, k_ghost_io_interface_raw_callback_t,
+						k_ghost_io_sync_status_t, void *)
+DECLARE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_register_response_interface, const char *, k_ghost_io_interface_response_callback_t,
+						k_ghost_io_sync_status_t, void *)
+DECLARE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_register_typed_interface, const char *, const k_ghost_io_schema_t *,
+						k_ghost_io_interface_typed_callback_t, k_ghost_io_sync_status_t, void *)
+DECLARE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_register_stream_interface, const char *, k_ghost_io_interface_stream_callback_t,
+						k_ghost_io_sync_status_t, void *)
 DECLARE_FAKE_VOID_FUNC(k_ghost_io_unregister_interface, const char *)
 DECLARE_FAKE_VOID_FUNC(k_ghost_io_send_event, const char *)
+DECLARE_FAKE_VOID_FUNC(k_ghost_io_send_interface_event, const char *, const char *)
+DECLARE_FAKE_VALUE_FUNC(k_ghost_io_timer_t, k_ghost_io_schedule, uint64_t, uint64_t, k_ghost_io_timer_callback_t, void *)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_cancel, k_ghost_io_timer_t)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_set_time_scale, double)
+DECLARE_FAKE_VOID_FUNC(k_ghost_io_pause_clock)
+DECLARE_FAKE_VOID_FUNC(k_ghost_io_resume_clock)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_step_clock, uint64_t)
+DECLARE_FAKE_VALUE_FUNC(uint64_t, k_ghost_io_get_time_us)
+DECLARE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_add_generator, const char *, const k_ghost_io_channel_t *, size_t, double)
+DECLARE_FAKE_VOID_FUNC(k_ghost_io_remove_generator, const char *)
+DECLARE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_add_playback, const char *, const char *, double, int)
+DECLARE_FAKE_VOID_FUNC(k_ghost_io_remove_playback, const char *)
+DECLARE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_add_state, const char *, const k_ghost_io_state_schema_t *, uint64_t)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_set_state, const char *, const void *)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_get_state, const char *, void *)
+DECLARE_FAKE_VOID_FUNC(k_ghost_io_remove_state, const char *)
+DECLARE_FAKE_VALUE_FUNC(k_ghost_io_register_ret_code_t, k_ghost_io_add_farm, const char *, const k_ghost_io_state_schema_t *, size_t, uint64_t, k_ghost_io_farm_tick_t, void *)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_set_farm_instance, const char *, size_t, const void *)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_get_farm_instance, const char *, size_t, void *)
+DECLARE_FAKE_VOID_FUNC(k_ghost_io_remove_farm, const char *)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_set_faults, const char *, const k_ghost_io_fault_profile_t *)
+DECLARE_FAKE_VOID_FUNC(k_ghost_io_set_sse_link, const k_ghost_io_link_profile_t *)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_start_recording, const char *)
+DECLARE_FAKE_VALUE_FUNC(int64_t, k_ghost_io_stop_recording)
+DECLARE_FAKE_VALUE_FUNC(int64_t, k_ghost_io_replay_recording, const char *, const char *, uint16_t, double)
+DECLARE_FAKE_VALUE_FUNC(size_t, k_ghost_io_snapshot, void *, size_t)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_restore, const void *, size_t)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_save_snapshot, const char *)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_load_snapshot, const char *)
+DECLARE_FAKE_VALUE_FUNC(k_ghost_io_token_t, k_ghost_io_defer)
+DECLARE_FAKE_VALUE_FUNC(int, k_ghost_io_complete, k_ghost_io_token_t, int, const char *)
 
 #ifdef __cplusplus
 }
@@ -8,11 +8,15 @@
 #include "k_ghost_io.h"
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "cJSON.h"
@@ -31,24 +35,306 @@
 #define K_GHOST_IO_REST_URI_PATH "/api/simulate"
 #endif
 
+#ifndef K_GHOST_IO_FAULTS_URI_PATH
+#define K_GHOST_IO_FAULTS_URI_PATH "/api/faults"
+#endif
+
 #define K_GHOST_IO_MAX_CLIENTS FD_SETSIZE
 
+#define K_GHOST_IO_STATUS_PENDING 0  //!< Internal status of a request whose response was deferred by the callback
+
+#ifndef K_GHOST_IO_RESPONSE_BUFFER_SIZE
+#define K_GHOST_IO_RESPONSE_BUFFER_SIZE 1024  //!< Initial size of the per-thread response buffer, grown to fit the largest response
+#endif
+
+#ifndef K_GHOST_IO_INTERFACE_TABLE_MIN_CAPACITY
+#define K_GHOST_IO_INTERFACE_TABLE_MIN_CAPACITY 16
+#endif
+
 /* Typedef -------------------------------------------------------------------*/
 /* Function Declaration ------------------------------------------------------*/
-/* Constant ------------------------------------------------------------------*/
-/* HTTP header for SSE events */
-const char *k_ghost_io_sse_header =
-	"HTTP/1.1 200 OK\r\n"
-	"Content-Type: text/event-stream\r\n"
-	"Cache-Control: no-cache\r\n"
-	"Connection: keep-alive\r\n"
-	"\r\n";
+/**
+ * @brief Create a new interface and add it to the list and to the hash index.
+ *
+ * @param interface_name Name of the interface to register
+ * @param template_p Callbacks, schema and user data of the interface, exactly one request callback set
+ *
+ * @return Returns registration status code. Refer to k_ghost_io_register_ret_code_t for possible values.
+ */
+static k_ghost_io_register_ret_code_t k_ghost_io_add_interface(const char *interface_name, const k_ghost_io_interface_t *template_p);
+
+/**
+ * @brief Build a copy of the hash index with one interface added or removed, growing the table when the load factor exceeds 50%.
+ *
+ * The current table is never modified, so readers can keep probing it while the copy is published.
+ *
+ * @param added_p Optional. Interface to be indexed, with name hash already computed
+ * @param removed_p Optional. Interface to be left out of the copy
+ *
+ * @return New table, NULL in case of failure.
+ */
+static k_ghost_io_interface_table_t *k_ghost_io_interface_table_copy(k_ghost_io_interface_t *added_p, const k_ghost_io_interface_t *removed_p);
+
+/**
+ * @brief Insert an entry in a table being built. The table must have a free slot.
+ *
+ * @param table_p Table not yet visible to the readers
+ * @param interface_p Interface to be indexed
+ */
+static void k_ghost_io_interface_table_put(k_ghost_io_interface_table_t *table_p, k_ghost_io_interface_t *interface_p);
+
+/**
+ * @brief Hand a request over to the worker of its interface, or dispatch it right away if there is no worker pool.
+ *
+ * Requests over the admission limits are answered with 503 instead.
+ *
+ * @param client_fd File descriptor of the client that sent the request
+ * @param interface_p Interface the request is addressed to
+ * @param request_body NUL terminated request body
+ * @param json_request Optional. Already parsed request body, only used when the request is not queued
+ *
+ * @return 1 if the connection now belongs to a worker or to a deferred response, 0 if the response was sent.
+ */
+static int k_ghost_io_submit_request(int client_fd, k_ghost_io_interface_t *interface_p, const char *request_body, const cJSON *json_request);
+
+/**
+ * @brief Call the callback of an interface and send back the outcome to the client.
+ *
+ * @param client_fd File descriptor of the client that sent the request
+ * @param interface_p Interface the request is addressed to
+ * @param request_body NUL terminated request body
+ * @param json_request Optional. Already parsed request body
+ *
+ * @return 1 if the callback deferred the response (the connection must be left open), 0 if the response was sent.
+ */
+static int k_ghost_io_dispatch_request(int client_fd, k_ghost_io_interface_t *interface_p, const char *request_body, const cJSON *json_request);
+
+/**
+ * @brief Call the callback of an interface.
+ *
+ * The body is parsed only if the interface has no raw callback and no tree is provided, and printed only if a raw callback has no body.
+ *
+ * @param interface_p Interface the request is addressed to
+ * @param request_body Optional. NUL terminated request body
+ * @param json_request Optional. Already parsed request body
+ * @param response_body_pp Optional. Set to the response body filled by a response callback, NULL if there is none.
+ *                         The body is valid until the next request served by the calling thread.
+ *
+ * @return HTTP status code of the outcome: 200 on success, 400 if the body is not valid JSON, 500 if the callback failed.
+ *         K_GHOST_IO_STATUS_PENDING if the callback deferred the response.
+ */
+static int k_ghost_io_run_callback(const k_ghost_io_interface_t *interface_p, const char *request_body, const cJSON *json_request,
+								   const char **response_body_pp);
+
+/**
+ * @brief Call the response callback of an interface and serialize the response it filled.
+ *
+ * @param interface_p Interface the request is addressed to
+ * @param json_request Parsed request body
+ * @param response_body_pp Optional. Set to the serialized response, NULL if the callback failed without filling it or deferred the response
+ *
+ * @return Return value of the callback, -1 if the response object could not be created.
+ */
+static int k_ghost_io_run_response_callback(const k_ghost_io_interface_t *interface_p, const cJSON *json_request, const char **response_body_pp);
+
+/**
+ * @brief Run the stream callback of an interface up to its last call.
+ *
+ * The body of an upload streamed by the I/O thread was already delivered: only the last call is left. Bodies that fit in
+ * a single read, and batch items, are delivered as a single chunk.
+ *
+ * @param interface_p Interface the request is addressed to
+ * @param request_body NUL terminated request body, NULL for a batch item or a streamed upload
+ * @param json_request Batch item, NULL otherwise
+ *
+ * @return Return value of the last call of the callback
+ */
+static int k_ghost_io_run_stream_callback(const k_ghost_io_interface_t *interface_p, const char *request_body, const cJSON *json_request);
+
+/**
+ * @brief Serialize a response into the response buffer of the calling thread.
+ *
+ * The buffer is reused across requests and grown when a response does not fit, so steady state responses are printed without allocating.
+ *
+ * @param json_response Response to serialize
+ *
+ * @return Unformatted JSON text, NULL in case of failure.
+ */
+static const char *k_ghost_io_print_response(cJSON *json_response);
+
+/**
+ * @brief Send a response with a JSON body, headers and body in a single write.
+ *
+ * @param client_fd File descriptor of the client
+ * @param status HTTP status code, 200 or 500
+ * @param body NUL terminated JSON body
+ */
+static void k_ghost_io_send_json_response(int client_fd, int status, const char *body);
+
+/**
+ * @brief Hand each command of a batch over to the worker of its interface; the last one to complete sends back the per command status array.
+ *
+ * Each item is admitted, faulted and queued like a single request; the response body holds one status per item, in the same order:
+ * 200 on success, 204 if the interface is not registered, 400 if the item is not a valid command, 500 if the callback failed,
+ * 503 if the item was shed.
+ *
+ * @param client_fd File descriptor of the client that sent the request
+ * @param json_request Parsed batch, a JSON array of commands
+ *
+ * @return 1 if the connection now belongs to the batch, 0 if the response was sent.
+ */
+static int k_ghost_io_manage_batch_request(int client_fd, const cJSON *json_request);
+
+/**
+ * @brief Admit an item of a batch and queue it on the worker of its interface, or complete it right away if it cannot be run.
+ *
+ * @param batch_p Batch the item belongs to
+ * @param index Index of the item in the batch
+ * @param item Command of the batch
+ */
+static void k_ghost_io_submit_batch_item(k_ghost_io_batch_t *batch_p, size_t index, const cJSON *item);
+
+/**
+ * @brief Run the callback of a batch item, release its admission and complete it.
+ *
+ * @param job_p Job of the item, not freed
+ */
+static void k_ghost_io_run_batch_item(const k_ghost_io_job_t *job_p);
+
+/**
+ * @brief Record the status of a batch item. The last completion sends the statuses, closes the connection and frees the batch.
+ *
+ * @param batch_p Batch the item belongs to
+ * @param index Index of the item in the batch, items_count for the completion held by the I/O thread while handing the items out
+ * @param status HTTP status of the item
+ */
+static void k_ghost_io_complete_batch_item(k_ghost_io_batch_t *batch_p, size_t index, int status);
+
+/**
+ * @brief Remove a deferred request from the pending list.
+ *
+ * @param token Token of the deferred request
+ *
+ * @return Removed entry, to be freed by the caller. NULL if the token is unknown.
+ */
+static k_ghost_io_pending_request_t *k_ghost_io_take_pending_request(k_ghost_io_token_t token);
+
+/**
+ * @brief Send a response with an optional JSON body.
+ *
+ * @param client_fd File descriptor of the client
+ * @param status HTTP status code
+ * @param body Optional. NUL terminated JSON body
+ */
+static void k_ghost_io_send_response(int client_fd, int status, const char *body);
+
+/**
+ * @brief cJSON allocation hook, serving the allocations from the active arena of the calling thread, if any.
+ *
+ * @param size Number of bytes to allocate
+ *
+ * @return Pointer to the allocated memory, NULL in case of failure.
+ */
+static void *k_ghost_io_cjson_malloc(size_t size);
+
+/**
+ * @brief cJSON free hook, ignoring the pointers that belong to the request arena of the calling thread.
+ *
+ * @param ptr Pointer to free
+ */
+static void k_ghost_io_cjson_free(void *ptr);
+
+/**
+ * @brief Install the cJSON allocation hooks. Called once.
+ */
+static void k_ghost_io_install_cjson_hooks(void);
 
-const char *k_ghost_io_sse_request_header  = "GET " K_GHOST_IO_SSE_URI_PATH " HTTP/1.1\r\n";
-const char *k_ghost_io_rest_request_header = "POST " K_GHOST_IO_REST_URI_PATH " HTTP/1.1\r\n";
+/**
+ * @brief Print a JSON tree into the request arena of the calling thread.
+ *
+ * @param json_request Tree to print
+ *
+ * @return Unformatted JSON text, NULL in case of failure.
+ */
+static char *k_ghost_io_print_request(const cJSON *json_request);
+
+/**
+ * @brief Parse a request body into the request arena of the calling thread.
+ *
+ * The tree must not be deleted: it is released with the request arena when the request is completed.
+ *
+ * @param json_text NUL terminated JSON text
+ *
+ * @return Parsed tree, NULL if the text is not valid JSON.
+ */
+static cJSON *k_ghost_io_parse_request(const char *json_text);
+
+/**
+ * @brief Send an event to the SSE clients.
+ *
+ * @param interface_name Interface the event is about, sent as the event name. NULL for an unnamed event sent to every client
+ * @param data Event data
+ */
+static void k_ghost_io_broadcast_event(const char *interface_name, const char *data);
+
+/**
+ * @brief Extract the interfaces an SSE client subscribes to from the query of its request.
+ *
+ * @param query Query string, after the '?' and up to the end of the request target. NULL if there is none
+ *
+ * @return Comma separated interface names, to be freed by the caller. NULL to subscribe to every interface.
+ */
+static char *k_ghost_io_parse_sse_filter(const char *query);
+
+/**
+ * @brief Check if an SSE client subscribed to an interface.
+ *
+ * @param client_p SSE client
+ * @param interface_name Interface name, not necessarily NUL terminated
+ * @param name_len Length of the interface name
+ *
+ * @return 1 if the events of the interface must be sent to the client, 0 otherwise.
+ */
+static int k_ghost_io_sse_client_wants(const k_ghost_io_sse_client_entry_t *client_p, const char *interface_name, size_t name_len);
+
+/**
+ * @brief Open the pipe used by k_ghost_io_wake. Called by the I/O thread before its first select.
+ */
+static void k_ghost_io_open_wake_pipe(void);
+
+/* Constant ------------------------------------------------------------------*/
+const char *k_ghost_io_sse_request_prefix	 = "GET " K_GHOST_IO_SSE_URI_PATH;
+const char *k_ghost_io_rest_request_header	 = "POST " K_GHOST_IO_REST_URI_PATH " HTTP/1.1\r\n";
+const char *k_ghost_io_rest_route_prefix	 = "POST " K_GHOST_IO_REST_URI_PATH "/";
+const char *k_ghost_io_faults_request_header = "POST " K_GHOST_IO_FAULTS_URI_PATH " HTTP/1.1\r\n";
 
 /* Variable ------------------------------------------------------------------*/
-k_ghost_io_ctx_t k_ghost_io_ctx = {0};
+/* Zeroed storage is not a valid mutex under POSIX, every lock of the context is initialized explicitly */
+k_ghost_io_ctx_t k_ghost_io_ctx = {
+	.registry_lock	= PTHREAD_MUTEX_INITIALIZER,
+	.pending_lock	= PTHREAD_MUTEX_INITIALIZER,
+	.sse_lock		= PTHREAD_MUTEX_INITIALIZER,
+	.generator_lock = PTHREAD_MUTEX_INITIALIZER,
+	.timers			= {.lock = PTHREAD_MUTEX_INITIALIZER, .callback_lock = PTHREAD_MUTEX_INITIALIZER},
+	.clock			= {.lock = PTHREAD_MUTEX_INITIALIZER},
+	.playback_lock	= PTHREAD_MUTEX_INITIALIZER,
+	.recorder		= {.lock = PTHREAD_MUTEX_INITIALIZER},
+	.state_lock		= PTHREAD_MUTEX_INITIALIZER,
+	.farm_lock		= PTHREAD_MUTEX_INITIALIZER,
+	.fault_lock		= PTHREAD_MUTEX_INITIALIZER,
+};
+
+static pthread_once_t						 k_ghost_io_hooks_once = PTHREAD_ONCE_INIT;	 //!< Guard for the one-time cJSON hooks installation
+static _Thread_local k_ghost_io_arena_t		 k_ghost_io_request_arena;					 //!< Backing memory of the request being processed by this thread
+static _Thread_local k_ghost_io_arena_t		 k_ghost_io_scratch_arena;					 //!< Scratch memory for the events and responses sent by this thread
+static _Thread_local int					 k_ghost_io_dispatch_fd = -1;				 //!< Client whose request is being dispatched by this thread, -1 if none
+static _Thread_local k_ghost_io_token_t		 k_ghost_io_deferred_token;					 //!< Token handed out by k_ghost_io_defer during the current dispatch
+static _Thread_local int					 k_ghost_io_deferred_completed;				 //!< Set when the callback completed its own token before returning
+static _Thread_local k_ghost_io_interface_t *k_ghost_io_dispatch_interface_p;			 //!< Interface of the request being dispatched by this thread, NULL if none
+static _Thread_local char					*k_ghost_io_response_buffer;				 //!< Buffer responses are serialized into, reused across requests
+static _Thread_local size_t					 k_ghost_io_response_buffer_size;			 //!< Size of the response buffer
+static _Thread_local k_ghost_io_arena_t		*k_ghost_io_active_arena;					 //!< Arena cJSON allocations are served from, NULL to use the heap
+static _Thread_local k_ghost_io_stream_t	*k_ghost_io_finishing_stream_p;				 //!< Upload whose body was already streamed to the callback, NULL if none
 
 /* Function Definition -------------------------------------------------------*/
 int k_ghost_io_init(void)
@@ -66,12 +352,17 @@ int k_ghost_io_init(void)
 			server_addr.sin_port		= htons(K_GHOST_IO_SERVER_PORT);
 			if (0 == setsockopt(k_ghost_io_ctx.socket_fd, SOL_SOCKET, SO_REUSEADDR, &socket_opt, sizeof(socket_opt)) &&
 				0 == bind(k_ghost_io_ctx.socket_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) && 0 == listen(k_ghost_io_ctx.socket_fd, 2) &&
-				0 == pthread_create(&k_ghost_io_ctx.system_thread, NULL, k_ghost_io_thread_func, &k_ghost_io_ctx))
+				0 == k_ghost_io_start_workers() && 0 == pthread_create(&k_ghost_io_ctx.system_thread, NULL, k_ghost_io_thread_func, &k_ghost_io_ctx))
 			{
 				ret_code = 0;
 			}
 			else
 			{
+				/* The workers may already run when the I/O thread fails to start */
+				if (k_ghost_io_ctx.workers)
+				{
+					k_ghost_io_stop_workers(k_ghost_io_ctx.worker_count);
+				}
 				close(k_ghost_io_ctx.socket_fd);
 				k_ghost_io_ctx.socket_fd = 0;
 			}
@@ -90,100 +381,239 @@ int k_ghost_io_init(void)
 	return ret_code;
 }
 
+int k_ghost_io_set_worker_count(const unsigned int worker_count)
+{
+	int ret_code = -1;
+	if (0 == k_ghost_io_ctx.socket_fd && worker_count <= K_GHOST_IO_MAX_WORKERS)
+	{
+		k_ghost_io_ctx.worker_count = worker_count;
+		ret_code					= 0;
+	}
+	return ret_code;
+}
+
 k_ghost_io_register_ret_code_t k_ghost_io_register_interface(const char *interface_name, k_ghost_io_interface_callback_t rest_cb,
 															 k_ghost_io_sync_status_t sync_cb, void *user_data_p)
 {
 	k_ghost_io_register_ret_code_t ret_code = K_GHOST_REGISTER_RET_CODE_ERROR;
-	if (interface_name && rest_cb)
+	if (rest_cb)
 	{
-		k_ghost_io_interface_t *interface_p = k_ghost_io_ctx.interfaces;
-		while (interface_p)
-		{
-			if (0 == strcmp(interface_p->interface_name, interface_name))
-			{
-				ret_code = K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED;
-				break;
-			}
-			interface_p = (k_ghost_io_interface_t *)interface_p->next_cb;
-		}
-		if (K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED != ret_code)
-		{
-			k_ghost_io_interface_t *new_interface = malloc(sizeof(k_ghost_io_interface_t));
-			if (new_interface)
-			{
-				new_interface->interface_name = strdup(interface_name);
-				new_interface->rest_cb		  = rest_cb;
-				new_interface->sync_cb		  = sync_cb;
-				new_interface->user_data_p	  = user_data_p;
-				new_interface->next_cb		  = k_ghost_io_ctx.interfaces;
-				k_ghost_io_ctx.interfaces	  = new_interface;
-				ret_code					  = K_GHOST_REGISTER_RET_CODE_OK;
-			}
-		}
+		const k_ghost_io_interface_t template = {.rest_cb = rest_cb, .sync_cb = sync_cb, .user_data_p = user_data_p};
+		ret_code							  = k_ghost_io_add_interface(interface_name, &template);
+	}
+	return ret_code;
+}
+
+k_ghost_io_register_ret_code_t k_ghost_io_register_raw_interface(const char *interface_name, k_ghost_io_interface_raw_callback_t raw_cb,
+																 k_ghost_io_sync_status_t sync_cb, void *user_data_p)
+{
+	k_ghost_io_register_ret_code_t ret_code = K_GHOST_REGISTER_RET_CODE_ERROR;
+	if (raw_cb)
+	{
+		const k_ghost_io_interface_t template = {.raw_cb = raw_cb, .sync_cb = sync_cb, .user_data_p = user_data_p};
+		ret_code							  = k_ghost_io_add_interface(interface_name, &template);
+	}
+	return ret_code;
+}
+
+k_ghost_io_register_ret_code_t k_ghost_io_register_response_interface(const char *interface_name, k_ghost_io_interface_response_callback_t response_cb,
+																	  k_ghost_io_sync_status_t sync_cb, void *user_data_p)
+{
+	k_ghost_io_register_ret_code_t ret_code = K_GHOST_REGISTER_RET_CODE_ERROR;
+	if (response_cb)
+	{
+		const k_ghost_io_interface_t template = {.response_cb = response_cb, .sync_cb = sync_cb, .user_data_p = user_data_p};
+		ret_code							  = k_ghost_io_add_interface(interface_name, &template);
+	}
+	return ret_code;
+}
+
+k_ghost_io_register_ret_code_t k_ghost_io_register_typed_interface(const char *interface_name, const k_ghost_io_schema_t *schema_p,
+																   k_ghost_io_interface_typed_callback_t typed_cb, k_ghost_io_sync_status_t sync_cb,
+																   void *user_data_p)
+{
+	k_ghost_io_register_ret_code_t ret_code = K_GHOST_REGISTER_RET_CODE_ERROR;
+	if (typed_cb && 0 == k_ghost_io_check_schema(schema_p))
+	{
+		const k_ghost_io_interface_t template = {.typed_cb = typed_cb, .schema_p = schema_p, .sync_cb = sync_cb, .user_data_p = user_data_p};
+		ret_code							  = k_ghost_io_add_interface(interface_name, &template);
+	}
+	return ret_code;
+}
+
+k_ghost_io_register_ret_code_t k_ghost_io_register_stream_interface(const char *interface_name, k_ghost_io_interface_stream_callback_t stream_cb,
+																	k_ghost_io_sync_status_t sync_cb, void *user_data_p)
+{
+	k_ghost_io_register_ret_code_t ret_code = K_GHOST_REGISTER_RET_CODE_ERROR;
+	if (stream_cb)
+	{
+		const k_ghost_io_interface_t template = {.stream_cb = stream_cb, .sync_cb = sync_cb, .user_data_p = user_data_p};
+		ret_code							  = k_ghost_io_add_interface(interface_name, &template);
 	}
 	return ret_code;
 }
 
 void k_ghost_io_unregister_interface(const char *interface_name)
 {
-	k_ghost_io_interface_t *previous_interface_p = NULL;
-	k_ghost_io_interface_t *current_interface_p	 = k_ghost_io_ctx.interfaces;
-	while (current_interface_p)
+	pthread_mutex_lock(&k_ghost_io_ctx.registry_lock);
+	k_ghost_io_interface_t		 *interface_p = interface_name ? k_ghost_io_find_interface(interface_name, strlen(interface_name)) : NULL;
+	k_ghost_io_interface_entry_t *entry_p	  = (k_ghost_io_interface_entry_t *)interface_p;
+	k_ghost_io_interface_table_t *table_p	  = NULL;
+	if (interface_p && 0 == k_ghost_io_registry_reserve(3) && (table_p = k_ghost_io_interface_table_copy(NULL, interface_p)))
 	{
-		if (0 == strcmp(current_interface_p->interface_name, interface_name))
+		k_ghost_io_interface_table_t *old_table_p = k_ghost_io_ctx.interface_table;
+		__atomic_store_n(&k_ghost_io_ctx.interface_table, table_p, __ATOMIC_RELEASE);
+
+		/* The removed interface keeps its next pointer: a reader standing on it can still walk the rest of the list */
+		if (entry_p->prev_cb)
 		{
-			if (previous_interface_p)
-			{
-				previous_interface_p->next_cb = current_interface_p->next_cb;
-			}
-			else
-			{
-				/* We need to remove the head of the list */
-				k_ghost_io_ctx.interfaces = current_interface_p->next_cb;
-			}
-			free(current_interface_p->interface_name);
-			free(current_interface_p);
-			break;
+			__atomic_store_n(&((k_ghost_io_interface_t *)entry_p->prev_cb)->next_cb, interface_p->next_cb, __ATOMIC_RELEASE);
+		}
+		else
+		{
+			/* We need to remove the head of the list */
+			__atomic_store_n(&k_ghost_io_ctx.interfaces, (k_ghost_io_interface_t *)interface_p->next_cb, __ATOMIC_RELEASE);
+		}
+		if (interface_p->next_cb)
+		{
+			((k_ghost_io_interface_entry_t *)interface_p->next_cb)->prev_cb = entry_p->prev_cb;
+		}
+		k_ghost_io_registry_retire(old_table_p);
+		/* Requests admitted for the interface keep it: the last of them to be answered retires it instead */
+		if (0 == __atomic_fetch_or(&entry_p->pending_count, K_GHOST_IO_INTERFACE_REMOVED, __ATOMIC_ACQ_REL))
+		{
+			k_ghost_io_registry_retire(interface_p->interface_name);
+			k_ghost_io_registry_retire(interface_p);
 		}
-		previous_interface_p = current_interface_p;
-		current_interface_p	 = (k_ghost_io_interface_t *)current_interface_p->next_cb;
 	}
+	k_ghost_io_registry_reclaim();
+	pthread_mutex_unlock(&k_ghost_io_ctx.registry_lock);
 }
 
 void k_ghost_io_send_event(const char *data)
+{
+	k_ghost_io_broadcast_event(NULL, data);
+}
+
+void k_ghost_io_send_interface_event(const char *interface_name, const char *data)
+{
+	if (interface_name)
+	{
+		k_ghost_io_broadcast_event(interface_name, data);
+	}
+}
+
+static void k_ghost_io_broadcast_event(const char *interface_name, const char *data)
 {
 	if (data)
 	{
-		k_ghost_io_sse_clients_list_t *current			= k_ghost_io_ctx.sse_clients;
-		const char					  *sse_event_header = "data: ";
-		const size_t				   needed_space		= strlen(sse_event_header) + strlen(data) + 5;	// +3 for \r\n\r\n\0
-		char						  *sse_data			= malloc(needed_space);
+		const size_t name_len	  = interface_name ? strlen(interface_name) : 0;
+		const size_t data_len	  = strlen(data);
+		const size_t needed_space = strlen("event: \r\ndata: \r\n\r\n") + name_len + data_len + 1;
+		k_ghost_io_record(K_GHOST_IO_TRACE_EVENT, interface_name, name_len, data, data_len);
+		char		*sse_data	  = k_ghost_io_arena_alloc(&k_ghost_io_scratch_arena, needed_space);
 		if (sse_data)
 		{
-			snprintf(sse_data, needed_space, "%s%s\r\n\r\n", sse_event_header, data);
+			const int sse_data_len = interface_name ? snprintf(sse_data, needed_space, "event: %s\r\ndata: %s\r\n\r\n", interface_name, data)
+													: snprintf(sse_data, needed_space, "data: %s\r\n\r\n", data);
+			pthread_mutex_lock(&k_ghost_io_ctx.sse_lock);
+			k_ghost_io_sse_client_entry_t *current = (k_ghost_io_sse_client_entry_t *)k_ghost_io_ctx.sse_clients;
 			while (current)
 			{
-				if (current->sse_client_fd > 0)
+				/* Unnamed events go to every client, named ones only to the clients subscribed to the interface */
+				if (current->client.sse_client_fd > 0 && (!interface_name || k_ghost_io_sse_client_wants(current, interface_name, name_len)))
 				{
-					send(current->sse_client_fd, sse_data, strlen(sse_data), 0);
+					/* Once per client, unless the fault profile of the interface drops or duplicates the event */
+					for (int copies = interface_name ? k_ghost_io_draw_event_copies(interface_name, name_len) : 1; copies > 0; copies--)
+					{
+						if (current->shaper)
+						{
+							k_ghost_io_shape_event(current, sse_data, (size_t)sse_data_len);
+						}
+						else
+						{
+							k_ghost_io_sse_write(current, sse_data, (size_t)sse_data_len);
+						}
+					}
 				}
-				current = current->next_client;
+				current = current->client.next_client;
 			}
-			free(sse_data);
+			pthread_mutex_unlock(&k_ghost_io_ctx.sse_lock);
+			k_ghost_io_arena_reset(&k_ghost_io_scratch_arena);
+		}
+	}
+}
+
+k_ghost_io_token_t k_ghost_io_defer(void)
+{
+	k_ghost_io_token_t token = k_ghost_io_deferred_token;
+	if (!token && k_ghost_io_dispatch_fd > 0 && k_ghost_io_dispatch_interface_p)
+	{
+		k_ghost_io_pending_request_t *pending_p = malloc(sizeof(k_ghost_io_pending_request_t));
+		if (pending_p)
+		{
+			/* The admission keeps the interface until the completion gives it back, even if it is unregistered in between */
+			pending_p->interface_p = k_ghost_io_dispatch_interface_p;
+			pthread_mutex_lock(&k_ghost_io_ctx.pending_lock);
+			do
+			{
+				token = ++k_ghost_io_ctx.last_token;
+			} while (0 == token);
+			pending_p->token				= token;
+			pending_p->client_fd			= k_ghost_io_dispatch_fd;
+			pending_p->next_request			= k_ghost_io_ctx.pending_requests;
+			k_ghost_io_ctx.pending_requests = pending_p;
+			pthread_mutex_unlock(&k_ghost_io_ctx.pending_lock);
+			k_ghost_io_deferred_token = token;
 		}
 	}
+	return token;
+}
+
+int k_ghost_io_complete(const k_ghost_io_token_t token, const int status, const char *body)
+{
+	int							  ret_code	= -1;
+	k_ghost_io_pending_request_t *pending_p = k_ghost_io_take_pending_request(token);
+	if (pending_p)
+	{
+		/* Completed from within the callback that deferred it: the dispatch must not answer the connection a second time */
+		k_ghost_io_deferred_completed = token == k_ghost_io_deferred_token ? 1 : k_ghost_io_deferred_completed;
+		k_ghost_io_send_response(pending_p->client_fd, status, body);
+		close(pending_p->client_fd);
+		k_ghost_io_release_request(pending_p->interface_p);
+		free(pending_p);
+		ret_code = 0;
+	}
+	return ret_code;
 }
 
 void *k_ghost_io_thread_func(void *arg)
 {
-	k_ghost_io_ctx_t *ctx_p								 = (k_ghost_io_ctx_t *)arg;
-	int				  client_fds[K_GHOST_IO_MAX_CLIENTS] = {0};
+	k_ghost_io_ctx_t		*ctx_p								  = (k_ghost_io_ctx_t *)arg;
+	int						 client_fds[K_GHOST_IO_MAX_CLIENTS]	  = {0};
+	k_ghost_io_connection_t *connections[K_GHOST_IO_MAX_CLIENTS] = {0};	 // State of the requests that did not fit in a single read
+	k_ghost_io_open_wake_pipe();
 	while (1)
 	{
+		/* Timers due are run first, the events they queue for slow clients are watched below */
+		const int64_t  wait_ns = k_ghost_io_clock_wait(k_ghost_io_run_timers(k_ghost_io_now_ns()));
+		struct timeval timeout = {.tv_sec = (time_t)(wait_ns / 1000000000), .tv_usec = (suseconds_t)((wait_ns % 1000000000 + 999) / 1000)};
+
 		/* Register socket FD into the readfds list */
+		fd_set writefds;
 		FD_ZERO(&ctx_p->readfds);
+		FD_ZERO(&writefds);
 		FD_SET(ctx_p->socket_fd, &ctx_p->readfds);
 		int max_fd = ctx_p->socket_fd;
+		if (ctx_p->wake_fds[0] > 0)
+		{
+			FD_SET(ctx_p->wake_fds[0], &ctx_p->readfds);
+			max_fd = ctx_p->wake_fds[0] > max_fd ? ctx_p->wake_fds[0] : max_fd;
+		}
+
+		/* SSE clients that are not keeping up: wait for their socket to take the rest of the data */
+		const int max_sse_fd = k_ghost_io_watch_sse_clients(&writefds);
+		max_fd				 = max_sse_fd > max_fd ? max_sse_fd : max_fd;
 
 		/* Check clients we need to insert in the set. This is useful once we get at least one connection to reinsert it in the set */
 		for (int i = 0; i < K_GHOST_IO_MAX_CLIENTS; i++)
@@ -199,8 +629,17 @@ void *k_ghost_io_thread_func(void *arg)
 		}
 
 		/* Wait for new connection and/or new content from clients */
-		if (select(max_fd + 1, &ctx_p->readfds, NULL, NULL, NULL) > 0)
+		if (select(max_fd + 1, &ctx_p->readfds, &writefds, NULL, wait_ns < 0 ? NULL : &timeout) > 0)
 		{
+			if (ctx_p->wake_fds[0] > 0 && FD_ISSET(ctx_p->wake_fds[0], &ctx_p->readfds))
+			{
+				char wake_buffer[64];
+				while (read(ctx_p->wake_fds[0], wake_buffer, sizeof(wake_buffer)) > 0)
+				{
+				}
+			}
+			k_ghost_io_flush_sse_clients(&writefds);
+
 			/* New connection */
 			if (FD_ISSET(ctx_p->socket_fd, &ctx_p->readfds))
 			{
@@ -224,25 +663,14 @@ void *k_ghost_io_thread_func(void *arg)
 					if (bytes <= 0)
 					{
 						/* Client closed the connection */
+						k_ghost_io_abort_connection(&connections[i]);
 						close(unblocked_fd);
 						k_ghost_io_remove_sse_client(unblocked_fd);
 						client_fds[i] = 0;
 					}
-					else if (strncmp(buffer, k_ghost_io_sse_request_header, strlen(k_ghost_io_sse_request_header)) == 0)
-					{
-						/* Client opened a connection towards the SSE endpoint. We need to keep the connection open */
-						k_ghost_io_add_sse_client(unblocked_fd);
-					}
-					else if (strncmp(buffer, k_ghost_io_rest_request_header, strlen(k_ghost_io_rest_request_header)) == 0)
-					{
-						/* Client opened a connection towards the REST endpoint. We need to answer back and close the connection */
-						k_ghost_io_manage_rest_request(unblocked_fd, buffer);
-						client_fds[i] = 0;
-					}
-					else
+					else if (k_ghost_io_feed_connection(&connections[i], unblocked_fd, buffer, (size_t)bytes))
 					{
-						/* Unknown request, we can close the connection after sending a 404 responses */
-						k_ghost_io_manage_unknown_endpoint(unblocked_fd);
+						/* Request answered, the connection was closed or now belongs to a worker or to a deferred response */
 						client_fds[i] = 0;
 					}
 				}
@@ -252,27 +680,105 @@ void *k_ghost_io_thread_func(void *arg)
 	return NULL;
 }
 
-int k_ghost_io_add_sse_client(const int sse_client_fd)
+int k_ghost_io_manage_request(const int client_fd, const char *request, const size_t header_len)
+{
+	int released = 1;
+	if (strncmp(request, k_ghost_io_sse_request_prefix, strlen(k_ghost_io_sse_request_prefix)) == 0 &&
+		(' ' == request[strlen(k_ghost_io_sse_request_prefix)] || '?' == request[strlen(k_ghost_io_sse_request_prefix)]))
+	{
+		/* Client opened a connection towards the SSE endpoint. We need to keep the connection open */
+		const char *query = request + strlen(k_ghost_io_sse_request_prefix);
+		if (0 == k_ghost_io_add_sse_client(client_fd, '?' == *query ? query + 1 : NULL))
+		{
+			released = 0;
+		}
+		else
+		{
+			close(client_fd);
+		}
+	}
+	else if (strncmp(request, k_ghost_io_rest_request_header, strlen(k_ghost_io_rest_request_header)) == 0)
+	{
+		/* Client opened a connection towards the REST endpoint. We need to answer back and close the connection */
+		k_ghost_io_manage_rest_request(client_fd, request, header_len);
+	}
+	else if (strncmp(request, k_ghost_io_rest_route_prefix, strlen(k_ghost_io_rest_route_prefix)) == 0)
+	{
+		/* Client addressed an interface through the URI path. Same lifecycle as the REST endpoint */
+		k_ghost_io_manage_rest_route_request(client_fd, request, header_len);
+	}
+	else if (strncmp(request, k_ghost_io_faults_request_header, strlen(k_ghost_io_faults_request_header)) == 0)
+	{
+		/* Fault profile set at runtime. Same lifecycle as the REST endpoint */
+		k_ghost_io_manage_faults_request(client_fd, request, header_len);
+	}
+	else
+	{
+		/* Unknown request, we can close the connection after sending a 404 responses */
+		k_ghost_io_manage_unknown_endpoint(client_fd);
+	}
+	return released;
+}
+
+k_ghost_io_interface_t *k_ghost_io_find_stream_interface(const char *request)
+{
+	k_ghost_io_interface_t *interface_p = NULL;
+	if (0 == strncmp(request, k_ghost_io_rest_route_prefix, strlen(k_ghost_io_rest_route_prefix)))
+	{
+		const char	*interface	   = request + strlen(k_ghost_io_rest_route_prefix);
+		const size_t interface_len = strcspn(interface, " ?\r\n");
+		interface_p				   = k_ghost_io_find_interface(interface, interface_len);
+		interface_p				   = interface_p && interface_p->stream_cb ? interface_p : NULL;
+	}
+	return interface_p;
+}
+
+int k_ghost_io_finish_stream(const int client_fd, k_ghost_io_interface_t *interface_p, k_ghost_io_stream_t *stream_p)
+{
+	k_ghost_io_finishing_stream_p = stream_p;
+	const int response_pending	  = k_ghost_io_dispatch_request(client_fd, interface_p, NULL, NULL);
+	k_ghost_io_finishing_stream_p = NULL;
+	return response_pending;
+}
+
+int k_ghost_io_add_sse_client(const int sse_client_fd, const char *query)
 {
 	int ret_code = -1;
-	if (sse_client_fd > 0)
+	if (sse_client_fd > 0 && 0 != k_ghost_io_admit_sse_client())
+	{
+		k_ghost_io_shed_request(sse_client_fd);
+	}
+	else if (sse_client_fd > 0)
 	{
-		k_ghost_io_sse_clients_list_t *new_client = malloc(sizeof(k_ghost_io_sse_clients_list_t));
+		k_ghost_io_sse_client_entry_t *entry_p	  = calloc(1, sizeof(k_ghost_io_sse_client_entry_t));
+		k_ghost_io_sse_clients_list_t *new_client = entry_p ? &entry_p->client : NULL;
 		if (new_client)
 		{
-			new_client->sse_client_fd  = sse_client_fd;
+			new_client->sse_client_fd = sse_client_fd;
+			entry_p->interfaces		  = k_ghost_io_parse_sse_filter(query);
+			entry_p->shaper			  = k_ghost_io_new_shaper(sse_client_fd, query);
+			k_ghost_io_send_static_response(sse_client_fd, K_GHOST_IO_RESPONSE_SSE_STREAM, 0);
+			pthread_mutex_lock(&k_ghost_io_ctx.sse_lock);
 			new_client->next_client	   = k_ghost_io_ctx.sse_clients;
 			k_ghost_io_ctx.sse_clients = new_client;
-			send(sse_client_fd, k_ghost_io_sse_header, strlen(k_ghost_io_sse_header), 0);
-			k_ghost_io_interface_t *interface_p = k_ghost_io_ctx.interfaces;
+			pthread_mutex_unlock(&k_ghost_io_ctx.sse_lock);
+			k_ghost_io_registry_read_begin();
+			k_ghost_io_interface_t *interface_p = __atomic_load_n(&k_ghost_io_ctx.interfaces, __ATOMIC_ACQUIRE);
 			while (interface_p)
 			{
-				if (interface_p->sync_cb)
+				/* Only the interfaces the client subscribed to: the others would be noise on a multiplexed stream */
+				const size_t name_len = ((k_ghost_io_interface_entry_t *)interface_p)->name_len;
+				if (interface_p->sync_cb && k_ghost_io_sse_client_wants(entry_p, interface_p->interface_name, name_len) &&
+					0 != k_ghost_io_submit_job(interface_p, -1, NULL))
 				{
 					interface_p->sync_cb();	 // Call the sync callback to send current interface status
 				}
-				interface_p = (k_ghost_io_interface_t *)interface_p->next_cb;
+				interface_p = __atomic_load_n((k_ghost_io_interface_t **)&interface_p->next_cb, __ATOMIC_ACQUIRE);
 			}
+			k_ghost_io_registry_read_end();
+			/* The states published by the library are sent whole as well, the client missed their earlier changes */
+			k_ghost_io_force_states();
+			k_ghost_io_force_farms();
 			ret_code = 0;
 		}
 	}
@@ -283,6 +789,7 @@ void k_ghost_io_remove_sse_client(const int sse_client_fd)
 {
 	if (sse_client_fd > 0)
 	{
+		pthread_mutex_lock(&k_ghost_io_ctx.sse_lock);
 		k_ghost_io_sse_clients_list_t *current = k_ghost_io_ctx.sse_clients;
 		k_ghost_io_sse_clients_list_t *prev	   = NULL;
 
@@ -300,94 +807,1004 @@ void k_ghost_io_remove_sse_client(const int sse_client_fd)
 					/* This was the first entry of the list */
 					k_ghost_io_ctx.sse_clients = current->next_client;
 				}
-				free(current);
+				const k_ghost_io_sse_client_entry_t *entry_p = (k_ghost_io_sse_client_entry_t *)current;
+				k_ghost_io_release_sse_bytes(entry_p->queued_len - entry_p->queued_offset);
+				if (entry_p->shaper)
+				{
+					k_ghost_io_stop_shaper(entry_p->shaper);
+				}
 				break;
 			}
 			prev	= current;
 			current = current->next_client;
 		}
+		pthread_mutex_unlock(&k_ghost_io_ctx.sse_lock);
+		if (current)
+		{
+			/* Freed out of the lock: a delivery of the shaper may be waiting for it, and is waited for */
+			k_ghost_io_sse_client_entry_t *entry_p = (k_ghost_io_sse_client_entry_t *)current;
+			if (entry_p->shaper)
+			{
+				k_ghost_io_free_shaper(entry_p->shaper);
+			}
+			free(entry_p->queued_data);
+			free(entry_p->interfaces);
+			free(entry_p);
+		}
 	}
 }
 
-void k_ghost_io_add_connection(int *client_a, const int new_connection_fd)
+int k_ghost_io_watch_sse_clients(fd_set *writefds)
 {
-	for (int i = 0; i < K_GHOST_IO_MAX_CLIENTS; i++)
+	int max_fd = -1;
+	pthread_mutex_lock(&k_ghost_io_ctx.sse_lock);
+	for (k_ghost_io_sse_client_entry_t *current = (k_ghost_io_sse_client_entry_t *)k_ghost_io_ctx.sse_clients; current; current = current->client.next_client)
 	{
-		if (client_a[i] == 0)
+		if (current->queued_data)
 		{
-			client_a[i] = new_connection_fd;
-			break;
+			FD_SET(current->client.sse_client_fd, writefds);
+			max_fd = current->client.sse_client_fd > max_fd ? current->client.sse_client_fd : max_fd;
 		}
 	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.sse_lock);
+	return max_fd;
 }
 
-void k_ghost_io_manage_rest_request(int client_fd, const char *request)
+void k_ghost_io_flush_sse_clients(const fd_set *writefds)
 {
-	if (request)
+	pthread_mutex_lock(&k_ghost_io_ctx.sse_lock);
+	for (k_ghost_io_sse_client_entry_t *current = (k_ghost_io_sse_client_entry_t *)k_ghost_io_ctx.sse_clients; current; current = current->client.next_client)
 	{
-		char  *request_body	   = strstr(request, "\r\n\r\n");
-		cJSON *json_request	   = NULL;
-		int	   interface_found = 0;
-		if (request_body)
+		if (current->queued_data && FD_ISSET(current->client.sse_client_fd, writefds))
 		{
-			json_request = cJSON_Parse(request_body + 4);  // Skip the "\r\n\r\n"
-			if (json_request)
+			const ssize_t sent = send(current->client.sse_client_fd, current->queued_data + current->queued_offset,
+									  current->queued_len - current->queued_offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (sent > 0)
 			{
-				char *interface = cJSON_GetStringValue(cJSON_GetObjectItem(json_request, "interface"));
-				if (interface)
-				{
-					k_ghost_io_interface_t *interface_p = k_ghost_io_ctx.interfaces;
-					while (interface_p)
-					{
-						if (0 == strcmp(interface_p->interface_name, interface))
-						{
-							interface_found = 1;
-							int ret_code	= interface_p->rest_cb(json_request, interface_p->user_data_p);
-							if (0 == ret_code)
-							{
-								const char *resp = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
-								send(client_fd, resp, strlen(resp), 0);
-							}
-							else
-							{
-								const char *resp = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
-								send(client_fd, resp, strlen(resp), 0);
-							}
-							break;
-						}
-						interface_p = (k_ghost_io_interface_t *)interface_p->next_cb;
-					}
-				}
-				cJSON_Delete(json_request);
-				if (!interface_found)
-				{
-					const char *resp = "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n";
-					send(client_fd, resp, strlen(resp), 0);
-				}
+				current->queued_offset += (size_t)sent;
+				k_ghost_io_release_sse_bytes((size_t)sent);
 			}
-			else
+			if (current->queued_offset == current->queued_len)
 			{
-				const char *resp = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
-				send(client_fd, resp, strlen(resp), 0);
+				/* Caught up: the next events go straight to the socket again */
+				free(current->queued_data);
+				current->queued_data   = NULL;
+				current->queued_len	   = 0;
+				current->queued_offset = 0;
 			}
 		}
-		else
-		{
-			const char *resp = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
-			send(client_fd, resp, strlen(resp), 0);
-		}
 	}
-	else
-	{
-		const char *resp = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
-		send(client_fd, resp, strlen(resp), 0);
-	}
-	close(client_fd);
+	pthread_mutex_unlock(&k_ghost_io_ctx.sse_lock);
 }
 
-void k_ghost_io_manage_unknown_endpoint(const int client_fd)
+void k_ghost_io_sse_write(k_ghost_io_sse_client_entry_t *client_p, const char *data, const size_t len)
 {
-	const char *resp = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
-	send(client_fd, resp, strlen(resp), 0);
-	close(client_fd);
-}
\ No newline at end of file
+	ssize_t sent = 0;
+	if (!client_p->queued_data)
+	{
+		/* Events queued earlier go first, the socket is only tried when the client is keeping up */
+		sent = send(client_p->client.sse_client_fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0 && EAGAIN != errno && EWOULDBLOCK != errno)
+		{
+			/* The connection is broken, the I/O thread removes the client when it reads the end of the stream */
+			sent = (ssize_t)len;
+		}
+		sent = sent < 0 ? 0 : sent;
+	}
+	const size_t left = len - (size_t)sent;
+	/* The end of an event already partially sent is always queued, dropping it would break the stream */
+	if (left && 0 == k_ghost_io_reserve_sse_bytes(left, 0 != sent))
+	{
+		const int was_idle = !client_p->queued_data;
+		if (client_p->queued_offset)
+		{
+			/* Drop what was already sent before growing, a client that stays slow must not make the buffer grow forever */
+			memmove(client_p->queued_data, client_p->queued_data + client_p->queued_offset, client_p->queued_len - client_p->queued_offset);
+			client_p->queued_len -= client_p->queued_offset;
+			client_p->queued_offset = 0;
+		}
+		char *queued_p = realloc(client_p->queued_data, client_p->queued_len + left);
+		if (queued_p)
+		{
+			memcpy(queued_p + client_p->queued_len, data + sent, left);
+			client_p->queued_data = queued_p;
+			client_p->queued_len += left;
+			if (was_idle)
+			{
+				/* The I/O thread may be waiting without watching this client yet */
+				k_ghost_io_wake();
+			}
+		}
+		else
+		{
+			k_ghost_io_release_sse_bytes(left);
+		}
+	}
+}
+
+void k_ghost_io_wake(void)
+{
+	const int wake_fd = __atomic_load_n(&k_ghost_io_ctx.wake_fds[1], __ATOMIC_ACQUIRE);
+	if (wake_fd > 0)
+	{
+		/* A full pipe already guarantees a wake up, the write can fail harmlessly */
+		const char wake_byte = 0;
+		if (write(wake_fd, &wake_byte, sizeof(wake_byte)) < 0)
+		{
+		}
+	}
+}
+
+void k_ghost_io_add_connection(int *client_a, const int new_connection_fd)
+{
+	for (int i = 0; i < K_GHOST_IO_MAX_CLIENTS; i++)
+	{
+		if (client_a[i] == 0)
+		{
+			client_a[i] = new_connection_fd;
+			break;
+		}
+	}
+}
+
+uint32_t k_ghost_io_hash_name(const char *name, const size_t name_len)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < name_len; i++)
+	{
+		hash ^= (uint8_t)name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+double k_ghost_io_random(uint64_t *state_p)
+{
+	*state_p ^= *state_p >> 12;
+	*state_p ^= *state_p << 25;
+	*state_p ^= *state_p >> 27;
+	return (double)((*state_p * 0x2545F4914F6CDD1DULL) >> 11) * 0x1.0p-53;
+}
+
+k_ghost_io_interface_t *k_ghost_io_find_interface(const char *name, const size_t name_len)
+{
+	k_ghost_io_interface_t		 *interface_p = NULL;
+	k_ghost_io_interface_table_t *table_p	  = __atomic_load_n(&k_ghost_io_ctx.interface_table, __ATOMIC_ACQUIRE);
+	if (name && table_p)
+	{
+		const uint32_t hash = k_ghost_io_hash_name(name, name_len);
+		const size_t   mask = table_p->capacity - 1;
+		for (size_t i = hash & mask; table_p->slots[i].interface_p; i = (i + 1) & mask)
+		{
+			k_ghost_io_interface_t *candidate_p = table_p->slots[i].interface_p;
+			if (hash == table_p->slots[i].name_hash && name_len == ((k_ghost_io_interface_entry_t *)candidate_p)->name_len &&
+				0 == memcmp(candidate_p->interface_name, name, name_len))
+			{
+				interface_p = candidate_p;
+				break;
+			}
+		}
+	}
+	return interface_p;
+}
+
+void k_ghost_io_manage_rest_request(int client_fd, const char *request, const size_t header_len)
+{
+	int						 response_pending = 0;
+	k_ghost_io_response_id_t resp			  = K_GHOST_IO_RESPONSE_NONE;
+	const char				*request_body	  = request && header_len ? request + header_len : NULL;
+	k_ghost_io_registry_read_begin();
+	if (request_body)
+	{
+		const char			   *interface	  = NULL;
+		size_t					interface_len = 0;
+		k_ghost_io_interface_t *interface_p	  = NULL;
+		k_ghost_io_record(K_GHOST_IO_TRACE_REST, NULL, 0, request_body, strlen(request_body));
+		if (0 == k_ghost_io_scan_interface_key(request_body, &interface, &interface_len))
+		{
+			/* Interface found without building the tree: requests for unknown interfaces never pay for a parse */
+			interface_p = k_ghost_io_find_interface(interface, interface_len);
+			if (interface_p)
+			{
+				response_pending = k_ghost_io_submit_request(client_fd, interface_p, request_body, NULL);
+			}
+			else
+			{
+				resp = K_GHOST_IO_RESPONSE_NO_CONTENT;
+			}
+		}
+		else
+		{
+			/* The scan could not decide (missing key, escaped name, malformed body), let the parser have the last word */
+			cJSON *json_request = k_ghost_io_parse_request(request_body);
+			if (cJSON_IsArray(json_request))
+			{
+				/* Admitted item by item */
+				response_pending = k_ghost_io_manage_batch_request(client_fd, json_request);
+			}
+			else if (json_request)
+			{
+				char *interface_name = cJSON_GetStringValue(cJSON_GetObjectItem(json_request, "interface"));
+				interface_p			 = interface_name ? k_ghost_io_find_interface(interface_name, strlen(interface_name)) : NULL;
+				if (interface_p)
+				{
+					response_pending = k_ghost_io_submit_request(client_fd, interface_p, request_body, json_request);
+				}
+				else
+				{
+					resp = K_GHOST_IO_RESPONSE_NO_CONTENT;
+				}
+			}
+			else
+			{
+				resp = K_GHOST_IO_RESPONSE_BAD_REQUEST;
+			}
+		}
+	}
+	else
+	{
+		resp = K_GHOST_IO_RESPONSE_BAD_REQUEST;
+	}
+	if (K_GHOST_IO_RESPONSE_NONE != resp)
+	{
+		k_ghost_io_send_static_response(client_fd, resp, 0);
+	}
+	/* The parsed tree, if any, is released at once together with the rest of the request memory */
+	k_ghost_io_arena_reset(&k_ghost_io_request_arena);
+	k_ghost_io_registry_read_end();
+	if (!response_pending)
+	{
+		close(client_fd);
+	}
+}
+
+void k_ghost_io_manage_rest_route_request(int client_fd, const char *request, const size_t header_len)
+{
+	int						 response_pending = 0;
+	k_ghost_io_response_id_t resp			  = K_GHOST_IO_RESPONSE_NONE;
+	k_ghost_io_interface_t	*interface_p	  = NULL;
+	k_ghost_io_registry_read_begin();
+	if (request && 0 == strncmp(request, k_ghost_io_rest_route_prefix, strlen(k_ghost_io_rest_route_prefix)))
+	{
+		/* The interface name ends where the request target ends, no need to look at the headers or the body */
+		const char	*interface	   = request + strlen(k_ghost_io_rest_route_prefix);
+		const size_t interface_len = strcspn(interface, " ?\r\n");
+		interface_p				   = k_ghost_io_find_interface(interface, interface_len);
+		if (interface_p)
+		{
+			if (header_len)
+			{
+				const char *request_body = request + header_len;
+				k_ghost_io_record(K_GHOST_IO_TRACE_ROUTE, interface, interface_len, request_body, strlen(request_body));
+				response_pending = k_ghost_io_submit_request(client_fd, interface_p, request_body, NULL);
+			}
+			else
+			{
+				resp = K_GHOST_IO_RESPONSE_BAD_REQUEST;
+			}
+		}
+		else
+		{
+			/* Not an interface, maybe an instance of a device farm. Anything else is unknown and its body never parsed */
+			if (!header_len || 0 != k_ghost_io_manage_farm_request(client_fd, interface, interface_len, request + header_len))
+			{
+				resp = K_GHOST_IO_RESPONSE_NOT_FOUND;
+			}
+		}
+	}
+	else
+	{
+		resp = K_GHOST_IO_RESPONSE_BAD_REQUEST;
+	}
+	if (K_GHOST_IO_RESPONSE_NONE != resp)
+	{
+		k_ghost_io_send_static_response(client_fd, resp, 0);
+	}
+	/* The parsed tree, if any, is released at once together with the rest of the request memory */
+	k_ghost_io_arena_reset(&k_ghost_io_request_arena);
+	k_ghost_io_registry_read_end();
+	if (!response_pending)
+	{
+		close(client_fd);
+	}
+}
+
+int k_ghost_io_scan_interface_key(const char *request_body, const char **interface_pp, size_t *interface_len_p)
+{
+	int			ret_code = -1;
+	const char *cursor	 = request_body ? k_ghost_io_json_skip_whitespace(request_body) : NULL;
+	if (cursor && '{' == *cursor && interface_pp && interface_len_p)
+	{
+		cursor = k_ghost_io_json_skip_whitespace(cursor + 1);
+		/* Walk the top level members only, values of other keys are skipped without being decoded */
+		while (cursor && '"' == *cursor)
+		{
+			const char *key		= cursor + 1;
+			const char *key_end = k_ghost_io_json_skip_string(cursor);
+			cursor				= key_end ? k_ghost_io_json_skip_whitespace(key_end) : NULL;
+			if (!cursor || ':' != *cursor)
+			{
+				break;
+			}
+			cursor = k_ghost_io_json_skip_whitespace(cursor + 1);
+			if (key_end - key - 1 == (ptrdiff_t)strlen("interface") && 0 == strncasecmp(key, "interface", strlen("interface")))
+			{
+				/* Same semantics as cJSON_GetObjectItem: first match, case insensitive. Escaped names are left to the parser */
+				const char *value_end = '"' == *cursor ? k_ghost_io_json_skip_string(cursor) : NULL;
+				if (value_end && !memchr(cursor + 1, '\\', (size_t)(value_end - cursor - 2)))
+				{
+					*interface_pp	 = cursor + 1;
+					*interface_len_p = (size_t)(value_end - cursor - 2);
+					ret_code		 = 0;
+				}
+				break;
+			}
+			cursor = k_ghost_io_json_skip_value(cursor);
+			cursor = cursor ? k_ghost_io_json_skip_whitespace(cursor) : NULL;
+			if (!cursor || ',' != *cursor)
+			{
+				break;
+			}
+			cursor = k_ghost_io_json_skip_whitespace(cursor + 1);
+		}
+	}
+	return ret_code;
+}
+
+void k_ghost_io_manage_unknown_endpoint(const int client_fd)
+{
+	k_ghost_io_send_static_response(client_fd, K_GHOST_IO_RESPONSE_NOT_FOUND, 0);
+	close(client_fd);
+}
+
+void k_ghost_io_run_job(const k_ghost_io_job_t *job_p)
+{
+	/* The interface may have been unregistered while the job was queued */
+	k_ghost_io_registry_read_begin();
+	if (job_p->batch_p)
+	{
+		k_ghost_io_run_batch_item(job_p);
+		k_ghost_io_arena_reset(&k_ghost_io_request_arena);
+	}
+	else if (job_p->request_body)
+	{
+		int response_pending = 0;
+		if (!k_ghost_io_interface_removed(job_p->interface_p))
+		{
+			response_pending = k_ghost_io_dispatch_request(job_p->client_fd, job_p->interface_p, job_p->request_body, NULL);
+		}
+		else
+		{
+			k_ghost_io_send_response(job_p->client_fd, 404, NULL);
+		}
+		k_ghost_io_arena_reset(&k_ghost_io_request_arena);
+		if (!response_pending)
+		{
+			close(job_p->client_fd);
+			k_ghost_io_release_request(job_p->interface_p);
+		}
+	}
+	else
+	{
+		/* Status synchronizations are not admitted, nothing keeps their interface */
+		const k_ghost_io_interface_t *interface_p = k_ghost_io_find_interface(job_p->interface_name, job_p->name_len);
+		if (interface_p && interface_p->sync_cb)
+		{
+			interface_p->sync_cb();
+		}
+	}
+	k_ghost_io_registry_read_end();
+}
+
+static int k_ghost_io_submit_request(const int client_fd, k_ghost_io_interface_t *interface_p, const char *request_body, const cJSON *json_request)
+{
+	int response_pending = 1;
+	if (0 != k_ghost_io_admit_request(interface_p))
+	{
+		/* Over the limits: a fast refusal, before any work is spent on the request */
+		k_ghost_io_shed_request(client_fd);
+		response_pending = 0;
+	}
+	else if (!interface_p->stream_cb && 0 == k_ghost_io_inject_fault(client_fd, interface_p, request_body, &response_pending))
+	{
+		/* Reset, failed or delayed by the fault profile of the interface. Uploads are streamed as they arrive and never faulted */
+		if (!response_pending)
+		{
+			k_ghost_io_release_request(interface_p);
+		}
+	}
+	else if (interface_p->stream_cb || 0 != k_ghost_io_submit_job(interface_p, client_fd, request_body))
+	{
+		/* No worker pool, or no memory to queue the job: run the callback right away. Uploads always run on the I/O thread */
+		response_pending = k_ghost_io_dispatch_request(client_fd, interface_p, request_body, json_request);
+		if (!response_pending)
+		{
+			k_ghost_io_release_request(interface_p);
+		}
+	}
+	return response_pending;
+}
+
+static int k_ghost_io_dispatch_request(const int client_fd, k_ghost_io_interface_t *interface_p, const char *request_body, const cJSON *json_request)
+{
+	int response_pending			= 0;
+	k_ghost_io_dispatch_fd			= client_fd;
+	k_ghost_io_dispatch_interface_p = interface_p;
+	k_ghost_io_deferred_token		= 0;
+	k_ghost_io_deferred_completed	= 0;
+	const char *response_body = NULL;
+	const int	status		  = k_ghost_io_run_callback(interface_p, request_body, json_request, &response_body);
+	if (K_GHOST_IO_STATUS_PENDING == status)
+	{
+		/* The connection now belongs to the token, k_ghost_io_complete answers and closes it */
+		response_pending = 1;
+	}
+	else if (k_ghost_io_deferred_completed)
+	{
+		/* Already answered and closed by k_ghost_io_complete, the fd may even belong to a new connection by now */
+		response_pending = 1;
+	}
+	else
+	{
+		if (k_ghost_io_deferred_token)
+		{
+			/* The callback deferred the response but then answered synchronously, the token is no longer valid */
+			free(k_ghost_io_take_pending_request(k_ghost_io_deferred_token));
+		}
+		if (response_body)
+		{
+			k_ghost_io_send_json_response(client_fd, status, response_body);
+		}
+		else
+		{
+			k_ghost_io_response_id_t resp = K_GHOST_IO_RESPONSE_NONE;
+			switch (status)
+			{
+				case 200:
+					resp = K_GHOST_IO_RESPONSE_OK;
+					break;
+				case 400:
+					resp = K_GHOST_IO_RESPONSE_BAD_REQUEST;
+					break;
+				default:
+					resp = K_GHOST_IO_RESPONSE_INTERNAL_ERROR;
+					break;
+			}
+			k_ghost_io_send_static_response(client_fd, resp, 0);
+		}
+	}
+	k_ghost_io_dispatch_fd			= -1;
+	k_ghost_io_dispatch_interface_p = NULL;
+	k_ghost_io_deferred_token		= 0;
+	k_ghost_io_deferred_completed	= 0;
+	return response_pending;
+}
+
+static int k_ghost_io_run_callback(const k_ghost_io_interface_t *interface_p, const char *request_body, const cJSON *json_request,
+								   const char **response_body_pp)
+{
+	int status	 = 500;
+	int ret_code = -1;
+	if (interface_p->typed_cb)
+	{
+		/* Decoded straight from the text, batch items are printed back like for raw callbacks */
+		void *command_p = k_ghost_io_arena_alloc(&k_ghost_io_request_arena, interface_p->schema_p->command_size + 1);
+		if (!request_body)
+		{
+			request_body = k_ghost_io_print_request(json_request);
+		}
+		if (command_p && request_body)
+		{
+			memset(command_p, 0, interface_p->schema_p->command_size);
+			const char *json_text = request_body + strspn(request_body, " \t\r\n");
+			if (0 == k_ghost_io_decode_command(interface_p->schema_p, '\0' == *json_text ? "{}" : json_text, command_p))
+			{
+				ret_code = interface_p->typed_cb(command_p, interface_p->user_data_p);
+			}
+			else
+			{
+				status = 400;
+			}
+		}
+	}
+	else if (interface_p->stream_cb)
+	{
+		ret_code = k_ghost_io_run_stream_callback(interface_p, request_body, json_request);
+	}
+	else if (interface_p->raw_cb)
+	{
+		/* The handler parses the body on its own. Batch items have no body of their own and are printed back */
+		if (!request_body)
+		{
+			request_body = k_ghost_io_print_request(json_request);
+		}
+		if (request_body)
+		{
+			ret_code = interface_p->raw_cb(request_body, strlen(request_body), interface_p->user_data_p);
+		}
+	}
+	else
+	{
+		if (!json_request)
+		{
+			/* An empty body is a command without parameters */
+			const char *json_text = request_body + strspn(request_body, " \t\r\n");
+			json_request		  = k_ghost_io_parse_request('\0' == *json_text ? "{}" : json_text);
+		}
+		if (json_request && interface_p->response_cb)
+		{
+			ret_code = k_ghost_io_run_response_callback(interface_p, json_request, response_body_pp);
+		}
+		else if (json_request)
+		{
+			ret_code = interface_p->rest_cb(json_request, interface_p->user_data_p);
+		}
+		else
+		{
+			status = 400;
+		}
+	}
+	if (0 == ret_code)
+	{
+		status = 200;
+	}
+	else if (K_GHOST_IO_CB_PENDING == ret_code && k_ghost_io_deferred_token)
+	{
+		status = K_GHOST_IO_STATUS_PENDING;
+	}
+	return status;
+}
+
+static int k_ghost_io_run_response_callback(const k_ghost_io_interface_t *interface_p, const cJSON *json_request, const char **response_body_pp)
+{
+	int ret_code = -1;
+	/* The root lives in the request arena, the items added by the callback come from the heap and go away with cJSON_Delete */
+	k_ghost_io_active_arena = &k_ghost_io_request_arena;
+	cJSON *json_response	= cJSON_CreateObject();
+	k_ghost_io_active_arena = NULL;
+	if (json_response)
+	{
+		ret_code = interface_p->response_cb(json_request, json_response, interface_p->user_data_p);
+		if (response_body_pp && K_GHOST_IO_CB_PENDING != ret_code && (0 == ret_code || json_response->child))
+		{
+			*response_body_pp = k_ghost_io_print_response(json_response);
+		}
+		cJSON_Delete(json_response);
+	}
+	return ret_code;
+}
+
+static int k_ghost_io_run_stream_callback(const k_ghost_io_interface_t *interface_p, const char *request_body, const cJSON *json_request)
+{
+	int					 ret_code	= 0;
+	k_ghost_io_stream_t	 whole_body = {0};
+	k_ghost_io_stream_t *stream_p	= k_ghost_io_finishing_stream_p ? k_ghost_io_finishing_stream_p : &whole_body;
+	if (!k_ghost_io_finishing_stream_p)
+	{
+		/* The whole body is already there: a single chunk, batch items printed back like for raw callbacks */
+		const char *body_p = request_body ? request_body : k_ghost_io_print_request(json_request);
+		ret_code		   = body_p ? 0 : -1;
+		if (body_p && '\0' != *body_p)
+		{
+			whole_body.total_len = strlen(body_p);
+			ret_code		   = interface_p->stream_cb(&whole_body, body_p, whole_body.total_len, interface_p->user_data_p);
+			whole_body.offset	 = whole_body.total_len;
+		}
+	}
+	/* Last call: it reports the outcome of a complete body, or lets the callback clean up an aborted one */
+	stream_p->done	   = 0 == ret_code ? 1 : -1;
+	const int last_ret = interface_p->stream_cb(stream_p, NULL, 0, interface_p->user_data_p);
+	ret_code		   = 0 == ret_code ? last_ret : ret_code;
+	return ret_code;
+}
+
+static const char *k_ghost_io_print_response(cJSON *json_response)
+{
+	const char *json_text = NULL;
+	if (k_ghost_io_response_buffer && cJSON_PrintPreallocated(json_response, k_ghost_io_response_buffer, (int)k_ghost_io_response_buffer_size, 0))
+	{
+		json_text = k_ghost_io_response_buffer;
+	}
+	else
+	{
+		/* First response of the thread, or too big for the buffer: print it once and size the buffer for the next ones */
+		k_ghost_io_active_arena = &k_ghost_io_request_arena;
+		json_text				= cJSON_PrintUnformatted(json_response);
+		k_ghost_io_active_arena = NULL;
+		if (json_text)
+		{
+			size_t buffer_size = k_ghost_io_response_buffer_size ? k_ghost_io_response_buffer_size : K_GHOST_IO_RESPONSE_BUFFER_SIZE;
+			while (buffer_size <= strlen(json_text) + 5)  // cJSON_PrintPreallocated needs some slack
+			{
+				buffer_size *= 2;
+			}
+			if (buffer_size != k_ghost_io_response_buffer_size)
+			{
+				char *buffer = realloc(k_ghost_io_response_buffer, buffer_size);
+				if (buffer)
+				{
+					k_ghost_io_response_buffer		= buffer;
+					k_ghost_io_response_buffer_size = buffer_size;
+				}
+			}
+		}
+	}
+	return json_text;
+}
+
+static void k_ghost_io_send_json_response(const int client_fd, const int status, const char *body)
+{
+	const size_t body_len = strlen(body);
+	char		 head[K_GHOST_IO_RESPONSE_HEAD_SIZE];
+	struct iovec response[2];
+	response[0].iov_base = head;
+	response[0].iov_len	 = k_ghost_io_format_response_head(head, status, NULL, body_len);
+	response[1].iov_base = (void *)body;
+	response[1].iov_len	 = body_len;
+	writev(client_fd, response, 2);
+}
+
+static int k_ghost_io_manage_batch_request(const int client_fd, const cJSON *json_request)
+{
+	int					response_pending = 0;
+	const int			items_count		 = cJSON_GetArraySize(json_request);
+	k_ghost_io_batch_t *batch_p			 = malloc(sizeof(k_ghost_io_batch_t) + (size_t)items_count * sizeof(int));
+	if (batch_p)
+	{
+		batch_p->client_fd	 = client_fd;
+		batch_p->reset		 = 0;
+		batch_p->remaining	 = (unsigned int)items_count + 1;
+		batch_p->items_count = (size_t)items_count;
+		size_t		 index	 = 0;
+		const cJSON *item	 = NULL;
+		cJSON_ArrayForEach(item, json_request)
+		{
+			k_ghost_io_submit_batch_item(batch_p, index++, item);
+		}
+		/* Every item is handed out: the last one to complete answers, this one if they all ran on the I/O thread */
+		k_ghost_io_complete_batch_item(batch_p, batch_p->items_count, 0);
+		response_pending = 1;
+	}
+	else
+	{
+		k_ghost_io_send_static_response(client_fd, K_GHOST_IO_RESPONSE_INTERNAL_ERROR, 0);
+	}
+	return response_pending;
+}
+
+static void k_ghost_io_submit_batch_item(k_ghost_io_batch_t *batch_p, const size_t index, const cJSON *item)
+{
+	int						status		= 400;
+	k_ghost_io_interface_t *interface_p = NULL;
+	k_ghost_io_job_t	   *job_p		= NULL;
+	if (cJSON_IsObject(item))
+	{
+		const char *interface_name = cJSON_GetStringValue(cJSON_GetObjectItem(item, "interface"));
+		interface_p				   = interface_name ? k_ghost_io_find_interface(interface_name, strlen(interface_name)) : NULL;
+		status					   = interface_p ? 503 : 204;
+	}
+	if (interface_p && 0 == k_ghost_io_admit_batch_item(interface_p))
+	{
+		/* Printed back into a job of its own, so that it runs behind the commands already queued for the interface */
+		const char *request_body = k_ghost_io_print_request(item);
+		job_p					 = request_body ? k_ghost_io_new_job(interface_p, batch_p->client_fd, request_body) : NULL;
+		status					 = 500;
+		if (!job_p)
+		{
+			k_ghost_io_release_request(interface_p);
+		}
+	}
+	if (job_p)
+	{
+		uint64_t delay_ns = 0;
+		/* Same faults as a single request, uploads are never faulted */
+		const k_ghost_io_fault_kind_t kind = interface_p->stream_cb ? K_GHOST_IO_FAULT_NONE : k_ghost_io_draw_fault(interface_p, &delay_ns);
+		job_p->batch_p					   = batch_p;
+		job_p->item						   = index;
+		if (K_GHOST_IO_FAULT_RESET == kind || K_GHOST_IO_FAULT_ERROR == kind)
+		{
+			/* The items share the connection: a reset item resets it once all of them are done */
+			batch_p->reset |= K_GHOST_IO_FAULT_RESET == kind;
+			k_ghost_io_release_request(interface_p);
+			k_ghost_io_complete_batch_item(batch_p, index, status);
+			free(job_p);
+		}
+		else if ((K_GHOST_IO_FAULT_DELAY != kind || 0 != k_ghost_io_delay_job(job_p, delay_ns)) && (interface_p->stream_cb || 0 != k_ghost_io_queue_job(job_p)))
+		{
+			/* No worker pool, or no memory to delay the item: run it right away. Uploads always run on the I/O thread */
+			k_ghost_io_run_batch_item(job_p);
+			free(job_p);
+		}
+	}
+	else
+	{
+		k_ghost_io_complete_batch_item(batch_p, index, status);
+	}
+}
+
+static void k_ghost_io_run_batch_item(const k_ghost_io_job_t *job_p)
+{
+	/* Unregistered while the item was queued: reported like an interface that is not registered */
+	const int status = k_ghost_io_interface_removed(job_p->interface_p) ? 204 : k_ghost_io_run_callback(job_p->interface_p, job_p->request_body, NULL, NULL);
+	k_ghost_io_release_request(job_p->interface_p);
+	k_ghost_io_complete_batch_item(job_p->batch_p, job_p->item, status);
+}
+
+static void k_ghost_io_complete_batch_item(k_ghost_io_batch_t *batch_p, const size_t index, const int status)
+{
+	if (index < batch_p->items_count)
+	{
+		batch_p->statuses[index] = status;
+	}
+	/* The last completion sees the statuses written by all the others, whatever thread they ran on */
+	if (1 == __atomic_fetch_sub(&batch_p->remaining, 1, __ATOMIC_ACQ_REL))
+	{
+		/* One status per item, at most 3 digits and a separator each */
+		const size_t body_size = 4 * batch_p->items_count + 3;
+		char		*resp	   = batch_p->reset ? NULL : k_ghost_io_arena_alloc(&k_ghost_io_scratch_arena, K_GHOST_IO_RESPONSE_HEAD_SIZE + body_size);
+		if (resp)
+		{
+			char  *body		 = resp + K_GHOST_IO_RESPONSE_HEAD_SIZE;
+			size_t body_len	 = 0;
+			body[body_len++] = '[';
+			for (size_t i = 0; i < batch_p->items_count; i++)
+			{
+				body_len += (size_t)snprintf(body + body_len, body_size - body_len, "%s%d", i ? "," : "", batch_p->statuses[i]);
+			}
+			body[body_len++] = ']';
+			/* Header and statuses go out with a single send. The client may have gone away while the items were run */
+			const size_t head_len = k_ghost_io_format_response_head(resp, 200, NULL, body_len);
+			memmove(resp + head_len, body, body_len);
+			send(batch_p->client_fd, resp, head_len + body_len, MSG_NOSIGNAL);
+			k_ghost_io_arena_reset(&k_ghost_io_scratch_arena);
+		}
+		else if (batch_p->reset)
+		{
+			/* Closed with a zero linger time, the client gets a reset instead of the statuses */
+			const struct linger linger = {.l_onoff = 1, .l_linger = 0};
+			setsockopt(batch_p->client_fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+		}
+		else
+		{
+			k_ghost_io_send_static_response(batch_p->client_fd, K_GHOST_IO_RESPONSE_INTERNAL_ERROR, 0);
+		}
+		close(batch_p->client_fd);
+		free(batch_p);
+	}
+}
+
+static k_ghost_io_pending_request_t *k_ghost_io_take_pending_request(const k_ghost_io_token_t token)
+{
+	k_ghost_io_pending_request_t *pending_p = NULL;
+	pthread_mutex_lock(&k_ghost_io_ctx.pending_lock);
+	k_ghost_io_pending_request_t *prev_p	= NULL;
+	k_ghost_io_pending_request_t *current_p = k_ghost_io_ctx.pending_requests;
+	while (current_p)
+	{
+		if (token == current_p->token)
+		{
+			if (prev_p)
+			{
+				prev_p->next_request = current_p->next_request;
+			}
+			else
+			{
+				k_ghost_io_ctx.pending_requests = current_p->next_request;
+			}
+			pending_p = current_p;
+			break;
+		}
+		prev_p	  = current_p;
+		current_p = current_p->next_request;
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.pending_lock);
+	return pending_p;
+}
+
+static void k_ghost_io_send_response(const int client_fd, const int status, const char *body)
+{
+	const size_t body_len = body ? strlen(body) : 0;
+	char		*resp	  = k_ghost_io_arena_alloc(&k_ghost_io_scratch_arena, K_GHOST_IO_RESPONSE_HEAD_SIZE + body_len);
+	if (resp)
+	{
+		const size_t head_len = k_ghost_io_format_response_head(resp, status, NULL, body_len);
+		memcpy(resp + head_len, body, body_len);
+		/* The client may have gone away while the response was pending */
+		send(client_fd, resp, head_len + body_len, MSG_NOSIGNAL);
+		k_ghost_io_arena_reset(&k_ghost_io_scratch_arena);
+	}
+}
+
+static void *k_ghost_io_cjson_malloc(const size_t size)
+{
+	return k_ghost_io_active_arena ? k_ghost_io_arena_alloc(k_ghost_io_active_arena, size) : malloc(size);
+}
+
+static void k_ghost_io_cjson_free(void *ptr)
+{
+	/* Arena memory is never freed one piece at a time, it goes away with k_ghost_io_arena_reset */
+	if (!k_ghost_io_arena_owns(&k_ghost_io_request_arena, ptr))
+	{
+		free(ptr);
+	}
+}
+
+static void k_ghost_io_install_cjson_hooks(void)
+{
+	cJSON_Hooks hooks = {.malloc_fn = k_ghost_io_cjson_malloc, .free_fn = k_ghost_io_cjson_free};
+	cJSON_InitHooks(&hooks);
+}
+
+static char *k_ghost_io_print_request(const cJSON *json_request)
+{
+	pthread_once(&k_ghost_io_hooks_once, k_ghost_io_install_cjson_hooks);
+	k_ghost_io_active_arena = &k_ghost_io_request_arena;
+	char *json_text			= cJSON_PrintUnformatted(json_request);
+	k_ghost_io_active_arena = NULL;
+	return json_text;
+}
+
+static cJSON *k_ghost_io_parse_request(const char *json_text)
+{
+	pthread_once(&k_ghost_io_hooks_once, k_ghost_io_install_cjson_hooks);
+	k_ghost_io_active_arena = &k_ghost_io_request_arena;
+	cJSON *json_request		= cJSON_Parse(json_text);
+	k_ghost_io_active_arena = NULL;
+	return json_request;
+}
+
+static k_ghost_io_register_ret_code_t k_ghost_io_add_interface(const char *interface_name, const k_ghost_io_interface_t *template_p)
+{
+	k_ghost_io_register_ret_code_t ret_code = K_GHOST_REGISTER_RET_CODE_ERROR;
+	pthread_mutex_lock(&k_ghost_io_ctx.registry_lock);
+	if (interface_name)
+	{
+		if (k_ghost_io_find_interface(interface_name, strlen(interface_name)))
+		{
+			ret_code = K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED;
+		}
+		else if (0 == k_ghost_io_registry_reserve(1))
+		{
+			k_ghost_io_interface_entry_t *entry_p		= malloc(sizeof(k_ghost_io_interface_entry_t));
+			k_ghost_io_interface_t		 *new_interface = entry_p ? &entry_p->interface : NULL;
+			if (new_interface)
+			{
+				entry_p->pending_count		  = 0;
+				entry_p->name_len			  = strlen(interface_name);
+				entry_p->name_hash			  = k_ghost_io_hash_name(interface_name, entry_p->name_len);
+				entry_p->prev_cb			  = NULL;
+				*new_interface				  = *template_p;
+				new_interface->interface_name = strdup(interface_name);
+				new_interface->next_cb		  = k_ghost_io_ctx.interfaces;
+				k_ghost_io_interface_table_t *table_p = new_interface->interface_name ? k_ghost_io_interface_table_copy(new_interface, NULL) : NULL;
+				if (table_p)
+				{
+					/* The interface is fully built before being published, readers never see it half initialized */
+					k_ghost_io_interface_table_t *old_table_p = k_ghost_io_ctx.interface_table;
+					__atomic_store_n(&k_ghost_io_ctx.interface_table, table_p, __ATOMIC_RELEASE);
+					if (k_ghost_io_ctx.interfaces)
+					{
+						((k_ghost_io_interface_entry_t *)k_ghost_io_ctx.interfaces)->prev_cb = new_interface;
+					}
+					__atomic_store_n(&k_ghost_io_ctx.interfaces, new_interface, __ATOMIC_RELEASE);
+					k_ghost_io_registry_retire(old_table_p);
+					ret_code = K_GHOST_REGISTER_RET_CODE_OK;
+				}
+				else
+				{
+					free(new_interface->interface_name);
+					free(entry_p);
+				}
+			}
+		}
+	}
+	k_ghost_io_registry_reclaim();
+	pthread_mutex_unlock(&k_ghost_io_ctx.registry_lock);
+	return ret_code;
+}
+
+static k_ghost_io_interface_table_t *k_ghost_io_interface_table_copy(k_ghost_io_interface_t *added_p, const k_ghost_io_interface_t *removed_p)
+{
+	/* Rehash the entries using the cached hashes, names are never touched */
+	const k_ghost_io_interface_table_t *table_p		= k_ghost_io_ctx.interface_table;
+	const size_t						count		= (table_p ? table_p->count : 0) + (added_p ? 1 : 0);
+	size_t								capacity	= table_p ? table_p->capacity : K_GHOST_IO_INTERFACE_TABLE_MIN_CAPACITY;
+	k_ghost_io_interface_table_t	   *new_table_p = NULL;
+	while (2 * count > capacity)
+	{
+		capacity *= 2;
+	}
+	new_table_p = calloc(1, sizeof(k_ghost_io_interface_table_t) + capacity * sizeof(k_ghost_io_interface_slot_t));
+	if (new_table_p)
+	{
+		new_table_p->capacity = capacity;
+		for (size_t i = 0; table_p && i < table_p->capacity; i++)
+		{
+			if (table_p->slots[i].interface_p && table_p->slots[i].interface_p != removed_p)
+			{
+				k_ghost_io_interface_table_put(new_table_p, table_p->slots[i].interface_p);
+			}
+		}
+		if (added_p)
+		{
+			k_ghost_io_interface_table_put(new_table_p, added_p);
+		}
+	}
+	return new_table_p;
+}
+
+static void k_ghost_io_interface_table_put(k_ghost_io_interface_table_t *table_p, k_ghost_io_interface_t *interface_p)
+{
+	const uint32_t name_hash = ((const k_ghost_io_interface_entry_t *)interface_p)->name_hash;
+	const size_t   mask		 = table_p->capacity - 1;
+	size_t		   i		 = name_hash & mask;
+	while (table_p->slots[i].interface_p)
+	{
+		i = (i + 1) & mask;
+	}
+	table_p->slots[i].name_hash	  = name_hash;
+	table_p->slots[i].interface_p = interface_p;
+	table_p->count++;
+}
+
+static void k_ghost_io_open_wake_pipe(void)
+{
+	int wake_fds[2];
+	if (0 == pipe(wake_fds))
+	{
+		fcntl(wake_fds[0], F_SETFL, O_NONBLOCK);
+		fcntl(wake_fds[1], F_SETFL, O_NONBLOCK);
+		k_ghost_io_ctx.wake_fds[0] = wake_fds[0];
+		__atomic_store_n(&k_ghost_io_ctx.wake_fds[1], wake_fds[1], __ATOMIC_RELEASE);
+	}
+}
+
+static char *k_ghost_io_parse_sse_filter(const char *query)
+{
+	char *interfaces = NULL;
+	if (query)
+	{
+		/* Both forms are accepted, and can be mixed: ?interface=a,b and ?interface=a&interface=b */
+		const size_t query_len = strcspn(query, " \r\n");
+		size_t		 used	   = 0;
+		interfaces			   = malloc(query_len + 1);
+		for (const char *param = query; interfaces && param < query + query_len;)
+		{
+			const size_t param_len = strcspn(param, "& \r\n");
+			if (param_len > strlen("interface=") && 0 == strncmp(param, "interface=", strlen("interface=")))
+			{
+				const size_t value_len = param_len - strlen("interface=");
+				if (used)
+				{
+					interfaces[used++] = ',';
+				}
+				memcpy(interfaces + used, param + strlen("interface="), value_len);
+				used += value_len;
+			}
+			param += param_len + 1;
+		}
+		if (interfaces && used)
+		{
+			interfaces[used] = '\0';
+		}
+		else
+		{
+			free(interfaces);
+			interfaces = NULL;
+		}
+	}
+	return interfaces;
+}
+
+static int k_ghost_io_sse_client_wants(const k_ghost_io_sse_client_entry_t *client_p, const char *interface_name, const size_t name_len)
+{
+	int wanted = !client_p->interfaces;
+	for (const char *cursor = client_p->interfaces; cursor && *cursor && !wanted;)
+	{
+		const size_t len = strcspn(cursor, ",");
+		/* A device farm covers its instances, "anemometer" the events of "anemometer/0042" */
+		wanted = (name_len == len || (name_len > len && '/' == interface_name[len])) && 0 == memcmp(cursor, interface_name, len);
+		cursor += len + (',' == cursor[len]);
+	}
+	return wanted;
+}
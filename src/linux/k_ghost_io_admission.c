@@ -0,0 +1,183 @@
+/**
+ * @file k_ghost_io_admission.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <stdio.h>
+#include <sys/socket.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_DEFAULT_RETRY_AFTER_S 1
+
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Take a slot of a counter bounded by a limit. A counter marked with K_GHOST_IO_INTERFACE_REMOVED has no slot left.
+ *
+ * @param counter_p Counter to increment
+ * @param limit Maximum value of the counter, 0 for no limit
+ *
+ * @return 0 if the slot was taken, -1 if the counter is already at the limit.
+ */
+static int k_ghost_io_counter_take(unsigned int *counter_p, unsigned int limit);
+
+/**
+ * @brief Give back a slot of a counter, never going below 0. The K_GHOST_IO_INTERFACE_REMOVED mark is kept.
+ *
+ * @param counter_p Counter to decrement
+ *
+ * @return Value of the counter before the slot was given back.
+ */
+static unsigned int k_ghost_io_counter_give(unsigned int *counter_p);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+int k_ghost_io_set_limits(const k_ghost_io_limits_t *limits_p)
+{
+	int ret_code = -1;
+	if (limits_p)
+	{
+		/* Field by field: the readers only need each limit to be consistent on its own */
+		__atomic_store_n(&k_ghost_io_ctx.limits.max_inflight_requests, limits_p->max_inflight_requests, __ATOMIC_RELAXED);
+		__atomic_store_n(&k_ghost_io_ctx.limits.max_interface_pending, limits_p->max_interface_pending, __ATOMIC_RELAXED);
+		__atomic_store_n(&k_ghost_io_ctx.limits.max_sse_queued_bytes, limits_p->max_sse_queued_bytes, __ATOMIC_RELAXED);
+		__atomic_store_n(&k_ghost_io_ctx.limits.retry_after_s, limits_p->retry_after_s, __ATOMIC_RELAXED);
+		ret_code = 0;
+	}
+	return ret_code;
+}
+
+void k_ghost_io_get_stats(k_ghost_io_stats_t *stats_p)
+{
+	if (stats_p)
+	{
+		stats_p->inflight_requests = __atomic_load_n(&k_ghost_io_ctx.inflight_requests, __ATOMIC_RELAXED);
+		stats_p->sse_queued_bytes  = __atomic_load_n(&k_ghost_io_ctx.sse_queued_bytes, __ATOMIC_RELAXED);
+		stats_p->shed_requests	   = __atomic_load_n(&k_ghost_io_ctx.shed_requests, __ATOMIC_RELAXED);
+		stats_p->dropped_events	   = __atomic_load_n(&k_ghost_io_ctx.dropped_events, __ATOMIC_RELAXED);
+	}
+}
+
+int k_ghost_io_admit_request(k_ghost_io_interface_t *interface_p)
+{
+	int ret_code = -1;
+	if (0 == k_ghost_io_counter_take(&k_ghost_io_ctx.inflight_requests, __atomic_load_n(&k_ghost_io_ctx.limits.max_inflight_requests, __ATOMIC_RELAXED)))
+	{
+		if (!interface_p || 0 == k_ghost_io_counter_take(&((k_ghost_io_interface_entry_t *)interface_p)->pending_count,
+														 __atomic_load_n(&k_ghost_io_ctx.limits.max_interface_pending, __ATOMIC_RELAXED)))
+		{
+			ret_code = 0;
+		}
+		else
+		{
+			k_ghost_io_counter_give(&k_ghost_io_ctx.inflight_requests);
+		}
+	}
+	return ret_code;
+}
+
+int k_ghost_io_admit_batch_item(k_ghost_io_interface_t *interface_p)
+{
+	const int ret_code = k_ghost_io_admit_request(interface_p);
+	if (0 != ret_code)
+	{
+		/* Reported as 503 among the statuses of the batch, no response of its own */
+		__atomic_add_fetch(&k_ghost_io_ctx.shed_requests, 1, __ATOMIC_RELAXED);
+	}
+	return ret_code;
+}
+
+void k_ghost_io_release_request(k_ghost_io_interface_t *interface_p)
+{
+	if (interface_p && K_GHOST_IO_INTERFACE_REMOVED + 1 == k_ghost_io_counter_give(&((k_ghost_io_interface_entry_t *)interface_p)->pending_count))
+	{
+		/* Last answer of an unregistered interface, the entry was kept for it. Readers may still stand on it, it is retired */
+		pthread_mutex_lock(&k_ghost_io_ctx.registry_lock);
+		if (0 == k_ghost_io_registry_reserve(2))
+		{
+			k_ghost_io_registry_retire(interface_p->interface_name);
+			k_ghost_io_registry_retire(interface_p);
+		}
+		k_ghost_io_registry_reclaim();
+		pthread_mutex_unlock(&k_ghost_io_ctx.registry_lock);
+	}
+	k_ghost_io_counter_give(&k_ghost_io_ctx.inflight_requests);
+}
+
+int k_ghost_io_interface_removed(const k_ghost_io_interface_t *interface_p)
+{
+	return 0 != (__atomic_load_n(&((const k_ghost_io_interface_entry_t *)interface_p)->pending_count, __ATOMIC_ACQUIRE) & K_GHOST_IO_INTERFACE_REMOVED);
+}
+
+void k_ghost_io_shed_request(const int client_fd)
+{
+	char		 resp[K_GHOST_IO_RESPONSE_HEAD_SIZE];
+	char		 retry_after[32];
+	unsigned int retry_after_s = __atomic_load_n(&k_ghost_io_ctx.limits.retry_after_s, __ATOMIC_RELAXED);
+	snprintf(retry_after, sizeof(retry_after), "Retry-After: %u\r\n", retry_after_s ? retry_after_s : K_GHOST_IO_DEFAULT_RETRY_AFTER_S);
+	__atomic_add_fetch(&k_ghost_io_ctx.shed_requests, 1, __ATOMIC_RELAXED);
+	send(client_fd, resp, k_ghost_io_format_response_head(resp, 503, retry_after, 0), 0);
+}
+
+int k_ghost_io_admit_sse_client(void)
+{
+	int			 ret_code = 0;
+	const size_t limit	  = __atomic_load_n(&k_ghost_io_ctx.limits.max_sse_queued_bytes, __ATOMIC_RELAXED);
+	if (limit && __atomic_load_n(&k_ghost_io_ctx.sse_queued_bytes, __ATOMIC_RELAXED) >= limit)
+	{
+		/* The clients already connected are not keeping up, a new one would only make it worse */
+		ret_code = -1;
+	}
+	return ret_code;
+}
+
+int k_ghost_io_reserve_sse_bytes(const size_t count, const int force)
+{
+	int			 ret_code = 0;
+	const size_t limit	  = __atomic_load_n(&k_ghost_io_ctx.limits.max_sse_queued_bytes, __ATOMIC_RELAXED);
+	if (!force && limit && k_ghost_io_ctx.sse_queued_bytes + count > limit)
+	{
+		__atomic_add_fetch(&k_ghost_io_ctx.dropped_events, 1, __ATOMIC_RELAXED);
+		ret_code = -1;
+	}
+	else
+	{
+		__atomic_add_fetch(&k_ghost_io_ctx.sse_queued_bytes, count, __ATOMIC_RELAXED);
+	}
+	return ret_code;
+}
+
+void k_ghost_io_release_sse_bytes(const size_t count)
+{
+	__atomic_sub_fetch(&k_ghost_io_ctx.sse_queued_bytes, count, __ATOMIC_RELAXED);
+}
+
+static int k_ghost_io_counter_take(unsigned int *counter_p, const unsigned int limit)
+{
+	int			 ret_code = -1;
+	unsigned int count	  = __atomic_load_n(counter_p, __ATOMIC_RELAXED);
+	/* Compare and swap instead of add and check: the counter never goes over the limit, not even for a moment */
+	while (ret_code && !(count & K_GHOST_IO_INTERFACE_REMOVED) && (!limit || count < limit))
+	{
+		if (__atomic_compare_exchange_n(counter_p, &count, count + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		{
+			ret_code = 0;
+		}
+	}
+	return ret_code;
+}
+
+static unsigned int k_ghost_io_counter_give(unsigned int *counter_p)
+{
+	unsigned int count = __atomic_load_n(counter_p, __ATOMIC_RELAXED);
+	/* Ordered with the unregistration: exactly one of them sees the interface both removed and idle */
+	while ((count & ~K_GHOST_IO_INTERFACE_REMOVED) && !__atomic_compare_exchange_n(counter_p, &count, count - 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+	{
+	}
+	return count;
+}
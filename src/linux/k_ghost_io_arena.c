@@ -0,0 +1,117 @@
+/**
+ * @file k_ghost_io_arena.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_ARENA_ALIGNMENT (sizeof(max_align_t))
+
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Allocate a new block and put it at the head of the arena.
+ *
+ * @param arena_p Arena the block belongs to
+ * @param size Minimum number of usable bytes in the block
+ *
+ * @return Pointer to the new block, NULL in case of failure.
+ */
+static k_ghost_io_arena_block_t *k_ghost_io_arena_add_block(k_ghost_io_arena_t *arena_p, size_t size);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+void *k_ghost_io_arena_alloc(k_ghost_io_arena_t *arena_p, size_t size)
+{
+	void *ptr = NULL;
+	if (arena_p)
+	{
+		k_ghost_io_arena_block_t *block_p = arena_p->head;
+		size							  = (size + K_GHOST_IO_ARENA_ALIGNMENT - 1) & ~(K_GHOST_IO_ARENA_ALIGNMENT - 1);
+		if (!block_p || block_p->size - block_p->used < size)
+		{
+			block_p = k_ghost_io_arena_add_block(arena_p, size > K_GHOST_IO_ARENA_BLOCK_SIZE ? size : K_GHOST_IO_ARENA_BLOCK_SIZE);
+		}
+		if (block_p)
+		{
+			ptr = (unsigned char *)block_p->data + block_p->used;
+			block_p->used += size;
+		}
+	}
+	return ptr;
+}
+
+void k_ghost_io_arena_reset(k_ghost_io_arena_t *arena_p)
+{
+	if (arena_p && arena_p->head)
+	{
+		if (arena_p->head->next)
+		{
+			/* The last request did not fit in one block: replace the chain with a single block big enough for it */
+			size_t					  total_size = 0;
+			k_ghost_io_arena_block_t *block_p	 = arena_p->head;
+			while (block_p)
+			{
+				k_ghost_io_arena_block_t *next_p = block_p->next;
+				total_size += block_p->size;
+				free(block_p);
+				block_p = next_p;
+			}
+			arena_p->head = NULL;
+			k_ghost_io_arena_add_block(arena_p, total_size);
+		}
+		else
+		{
+			arena_p->head->used = 0;
+		}
+	}
+}
+
+void k_ghost_io_arena_free(k_ghost_io_arena_t *arena_p)
+{
+	if (arena_p)
+	{
+		k_ghost_io_arena_block_t *block_p = arena_p->head;
+		while (block_p)
+		{
+			k_ghost_io_arena_block_t *next_p = block_p->next;
+			free(block_p);
+			block_p = next_p;
+		}
+		arena_p->head = NULL;
+	}
+}
+
+int k_ghost_io_arena_owns(const k_ghost_io_arena_t *arena_p, const void *ptr)
+{
+	int owned = 0;
+	if (arena_p && ptr)
+	{
+		for (const k_ghost_io_arena_block_t *block_p = arena_p->head; block_p && !owned; block_p = block_p->next)
+		{
+			const uintptr_t start = (uintptr_t)block_p->data;
+			owned				  = (uintptr_t)ptr >= start && (uintptr_t)ptr < start + block_p->size;
+		}
+	}
+	return owned;
+}
+
+static k_ghost_io_arena_block_t *k_ghost_io_arena_add_block(k_ghost_io_arena_t *arena_p, const size_t size)
+{
+	k_ghost_io_arena_block_t *block_p = malloc(sizeof(k_ghost_io_arena_block_t) + size);
+	if (block_p)
+	{
+		block_p->next = arena_p->head;
+		block_p->size = size;
+		block_p->used = 0;
+		arena_p->head = block_p;
+	}
+	return block_p;
+}
@@ -0,0 +1,230 @@
+/**
+ * @file k_ghost_io_clock.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <math.h>
+#include <time.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Read the monotonic clock of the system.
+ *
+ * @return Current time in nanoseconds
+ */
+static uint64_t k_ghost_io_system_ns(void);
+
+/**
+ * @brief Compute the library time at a given monotonic time.
+ *
+ * @param pace_p Clock under its lock, or a copy of its pace
+ * @param real_ns Monotonic time, in nanoseconds
+ *
+ * @return Library time, in nanoseconds
+ */
+static uint64_t k_ghost_io_clock_at(const k_ghost_io_clock_t *pace_p, uint64_t real_ns);
+
+/**
+ * @brief Write the pace of the clock, seen whole or not at all by the readers of the time. Must hold the clock lock.
+ *
+ * @param mode Pace of the clock
+ * @param scale Scale of the clock
+ * @param base_real_ns Monotonic time of the change
+ * @param base_virtual_ns Library time at the change
+ */
+static void k_ghost_io_clock_write(k_ghost_io_clock_mode_t mode, double scale, uint64_t base_real_ns, uint64_t base_virtual_ns);
+
+/**
+ * @brief Change the pace of the clock, starting from its current time. Must hold the clock lock.
+ *
+ * @param mode New pace of the clock
+ * @param scale New scale of the clock
+ */
+static void k_ghost_io_clock_rebase(k_ghost_io_clock_mode_t mode, double scale);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+int k_ghost_io_set_time_scale(const double scale)
+{
+	int ret_code = -1;
+	/* Written this way round, not a number is rejected too */
+	if (scale >= 0.0 && isfinite(scale))
+	{
+		k_ghost_io_clock_t *clock_p = &k_ghost_io_ctx.clock;
+		pthread_mutex_lock(&clock_p->lock);
+		const k_ghost_io_clock_mode_t mode = K_GHOST_IO_TIME_SCALE_UNBOUNDED == scale ? K_GHOST_IO_CLOCK_UNBOUNDED : K_GHOST_IO_CLOCK_SCALED;
+		k_ghost_io_clock_rebase(K_GHOST_IO_CLOCK_PAUSED == clock_p->mode ? K_GHOST_IO_CLOCK_PAUSED : mode, scale);
+		clock_p->running_mode = mode;
+		pthread_mutex_unlock(&clock_p->lock);
+		k_ghost_io_wake();
+		ret_code = 0;
+	}
+	return ret_code;
+}
+
+void k_ghost_io_pause_clock(void)
+{
+	k_ghost_io_clock_t *clock_p = &k_ghost_io_ctx.clock;
+	pthread_mutex_lock(&clock_p->lock);
+	if (K_GHOST_IO_CLOCK_SYSTEM == clock_p->mode)
+	{
+		/* Once paused, the clock can no longer be the system clock: it resumes at the same pace, behind it */
+		clock_p->running_mode = K_GHOST_IO_CLOCK_SCALED;
+		k_ghost_io_clock_rebase(K_GHOST_IO_CLOCK_PAUSED, 1.0);
+	}
+	else if (K_GHOST_IO_CLOCK_PAUSED != clock_p->mode)
+	{
+		k_ghost_io_clock_rebase(K_GHOST_IO_CLOCK_PAUSED, clock_p->scale);
+	}
+	pthread_mutex_unlock(&clock_p->lock);
+}
+
+void k_ghost_io_resume_clock(void)
+{
+	k_ghost_io_clock_t *clock_p = &k_ghost_io_ctx.clock;
+	pthread_mutex_lock(&clock_p->lock);
+	if (K_GHOST_IO_CLOCK_PAUSED == clock_p->mode)
+	{
+		k_ghost_io_clock_rebase(clock_p->running_mode, clock_p->scale);
+	}
+	pthread_mutex_unlock(&clock_p->lock);
+	k_ghost_io_wake();
+}
+
+int k_ghost_io_step_clock(const uint64_t step_us)
+{
+	int					ret_code = -1;
+	k_ghost_io_clock_t *clock_p	 = &k_ghost_io_ctx.clock;
+	pthread_mutex_lock(&clock_p->lock);
+	if (K_GHOST_IO_CLOCK_PAUSED == clock_p->mode)
+	{
+		k_ghost_io_clock_write(clock_p->mode, clock_p->scale, clock_p->base_real_ns, clock_p->base_virtual_ns + step_us * 1000);
+		ret_code = 0;
+	}
+	pthread_mutex_unlock(&clock_p->lock);
+	if (0 == ret_code)
+	{
+		k_ghost_io_wake();
+	}
+	return ret_code;
+}
+
+uint64_t k_ghost_io_get_time_us(void)
+{
+	return k_ghost_io_now_ns() / 1000;
+}
+
+uint64_t k_ghost_io_now_ns(void)
+{
+	uint64_t			now_ns	= 0;
+	k_ghost_io_clock_t *clock_p = &k_ghost_io_ctx.clock;
+	/* The system clock is never changed back to, so it can be read without the lock */
+	if (K_GHOST_IO_CLOCK_SYSTEM == __atomic_load_n(&clock_p->mode, __ATOMIC_ACQUIRE))
+	{
+		now_ns = k_ghost_io_system_ns();
+	}
+	else
+	{
+		/* Read on every timestamp of every thread, a change of pace makes the reader retry rather than wait for the lock */
+		k_ghost_io_clock_t pace;
+		uint32_t		   sequence = 0;
+		do
+		{
+			sequence			 = __atomic_load_n(&clock_p->sequence, __ATOMIC_ACQUIRE);
+			pace.mode			 = __atomic_load_n(&clock_p->mode, __ATOMIC_RELAXED);
+			pace.base_real_ns	 = __atomic_load_n(&clock_p->base_real_ns, __ATOMIC_RELAXED);
+			pace.base_virtual_ns = __atomic_load_n(&clock_p->base_virtual_ns, __ATOMIC_RELAXED);
+			__atomic_load(&clock_p->scale, &pace.scale, __ATOMIC_RELAXED);
+			/* The monotonic clock is read before the check too: a clock paused meanwhile is never seen past its pause */
+			now_ns = k_ghost_io_clock_at(&pace, k_ghost_io_system_ns());
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		} while ((sequence & 1) || sequence != __atomic_load_n(&clock_p->sequence, __ATOMIC_RELAXED));
+	}
+	return now_ns;
+}
+
+int64_t k_ghost_io_clock_wait(const int64_t wait_ns)
+{
+	int64_t				real_wait_ns = wait_ns;
+	k_ghost_io_clock_t *clock_p		 = &k_ghost_io_ctx.clock;
+	if (wait_ns >= 0 && K_GHOST_IO_CLOCK_SYSTEM != __atomic_load_n(&clock_p->mode, __ATOMIC_ACQUIRE))
+	{
+		pthread_mutex_lock(&clock_p->lock);
+		switch (clock_p->mode)
+		{
+			case K_GHOST_IO_CLOCK_SCALED:
+			{
+				/* Rounded up, waking up before the timer would only loop again; clamped for the slowest scales */
+				const double real_ns = ceil((double)wait_ns / clock_p->scale);
+				real_wait_ns		 = real_ns < (double)INT64_MAX ? (int64_t)real_ns : INT64_MAX;
+				break;
+			}
+			case K_GHOST_IO_CLOCK_PAUSED:
+				real_wait_ns = -1;
+				break;
+			case K_GHOST_IO_CLOCK_UNBOUNDED:
+				/* Nothing left to do until the next timer: skip the wait altogether */
+				k_ghost_io_clock_write(clock_p->mode, clock_p->scale, clock_p->base_real_ns, clock_p->base_virtual_ns + (uint64_t)wait_ns);
+				real_wait_ns = 0;
+				break;
+			case K_GHOST_IO_CLOCK_SYSTEM:
+			default:
+				break;
+		}
+		pthread_mutex_unlock(&clock_p->lock);
+	}
+	return real_wait_ns;
+}
+
+static uint64_t k_ghost_io_system_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * K_GHOST_IO_NS_PER_S + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t k_ghost_io_clock_at(const k_ghost_io_clock_t *pace_p, const uint64_t real_ns)
+{
+	uint64_t now_ns = pace_p->base_virtual_ns;
+	switch (pace_p->mode)
+	{
+		case K_GHOST_IO_CLOCK_SYSTEM:
+			now_ns = real_ns;
+			break;
+		case K_GHOST_IO_CLOCK_SCALED:
+			now_ns += (uint64_t)((double)(real_ns - pace_p->base_real_ns) * pace_p->scale);
+			break;
+		case K_GHOST_IO_CLOCK_PAUSED:
+		case K_GHOST_IO_CLOCK_UNBOUNDED:
+		default:
+			break;
+	}
+	return now_ns;
+}
+
+static void k_ghost_io_clock_write(const k_ghost_io_clock_mode_t mode, const double scale, const uint64_t base_real_ns, const uint64_t base_virtual_ns)
+{
+	k_ghost_io_clock_t *clock_p	 = &k_ghost_io_ctx.clock;
+	const uint32_t		sequence = clock_p->sequence;
+	__atomic_store_n(&clock_p->sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store(&clock_p->scale, &scale, __ATOMIC_RELAXED);
+	__atomic_store_n(&clock_p->base_real_ns, base_real_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&clock_p->base_virtual_ns, base_virtual_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&clock_p->mode, mode, __ATOMIC_RELEASE);
+	__atomic_store_n(&clock_p->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+static void k_ghost_io_clock_rebase(const k_ghost_io_clock_mode_t mode, const double scale)
+{
+	k_ghost_io_clock_t *clock_p = &k_ghost_io_ctx.clock;
+	const uint64_t		real_ns = k_ghost_io_system_ns();
+	k_ghost_io_clock_write(mode, scale, real_ns, k_ghost_io_clock_at(clock_p, real_ns));
+}
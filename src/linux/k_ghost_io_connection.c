@@ -0,0 +1,523 @@
+/**
+ * @file k_ghost_io_connection.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Read the headers of a request to know how its body is framed.
+ *
+ * @param headers_p Headers of the request, as scanned by k_ghost_io_scan_headers
+ * @param content_length_p Set to the value of Content-Length, 0 if missing
+ * @param expect_continue_p Set if the client waits for 100 Continue before sending the body
+ *
+ * @return State the body starts in. K_GHOST_IO_BODY_COMPLETE if the request has no body, K_GHOST_IO_BODY_HEADERS if
+ *         the framing is invalid.
+ */
+static k_ghost_io_body_state_t k_ghost_io_parse_framing(const k_ghost_io_headers_t *headers_p, size_t *content_length_p, int *expect_continue_p);
+
+/**
+ * @brief Check whether a request was received in full by a single read.
+ *
+ * @param data Bytes read, NUL terminated
+ * @param len Number of bytes read
+ * @param header_len_p Filled with the length of the headers, blank line included, when they are complete
+ *
+ * @return 1 if the request is complete, 0 otherwise.
+ */
+static int k_ghost_io_request_complete(const char *data, size_t len, size_t *header_len_p);
+
+/**
+ * @brief Buffer the bytes of a request whose headers are not complete yet, and start its body once they are.
+ *
+ * @param connection_p State of the connection
+ * @param client_fd File descriptor of the client
+ * @param data Bytes read
+ * @param len Number of bytes read
+ *
+ * @return 0 on success, -1 if the request was answered with an error and the connection closed.
+ */
+static int k_ghost_io_receive_headers(k_ghost_io_connection_t *connection_p, int client_fd, const char *data, size_t len);
+
+/**
+ * @brief Set up the body of a request whose headers are complete, and decode the body bytes read with the headers.
+ *
+ * @param connection_p State of the connection, with the body bytes at the end of the buffer
+ * @param client_fd File descriptor of the client
+ * @param expect_continue Set if the client waits for 100 Continue before sending the body
+ *
+ * @return 0 on success, -1 if the request was answered with an error and the connection closed.
+ */
+static int k_ghost_io_start_body(k_ghost_io_connection_t *connection_p, int client_fd, int expect_continue);
+
+/**
+ * @brief Decode body bytes, framing included.
+ *
+ * @param connection_p State of the connection, past the headers
+ * @param client_fd File descriptor of the client
+ * @param data Body bytes
+ * @param len Number of body bytes
+ *
+ * @return 0 on success, -1 if the request was answered with an error and the connection closed.
+ */
+static int k_ghost_io_receive_body(k_ghost_io_connection_t *connection_p, int client_fd, const char *data, size_t len);
+
+/**
+ * @brief Walk one byte of the framing of a chunked body: size lines, line breaks and trailer.
+ *
+ * @param connection_p State of the connection
+ * @param byte Byte to decode
+ *
+ * @return 0 on success, -1 if the framing is invalid.
+ */
+static int k_ghost_io_decode_chunk_framing(k_ghost_io_connection_t *connection_p, char byte);
+
+/**
+ * @brief Hand decoded body bytes to the stream callback, or append them to the request buffer.
+ *
+ * @param connection_p State of the connection
+ * @param client_fd File descriptor of the client
+ * @param data Decoded body bytes
+ * @param len Number of bytes
+ *
+ * @return 0 on success, -1 if the request was answered with an error and the connection closed.
+ */
+static int k_ghost_io_deliver_body(k_ghost_io_connection_t *connection_p, int client_fd, const char *data, size_t len);
+
+/**
+ * @brief Append bytes to the request buffer, growing it up to K_GHOST_IO_MAX_REQUEST_SIZE.
+ *
+ * @param connection_p State of the connection
+ * @param data Bytes to append. May be in the buffer itself, past its end
+ * @param len Number of bytes
+ *
+ * @return 0 on success, -1 if the request is too large or in case of allocation failure.
+ */
+static int k_ghost_io_buffer_append(k_ghost_io_connection_t *connection_p, const char *data, size_t len);
+
+/**
+ * @brief Answer a complete request: route a buffered request, make the last call of a streamed upload.
+ *
+ * @param connection_p State of the connection
+ * @param client_fd File descriptor of the client
+ *
+ * @return 0 if the I/O thread must keep watching the connection, 1 if it was closed or handed over.
+ */
+static int k_ghost_io_complete_request(k_ghost_io_connection_t *connection_p, int client_fd);
+
+/**
+ * @brief Answer a request with an error and close the connection. A streamed upload is reported as aborted.
+ *
+ * @param connection_p State of the connection
+ * @param client_fd File descriptor of the client
+ * @param response_id Response to send
+ */
+static void k_ghost_io_fail_request(k_ghost_io_connection_t *connection_p, int client_fd, k_ghost_io_response_id_t response_id);
+
+/**
+ * @brief Make the last call of an aborted upload and give back its admission slot.
+ *
+ * @param connection_p State of the connection, its stream name is freed
+ */
+static void k_ghost_io_abort_stream(k_ghost_io_connection_t *connection_p);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+int k_ghost_io_feed_connection(k_ghost_io_connection_t **connection_pp, const int client_fd, const char *data, const size_t len)
+{
+	int	   released	  = 1;
+	size_t header_len = 0;
+	if (!*connection_pp && k_ghost_io_request_complete(data, len, &header_len))
+	{
+		/* Whole request in a single read, the common case: routed from the read buffer without any state, nor a second scan */
+		released = k_ghost_io_manage_request(client_fd, data, header_len);
+	}
+	else
+	{
+		if (!*connection_pp)
+		{
+			*connection_pp = calloc(1, sizeof(k_ghost_io_connection_t));
+		}
+		if (!*connection_pp)
+		{
+			close(client_fd);
+		}
+		else if (0 == (K_GHOST_IO_BODY_HEADERS == (*connection_pp)->state ? k_ghost_io_receive_headers(*connection_pp, client_fd, data, len)
+																			: k_ghost_io_receive_body(*connection_pp, client_fd, data, len)))
+		{
+			released = K_GHOST_IO_BODY_COMPLETE == (*connection_pp)->state ? k_ghost_io_complete_request(*connection_pp, client_fd) : 0;
+		}
+
+		/* Request answered, or connection closed on error: the next request starts from a clean state */
+		if (*connection_pp && (released || K_GHOST_IO_BODY_COMPLETE == (*connection_pp)->state))
+		{
+			free((*connection_pp)->buffer);
+			free(*connection_pp);
+			*connection_pp = NULL;
+		}
+	}
+	return released;
+}
+
+void k_ghost_io_abort_connection(k_ghost_io_connection_t **connection_pp)
+{
+	if (*connection_pp)
+	{
+		k_ghost_io_abort_stream(*connection_pp);
+		free((*connection_pp)->buffer);
+		free(*connection_pp);
+		*connection_pp = NULL;
+	}
+}
+
+static k_ghost_io_body_state_t k_ghost_io_parse_framing(const k_ghost_io_headers_t *headers_p, size_t *content_length_p, int *expect_continue_p)
+{
+	k_ghost_io_body_state_t			 state			   = K_GHOST_IO_BODY_COMPLETE;
+	const k_ghost_io_header_value_t *content_length	   = &headers_p->values[K_GHOST_IO_HEADER_CONTENT_LENGTH];
+	const k_ghost_io_header_value_t *transfer_encoding = &headers_p->values[K_GHOST_IO_HEADER_TRANSFER_ENCODING];
+	const k_ghost_io_header_value_t *expect			   = &headers_p->values[K_GHOST_IO_HEADER_EXPECT];
+	*content_length_p								   = 0;
+	*expect_continue_p								   = 0;
+	if (expect->len == strlen("100-continue") && 0 == strncasecmp(expect->value, "100-continue", expect->len))
+	{
+		*expect_continue_p = 1;
+	}
+	if (transfer_encoding->value)
+	{
+		/* chunked is the only coding understood, and it must come last. It overrides Content-Length */
+		const size_t chunked_len = strlen("chunked");
+		if (transfer_encoding->len >= chunked_len && 0 == strncasecmp(transfer_encoding->value + transfer_encoding->len - chunked_len, "chunked", chunked_len))
+		{
+			state = K_GHOST_IO_BODY_CHUNK_SIZE;
+		}
+		else
+		{
+			state = K_GHOST_IO_BODY_HEADERS;
+		}
+	}
+	else if (content_length->value)
+	{
+		size_t length = 0;
+		for (size_t i = 0; i < content_length->len && K_GHOST_IO_BODY_HEADERS != state; i++)
+		{
+			if (!isdigit((unsigned char)content_length->value[i]) || length > (SIZE_MAX - 9) / 10)
+			{
+				state = K_GHOST_IO_BODY_HEADERS;
+			}
+			length = length * 10 + (size_t)(content_length->value[i] - '0');
+		}
+		if (0 == content_length->len)
+		{
+			state = K_GHOST_IO_BODY_HEADERS;
+		}
+		else if (K_GHOST_IO_BODY_HEADERS != state)
+		{
+			/* Without a body to wait for, the request is complete with its headers */
+			*content_length_p = length;
+			state			  = length ? K_GHOST_IO_BODY_LENGTH : K_GHOST_IO_BODY_COMPLETE;
+		}
+	}
+	return state;
+}
+
+static int k_ghost_io_request_complete(const char *data, const size_t len, size_t *header_len_p)
+{
+	int					 ret_code = 0;
+	k_ghost_io_headers_t headers;
+	if (0 == k_ghost_io_scan_headers(data, len, &headers))
+	{
+		*header_len_p = headers.header_len;
+		size_t						  content_length  = 0;
+		int							  expect_continue = 0;
+		const k_ghost_io_body_state_t state			  = k_ghost_io_parse_framing(&headers, &content_length, &expect_continue);
+		ret_code = K_GHOST_IO_BODY_COMPLETE == state || (K_GHOST_IO_BODY_LENGTH == state && len - headers.header_len >= content_length);
+	}
+	return ret_code;
+}
+
+static int k_ghost_io_receive_headers(k_ghost_io_connection_t *connection_p, const int client_fd, const char *data, const size_t len)
+{
+	int ret_code = 0;
+	/* Only the new bytes are scanned, plus the end of the previous read where the blank line may have started */
+	const size_t scan_start = connection_p->buffer_len > 3 ? connection_p->buffer_len - 3 : 0;
+	if (0 != k_ghost_io_buffer_append(connection_p, data, len))
+	{
+		k_ghost_io_fail_request(connection_p, client_fd, K_GHOST_IO_RESPONSE_CONTENT_TOO_LARGE);
+		ret_code = -1;
+	}
+	else
+	{
+		k_ghost_io_headers_t headers;
+		if (k_ghost_io_find_header_end(connection_p->buffer + scan_start, connection_p->buffer_len - scan_start) &&
+			0 == k_ghost_io_scan_headers(connection_p->buffer, connection_p->buffer_len, &headers))
+		{
+			int expect_continue		 = 0;
+			connection_p->header_len = headers.header_len;
+			connection_p->state		 = k_ghost_io_parse_framing(&headers, &connection_p->body_left, &expect_continue);
+			if (K_GHOST_IO_BODY_HEADERS == connection_p->state)
+			{
+				k_ghost_io_fail_request(connection_p, client_fd, K_GHOST_IO_RESPONSE_BAD_REQUEST);
+				ret_code = -1;
+			}
+			else if (K_GHOST_IO_BODY_COMPLETE != connection_p->state)
+			{
+				ret_code = k_ghost_io_start_body(connection_p, client_fd, expect_continue);
+			}
+		}
+	}
+	return ret_code;
+}
+
+static int k_ghost_io_start_body(k_ghost_io_connection_t *connection_p, const int client_fd, const int expect_continue)
+{
+	int ret_code = 0;
+	k_ghost_io_registry_read_begin();
+	k_ghost_io_interface_t *interface_p = k_ghost_io_find_stream_interface(connection_p->buffer);
+	if (interface_p && 0 != k_ghost_io_admit_request(interface_p))
+	{
+		/* Refused before the client sends the rest of the upload */
+		k_ghost_io_shed_request(client_fd);
+		close(client_fd);
+		ret_code = -1;
+	}
+	else if (interface_p)
+	{
+		/* Kept by the admission until the upload is answered, every chunk checks it was not unregistered in between */
+		connection_p->stream_interface_p = interface_p;
+		connection_p->stream.total_len	 = K_GHOST_IO_BODY_LENGTH == connection_p->state ? connection_p->body_left : 0;
+	}
+	k_ghost_io_registry_read_end();
+
+	if (0 == ret_code)
+	{
+		/* The bytes read with the headers are decoded in place: the decoded body is never longer than its encoding */
+		const size_t body_len	 = connection_p->buffer_len - connection_p->header_len;
+		connection_p->buffer_len = connection_p->header_len;
+		if (expect_continue && 0 == body_len)
+		{
+			k_ghost_io_send_static_response(client_fd, K_GHOST_IO_RESPONSE_CONTINUE, 0);
+		}
+		ret_code = k_ghost_io_receive_body(connection_p, client_fd, connection_p->buffer + connection_p->header_len, body_len);
+	}
+	return ret_code;
+}
+
+static int k_ghost_io_receive_body(k_ghost_io_connection_t *connection_p, const int client_fd, const char *data, const size_t len)
+{
+	int	   ret_code = 0;
+	size_t i		= 0;
+	while (0 == ret_code && i < len && K_GHOST_IO_BODY_COMPLETE != connection_p->state)
+	{
+		if (K_GHOST_IO_BODY_LENGTH == connection_p->state || K_GHOST_IO_BODY_CHUNK_DATA == connection_p->state)
+		{
+			/* Payload bytes are handed over in one go, only the framing is walked byte by byte */
+			const size_t span = len - i < connection_p->body_left ? len - i : connection_p->body_left;
+			ret_code		  = k_ghost_io_deliver_body(connection_p, client_fd, data + i, span);
+			connection_p->body_left -= span;
+			i += span;
+			if (0 == connection_p->body_left)
+			{
+				connection_p->state = K_GHOST_IO_BODY_LENGTH == connection_p->state ? K_GHOST_IO_BODY_COMPLETE : K_GHOST_IO_BODY_CHUNK_END;
+			}
+		}
+		else if (0 != k_ghost_io_decode_chunk_framing(connection_p, data[i++]))
+		{
+			k_ghost_io_fail_request(connection_p, client_fd, K_GHOST_IO_RESPONSE_BAD_REQUEST);
+			ret_code = -1;
+		}
+	}
+	return ret_code;
+}
+
+static int k_ghost_io_decode_chunk_framing(k_ghost_io_connection_t *connection_p, const char byte)
+{
+	int ret_code = 0;
+	switch (connection_p->state)
+	{
+		case K_GHOST_IO_BODY_CHUNK_SIZE:
+		case K_GHOST_IO_BODY_CHUNK_EXT:
+			if ('\n' == byte)
+			{
+				/* End of the size line: data follows, or the trailer after the last chunk */
+				ret_code				   = connection_p->chunk_digits ? 0 : -1;
+				connection_p->state		   = connection_p->body_left ? K_GHOST_IO_BODY_CHUNK_DATA : K_GHOST_IO_BODY_TRAILER;
+				connection_p->chunk_digits = 0;
+				connection_p->line_len	   = 0;
+			}
+			else if ('\r' == byte || K_GHOST_IO_BODY_CHUNK_EXT == connection_p->state)
+			{
+				/* Chunk extensions are ignored */
+			}
+			else if (isxdigit((unsigned char)byte) && connection_p->body_left <= SIZE_MAX / 16)
+			{
+				const int digit			= isdigit((unsigned char)byte) ? byte - '0' : tolower((unsigned char)byte) - 'a' + 10;
+				connection_p->body_left = connection_p->body_left * 16 + (size_t)digit;
+				connection_p->chunk_digits++;
+			}
+			else if (';' == byte || ' ' == byte || '\t' == byte)
+			{
+				connection_p->state = K_GHOST_IO_BODY_CHUNK_EXT;
+			}
+			else
+			{
+				ret_code = -1;
+			}
+			break;
+		case K_GHOST_IO_BODY_CHUNK_END:
+			if ('\n' == byte)
+			{
+				connection_p->state = K_GHOST_IO_BODY_CHUNK_SIZE;
+			}
+			else if ('\r' != byte)
+			{
+				ret_code = -1;
+			}
+			break;
+		case K_GHOST_IO_BODY_TRAILER:
+			if ('\n' == byte)
+			{
+				/* Trailer fields are skipped, the empty line ends the request */
+				connection_p->state	   = connection_p->line_len ? K_GHOST_IO_BODY_TRAILER : K_GHOST_IO_BODY_COMPLETE;
+				connection_p->line_len = 0;
+			}
+			else if ('\r' != byte)
+			{
+				connection_p->line_len++;
+			}
+			break;
+		default:
+			ret_code = -1;
+			break;
+	}
+	return ret_code;
+}
+
+static int k_ghost_io_deliver_body(k_ghost_io_connection_t *connection_p, const int client_fd, const char *data, const size_t len)
+{
+	int ret_code = 0;
+	if (connection_p->stream_interface_p)
+	{
+		k_ghost_io_registry_read_begin();
+		k_ghost_io_interface_t *interface_p = connection_p->stream_interface_p;
+		if (k_ghost_io_interface_removed(interface_p))
+		{
+			k_ghost_io_fail_request(connection_p, client_fd, K_GHOST_IO_RESPONSE_NOT_FOUND);
+			ret_code = -1;
+		}
+		else if (0 != interface_p->stream_cb(&connection_p->stream, data, len, interface_p->user_data_p))
+		{
+			k_ghost_io_fail_request(connection_p, client_fd, K_GHOST_IO_RESPONSE_INTERNAL_ERROR);
+			ret_code = -1;
+		}
+		else
+		{
+			connection_p->stream.offset += len;
+		}
+		k_ghost_io_registry_read_end();
+	}
+	else if (0 != k_ghost_io_buffer_append(connection_p, data, len))
+	{
+		k_ghost_io_fail_request(connection_p, client_fd, K_GHOST_IO_RESPONSE_CONTENT_TOO_LARGE);
+		ret_code = -1;
+	}
+	return ret_code;
+}
+
+static int k_ghost_io_buffer_append(k_ghost_io_connection_t *connection_p, const char *data, const size_t len)
+{
+	int ret_code = 0;
+	if (len > K_GHOST_IO_MAX_REQUEST_SIZE - connection_p->buffer_len)
+	{
+		ret_code = -1;
+	}
+	else if (connection_p->buffer_len + len > connection_p->buffer_capacity)
+	{
+		/* Only grown for bytes coming from a read, never for a body decoded in place */
+		size_t capacity = 2 * (connection_p->buffer_len + len);
+		capacity		= capacity < K_GHOST_IO_MAX_REQUEST_SIZE ? capacity : K_GHOST_IO_MAX_REQUEST_SIZE;
+		char *buffer	= realloc(connection_p->buffer, capacity + 1);
+		if (buffer)
+		{
+			connection_p->buffer		  = buffer;
+			connection_p->buffer_capacity = capacity;
+		}
+		else
+		{
+			ret_code = -1;
+		}
+	}
+	if (0 == ret_code)
+	{
+		memmove(connection_p->buffer + connection_p->buffer_len, data, len);
+		connection_p->buffer_len += len;
+		connection_p->buffer[connection_p->buffer_len] = '\0';
+	}
+	return ret_code;
+}
+
+static int k_ghost_io_complete_request(k_ghost_io_connection_t *connection_p, const int client_fd)
+{
+	int released = 1;
+	if (connection_p->stream_interface_p)
+	{
+		k_ghost_io_registry_read_begin();
+		k_ghost_io_interface_t *interface_p = connection_p->stream_interface_p;
+		if (k_ghost_io_interface_removed(interface_p))
+		{
+			k_ghost_io_send_static_response(client_fd, K_GHOST_IO_RESPONSE_NOT_FOUND, 0);
+			k_ghost_io_release_request(interface_p);
+			close(client_fd);
+		}
+		else if (!k_ghost_io_finish_stream(client_fd, interface_p, &connection_p->stream))
+		{
+			k_ghost_io_release_request(interface_p);
+			close(client_fd);
+		}
+		k_ghost_io_registry_read_end();
+	}
+	else
+	{
+		released = k_ghost_io_manage_request(client_fd, connection_p->buffer, connection_p->header_len);
+	}
+	return released;
+}
+
+static void k_ghost_io_fail_request(k_ghost_io_connection_t *connection_p, const int client_fd, const k_ghost_io_response_id_t response_id)
+{
+	k_ghost_io_abort_stream(connection_p);
+	k_ghost_io_send_static_response(client_fd, response_id, 0);
+	close(client_fd);
+}
+
+static void k_ghost_io_abort_stream(k_ghost_io_connection_t *connection_p)
+{
+	if (connection_p->stream_interface_p)
+	{
+		/* Last call, for the callback to drop what it kept of the upload */
+		k_ghost_io_registry_read_begin();
+		k_ghost_io_interface_t *interface_p = connection_p->stream_interface_p;
+		if (!k_ghost_io_interface_removed(interface_p))
+		{
+			connection_p->stream.done = -1;
+			interface_p->stream_cb(&connection_p->stream, NULL, 0, interface_p->user_data_p);
+		}
+		connection_p->stream_interface_p = NULL;
+		k_ghost_io_release_request(interface_p);
+		k_ghost_io_registry_read_end();
+	}
+}
@@ -0,0 +1,485 @@
+/**
+ * @file k_ghost_io_farm.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_FARM_INDEX_DIGITS 4	//!< Least number of digits of the instance indexes in their names, zero padded
+
+#define K_GHOST_IO_FARM_NAME_ROOM 22  //!< Room for the '/', the index of an instance and the NUL after the farm name
+
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Find a device farm. Must hold the farm lock.
+ *
+ * @param farm_name Name of the farm, not necessarily NUL terminated
+ * @param name_len Length of the name
+ *
+ * @return Pointer to the link pointing to the farm, pointing to NULL if there is none
+ */
+static k_ghost_io_farm_t **k_ghost_io_find_farm(const char *farm_name, size_t name_len);
+
+/**
+ * @brief Size of a column, rounded up so that the next one starts on a cache line.
+ *
+ * @param field_p Field of the column
+ * @param count Number of instances
+ *
+ * @return Size of the column in bytes
+ */
+static size_t k_ghost_io_column_size(const k_ghost_io_field_t *field_p, size_t count);
+
+/**
+ * @brief Copy an instance between its struct and the columns of its farm. Must hold the farm lock.
+ *
+ * @param farm_p Device farm
+ * @param index Index of the instance
+ * @param instance_p Instance struct
+ * @param to_columns Set to copy the struct into the columns, clear to fill the struct
+ */
+static void k_ghost_io_copy_instance(k_ghost_io_farm_t *farm_p, size_t index, void *instance_p, int to_columns);
+
+/**
+ * @brief Mark the instances whose field moved far enough to be published, one pass over the column. Must hold the farm lock.
+ *
+ * @param farm_p Device farm
+ * @param field_index Index of the field in the schema
+ */
+static void k_ghost_io_mark_changes(k_ghost_io_farm_t *farm_p, size_t field_index);
+
+/**
+ * @brief Format fields of an instance as a JSON object. Must hold the farm lock.
+ *
+ * @param farm_p Device farm
+ * @param index Index of the instance
+ * @param fields Fields to format, one bit each
+ * @param out Where to write the object, event_size bytes at least
+ *
+ * @return Length of the object
+ */
+static size_t k_ghost_io_format_instance(const k_ghost_io_farm_t *farm_p, size_t index, uint64_t fields, char *out);
+
+/**
+ * @brief Timer callback of a farm: update all the instances, then publish the ones that moved.
+ *
+ * @param user_data_p Device farm
+ */
+static void k_ghost_io_tick_farm(void *user_data_p);
+
+/**
+ * @brief Check a snapshot record against a farm: size of the columns and termination of the strings. Must hold the farm lock.
+ *
+ * @param farm_p Farm the record is for
+ * @param data Data of the record
+ * @param data_len Length of the data
+ *
+ * @return 1 if the record can be restored, 0 otherwise.
+ */
+static int k_ghost_io_farm_record_valid(const k_ghost_io_farm_t *farm_p, const char *data, size_t data_len);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+k_ghost_io_register_ret_code_t k_ghost_io_add_farm(const char *farm_name, const k_ghost_io_state_schema_t *state_schema_p, const size_t count, const uint64_t period_us,
+												   k_ghost_io_farm_tick_t tick_cb, void *user_data_p)
+{
+	k_ghost_io_register_ret_code_t ret_code = K_GHOST_REGISTER_RET_CODE_ERROR;
+	const k_ghost_io_schema_t	  *schema_p = state_schema_p ? &state_schema_p->schema : NULL;
+	if (farm_name && count && period_us && tick_cb && 0 == k_ghost_io_check_schema(schema_p) && schema_p->fields_count)
+	{
+		/* Current and published columns in one block, each column on its own cache lines */
+		size_t values_size = 0;
+		for (size_t i = 0; i < schema_p->fields_count; i++)
+		{
+			values_size += 2 * k_ghost_io_column_size(&schema_p->fields[i], count);
+		}
+		const size_t	   name_len = strlen(farm_name);
+		k_ghost_io_farm_t *farm_p	= calloc(1, sizeof(k_ghost_io_farm_t) + 2 * schema_p->fields_count * sizeof(void *));
+		char			  *values	= farm_p ? aligned_alloc(K_GHOST_IO_CACHE_LINE_SIZE, values_size) : NULL;
+		uint64_t		  *changed	= values ? calloc(count, sizeof(uint64_t)) : NULL;
+		char			  *event	= changed ? malloc(k_ghost_io_state_event_size(schema_p)) : NULL;
+		char			  *names	= event ? malloc(2 * (name_len + K_GHOST_IO_FARM_NAME_ROOM)) : NULL;
+		if (names)
+		{
+			memset(values, 0, values_size);
+			/* The farm name, then the buffer the names of the instances are formatted into */
+			memcpy(names, farm_name, name_len + 1);
+			char *column = values;
+			for (size_t i = 0; i < 2 * schema_p->fields_count; i++)
+			{
+				farm_p->columns[i] = column;
+				column += k_ghost_io_column_size(&schema_p->fields[i % schema_p->fields_count], count);
+			}
+			farm_p->farm_name	  = names;
+			farm_p->name_len	  = name_len;
+			farm_p->schema_p	  = schema_p;
+			farm_p->state_fields  = state_schema_p->state_fields;
+			farm_p->count		  = count;
+			farm_p->tick_cb		  = tick_cb;
+			farm_p->user_data_p	  = user_data_p;
+			farm_p->forced		  = 1;
+			farm_p->changed		  = changed;
+			farm_p->event		  = event;
+			farm_p->event_size	  = k_ghost_io_state_event_size(schema_p);
+			farm_p->instance_name = names + name_len + K_GHOST_IO_FARM_NAME_ROOM;
+			farm_p->values		  = values;
+			farm_p->last_tick_ns  = k_ghost_io_now_ns();
+			pthread_mutex_lock(&k_ghost_io_ctx.farm_lock);
+			if (*k_ghost_io_find_farm(farm_name, name_len))
+			{
+				ret_code = K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED;
+			}
+			else
+			{
+				const uint64_t period_ns = period_us * 1000;
+				farm_p->timer			 = k_ghost_io_schedule_ns(period_ns, period_ns, k_ghost_io_tick_farm, farm_p);
+				if (farm_p->timer)
+				{
+					farm_p->next_farm	 = k_ghost_io_ctx.farms;
+					k_ghost_io_ctx.farms = farm_p;
+					farm_p				 = NULL;
+					ret_code			 = K_GHOST_REGISTER_RET_CODE_OK;
+				}
+			}
+			pthread_mutex_unlock(&k_ghost_io_ctx.farm_lock);
+		}
+		if (farm_p)
+		{
+			free(names);
+			free(event);
+			free(changed);
+			free(values);
+			free(farm_p);
+		}
+	}
+	return ret_code;
+}
+
+int k_ghost_io_set_farm_instance(const char *farm_name, const size_t index, const void *instance_p)
+{
+	int ret_code = -1;
+	if (farm_name && instance_p)
+	{
+		pthread_mutex_lock(&k_ghost_io_ctx.farm_lock);
+		k_ghost_io_farm_t *farm_p = *k_ghost_io_find_farm(farm_name, strlen(farm_name));
+		if (farm_p && index < farm_p->count)
+		{
+			k_ghost_io_copy_instance(farm_p, index, (void *)instance_p, 1);
+			ret_code = 0;
+		}
+		pthread_mutex_unlock(&k_ghost_io_ctx.farm_lock);
+	}
+	return ret_code;
+}
+
+int k_ghost_io_get_farm_instance(const char *farm_name, const size_t index, void *instance_p)
+{
+	int ret_code = -1;
+	if (farm_name && instance_p)
+	{
+		pthread_mutex_lock(&k_ghost_io_ctx.farm_lock);
+		k_ghost_io_farm_t *farm_p = *k_ghost_io_find_farm(farm_name, strlen(farm_name));
+		if (farm_p && index < farm_p->count)
+		{
+			k_ghost_io_copy_instance(farm_p, index, instance_p, 0);
+			ret_code = 0;
+		}
+		pthread_mutex_unlock(&k_ghost_io_ctx.farm_lock);
+	}
+	return ret_code;
+}
+
+void k_ghost_io_remove_farm(const char *farm_name)
+{
+	if (farm_name)
+	{
+		pthread_mutex_lock(&k_ghost_io_ctx.farm_lock);
+		k_ghost_io_farm_t **link_pp = k_ghost_io_find_farm(farm_name, strlen(farm_name));
+		k_ghost_io_farm_t  *farm_p	= *link_pp;
+		if (farm_p)
+		{
+			*link_pp = farm_p->next_farm;
+		}
+		pthread_mutex_unlock(&k_ghost_io_ctx.farm_lock);
+		if (farm_p)
+		{
+			/* Waits for a tick in progress, the farm is no longer found by the next ones */
+			k_ghost_io_cancel(farm_p->timer);
+			free(farm_p->farm_name);
+			free(farm_p->event);
+			free(farm_p->changed);
+			free(farm_p->values);
+			free(farm_p);
+		}
+	}
+}
+
+void k_ghost_io_force_farms(void)
+{
+	pthread_mutex_lock(&k_ghost_io_ctx.farm_lock);
+	for (k_ghost_io_farm_t *farm_p = k_ghost_io_ctx.farms; farm_p; farm_p = farm_p->next_farm)
+	{
+		farm_p->forced = 1;
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.farm_lock);
+}
+
+int k_ghost_io_manage_farm_request(const int client_fd, const char *name, const size_t name_len, const char *request_body)
+{
+	int	   ret_code	 = -1;
+	size_t farm_len	 = name_len;
+	size_t index	 = 0;
+	size_t digits	 = 0;
+	char  *response	 = NULL;
+	size_t resp_len	 = 0;
+	int	   malformed = 0;
+	while (farm_len && '/' != name[farm_len - 1])
+	{
+		farm_len--;
+	}
+	/* Only the canonical name of an instance, so that requests and events agree on it: "0042", not "42" nor "00042" */
+	for (const char *cursor = name + farm_len; farm_len && cursor < name + name_len && *cursor >= '0' && *cursor <= '9' && digits < 20; cursor++)
+	{
+		index = index * 10 + (size_t)(*cursor - '0');
+		digits++;
+	}
+	char canonical[K_GHOST_IO_FARM_NAME_ROOM];
+	if (farm_len > 1 && digits == name_len - farm_len && (int)digits == snprintf(canonical, sizeof(canonical), "%0*zu", K_GHOST_IO_FARM_INDEX_DIGITS, index))
+	{
+		pthread_mutex_lock(&k_ghost_io_ctx.farm_lock);
+		k_ghost_io_farm_t *farm_p = *k_ghost_io_find_farm(name, farm_len - 1);
+		if (farm_p && index < farm_p->count)
+		{
+			k_ghost_io_record(K_GHOST_IO_TRACE_ROUTE, name, name_len, request_body, strlen(request_body));
+			/* Decoded over the current values, the fields missing from the body keep them */
+			void *instance_p = malloc(farm_p->schema_p->command_size);
+			response		 = instance_p ? malloc(K_GHOST_IO_RESPONSE_HEAD_SIZE + farm_p->event_size) : NULL;
+			if (response)
+			{
+				k_ghost_io_copy_instance(farm_p, index, instance_p, 0);
+				malformed = 0 != k_ghost_io_decode_command(farm_p->schema_p, request_body, instance_p);
+				if (!malformed)
+				{
+					k_ghost_io_copy_instance(farm_p, index, instance_p, 1);
+					const size_t body_len = k_ghost_io_format_instance(farm_p, index, UINT64_MAX, farm_p->event);
+					resp_len			  = k_ghost_io_format_response_head(response, 200, NULL, body_len);
+					memcpy(response + resp_len, farm_p->event, body_len);
+					resp_len += body_len;
+				}
+			}
+			free(instance_p);
+			ret_code = 0;
+		}
+		pthread_mutex_unlock(&k_ghost_io_ctx.farm_lock);
+	}
+	if (0 == ret_code)
+	{
+		if (resp_len)
+		{
+			send(client_fd, response, resp_len, 0);
+		}
+		else
+		{
+			k_ghost_io_send_static_response(client_fd, malformed ? K_GHOST_IO_RESPONSE_BAD_REQUEST : K_GHOST_IO_RESPONSE_INTERNAL_ERROR, 0);
+		}
+	}
+	free(response);
+	return ret_code;
+}
+
+void k_ghost_io_snapshot_farms(k_ghost_io_snapshot_writer_t *writer_p)
+{
+	pthread_mutex_lock(&k_ghost_io_ctx.farm_lock);
+	for (const k_ghost_io_farm_t *farm_p = k_ghost_io_ctx.farms; farm_p; farm_p = farm_p->next_farm)
+	{
+		const k_ghost_io_schema_t *schema_p = farm_p->schema_p;
+		size_t					   data_len = sizeof(uint64_t);
+		for (size_t i = 0; i < schema_p->fields_count; i++)
+		{
+			data_len += farm_p->count * schema_p->fields[i].size;
+		}
+		if (0 == k_ghost_io_snapshot_record(writer_p, K_GHOST_IO_SNAPSHOT_FARM, farm_p->farm_name, data_len))
+		{
+			const uint64_t remaining_ns = k_ghost_io_timer_remaining_ns(farm_p->timer);
+			k_ghost_io_snapshot_append(writer_p, &remaining_ns, sizeof(remaining_ns));
+			for (size_t i = 0; i < schema_p->fields_count; i++)
+			{
+				k_ghost_io_snapshot_append(writer_p, farm_p->columns[i], farm_p->count * schema_p->fields[i].size);
+			}
+		}
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.farm_lock);
+}
+
+int k_ghost_io_check_farm_record(const char *farm_name, const char *data, const size_t data_len)
+{
+	pthread_mutex_lock(&k_ghost_io_ctx.farm_lock);
+	const k_ghost_io_farm_t *farm_p	  = *k_ghost_io_find_farm(farm_name, strlen(farm_name));
+	const int				 ret_code = !farm_p || k_ghost_io_farm_record_valid(farm_p, data, data_len) ? 0 : -1;
+	pthread_mutex_unlock(&k_ghost_io_ctx.farm_lock);
+	return ret_code;
+}
+
+int k_ghost_io_restore_farm(const char *farm_name, const char *data, const size_t data_len)
+{
+	int ret_code = -1;
+	pthread_mutex_lock(&k_ghost_io_ctx.farm_lock);
+	k_ghost_io_farm_t *farm_p = *k_ghost_io_find_farm(farm_name, strlen(farm_name));
+	if (farm_p && k_ghost_io_farm_record_valid(farm_p, data, data_len))
+	{
+		uint64_t remaining_ns = 0;
+		memcpy(&remaining_ns, data, sizeof(remaining_ns));
+		data += sizeof(remaining_ns);
+		for (size_t i = 0; i < farm_p->schema_p->fields_count; i++)
+		{
+			memcpy(farm_p->columns[i], data, farm_p->count * farm_p->schema_p->fields[i].size);
+			data += farm_p->count * farm_p->schema_p->fields[i].size;
+		}
+		/* The clients saw the values before the restore, every instance is theirs again at the next tick */
+		farm_p->forced = 1;
+		ret_code	   = k_ghost_io_rearm_ns(farm_p->timer, remaining_ns);
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.farm_lock);
+	return ret_code;
+}
+
+static k_ghost_io_farm_t **k_ghost_io_find_farm(const char *farm_name, const size_t name_len)
+{
+	k_ghost_io_farm_t **link_pp = &k_ghost_io_ctx.farms;
+	while (*link_pp && (name_len != (*link_pp)->name_len || 0 != memcmp((*link_pp)->farm_name, farm_name, name_len)))
+	{
+		link_pp = (k_ghost_io_farm_t **)&(*link_pp)->next_farm;
+	}
+	return link_pp;
+}
+
+static size_t k_ghost_io_column_size(const k_ghost_io_field_t *field_p, const size_t count)
+{
+	return (count * field_p->size + K_GHOST_IO_CACHE_LINE_SIZE - 1) & ~(size_t)(K_GHOST_IO_CACHE_LINE_SIZE - 1);
+}
+
+static void k_ghost_io_copy_instance(k_ghost_io_farm_t *farm_p, const size_t index, void *instance_p, const int to_columns)
+{
+	for (size_t i = 0; i < farm_p->schema_p->fields_count; i++)
+	{
+		const k_ghost_io_field_t *field_p  = &farm_p->schema_p->fields[i];
+		char					 *member_p = (char *)instance_p + field_p->offset;
+		char					 *value_p  = (char *)farm_p->columns[i] + index * field_p->size;
+		memcpy(to_columns ? value_p : member_p, to_columns ? member_p : value_p, field_p->size);
+	}
+}
+
+static void k_ghost_io_mark_changes(k_ghost_io_farm_t *farm_p, const size_t field_index)
+{
+	const k_ghost_io_field_t *field_p	= &farm_p->schema_p->fields[field_index];
+	const char				 *current	= farm_p->columns[field_index];
+	const char				 *published = farm_p->columns[farm_p->schema_p->fields_count + field_index];
+	const uint64_t			  bit		= (uint64_t)1 << field_index;
+	const double			  deadband	= farm_p->state_fields ? farm_p->state_fields[field_index].deadband : 0.0;
+	uint64_t				 *changed	= farm_p->changed;
+	/* Doubles, the bulk of the sensor models, in a loop without calls that the compiler can vectorize. Same rules as the state store */
+	if (K_GHOST_IO_FIELD_DOUBLE == field_p->type && sizeof(double) == field_p->size)
+	{
+		const double *current_p	  = (const double *)current;
+		const double *published_p = (const double *)published;
+		for (size_t i = 0; i < farm_p->count; i++)
+		{
+			const double value = current_p[i];
+			const double last  = published_p[i];
+			const int	 moved = isnan(value) || isnan(last) ? isnan(value) != isnan(last) : fabs(value - last) > deadband;
+			changed[i] |= moved ? bit : 0;
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < farm_p->count; i++)
+		{
+			changed[i] |= k_ghost_io_state_moved(field_p, deadband, current + i * field_p->size, published + i * field_p->size) ? bit : 0;
+		}
+	}
+}
+
+static size_t k_ghost_io_format_instance(const k_ghost_io_farm_t *farm_p, const size_t index, const uint64_t fields, char *out)
+{
+	char *start = out;
+	*out++		= '{';
+	for (size_t i = 0; i < farm_p->schema_p->fields_count; i++)
+	{
+		if (fields >> i & 1)
+		{
+			const k_ghost_io_field_t *field_p = &farm_p->schema_p->fields[i];
+			out								  = k_ghost_io_format_member(field_p, out, (const char *)farm_p->columns[i] + index * field_p->size);
+		}
+	}
+	/* The last comma closes the object, an empty one has none */
+	out += out == start + 1 ? 1 : 0;
+	out[-1] = '}';
+	*out	= '\0';
+	return (size_t)(out - start);
+}
+
+static void k_ghost_io_tick_farm(void *user_data_p)
+{
+	k_ghost_io_farm_t		  *farm_p	= user_data_p;
+	const k_ghost_io_schema_t *schema_p = farm_p->schema_p;
+	const uint64_t			   now_ns	= k_ghost_io_ctx.timers.now_ns;
+	pthread_mutex_lock(&k_ghost_io_ctx.farm_lock);
+	farm_p->tick_cb(farm_p->columns, farm_p->count, now_ns - farm_p->last_tick_ns, farm_p->user_data_p);
+	farm_p->last_tick_ns = now_ns;
+	/* Column by column: each pass reads two contiguous arrays */
+	memset(farm_p->changed, farm_p->forced ? 0xFF : 0, farm_p->count * sizeof(uint64_t));
+	for (size_t i = 0; !farm_p->forced && i < schema_p->fields_count; i++)
+	{
+		k_ghost_io_mark_changes(farm_p, i);
+	}
+	farm_p->forced = 0;
+	for (size_t index = 0; index < farm_p->count; index++)
+	{
+		const uint64_t fields = farm_p->changed[index];
+		if (fields)
+		{
+			k_ghost_io_format_instance(farm_p, index, fields, farm_p->event);
+			for (size_t i = 0; i < schema_p->fields_count; i++)
+			{
+				/* The published values follow only the published changes, slow drifts add up until they cross the deadband */
+				const size_t size = schema_p->fields[i].size;
+				if (fields >> i & 1)
+				{
+					memcpy((char *)farm_p->columns[schema_p->fields_count + i] + index * size, (const char *)farm_p->columns[i] + index * size, size);
+				}
+			}
+			snprintf(farm_p->instance_name, farm_p->name_len + K_GHOST_IO_FARM_NAME_ROOM, "%s/%0*zu", farm_p->farm_name, K_GHOST_IO_FARM_INDEX_DIGITS, index);
+			k_ghost_io_send_interface_event(farm_p->instance_name, farm_p->event);
+		}
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.farm_lock);
+}
+
+static int k_ghost_io_farm_record_valid(const k_ghost_io_farm_t *farm_p, const char *data, const size_t data_len)
+{
+	size_t expected = sizeof(uint64_t);
+	for (size_t i = 0; i < farm_p->schema_p->fields_count; i++)
+	{
+		expected += farm_p->count * farm_p->schema_p->fields[i].size;
+	}
+	int valid = expected == data_len;
+	/* Strings from a corrupt or foreign file would be read past their member once published */
+	data += sizeof(uint64_t);
+	for (size_t i = 0; valid && i < farm_p->schema_p->fields_count; i++)
+	{
+		valid = 0 == k_ghost_io_check_string_members(&farm_p->schema_p->fields[i], data, farm_p->count);
+		data += farm_p->count * farm_p->schema_p->fields[i].size;
+	}
+	return valid;
+}
@@ -0,0 +1,287 @@
+/**
+ * @file k_ghost_io_faults.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_FAULT_NAME_SIZE 64  //!< Longest interface name accepted by the control endpoint, terminator included
+
+#define K_GHOST_IO_FAULT_MAX_DELAY_US 3600000000.0	//!< Longest delay accepted by the control endpoint, one hour
+
+/* Typedef -------------------------------------------------------------------*/
+typedef struct
+{
+	char	interface[K_GHOST_IO_FAULT_NAME_SIZE];	//!< Name of the interface
+	int64_t delay_us;								//!< See k_ghost_io_fault_profile_t
+	int64_t jitter_us;								//!< See k_ghost_io_fault_profile_t
+	double	error_rate;								//!< See k_ghost_io_fault_profile_t
+	double	reset_rate;								//!< See k_ghost_io_fault_profile_t
+	double	drop_rate;								//!< See k_ghost_io_fault_profile_t
+	double	duplicate_rate;							//!< See k_ghost_io_fault_profile_t
+	int64_t seed;									//!< See k_ghost_io_fault_profile_t
+} k_ghost_io_fault_request_t;
+
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Find the fault profile of an interface. Must hold the fault lock.
+ *
+ * @param interface_name Name of the interface, not NUL terminated
+ * @param name_len Length of the name
+ *
+ * @return Pointer to the link pointing to the profile, pointing to NULL if there is none
+ */
+static k_ghost_io_fault_t **k_ghost_io_find_fault(const char *interface_name, size_t name_len);
+
+/**
+ * @brief Timer callback of a delayed request: hand it to the workers, or run it right away without them.
+ *
+ * @param user_data_p Job of the request, queued or freed
+ */
+static void k_ghost_io_run_delayed_request(void *user_data_p);
+
+/* Constant ------------------------------------------------------------------*/
+static const k_ghost_io_field_t k_ghost_io_fault_fields[] = {
+	K_GHOST_IO_REQUIRED_FIELD(k_ghost_io_fault_request_t, interface, K_GHOST_IO_FIELD_STRING, 0, 0),
+	K_GHOST_IO_FIELD(k_ghost_io_fault_request_t, delay_us, K_GHOST_IO_FIELD_INT, 0, K_GHOST_IO_FAULT_MAX_DELAY_US),
+	K_GHOST_IO_FIELD(k_ghost_io_fault_request_t, jitter_us, K_GHOST_IO_FIELD_INT, 0, K_GHOST_IO_FAULT_MAX_DELAY_US),
+	K_GHOST_IO_FIELD(k_ghost_io_fault_request_t, error_rate, K_GHOST_IO_FIELD_DOUBLE, 0, 1),
+	K_GHOST_IO_FIELD(k_ghost_io_fault_request_t, reset_rate, K_GHOST_IO_FIELD_DOUBLE, 0, 1),
+	K_GHOST_IO_FIELD(k_ghost_io_fault_request_t, drop_rate, K_GHOST_IO_FIELD_DOUBLE, 0, 1),
+	K_GHOST_IO_FIELD(k_ghost_io_fault_request_t, duplicate_rate, K_GHOST_IO_FIELD_DOUBLE, 0, 1),
+	K_GHOST_IO_FIELD(k_ghost_io_fault_request_t, seed, K_GHOST_IO_FIELD_INT, 0, 0),
+};
+
+static const k_ghost_io_schema_t k_ghost_io_fault_schema = {k_ghost_io_fault_fields, sizeof(k_ghost_io_fault_fields) / sizeof(k_ghost_io_fault_fields[0]),
+															sizeof(k_ghost_io_fault_request_t)};
+
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+int k_ghost_io_set_faults(const char *interface_name, const k_ghost_io_fault_profile_t *profile_p)
+{
+	int ret_code = -1;
+	/* Written this way round, not a number is rejected too */
+	if (interface_name &&
+		(!profile_p || (profile_p->error_rate >= 0.0 && profile_p->error_rate <= 1.0 && profile_p->reset_rate >= 0.0 && profile_p->reset_rate <= 1.0 &&
+						profile_p->drop_rate >= 0.0 && profile_p->drop_rate <= 1.0 && profile_p->duplicate_rate >= 0.0 && profile_p->duplicate_rate <= 1.0)))
+	{
+		const size_t		name_len = strlen(interface_name);
+		const int			faulty	 = profile_p && (profile_p->delay_us || profile_p->jitter_us || profile_p->error_rate > 0.0 || profile_p->reset_rate > 0.0 ||
+												  profile_p->drop_rate > 0.0 || profile_p->duplicate_rate > 0.0);
+		k_ghost_io_fault_t *added_p	 = faulty ? malloc(sizeof(k_ghost_io_fault_t) + name_len + 1) : NULL;
+		if (added_p)
+		{
+			/* A new profile starts over from its seed */
+			added_p->profile   = *profile_p;
+			added_p->rng_state = profile_p->seed ? profile_p->seed : k_ghost_io_hash_name(interface_name, name_len) | 1ULL << 32;
+			added_p->name_len  = name_len;
+			memcpy(added_p->interface_name, interface_name, name_len + 1);
+		}
+		if (added_p || !faulty)
+		{
+			pthread_mutex_lock(&k_ghost_io_ctx.fault_lock);
+			k_ghost_io_fault_t **link_pp   = k_ghost_io_find_fault(interface_name, name_len);
+			k_ghost_io_fault_t	*removed_p = *link_pp;
+			if (removed_p)
+			{
+				__atomic_store_n(link_pp, (k_ghost_io_fault_t *)removed_p->next_fault, __ATOMIC_RELEASE);
+			}
+			if (added_p)
+			{
+				added_p->next_fault = k_ghost_io_ctx.faults;
+				__atomic_store_n(&k_ghost_io_ctx.faults, added_p, __ATOMIC_RELEASE);
+			}
+			pthread_mutex_unlock(&k_ghost_io_ctx.fault_lock);
+			free(removed_p);
+			ret_code = 0;
+		}
+	}
+	return ret_code;
+}
+
+int k_ghost_io_inject_fault(const int client_fd, k_ghost_io_interface_t *interface_p, const char *request_body, int *response_pending_p)
+{
+	int							  ret_code = -1;
+	uint64_t					  delay_ns = 0;
+	const k_ghost_io_fault_kind_t kind	   = k_ghost_io_draw_fault(interface_p, &delay_ns);
+	switch (kind)
+	{
+		case K_GHOST_IO_FAULT_RESET:
+		{
+			/* Closed with a zero linger time, the client gets a reset instead of the end of the stream */
+			const struct linger linger = {.l_onoff = 1, .l_linger = 0};
+			setsockopt(client_fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+			*response_pending_p = 0;
+			ret_code			= 0;
+			break;
+		}
+		case K_GHOST_IO_FAULT_ERROR:
+			k_ghost_io_send_static_response(client_fd, K_GHOST_IO_RESPONSE_INTERNAL_ERROR, 0);
+			*response_pending_p = 0;
+			ret_code			= 0;
+			break;
+		case K_GHOST_IO_FAULT_DELAY:
+		{
+			/* Without memory to keep the request, it is run at once */
+			k_ghost_io_job_t *job_p = k_ghost_io_new_job(interface_p, client_fd, request_body);
+			if (job_p && 0 == k_ghost_io_delay_job(job_p, delay_ns))
+			{
+				*response_pending_p = 1;
+				ret_code			= 0;
+			}
+			else
+			{
+				free(job_p);
+			}
+			break;
+		}
+		case K_GHOST_IO_FAULT_NONE:
+		default:
+			break;
+	}
+	return ret_code;
+}
+
+k_ghost_io_fault_kind_t k_ghost_io_draw_fault(const k_ghost_io_interface_t *interface_p, uint64_t *delay_ns_p)
+{
+	k_ghost_io_fault_kind_t kind = K_GHOST_IO_FAULT_NONE;
+	/* Without any profile, requests do not pay for the lock */
+	if (__atomic_load_n(&k_ghost_io_ctx.faults, __ATOMIC_ACQUIRE))
+	{
+		pthread_mutex_lock(&k_ghost_io_ctx.fault_lock);
+		k_ghost_io_fault_t *fault_p = *k_ghost_io_find_fault(interface_p->interface_name, ((const k_ghost_io_interface_entry_t *)interface_p)->name_len);
+		if (fault_p)
+		{
+			/* A single draw picks at most one failure, their rates add up */
+			const k_ghost_io_fault_profile_t *profile_p = &fault_p->profile;
+			const double					  draw		 = k_ghost_io_random(&fault_p->rng_state);
+			if (draw < profile_p->reset_rate)
+			{
+				kind = K_GHOST_IO_FAULT_RESET;
+			}
+			else if (draw < profile_p->reset_rate + profile_p->error_rate)
+			{
+				kind = K_GHOST_IO_FAULT_ERROR;
+			}
+			else if (profile_p->delay_us || profile_p->jitter_us)
+			{
+				kind		= K_GHOST_IO_FAULT_DELAY;
+				*delay_ns_p = (profile_p->delay_us + (uint64_t)((double)profile_p->jitter_us * k_ghost_io_random(&fault_p->rng_state))) * 1000;
+			}
+		}
+		pthread_mutex_unlock(&k_ghost_io_ctx.fault_lock);
+	}
+	return kind;
+}
+
+int k_ghost_io_delay_job(k_ghost_io_job_t *job_p, const uint64_t delay_ns)
+{
+	return k_ghost_io_schedule_ns(delay_ns, 0, k_ghost_io_run_delayed_request, job_p) ? 0 : -1;
+}
+
+int k_ghost_io_draw_event_copies(const char *interface_name, const size_t name_len)
+{
+	int copies = 1;
+	if (__atomic_load_n(&k_ghost_io_ctx.faults, __ATOMIC_ACQUIRE))
+	{
+		pthread_mutex_lock(&k_ghost_io_ctx.fault_lock);
+		k_ghost_io_fault_t *fault_p = *k_ghost_io_find_fault(interface_name, name_len);
+		if (fault_p && (fault_p->profile.drop_rate > 0.0 || fault_p->profile.duplicate_rate > 0.0))
+		{
+			const double draw = k_ghost_io_random(&fault_p->rng_state);
+			if (draw < fault_p->profile.drop_rate)
+			{
+				copies = 0;
+			}
+			else if (draw < fault_p->profile.drop_rate + fault_p->profile.duplicate_rate)
+			{
+				copies = 2;
+			}
+		}
+		pthread_mutex_unlock(&k_ghost_io_ctx.fault_lock);
+	}
+	return copies;
+}
+
+void k_ghost_io_manage_faults_request(const int client_fd, const char *request, const size_t header_len)
+{
+	k_ghost_io_response_id_t   resp			= K_GHOST_IO_RESPONSE_BAD_REQUEST;
+	const char				  *request_body = request && header_len ? request + header_len : NULL;
+	k_ghost_io_fault_request_t fault_request;
+	memset(&fault_request, 0, sizeof(fault_request));
+	if (request_body && 0 == k_ghost_io_decode_command(&k_ghost_io_fault_schema, request_body, &fault_request) && '\0' != fault_request.interface[0])
+	{
+		const k_ghost_io_fault_profile_t profile = {
+			.delay_us		= (uint64_t)fault_request.delay_us,
+			.jitter_us		= (uint64_t)fault_request.jitter_us,
+			.error_rate		= fault_request.error_rate,
+			.reset_rate		= fault_request.reset_rate,
+			.drop_rate		= fault_request.drop_rate,
+			.duplicate_rate = fault_request.duplicate_rate,
+			.seed			= (uint64_t)fault_request.seed,
+		};
+		if (0 == k_ghost_io_set_faults(fault_request.interface, &profile))
+		{
+			resp = K_GHOST_IO_RESPONSE_OK;
+		}
+	}
+	k_ghost_io_send_static_response(client_fd, resp, 0);
+	close(client_fd);
+}
+
+void k_ghost_io_snapshot_faults(k_ghost_io_snapshot_writer_t *writer_p)
+{
+	pthread_mutex_lock(&k_ghost_io_ctx.fault_lock);
+	for (const k_ghost_io_fault_t *fault_p = k_ghost_io_ctx.faults; fault_p; fault_p = fault_p->next_fault)
+	{
+		if (0 == k_ghost_io_snapshot_record(writer_p, K_GHOST_IO_SNAPSHOT_FAULTS, fault_p->interface_name, sizeof(fault_p->rng_state)))
+		{
+			k_ghost_io_snapshot_append(writer_p, &fault_p->rng_state, sizeof(fault_p->rng_state));
+		}
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.fault_lock);
+}
+
+int k_ghost_io_restore_faults(const char *interface_name, const char *data, const size_t data_len)
+{
+	int ret_code = -1;
+	pthread_mutex_lock(&k_ghost_io_ctx.fault_lock);
+	k_ghost_io_fault_t *fault_p = *k_ghost_io_find_fault(interface_name, strlen(interface_name));
+	if (fault_p && sizeof(fault_p->rng_state) == data_len)
+	{
+		memcpy(&fault_p->rng_state, data, sizeof(fault_p->rng_state));
+		ret_code = 0;
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.fault_lock);
+	return ret_code;
+}
+
+static k_ghost_io_fault_t **k_ghost_io_find_fault(const char *interface_name, const size_t name_len)
+{
+	k_ghost_io_fault_t **link_pp = &k_ghost_io_ctx.faults;
+	while (*link_pp && (name_len != (*link_pp)->name_len || 0 != memcmp((*link_pp)->interface_name, interface_name, name_len)))
+	{
+		link_pp = (k_ghost_io_fault_t **)&(*link_pp)->next_fault;
+	}
+	return link_pp;
+}
+
+static void k_ghost_io_run_delayed_request(void *user_data_p)
+{
+	k_ghost_io_job_t *job_p	 = user_data_p;
+	const int		  queued = k_ghost_io_interface_removed(job_p->interface_p) ? -1 : k_ghost_io_queue_job(job_p);
+	if (0 != queued)
+	{
+		/* Answers 404 if the interface was unregistered in the meantime, and releases the request either way */
+		k_ghost_io_run_job(job_p);
+		free(job_p);
+	}
+}
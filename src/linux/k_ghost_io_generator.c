@@ -0,0 +1,288 @@
+/**
+ * @file k_ghost_io_generator.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_MAX_GENERATOR_RATE_HZ ((double)K_GHOST_IO_NS_PER_S / K_GHOST_IO_TIMER_TICK_NS)  //!< One event per timer tick
+
+#define K_GHOST_IO_SAMPLE_TEXT_SIZE 32	//!< Room for a formatted sample, with its quotes, colon and comma
+
+#define K_GHOST_IO_TWO_PI 6.28318530717958647692
+
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Find the generator of an interface. Must hold the generator lock.
+ *
+ * @param interface_name Name of the interface
+ *
+ * @return Pointer to the link pointing to the generator, pointing to NULL if there is none
+ */
+static k_ghost_io_generator_t **k_ghost_io_find_generator(const char *interface_name);
+
+/**
+ * @brief Compute the value of a channel at a given time.
+ *
+ * @param generator_p Generator the channel belongs to, for its noise
+ * @param state_p Channel to sample
+ * @param t Time since the first event, in seconds
+ *
+ * @return Sample of the channel
+ */
+static double k_ghost_io_sample_channel(k_ghost_io_generator_t *generator_p, k_ghost_io_channel_state_t *state_p, double t);
+
+/**
+ * @brief Timer callback of a generator: format the samples as a JSON object and send them to the SSE clients.
+ *
+ * @param user_data_p Generator to publish
+ */
+static void k_ghost_io_publish_generator(void *user_data_p);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+k_ghost_io_register_ret_code_t k_ghost_io_add_generator(const char *interface_name, const k_ghost_io_channel_t *channels_p, const size_t channels_count,
+														const double rate_hz)
+{
+	k_ghost_io_register_ret_code_t ret_code	  = K_GHOST_REGISTER_RET_CODE_ERROR;
+	size_t						   names_size = 0;
+	int							   valid	  = interface_name && channels_p && channels_count && rate_hz > 0.0 && rate_hz <= K_GHOST_IO_MAX_GENERATOR_RATE_HZ;
+	for (size_t i = 0; valid && i < channels_count; i++)
+	{
+		valid = NULL != channels_p[i].name;
+		names_size += valid ? strlen(channels_p[i].name) + 1 : 0;
+	}
+	if (valid)
+	{
+		/* A single allocation holds the generator, its channels and their names; the event buffer is sized once for any sample and escaped names */
+		const size_t			channels_size = channels_count * sizeof(k_ghost_io_channel_state_t);
+		const size_t			event_size	  = 6 * names_size + channels_count * K_GHOST_IO_SAMPLE_TEXT_SIZE + 3;
+		k_ghost_io_generator_t *generator_p	  = calloc(1, sizeof(k_ghost_io_generator_t) + channels_size + names_size);
+		char				   *name_p		  = generator_p ? strdup(interface_name) : NULL;
+		char				   *event		  = name_p ? malloc(event_size) : NULL;
+		if (event)
+		{
+			char *names = (char *)generator_p->channels + channels_size;
+			for (size_t i = 0; i < channels_count; i++)
+			{
+				const size_t name_size				  = strlen(channels_p[i].name) + 1;
+				generator_p->channels[i].channel	  = channels_p[i];
+				generator_p->channels[i].channel.name = memcpy(names, channels_p[i].name, name_size);
+				generator_p->channels[i].gust_period  = INT64_MIN;
+				names += name_size;
+			}
+			generator_p->interface_name = name_p;
+			generator_p->event			= event;
+			generator_p->event_size		= event_size;
+			generator_p->channels_count = channels_count;
+			generator_p->period_ns		= (uint64_t)((double)K_GHOST_IO_NS_PER_S / rate_hz);
+			generator_p->rng_state		= k_ghost_io_hash_name(interface_name, strlen(interface_name)) | 1ULL << 32;
+			generator_p->start_ns		= k_ghost_io_now_ns();
+			pthread_mutex_lock(&k_ghost_io_ctx.generator_lock);
+			if (*k_ghost_io_find_generator(interface_name))
+			{
+				ret_code = K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED;
+			}
+			else
+			{
+				/* Scheduled under the lock, so that a concurrent removal always finds the timer to cancel */
+				generator_p->timer = k_ghost_io_schedule_ns(0, generator_p->period_ns, k_ghost_io_publish_generator, generator_p);
+				if (generator_p->timer)
+				{
+					generator_p->next_generator = k_ghost_io_ctx.generators;
+					k_ghost_io_ctx.generators	= generator_p;
+					generator_p					= NULL;
+					ret_code					= K_GHOST_REGISTER_RET_CODE_OK;
+				}
+			}
+			pthread_mutex_unlock(&k_ghost_io_ctx.generator_lock);
+		}
+		if (generator_p)
+		{
+			free(event);
+			free(name_p);
+			free(generator_p);
+		}
+	}
+	return ret_code;
+}
+
+void k_ghost_io_remove_generator(const char *interface_name)
+{
+	if (interface_name)
+	{
+		pthread_mutex_lock(&k_ghost_io_ctx.generator_lock);
+		k_ghost_io_generator_t **link_pp	 = k_ghost_io_find_generator(interface_name);
+		k_ghost_io_generator_t	*generator_p = *link_pp;
+		if (generator_p)
+		{
+			*link_pp = generator_p->next_generator;
+		}
+		pthread_mutex_unlock(&k_ghost_io_ctx.generator_lock);
+		if (generator_p)
+		{
+			/* Waits for an event being published, if any */
+			k_ghost_io_cancel(generator_p->timer);
+			free(generator_p->event);
+			free(generator_p->interface_name);
+			free(generator_p);
+		}
+	}
+}
+
+void k_ghost_io_snapshot_generators(k_ghost_io_snapshot_writer_t *writer_p)
+{
+	const uint64_t now_ns = k_ghost_io_now_ns();
+	pthread_mutex_lock(&k_ghost_io_ctx.generator_lock);
+	for (const k_ghost_io_generator_t *generator_p = k_ghost_io_ctx.generators; generator_p; generator_p = generator_p->next_generator)
+	{
+		const size_t data_len = 3 * sizeof(uint64_t) + generator_p->channels_count * (sizeof(int64_t) + sizeof(double));
+		if (0 == k_ghost_io_snapshot_record(writer_p, K_GHOST_IO_SNAPSHOT_GENERATOR, generator_p->interface_name, data_len))
+		{
+			/* The phase of the waveforms is kept as the time since the start, the restore moves the start instead of the clock */
+			const uint64_t elapsed_ns	= now_ns - generator_p->start_ns;
+			const uint64_t remaining_ns = k_ghost_io_timer_remaining_ns(generator_p->timer);
+			k_ghost_io_snapshot_append(writer_p, &elapsed_ns, sizeof(elapsed_ns));
+			k_ghost_io_snapshot_append(writer_p, &remaining_ns, sizeof(remaining_ns));
+			k_ghost_io_snapshot_append(writer_p, &generator_p->rng_state, sizeof(generator_p->rng_state));
+			for (size_t i = 0; i < generator_p->channels_count; i++)
+			{
+				k_ghost_io_snapshot_append(writer_p, &generator_p->channels[i].gust_period, sizeof(int64_t));
+				k_ghost_io_snapshot_append(writer_p, &generator_p->channels[i].gust_height, sizeof(double));
+			}
+		}
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.generator_lock);
+}
+
+int k_ghost_io_restore_generator(const char *interface_name, const char *data, const size_t data_len)
+{
+	int			   ret_code = -1;
+	const uint64_t now_ns	= k_ghost_io_now_ns();
+	pthread_mutex_lock(&k_ghost_io_ctx.generator_lock);
+	k_ghost_io_generator_t *generator_p = *k_ghost_io_find_generator(interface_name);
+	if (generator_p && 3 * sizeof(uint64_t) + generator_p->channels_count * (sizeof(int64_t) + sizeof(double)) == data_len)
+	{
+		uint64_t elapsed_ns	  = 0;
+		uint64_t remaining_ns = 0;
+		memcpy(&elapsed_ns, data, sizeof(elapsed_ns));
+		memcpy(&remaining_ns, data + sizeof(uint64_t), sizeof(remaining_ns));
+		memcpy(&generator_p->rng_state, data + 2 * sizeof(uint64_t), sizeof(generator_p->rng_state));
+		data += 3 * sizeof(uint64_t);
+		for (size_t i = 0; i < generator_p->channels_count; i++)
+		{
+			memcpy(&generator_p->channels[i].gust_period, data, sizeof(int64_t));
+			memcpy(&generator_p->channels[i].gust_height, data + sizeof(int64_t), sizeof(double));
+			data += sizeof(int64_t) + sizeof(double);
+		}
+		generator_p->start_ns = now_ns - elapsed_ns;
+		ret_code			  = k_ghost_io_rearm_ns(generator_p->timer, remaining_ns);
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.generator_lock);
+	return ret_code;
+}
+
+static k_ghost_io_generator_t **k_ghost_io_find_generator(const char *interface_name)
+{
+	k_ghost_io_generator_t **link_pp = &k_ghost_io_ctx.generators;
+	while (*link_pp && 0 != strcmp((*link_pp)->interface_name, interface_name))
+	{
+		link_pp = (k_ghost_io_generator_t **)&(*link_pp)->next_generator;
+	}
+	return link_pp;
+}
+
+static double k_ghost_io_sample_channel(k_ghost_io_generator_t *generator_p, k_ghost_io_channel_state_t *state_p, const double t)
+{
+	const k_ghost_io_channel_t *channel_p = &state_p->channel;
+	const double				cycles	  = channel_p->frequency_hz * t + channel_p->phase;
+	const double				position  = cycles - floor(cycles);
+	double						value	  = channel_p->offset;
+	switch (channel_p->waveform)
+	{
+		case K_GHOST_IO_WAVE_SINE:
+			value += channel_p->amplitude * sin(K_GHOST_IO_TWO_PI * position);
+			break;
+		case K_GHOST_IO_WAVE_SQUARE:
+			value += position < 0.5 ? channel_p->amplitude : -channel_p->amplitude;
+			break;
+		case K_GHOST_IO_WAVE_TRIANGLE:
+			value += channel_p->amplitude * (position < 0.5 ? 4.0 * position - 1.0 : 3.0 - 4.0 * position);
+			break;
+		case K_GHOST_IO_WAVE_RAMP:
+			value += channel_p->amplitude * (2.0 * position - 1.0);
+			break;
+		case K_GHOST_IO_WAVE_GUST:
+		{
+			const int64_t period = (int64_t)floor(cycles);
+			if (period != state_p->gust_period)
+			{
+				state_p->gust_period = period;
+				state_p->gust_height = channel_p->amplitude * k_ghost_io_random(&generator_p->rng_state);
+			}
+			value += state_p->gust_height * 0.5 * (1.0 - cos(K_GHOST_IO_TWO_PI * position));
+			break;
+		}
+		case K_GHOST_IO_WAVE_CONSTANT:
+		default:
+			break;
+	}
+	switch (channel_p->noise)
+	{
+		case K_GHOST_IO_NOISE_UNIFORM:
+			value += channel_p->noise_amplitude * (2.0 * k_ghost_io_random(&generator_p->rng_state) - 1.0);
+			break;
+		case K_GHOST_IO_NOISE_GAUSSIAN:
+		{
+			/* Box-Muller, 1 - u keeps the logarithm away from 0 */
+			const double u = 1.0 - k_ghost_io_random(&generator_p->rng_state);
+			const double v = k_ghost_io_random(&generator_p->rng_state);
+			value += channel_p->noise_amplitude * sqrt(-2.0 * log(u)) * cos(K_GHOST_IO_TWO_PI * v);
+			break;
+		}
+		case K_GHOST_IO_NOISE_NONE:
+		default:
+			break;
+	}
+	return value;
+}
+
+static void k_ghost_io_publish_generator(void *user_data_p)
+{
+	k_ghost_io_generator_t *generator_p = user_data_p;
+	char				   *end			= generator_p->event + generator_p->event_size;
+	char				   *out			= generator_p->event;
+	*out++								= '{';
+	/* The phase, the random draws and the gusts move on under the lock, so that snapshots and restores see them whole */
+	pthread_mutex_lock(&k_ghost_io_ctx.generator_lock);
+	/* Sampled at the scheduled time, whatever the lateness of the timer: the latest tick if some were missed */
+	const uint64_t elapsed_ns = k_ghost_io_ctx.timers.now_ns - generator_p->start_ns;
+	const double   t		  = (double)(elapsed_ns / generator_p->period_ns * generator_p->period_ns) / (double)K_GHOST_IO_NS_PER_S;
+	for (size_t i = 0; i < generator_p->channels_count; i++)
+	{
+		const double value = k_ghost_io_sample_channel(generator_p, &generator_p->channels[i], t);
+		const char	*name  = generator_p->channels[i].channel.name;
+		if (i)
+		{
+			*out++ = ',';
+		}
+		out	   = k_ghost_io_json_write_string(out, name, strlen(name));
+		*out++ = ':';
+		/* Non finite values have no JSON representation */
+		out += isfinite(value) ? snprintf(out, (size_t)(end - out), "%.6g", value) : snprintf(out, (size_t)(end - out), "null");
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.generator_lock);
+	*out++ = '}';
+	*out   = '\0';
+	k_ghost_io_send_interface_event(generator_p->interface_name, generator_p->event);
+}
@@ -0,0 +1,554 @@
+/**
+ * @file k_ghost_io_json.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Decode a JSON value into a member of the command struct.
+ *
+ * @param field_p Field the value belongs to
+ * @param cursor Pointer to the first character of the value
+ * @param member_p Pointer to the member in the command struct
+ *
+ * @return Pointer past the value, NULL if the value does not match the field.
+ */
+static const char *k_ghost_io_decode_field(const k_ghost_io_field_t *field_p, const char *cursor, void *member_p);
+
+/**
+ * @brief Decode a JSON string into a char array.
+ *
+ * @param cursor Pointer to the opening quote
+ * @param buffer Destination char array
+ * @param size Size of the destination, including the NUL terminator
+ *
+ * @return Pointer past the closing quote, NULL if the string is malformed or does not fit.
+ */
+static const char *k_ghost_io_decode_string(const char *cursor, char *buffer, size_t size);
+
+/**
+ * @brief Parse the four hex digits of a \\u escape.
+ *
+ * @param cursor Pointer to the first digit
+ *
+ * @return Code unit, -1 if the digits are not valid.
+ */
+static long k_ghost_io_decode_hex4(const char *cursor);
+
+/**
+ * @brief Measure a number following the JSON grammar: no hex, no leading '+' or zeros, no inf nor nan.
+ *
+ * @param cursor Pointer to the first character of the number
+ *
+ * @return Length of the number, 0 if the text is not a JSON number.
+ */
+static size_t k_ghost_io_json_number_len(const char *cursor);
+
+/**
+ * @brief Store an integer into a member of 1, 2, 4 or 8 bytes.
+ *
+ * @param member_p Pointer to the member in the command struct
+ * @param size Size of the member
+ * @param value Value to store, already checked to fit
+ */
+static void k_ghost_io_store_int(void *member_p, size_t size, long long value);
+
+/**
+ * @brief Check a decoded number against the range of its field.
+ *
+ * @param field_p Field the number belongs to
+ * @param value Decoded number
+ *
+ * @return 1 if the number is accepted, 0 otherwise.
+ */
+static int k_ghost_io_in_range(const k_ghost_io_field_t *field_p, double value);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+const char *k_ghost_io_json_skip_whitespace(const char *cursor)
+{
+	return cursor + strspn(cursor, " \t\r\n");
+}
+
+char *k_ghost_io_json_write_string(char *out, const char *value, const size_t value_size)
+{
+	*out++ = '"';
+	for (size_t i = 0; i < value_size && '\0' != value[i]; i++)
+	{
+		const unsigned char character = (unsigned char)value[i];
+		if ('"' == character || '\\' == character)
+		{
+			*out++ = '\\';
+			*out++ = (char)character;
+		}
+		else if (character < 0x20)
+		{
+			out += sprintf(out, "\\u%04x", character);
+		}
+		else
+		{
+			/* UTF-8 sequences are copied as they are */
+			*out++ = (char)character;
+		}
+	}
+	*out++ = '"';
+	return out;
+}
+
+const char *k_ghost_io_json_skip_string(const char *cursor)
+{
+	const char *end = NULL;
+	for (cursor++; '\0' != *cursor; cursor++)
+	{
+		if ('\\' == *cursor)
+		{
+			/* Skip the escaped character, \uXXXX needs no special care since hex digits are never quotes */
+			if ('\0' == *++cursor)
+			{
+				break;
+			}
+		}
+		else if ('"' == *cursor)
+		{
+			end = cursor + 1;
+			break;
+		}
+	}
+	return end;
+}
+
+const char *k_ghost_io_json_skip_value(const char *cursor)
+{
+	if ('"' == *cursor)
+	{
+		cursor = k_ghost_io_json_skip_string(cursor);
+	}
+	else if ('{' == *cursor || '[' == *cursor)
+	{
+		/* Nested containers are skipped by depth only, strings are skipped as a whole so brackets inside them do not count */
+		size_t depth = 0;
+		do
+		{
+			if ('{' == *cursor || '[' == *cursor)
+			{
+				depth++;
+				cursor++;
+			}
+			else if ('}' == *cursor || ']' == *cursor)
+			{
+				depth--;
+				cursor++;
+			}
+			else if ('"' == *cursor)
+			{
+				cursor = k_ghost_io_json_skip_string(cursor);
+			}
+			else if ('\0' == *cursor)
+			{
+				cursor = NULL;
+			}
+			else
+			{
+				cursor++;
+			}
+		} while (cursor && depth > 0);
+	}
+	else
+	{
+		/* Numbers and literals end at the first delimiter */
+		const size_t len = strcspn(cursor, ",}] \t\r\n");
+		cursor			 = len ? cursor + len : NULL;
+	}
+	return cursor;
+}
+
+int k_ghost_io_check_schema(const k_ghost_io_schema_t *schema_p)
+{
+	int ret_code = -1;
+	if (schema_p && (schema_p->fields || 0 == schema_p->fields_count) && schema_p->fields_count <= K_GHOST_IO_MAX_SCHEMA_FIELDS)
+	{
+		ret_code = 0;
+		for (size_t i = 0; i < schema_p->fields_count && 0 == ret_code; i++)
+		{
+			const k_ghost_io_field_t *field_p = &schema_p->fields[i];
+			int						  size_ok = 0;
+			switch (field_p->type)
+			{
+				case K_GHOST_IO_FIELD_BOOL:
+					size_ok = sizeof(bool) == field_p->size;
+					break;
+				case K_GHOST_IO_FIELD_INT:
+					size_ok = 1 == field_p->size || 2 == field_p->size || 4 == field_p->size || 8 == field_p->size;
+					break;
+				case K_GHOST_IO_FIELD_DOUBLE:
+					size_ok = sizeof(float) == field_p->size || sizeof(double) == field_p->size;
+					break;
+				case K_GHOST_IO_FIELD_STRING:
+					size_ok = field_p->size > 0;
+					break;
+				default:
+					break;
+			}
+			if (!size_ok || !field_p->name || field_p->offset + field_p->size > schema_p->command_size)
+			{
+				ret_code = -1;
+			}
+		}
+	}
+	return ret_code;
+}
+
+int k_ghost_io_decode_command(const k_ghost_io_schema_t *schema_p, const char *json_text, void *command_p)
+{
+	int			ret_code = -1;
+	uint64_t	seen	 = 0;
+	const char *cursor	 = k_ghost_io_json_skip_whitespace(json_text);
+	if ('{' == *cursor)
+	{
+		cursor = k_ghost_io_json_skip_whitespace(cursor + 1);
+		if ('}' == *cursor)
+		{
+			cursor++;
+		}
+		else
+		{
+			while (cursor)
+			{
+				/* Key: looked up in the schema without being copied. Escaped keys never match a field name */
+				const char *key		= cursor + 1;
+				const char *key_end = '"' == *cursor ? k_ghost_io_json_skip_string(cursor) : NULL;
+				cursor				= key_end ? k_ghost_io_json_skip_whitespace(key_end) : NULL;
+				if (!cursor || ':' != *cursor)
+				{
+					cursor = NULL;
+					break;
+				}
+				cursor							  = k_ghost_io_json_skip_whitespace(cursor + 1);
+				const size_t			  key_len = (size_t)(key_end - 1 - key);
+				const k_ghost_io_field_t *field_p = NULL;
+				for (size_t i = 0; i < schema_p->fields_count && !field_p; i++)
+				{
+					if (0 == strncmp(schema_p->fields[i].name, key, key_len) && '\0' == schema_p->fields[i].name[key_len])
+					{
+						field_p = &schema_p->fields[i];
+						seen |= (uint64_t)1 << i;
+					}
+				}
+				cursor = field_p ? k_ghost_io_decode_field(field_p, cursor, (char *)command_p + field_p->offset) : k_ghost_io_json_skip_value(cursor);
+				cursor = cursor ? k_ghost_io_json_skip_whitespace(cursor) : NULL;
+				if (cursor && ',' == *cursor)
+				{
+					cursor = k_ghost_io_json_skip_whitespace(cursor + 1);
+				}
+				else
+				{
+					cursor = cursor && '}' == *cursor ? cursor + 1 : NULL;
+					break;
+				}
+			}
+		}
+	}
+	else
+	{
+		cursor = NULL;
+	}
+	if (cursor && '\0' == *k_ghost_io_json_skip_whitespace(cursor))
+	{
+		ret_code = 0;
+		for (size_t i = 0; i < schema_p->fields_count; i++)
+		{
+			if (schema_p->fields[i].required && !(seen & ((uint64_t)1 << i)))
+			{
+				ret_code = -1;
+			}
+		}
+	}
+	return ret_code;
+}
+
+static const char *k_ghost_io_decode_field(const k_ghost_io_field_t *field_p, const char *cursor, void *member_p)
+{
+	const char *end = NULL;
+	switch (field_p->type)
+	{
+		case K_GHOST_IO_FIELD_BOOL:
+		{
+			bool value = false;
+			if (0 == strncmp(cursor, "true", 4))
+			{
+				value = true;
+				end	  = cursor + 4;
+			}
+			else if (0 == strncmp(cursor, "false", 5))
+			{
+				end = cursor + 5;
+			}
+			if (end)
+			{
+				memcpy(member_p, &value, sizeof(value));
+			}
+			break;
+		}
+		case K_GHOST_IO_FIELD_INT:
+		{
+			char *number_end		  = NULL;
+			errno					  = 0;
+			const long long value	  = ('-' == *cursor || ('0' <= *cursor && '9' >= *cursor)) ? strtoll(cursor, &number_end, 10) : 0;
+			const int		bits	  = (int)(8 * field_p->size);
+			const long long max_value = 64 == bits ? INT64_MAX : (1LL << (bits - 1)) - 1;
+			const long long min_value = 64 == bits ? INT64_MIN : -(1LL << (bits - 1));
+			if (number_end && 0 == errno && !strchr(".eE", *number_end) && value >= min_value && value <= max_value &&
+				k_ghost_io_in_range(field_p, (double)value))
+			{
+				k_ghost_io_store_int(member_p, field_p->size, value);
+				end = number_end;
+			}
+			break;
+		}
+		case K_GHOST_IO_FIELD_DOUBLE:
+		{
+			/* strtod takes more than JSON does (hex, inf, nan): the grammar is checked first, then the overflows of the member */
+			const size_t number_len = k_ghost_io_json_number_len(cursor);
+			char		*number_end = NULL;
+			errno					= 0;
+			const double value		= number_len ? strtod(cursor, &number_end) : 0;
+			const double max_value	= sizeof(float) == field_p->size ? FLT_MAX : DBL_MAX;
+			if (number_len && number_end == cursor + number_len && 0 == errno && isfinite(value) && fabs(value) <= max_value &&
+				k_ghost_io_in_range(field_p, value))
+			{
+				if (sizeof(float) == field_p->size)
+				{
+					const float value_float = (float)value;
+					memcpy(member_p, &value_float, sizeof(value_float));
+				}
+				else
+				{
+					memcpy(member_p, &value, sizeof(value));
+				}
+				end = number_end;
+			}
+			break;
+		}
+		case K_GHOST_IO_FIELD_STRING:
+			end = '"' == *cursor ? k_ghost_io_decode_string(cursor, member_p, field_p->size) : NULL;
+			break;
+		default:
+			break;
+	}
+	return end;
+}
+
+static const char *k_ghost_io_decode_string(const char *cursor, char *buffer, const size_t size)
+{
+	size_t len = 0;
+	for (cursor++; cursor && '"' != *cursor; cursor++)
+	{
+		unsigned long code_point = (unsigned char)*cursor;
+		int			  unicode	 = 0;
+		if ('\0' == *cursor || code_point < 0x20)
+		{
+			cursor = NULL;
+			break;
+		}
+		if ('\\' == *cursor)
+		{
+			cursor++;
+			switch (*cursor)
+			{
+				case '"':
+				case '\\':
+				case '/':
+					code_point = (unsigned char)*cursor;
+					break;
+				case 'b':
+					code_point = '\b';
+					break;
+				case 'f':
+					code_point = '\f';
+					break;
+				case 'n':
+					code_point = '\n';
+					break;
+				case 'r':
+					code_point = '\r';
+					break;
+				case 't':
+					code_point = '\t';
+					break;
+				case 'u':
+				{
+					const long high = k_ghost_io_decode_hex4(cursor + 1);
+					unicode			= 1;
+					code_point		= high >= 0 ? (unsigned long)high : 0;
+					cursor += 4;
+					if (high >= 0xD800 && high <= 0xDBFF && '\\' == cursor[1] && 'u' == cursor[2])
+					{
+						/* Surrogate pair */
+						const long low = k_ghost_io_decode_hex4(cursor + 3);
+						if (low >= 0xDC00 && low <= 0xDFFF)
+						{
+							code_point = 0x10000 + (((unsigned long)high - 0xD800) << 10) + ((unsigned long)low - 0xDC00);
+							cursor += 6;
+						}
+					}
+					if (high < 0 || (code_point >= 0xD800 && code_point <= 0xDFFF))
+					{
+						cursor = NULL;
+					}
+					break;
+				}
+				default:
+					cursor = NULL;
+					break;
+			}
+			if (!cursor)
+			{
+				break;
+			}
+		}
+		/* Code points of \u escapes are encoded as UTF-8, any other byte is copied as it is */
+		char   encoded[4];
+		size_t encoded_len = 0;
+		if (!unicode || code_point < 0x80)
+		{
+			encoded[encoded_len++] = (char)code_point;
+		}
+		else if (code_point < 0x800)
+		{
+			encoded[encoded_len++] = (char)(0xC0 | (code_point >> 6));
+			encoded[encoded_len++] = (char)(0x80 | (code_point & 0x3F));
+		}
+		else if (code_point < 0x10000)
+		{
+			encoded[encoded_len++] = (char)(0xE0 | (code_point >> 12));
+			encoded[encoded_len++] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+			encoded[encoded_len++] = (char)(0x80 | (code_point & 0x3F));
+		}
+		else
+		{
+			encoded[encoded_len++] = (char)(0xF0 | (code_point >> 18));
+			encoded[encoded_len++] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+			encoded[encoded_len++] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+			encoded[encoded_len++] = (char)(0x80 | (code_point & 0x3F));
+		}
+		if (len + encoded_len >= size)
+		{
+			/* Does not fit with its terminator: a truncated value would be silently wrong */
+			cursor = NULL;
+			break;
+		}
+		memcpy(buffer + len, encoded, encoded_len);
+		len += encoded_len;
+	}
+	if (cursor)
+	{
+		buffer[len] = '\0';
+		cursor++;
+	}
+	return cursor;
+}
+
+static long k_ghost_io_decode_hex4(const char *cursor)
+{
+	long value = 0;
+	for (int i = 0; i < 4 && value >= 0; i++)
+	{
+		const char digit = cursor[i];
+		if ('0' <= digit && '9' >= digit)
+		{
+			value = (value << 4) | (digit - '0');
+		}
+		else if ('a' <= digit && 'f' >= digit)
+		{
+			value = (value << 4) | (digit - 'a' + 10);
+		}
+		else if ('A' <= digit && 'F' >= digit)
+		{
+			value = (value << 4) | (digit - 'A' + 10);
+		}
+		else
+		{
+			value = -1;
+		}
+	}
+	return value;
+}
+
+static void k_ghost_io_store_int(void *member_p, const size_t size, const long long value)
+{
+	switch (size)
+	{
+		case 1:
+		{
+			const int8_t value_8 = (int8_t)value;
+			memcpy(member_p, &value_8, sizeof(value_8));
+			break;
+		}
+		case 2:
+		{
+			const int16_t value_16 = (int16_t)value;
+			memcpy(member_p, &value_16, sizeof(value_16));
+			break;
+		}
+		case 4:
+		{
+			const int32_t value_32 = (int32_t)value;
+			memcpy(member_p, &value_32, sizeof(value_32));
+			break;
+		}
+		default:
+		{
+			const int64_t value_64 = (int64_t)value;
+			memcpy(member_p, &value_64, sizeof(value_64));
+			break;
+		}
+	}
+}
+
+static size_t k_ghost_io_json_number_len(const char *cursor)
+{
+	const char *start = cursor;
+	cursor += '-' == *cursor;
+	const size_t int_digits = strspn(cursor, "0123456789");
+	size_t		 len		= 0;
+	if (int_digits && ('0' != *cursor || 1 == int_digits))
+	{
+		cursor += int_digits;
+		len = 1;
+		if ('.' == *cursor)
+		{
+			const size_t fraction_digits = strspn(cursor + 1, "0123456789");
+			cursor += 1 + fraction_digits;
+			len = fraction_digits;
+		}
+		if (len && ('e' == *cursor || 'E' == *cursor))
+		{
+			cursor += 1 + ('+' == cursor[1] || '-' == cursor[1]);
+			const size_t exponent_digits = strspn(cursor, "0123456789");
+			cursor += exponent_digits;
+			len = exponent_digits;
+		}
+	}
+	return len ? (size_t)(cursor - start) : 0;
+}
+
+static int k_ghost_io_in_range(const k_ghost_io_field_t *field_p, const double value)
+{
+	return field_p->min == field_p->max || (value >= field_p->min && value <= field_p->max);
+}
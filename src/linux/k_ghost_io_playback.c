@@ -0,0 +1,423 @@
+/**
+ * @file k_ghost_io_playback.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_RECORDING_MAGIC "KGIOREC1"
+
+#define K_GHOST_IO_RECORDING_HEADER_SIZE 16	 //!< Magic, number of channels and size of the names of a binary recording
+
+#define K_GHOST_IO_PLAYBACK_LINE_SIZE 4096	//!< Longest CSV line replayed, longer ones are skipped
+
+#define K_GHOST_IO_PLAYBACK_RELEASE_SIZE (1024 * 1024)	//!< Amount of played data given back at once
+
+#define K_GHOST_IO_RECORD_TEXT_SIZE 32	//!< Room for a formatted value, with its quotes, colon and comma
+
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Find the playback of an interface. Must hold the playback lock.
+ *
+ * @param interface_name Name of the interface
+ *
+ * @return Pointer to the link pointing to the playback, pointing to NULL if there is none
+ */
+static k_ghost_io_playback_t **k_ghost_io_find_playback(const char *interface_name);
+
+/**
+ * @brief Read the channel names of a recording and locate its first record.
+ *
+ * @param map Mapping of the recording
+ * @param map_size Size of the recording
+ * @param binary_p Set if the recording is in the binary format
+ * @param channels_count_p Set to the number of channels
+ * @param names_p Set to the first channel name. CSV names are separated by commas, binary ones are NUL-terminated
+ * @param names_size_p Set to the size of the names, separators included
+ *
+ * @return Offset of the first record, 0 if the header is invalid
+ */
+static size_t k_ghost_io_read_recording_header(const char *map, size_t map_size, int *binary_p, size_t *channels_count_p, const char **names_p,
+											   size_t *names_size_p);
+
+/**
+ * @brief Format the next record into the event buffer, starting over at the end of a looping recording.
+ *
+ * @param playback_p Playback to advance
+ *
+ * @return 1 if a record was loaded, 0 at the end of the recording
+ */
+static int k_ghost_io_load_record(k_ghost_io_playback_t *playback_p);
+
+/**
+ * @brief Decode the binary record at the offset of a playback and move past it.
+ *
+ * @param playback_p Playback to advance
+ * @param time_p Set to the time of the record
+ *
+ * @return 1 if a record was formatted, 0 if the rest of the recording is too short for one
+ */
+static int k_ghost_io_decode_binary(k_ghost_io_playback_t *playback_p, double *time_p);
+
+/**
+ * @brief Decode the CSV line at the offset of a playback and move past it.
+ *
+ * @param playback_p Playback to advance
+ * @param time_p Set to the time of the record
+ *
+ * @return 1 if a record was formatted, 0 if the line was skipped
+ */
+static int k_ghost_io_decode_csv(k_ghost_io_playback_t *playback_p, double *time_p);
+
+/**
+ * @brief Append a value to the event being formatted.
+ *
+ * @param playback_p Playback the event belongs to
+ * @param out Where to write the value
+ * @param channel Index of the channel
+ * @param valid Set if the value was decoded
+ * @param value Value of the channel
+ *
+ * @return End of the written text
+ */
+static char *k_ghost_io_format_value(const k_ghost_io_playback_t *playback_p, char *out, size_t channel, int valid, double value);
+
+/**
+ * @brief Timer callback of a playback: send the records due and arm the timer of the next one.
+ *
+ * @param user_data_p Playback to advance
+ */
+static void k_ghost_io_play_records(void *user_data_p);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+k_ghost_io_register_ret_code_t k_ghost_io_add_playback(const char *interface_name, const char *path, const double speed, const int loop)
+{
+	k_ghost_io_register_ret_code_t ret_code = K_GHOST_REGISTER_RET_CODE_ERROR;
+	const int					   fd		= interface_name && path && speed > 0.0 && isfinite(speed) ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+	struct stat					   file_stat;
+	if (fd >= 0 && 0 == fstat(fd, &file_stat) && file_stat.st_size > 0)
+	{
+		/* The mapping outlives the descriptor */
+		const size_t map_size = (size_t)file_stat.st_size;
+		char		*map	  = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		int			 binary	  = 0;
+		size_t		 count	  = 0;
+		size_t		 size	  = 0;
+		const char	*names	  = NULL;
+		const size_t data	  = MAP_FAILED != map ? k_ghost_io_read_recording_header(map, map_size, &binary, &count, &names, &size) : 0;
+		if (data)
+		{
+			madvise(map, map_size, MADV_SEQUENTIAL);
+			const size_t		   names_offset = sizeof(k_ghost_io_playback_t) + count * sizeof(char *);
+			k_ghost_io_playback_t *playback_p	= calloc(1, names_offset + size);
+			char				  *name_p		= playback_p ? strdup(interface_name) : NULL;
+			char				  *event		= name_p ? malloc(6 * size + count * K_GHOST_IO_RECORD_TEXT_SIZE + 3) : NULL;
+			if (event)
+			{
+				/* Both formats get NUL-terminated names, the CSV header line may end the recording */
+				char *copy	   = memcpy((char *)playback_p + names_offset, names, size - 1);
+				copy[size - 1] = '\0';
+				for (size_t i = 0; i < count; i++)
+				{
+					playback_p->channel_names[i] = copy;
+					copy += strcspn(copy, binary ? "" : ",");
+					*copy++ = '\0';
+				}
+				playback_p->interface_name = name_p;
+				playback_p->map			   = map;
+				playback_p->map_size	   = map_size;
+				playback_p->data_offset	   = data;
+				playback_p->offset		   = data;
+				playback_p->binary		   = binary;
+				playback_p->loop		   = loop;
+				playback_p->speed		   = speed;
+				playback_p->first_time	   = NAN;
+				playback_p->start_ns	   = k_ghost_io_now_ns();
+				playback_p->event		   = event;
+				playback_p->event_size	   = 6 * size + count * K_GHOST_IO_RECORD_TEXT_SIZE + 3;
+				playback_p->channels_count = count;
+				/* A recording without any record is rejected, a looping one would never find one to send */
+				if (k_ghost_io_load_record(playback_p))
+				{
+					pthread_mutex_lock(&k_ghost_io_ctx.playback_lock);
+					if (*k_ghost_io_find_playback(interface_name))
+					{
+						ret_code = K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED;
+					}
+					else
+					{
+						playback_p->timer = k_ghost_io_schedule_ns(0, 0, k_ghost_io_play_records, playback_p);
+						if (playback_p->timer)
+						{
+							playback_p->next_playback = k_ghost_io_ctx.playbacks;
+							k_ghost_io_ctx.playbacks  = playback_p;
+							playback_p				  = NULL;
+							map						  = MAP_FAILED;
+							ret_code				  = K_GHOST_REGISTER_RET_CODE_OK;
+						}
+					}
+					pthread_mutex_unlock(&k_ghost_io_ctx.playback_lock);
+				}
+			}
+			if (playback_p)
+			{
+				free(event);
+				free(name_p);
+				free(playback_p);
+			}
+		}
+		if (MAP_FAILED != map)
+		{
+			munmap(map, map_size);
+		}
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	return ret_code;
+}
+
+void k_ghost_io_remove_playback(const char *interface_name)
+{
+	if (interface_name)
+	{
+		pthread_mutex_lock(&k_ghost_io_ctx.playback_lock);
+		k_ghost_io_playback_t **link_pp	   = k_ghost_io_find_playback(interface_name);
+		k_ghost_io_playback_t  *playback_p = *link_pp;
+		if (playback_p)
+		{
+			*link_pp = playback_p->next_playback;
+		}
+		pthread_mutex_unlock(&k_ghost_io_ctx.playback_lock);
+		if (playback_p)
+		{
+			/* Records being sent may arm one more timer until the flag is seen: the second cancellation, once they are sent, disarms it */
+			__atomic_store_n(&playback_p->stopped, 1, __ATOMIC_SEQ_CST);
+			k_ghost_io_cancel(__atomic_load_n(&playback_p->timer, __ATOMIC_SEQ_CST));
+			k_ghost_io_cancel(__atomic_load_n(&playback_p->timer, __ATOMIC_SEQ_CST));
+			munmap((void *)playback_p->map, playback_p->map_size);
+			free(playback_p->event);
+			free(playback_p->interface_name);
+			free(playback_p);
+		}
+	}
+}
+
+static k_ghost_io_playback_t **k_ghost_io_find_playback(const char *interface_name)
+{
+	k_ghost_io_playback_t **link_pp = &k_ghost_io_ctx.playbacks;
+	while (*link_pp && 0 != strcmp((*link_pp)->interface_name, interface_name))
+	{
+		link_pp = (k_ghost_io_playback_t **)&(*link_pp)->next_playback;
+	}
+	return link_pp;
+}
+
+static size_t k_ghost_io_read_recording_header(const char *map, const size_t map_size, int *binary_p, size_t *channels_count_p, const char **names_p,
+											   size_t *names_size_p)
+{
+	size_t data = 0;
+	if (map_size >= K_GHOST_IO_RECORDING_HEADER_SIZE && 0 == memcmp(map, K_GHOST_IO_RECORDING_MAGIC, sizeof(K_GHOST_IO_RECORDING_MAGIC) - 1))
+	{
+		uint32_t count		= 0;
+		uint32_t names_size = 0;
+		memcpy(&count, map + 8, sizeof(count));
+		memcpy(&names_size, map + 12, sizeof(names_size));
+		if (count && names_size <= map_size - K_GHOST_IO_RECORDING_HEADER_SIZE)
+		{
+			/* Exactly one name per channel, the last one ending the names */
+			const char *names = map + K_GHOST_IO_RECORDING_HEADER_SIZE;
+			size_t		found = 0;
+			for (size_t i = 0; i < names_size; i++)
+			{
+				found += '\0' == names[i];
+			}
+			if (found == count && '\0' == names[names_size - 1])
+			{
+				*binary_p		  = 1;
+				*channels_count_p = count;
+				*names_p		  = names;
+				*names_size_p	  = names_size;
+				data			  = (K_GHOST_IO_RECORDING_HEADER_SIZE + names_size + 7) & ~(size_t)7;
+			}
+		}
+	}
+	else
+	{
+		const char *line_end = memchr(map, '\n', map_size);
+		const char *next	 = line_end ? line_end + 1 : map + map_size;
+		line_end			 = line_end ? line_end : map + map_size;
+		line_end -= line_end > map && '\r' == line_end[-1];
+		/* The time column is named too, but not replayed */
+		const char *names = memchr(map, ',', (size_t)(line_end - map));
+		if (names && names + 1 < line_end && !memchr(map, '\0', (size_t)(line_end - map)))
+		{
+			names++;
+			*binary_p		  = 0;
+			*channels_count_p = 1;
+			for (const char *c = names; c < line_end; c++)
+			{
+				*channels_count_p += ',' == *c;
+			}
+			*names_p	  = names;
+			*names_size_p = (size_t)(line_end - names) + 1;
+			data		  = (size_t)(next - map);
+		}
+	}
+	return data;
+}
+
+static int k_ghost_io_load_record(k_ghost_io_playback_t *playback_p)
+{
+	double time	   = 0.0;
+	int	   loaded  = 0;
+	int	   wrapped = !playback_p->loop;
+	while (!loaded && (playback_p->offset < playback_p->map_size || !wrapped))
+	{
+		if (playback_p->offset >= playback_p->map_size)
+		{
+			/* Started over one tick after the last record, so that even a recording without duration paces itself */
+			playback_p->offset	   = playback_p->data_offset;
+			playback_p->released   = 0;
+			playback_p->start_ns   = playback_p->due_ns + K_GHOST_IO_TIMER_TICK_NS;
+			playback_p->first_time = NAN;
+			wrapped				   = 1;
+		}
+		loaded = playback_p->binary ? k_ghost_io_decode_binary(playback_p, &time) : k_ghost_io_decode_csv(playback_p, &time);
+	}
+	if (loaded)
+	{
+		if (isnan(playback_p->first_time))
+		{
+			playback_p->first_time = time;
+		}
+		const double offset_ns = (time - playback_p->first_time) / playback_p->speed * (double)K_GHOST_IO_NS_PER_S;
+		playback_p->due_ns	   = playback_p->start_ns + (offset_ns > 0.0 ? (uint64_t)offset_ns : 0);
+	}
+	if (playback_p->offset - playback_p->released >= K_GHOST_IO_PLAYBACK_RELEASE_SIZE)
+	{
+		/* The pages played are given back, they would otherwise stay resident for the whole replay */
+		const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+		const size_t released  = playback_p->offset & ~(page_size - 1);
+		madvise((char *)playback_p->map + playback_p->released, released - playback_p->released, MADV_DONTNEED);
+		playback_p->released = released;
+	}
+	playback_p->pending = loaded;
+	return loaded;
+}
+
+static int k_ghost_io_decode_binary(k_ghost_io_playback_t *playback_p, double *time_p)
+{
+	int			 decoded	 = 0;
+	const size_t record_size = (playback_p->channels_count + 1) * sizeof(double);
+	if (playback_p->map_size - playback_p->offset >= record_size)
+	{
+		const char *record = playback_p->map + playback_p->offset;
+		char	   *out	   = playback_p->event;
+		memcpy(time_p, record, sizeof(double));
+		*out++ = '{';
+		for (size_t i = 0; i < playback_p->channels_count; i++)
+		{
+			double value = 0.0;
+			memcpy(&value, record + (i + 1) * sizeof(double), sizeof(double));
+			out = k_ghost_io_format_value(playback_p, out, i, 1, value);
+		}
+		*out++ = '}';
+		*out   = '\0';
+		playback_p->offset += record_size;
+		decoded = isfinite(*time_p);
+	}
+	else
+	{
+		/* A truncated last record is ignored */
+		playback_p->offset = playback_p->map_size;
+	}
+	return decoded;
+}
+
+static int k_ghost_io_decode_csv(k_ghost_io_playback_t *playback_p, double *time_p)
+{
+	int			decoded	 = 0;
+	const char *start	 = playback_p->map + playback_p->offset;
+	const char *line_end = memchr(start, '\n', playback_p->map_size - playback_p->offset);
+	playback_p->offset	 = line_end ? (size_t)(line_end + 1 - playback_p->map) : playback_p->map_size;
+	line_end			 = line_end ? line_end : playback_p->map + playback_p->map_size;
+	line_end -= line_end > start && '\r' == line_end[-1];
+	const size_t len = (size_t)(line_end - start);
+	if (len && '#' != *start && len < K_GHOST_IO_PLAYBACK_LINE_SIZE)
+	{
+		/* Copied to be NUL-terminated: the mapping of the recording may end right after the last digit */
+		char line[K_GHOST_IO_PLAYBACK_LINE_SIZE];
+		memcpy(line, start, len);
+		line[len]	= '\0';
+		char *field = line;
+		char *end	= NULL;
+		*time_p		= strtod(field, &end);
+		if (end != field && (',' == *end || '\0' == *end) && isfinite(*time_p))
+		{
+			char *out = playback_p->event;
+			*out++	  = '{';
+			for (size_t i = 0; i < playback_p->channels_count; i++)
+			{
+				/* Missing trailing fields are sent as null too */
+				field				= '\0' == *end ? end : end + 1;
+				const double value	= strtod(field, &end);
+				const int	 valid	= end != field && (',' == *end || '\0' == *end);
+				end					= valid ? end : field + strcspn(field, ",");
+				out					= k_ghost_io_format_value(playback_p, out, i, valid, value);
+			}
+			*out++	= '}';
+			*out	= '\0';
+			decoded = 1;
+		}
+	}
+	return decoded;
+}
+
+static char *k_ghost_io_format_value(const k_ghost_io_playback_t *playback_p, char *out, const size_t channel, const int valid, const double value)
+{
+	const char *name = playback_p->channel_names[channel];
+	if (channel)
+	{
+		*out++ = ',';
+	}
+	/* Names come from the recording, anything in them is escaped */
+	out				  = k_ghost_io_json_write_string(out, name, strlen(name));
+	*out++			  = ':';
+	const size_t room = (size_t)(playback_p->event + playback_p->event_size - out);
+	/* Non finite values have no JSON representation */
+	return out + (valid && isfinite(value) ? snprintf(out, room, "%.15g", value) : snprintf(out, room, "null"));
+}
+
+static void k_ghost_io_play_records(void *user_data_p)
+{
+	k_ghost_io_playback_t *playback_p = user_data_p;
+	/* Every record due is sent at once, so that recordings denser than the timer ticks keep up */
+	do
+	{
+		k_ghost_io_send_interface_event(playback_p->interface_name, playback_p->event);
+	} while (k_ghost_io_load_record(playback_p) && playback_p->due_ns <= k_ghost_io_ctx.timers.now_ns);
+	if (playback_p->pending && !__atomic_load_n(&playback_p->stopped, __ATOMIC_SEQ_CST))
+	{
+		const uint64_t now_ns = k_ghost_io_now_ns();
+		__atomic_store_n(&playback_p->timer,
+						 k_ghost_io_schedule_ns(playback_p->due_ns > now_ns ? playback_p->due_ns - now_ns : 0, 0, k_ghost_io_play_records, playback_p),
+						 __ATOMIC_SEQ_CST);
+	}
+}
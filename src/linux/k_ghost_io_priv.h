@@ -16,18 +16,478 @@ extern "C"
 
 #include "k_ghost_io.h"
 /* Macro ---------------------------------------------------------------------*/
+#ifndef K_GHOST_IO_ARENA_BLOCK_SIZE
+#define K_GHOST_IO_ARENA_BLOCK_SIZE 4096
+#endif
+
+#ifndef K_GHOST_IO_MAX_READERS
+#define K_GHOST_IO_MAX_READERS (K_GHOST_IO_MAX_WORKERS + 2)  //!< Threads tracked by the registry reclamation: I/O thread, workers, one spare
+#endif
+
+#define K_GHOST_IO_INTERFACE_REMOVED 0x80000000U  //!< Set in the pending count of an unregistered interface, retired with its last answer
+
+#define K_GHOST_IO_CACHE_LINE_SIZE 64
+
+#define K_GHOST_IO_MAX_SCHEMA_FIELDS 64	 //!< Fields of a schema, one bit each in the set of the decoded fields
+
+#ifndef K_GHOST_IO_SERVER_NAME
+#define K_GHOST_IO_SERVER_NAME "k_ghost_io"	 //!< Value of the Server header, see k_ghost_io_set_server_headers
+#endif
+
+#define K_GHOST_IO_RESPONSE_HEAD_SIZE 256  //!< Room for the headers of any response: status line, Date/Server and framing headers
+
+#define K_GHOST_IO_NS_PER_S 1000000000ULL
+
+#ifndef K_GHOST_IO_TIMER_TICK_NS
+#define K_GHOST_IO_TIMER_TICK_NS 100000ULL	//!< Resolution of the timers. With 100 us, the wheel reaches 29 hours without wrapping
+#endif
+
+#define K_GHOST_IO_TIMER_LEVELS 5  //!< Levels of the timer wheel, each one 64 times coarser than the previous
+
+#define K_GHOST_IO_TIMER_SLOT_BITS 6  //!< Bits of the tick counter indexing the slots of a level
+
+#define K_GHOST_IO_TIMER_SLOTS (1U << K_GHOST_IO_TIMER_SLOT_BITS)  //!< Slots of a level, one bit each in the occupancy mask
+
+#define K_GHOST_IO_TIMER_MAX_TICKS (1ULL << (K_GHOST_IO_TIMER_LEVELS * K_GHOST_IO_TIMER_SLOT_BITS))	 //!< Ticks covered by the wheel
+
+#ifndef K_GHOST_IO_MAX_REQUEST_SIZE
+#define K_GHOST_IO_MAX_REQUEST_SIZE 65536  //!< Largest request buffered in full, headers included. Streamed bodies are not limited
+#endif
+
+#ifndef K_GHOST_IO_RECORDER_BUFFER_SIZE
+#define K_GHOST_IO_RECORDER_BUFFER_SIZE (4U * 1024 * 1024)	//!< Size of the buffer of the traffic recorder, a power of two
+#endif
+
 /* Typedef -------------------------------------------------------------------*/
+typedef enum
+{
+	K_GHOST_IO_TRACE_REST  = 1,	 //!< Request to the REST endpoint, without name
+	K_GHOST_IO_TRACE_ROUTE = 2,	 //!< Request routed by its path, named after the interface
+	K_GHOST_IO_TRACE_EVENT = 3,	 //!< Event sent to the SSE clients, named after its interface if any
+} k_ghost_io_trace_kind_t;
+
+typedef struct
+{
+	uint64_t time_ns;	//!< Time of the library clock the entry was recorded at
+	uint32_t data_len;	//!< Length of the data, following the name
+	uint16_t name_len;	//!< Length of the interface name, following the entry
+	uint8_t	 kind;		//!< Kind of entry, see k_ghost_io_trace_kind_t
+	uint8_t	 reserved;	//!< Always 0
+} k_ghost_io_trace_entry_t;
+
+typedef struct
+{
+	char		   *buffer;	  //!< Entries not written yet, each behind a commit word, K_GHOST_IO_RECORDER_BUFFER_SIZE bytes
+	char		   *stage;	  //!< Entries copied out of the buffer, written to the file at once
+	uint64_t		head;	  //!< Bytes reserved by the producers since the start
+	uint64_t		tail;	  //!< Bytes given back by the flush thread since the start
+	uint64_t		dropped;  //!< Entries that did not fit in the buffer
+	int				active;	  //!< Set while entries are accepted
+	int				writers;  //!< Producers between the check of active and the commit of their entry
+	int				stop;	  //!< Set to let the flush thread write the last entries and exit
+	int				fd;		  //!< File of the capture
+	pthread_t		thread;	  //!< Thread writing the entries to the file
+	pthread_mutex_t lock;	  //!< Serializes the start and the stop of the captures
+} k_ghost_io_recorder_t;
+
+typedef enum
+{
+	K_GHOST_IO_SNAPSHOT_STATE	  = 1,	//!< Values of a state and time to its next publication
+	K_GHOST_IO_SNAPSHOT_GENERATOR = 2,	//!< Phase, random draws and gusts of a generator
+	K_GHOST_IO_SNAPSHOT_FAULTS	  = 3,	//!< Random draws of a fault profile
+	K_GHOST_IO_SNAPSHOT_FARM	  = 4,	//!< Values of a device farm and time to its next tick
+} k_ghost_io_snapshot_kind_t;
+
+typedef struct
+{
+	uint32_t data_len;	//!< Length of the data, following the name
+	uint16_t name_len;	//!< Length of the interface name, following the record
+	uint8_t	 kind;		//!< Kind of record, see k_ghost_io_snapshot_kind_t
+	uint8_t	 reserved;	//!< Always 0
+} k_ghost_io_snapshot_record_t;
+
+typedef struct
+{
+	char  *buffer;	//!< Where the snapshot is written, NULL to only measure it
+	size_t size;	//!< Size of the buffer
+	size_t offset;	//!< Length of the snapshot so far, whether it fit in the buffer or not
+} k_ghost_io_snapshot_writer_t;
+
+typedef enum
+{
+	K_GHOST_IO_CLOCK_SYSTEM,	 //!< In step with the monotonic clock, never changed
+	K_GHOST_IO_CLOCK_SCALED,	 //!< Running at the configured scale
+	K_GHOST_IO_CLOCK_PAUSED,	 //!< Stopped, only moved by k_ghost_io_step_clock
+	K_GHOST_IO_CLOCK_UNBOUNDED,	 //!< Stopped, moved to the next timer whenever the I/O thread is idle
+} k_ghost_io_clock_mode_t;
+
+typedef struct
+{
+	pthread_mutex_t			lock;			  //!< Serializes the writers of the clock, readers of the time never take it
+	uint32_t				sequence;		  //!< Odd while the pace below is being written, readers retry until it is even and unchanged
+	k_ghost_io_clock_mode_t mode;			  //!< Pace of the clock. Read without the lock to tell the system clock apart
+	k_ghost_io_clock_mode_t running_mode;	  //!< Mode to go back to when the clock is resumed
+	double					scale;			  //!< Virtual nanoseconds per real nanosecond in K_GHOST_IO_CLOCK_SCALED mode
+	uint64_t				base_real_ns;	  //!< Monotonic time of the last change of pace
+	uint64_t				base_virtual_ns;  //!< Virtual time at the last change of pace
+} k_ghost_io_clock_t;
+
+typedef struct
+{
+	uint64_t					expires_ns;	  //!< Time the timer is due
+	uint64_t					period_ns;	  //!< Time between two runs, 0 for a one-shot timer
+	k_ghost_io_timer_callback_t timer_cb;	  //!< Callback run when the timer is due
+	void					   *user_data_p;  //!< User data passed to the callback
+	uint32_t					generation;	  //!< Incremented every time the node is released, so that stale handles are told apart
+	uint32_t					next;		  //!< Index + 1 of the next node in the slot or in the free list, 0 for none
+	uint32_t					prev;		  //!< Index + 1 of the previous node in the slot, 0 for the first one
+	uint32_t					slot;		  //!< Index + 1 of the wheel slot holding the node, 0 if the timer is not armed
+} k_ghost_io_timer_node_t;
+
+typedef struct
+{
+	pthread_mutex_t			 lock;													  //!< Lock of the wheel, timers are armed and cancelled from any thread
+	pthread_mutex_t			 callback_lock;											  //!< Held while a callback runs, so that k_ghost_io_cancel can wait for it
+	k_ghost_io_timer_node_t *nodes;													  //!< Pool of the timers, addressed by index. Never shrinks
+	uint32_t				 capacity;												  //!< Number of nodes in the pool
+	uint32_t				 free_head;												  //!< Index + 1 of the first free node, 0 if the pool is full
+	uint32_t				 armed_count;											  //!< Number of armed timers
+	uint64_t				 now_tick;												  //!< Last tick processed
+	uint64_t				 now_ns;												  //!< Time passed to the running k_ghost_io_run_timers, read by the callbacks
+	uint64_t				 occupied[K_GHOST_IO_TIMER_LEVELS];						  //!< Non-empty slots of each level, one bit per slot
+	uint32_t				 heads[K_GHOST_IO_TIMER_LEVELS][K_GHOST_IO_TIMER_SLOTS];  //!< Index + 1 of the first node of each slot, 0 if empty
+} k_ghost_io_timer_wheel_t;
+
+typedef struct
+{
+	k_ghost_io_channel_t channel;	   //!< Parameters of the channel, the name points into the generator
+	int64_t				 gust_period;  //!< Period the current gust was drawn for
+	double				 gust_height;  //!< Height of the current gust
+} k_ghost_io_channel_state_t;
+
+typedef struct
+{
+	void					  *next_generator;	//!< Pointer to the next generator in the list
+	char					  *interface_name;	//!< Name of the interface the events are about
+	uint64_t				   period_ns;		//!< Time between two events
+	uint64_t				   start_ns;		//!< Time of the first event, the origin of the waveforms
+	k_ghost_io_timer_t		   timer;			//!< Periodic timer publishing the events
+	uint64_t				   rng_state;		//!< State of the noise generator, never 0
+	char					  *event;			//!< Buffer the events are formatted into, large enough for any sample
+	size_t					   event_size;		//!< Size of the event buffer
+	size_t					   channels_count;	//!< Number of channels
+	k_ghost_io_channel_state_t channels[];		//!< Channels of the generator
+} k_ghost_io_generator_t;
+
+typedef struct
+{
+	void			  *next_playback;	 //!< Pointer to the next playback in the list
+	char			  *interface_name;	 //!< Name of the interface the events are about
+	const char		  *map;				 //!< Mapping of the recording
+	size_t			   map_size;		 //!< Size of the recording
+	size_t			   data_offset;		 //!< Offset of the first record
+	size_t			   offset;			 //!< Offset of the record following the one in the event buffer
+	size_t			   released;		 //!< Offset up to which the pages were given back
+	int				   binary;			 //!< Set for the binary format, CSV otherwise
+	int				   loop;			 //!< Set to start over after the last record
+	int				   stopped;			 //!< Set once removed, so that the timer callback does not arm again
+	double			   speed;			 //!< Pace of the replay
+	double			   first_time;		 //!< Time of the first record of the recording, in seconds
+	uint64_t		   start_ns;		 //!< Library time the first record was sent at
+	uint64_t		   due_ns;			 //!< Library time of the record in the event buffer
+	int				   pending;			 //!< Set if the event buffer holds a record to send
+	k_ghost_io_timer_t timer;			 //!< One-shot timer of the record in the event buffer
+	char			  *event;			 //!< Buffer the record to send is formatted into, large enough for any record
+	size_t			   event_size;		 //!< Size of the event buffer
+	size_t			   channels_count;	 //!< Number of channels
+	const char		  *channel_names[];	 //!< Names of the channels, stored after the array
+} k_ghost_io_playback_t;
+
+typedef struct
+{
+	void						   *next_state;		 //!< Pointer to the next state in the list
+	char						   *interface_name;	 //!< Name of the interface the events are about
+	const k_ghost_io_schema_t	   *schema_p;		 //!< Fields of the state, not copied
+	const k_ghost_io_state_field_t *state_fields;	 //!< Publication of the fields, NULL to publish any change
+	k_ghost_io_timer_t				timer;			 //!< Periodic timer publishing the changes
+	uint64_t						forced;			 //!< Fields published at the next period whatever their change, one bit each
+	char						   *event;			 //!< Buffer the changes are formatted into, large enough for every field
+	size_t							event_size;		 //!< Size of the event buffer
+	char						   *published;		 //!< Values as last published, stored after the values as last set
+	char							current[];		 //!< Values as last set
+} k_ghost_io_state_t;
+
+typedef struct
+{
+	void						   *next_farm;		//!< Pointer to the next farm in the list
+	char						   *farm_name;		//!< Name of the farm, prefix of the instance names
+	size_t							name_len;		//!< Length of the farm name
+	const k_ghost_io_schema_t	   *schema_p;		//!< Fields of an instance, not copied
+	const k_ghost_io_state_field_t *state_fields;	//!< Publication of the fields, NULL to publish any change
+	size_t							count;			//!< Number of instances
+	k_ghost_io_farm_tick_t			tick_cb;		//!< Model update of all the instances
+	void						   *user_data_p;	//!< User data passed to the tick callback
+	k_ghost_io_timer_t				timer;			//!< Periodic timer running the ticks
+	uint64_t						last_tick_ns;	//!< Time of the previous tick
+	int								forced;			//!< Set to publish every instance in full at the next tick
+	uint64_t					   *changed;		//!< Fields of each instance to publish at this tick, one bit each
+	char						   *event;			//!< Buffer the changes of an instance are formatted into, large enough for every field
+	size_t							event_size;		//!< Size of the event buffer
+	char						   *instance_name;	//!< Buffer the names of the instances are formatted into, after the farm name
+	char						   *values;			//!< Block of all the columns, aligned on a cache line
+	void						   *columns[];		//!< Values as last set, one column per field, then the values as last published
+} k_ghost_io_farm_t;
+
+typedef struct
+{
+	void					  *next_fault;		  //!< Pointer to the next profile in the list
+	k_ghost_io_fault_profile_t profile;			  //!< Faults injected into the interface
+	uint64_t				   rng_state;		  //!< State of the random draws (xorshift64*)
+	size_t					   name_len;		  //!< Length of the interface name
+	char					   interface_name[];  //!< NUL terminated name of the interface
+} k_ghost_io_fault_t;
+
+typedef struct
+{
+	void	*next_event;  //!< Pointer to the next event on the link, in delivery order
+	uint64_t deliver_ns;  //!< Time the event has fully arrived at the client
+	size_t	 len;		  //!< Length of the event
+	char	 data[];	  //!< Event, as written to the stream
+} k_ghost_io_link_event_t;
+
+typedef struct
+{
+	k_ghost_io_link_profile_t profile;	  //!< Link emulated for the client
+	k_ghost_io_link_event_t	 *head;		  //!< Oldest event still on the link, NULL if none
+	k_ghost_io_link_event_t	 *tail;		  //!< Newest event on the link
+	uint64_t				  free_ns;	  //!< Time the link is done carrying the events already on it
+	uint64_t				  rng_state;  //!< State of the jitter draws (xorshift64*)
+	k_ghost_io_timer_t		  timer;	  //!< Timer of the delivery of the oldest event, 0 if none
+	int						  stopped;	  //!< Set once the client is removed, no more deliveries
+} k_ghost_io_sse_shaper_t;
+
+typedef struct
+{
+	void	   *next;	 //!< Pointer to the next (older) block of the arena
+	size_t		size;	 //!< Number of usable bytes in the block
+	size_t		used;	 //!< Number of bytes already handed out
+	max_align_t data[];	 //!< Block storage, aligned for any type
+} k_ghost_io_arena_block_t;
+
+typedef struct
+{
+	k_ghost_io_arena_block_t *head;	 //!< Block allocations are served from, NULL until the first allocation
+} k_ghost_io_arena_t;
+
+typedef struct
+{
+	k_ghost_io_interface_t interface;	   //!< Registered interface, first so that both share their address
+	size_t				   name_len;	   //!< Length of the interface name, computed once at registration
+	uint32_t			   name_hash;	   //!< Hash of the interface name, computed once at registration
+	void				  *prev_cb;		   //!< Pointer to the previous REST API callback in the list
+	unsigned int		   pending_count;  //!< Commands accepted and not answered yet, with K_GHOST_IO_INTERFACE_REMOVED once unregistered
+} k_ghost_io_interface_entry_t;
+
+typedef struct
+{
+	k_ghost_io_sse_clients_list_t client;		  //!< Connected client, first so that both share their address
+	char						 *queued_data;	  //!< Event data the socket could not take yet, NULL if the client is keeping up
+	size_t						  queued_len;	  //!< Number of bytes in queued_data
+	size_t						  queued_offset;  //!< Number of bytes of queued_data already sent
+	char						 *interfaces;	  //!< Comma separated names of the interfaces the client subscribed to, NULL for all of them
+	k_ghost_io_sse_shaper_t		 *shaper;		  //!< Emulated link the events go through, NULL if the stream is not shaped
+} k_ghost_io_sse_client_entry_t;
+
+typedef struct
+{
+	uint32_t				name_hash;	  //!< Cached hash of the interface name, checked before comparing names
+	k_ghost_io_interface_t *interface_p;  //!< Registered interface, NULL if the slot is empty
+} k_ghost_io_interface_slot_t;
+
+typedef struct
+{
+	size_t						capacity;  //!< Number of slots, always a power of two
+	size_t						count;	   //!< Number of used slots
+	k_ghost_io_interface_slot_t slots[];   //!< Open addressing slots, linearly probed
+} k_ghost_io_interface_table_t;
+
+typedef struct
+{
+	uint64_t epoch;																		 //!< Registry epoch seen when the reader entered its read section, plus one. 0 outside of read sections
+	uint32_t claimed;																	 //!< Set once a thread owns the slot
+	uint8_t	 padding[K_GHOST_IO_CACHE_LINE_SIZE - sizeof(uint64_t) - sizeof(uint32_t)];	 //!< Keeps each reader on its own cache line
+} k_ghost_io_reader_slot_t;
+
+typedef struct
+{
+	void	*ptr;	 //!< Memory unlinked from the registry, freed once no reader can see it
+	uint64_t epoch;	 //!< Registry epoch in which the memory was unlinked
+} k_ghost_io_retired_t;
+
 typedef struct
 {
-	int							   socket_fd;	   //!< File descriptor for the server socket
-	pthread_t					   system_thread;  //!< Thread for handling system operations
-	fd_set						   readfds;		   //!< File descriptor set for read operations with select
-	k_ghost_io_sse_clients_list_t *sse_clients;	   //!< Pointer to the linked list of SSE clients
-	k_ghost_io_interface_t		  *interfaces;	   //!< Pointer to the registered interfaces
+	k_ghost_io_token_t		token;		   //!< Token handed out to the callback
+	int						client_fd;	   //!< File descriptor of the client waiting for the response
+	void				   *next_request;  //!< Pointer to the next pending request in the list
+	k_ghost_io_interface_t *interface_p;   //!< Interface the request was admitted for, kept by the admission until the response
+} k_ghost_io_pending_request_t;
+
+typedef struct
+{
+	int			 client_fd;	   //!< Client waiting for the statuses
+	int			 reset;		   //!< Set if an item drew a connection reset, the client is then reset instead of answered
+	unsigned int remaining;	   //!< Items not completed yet, plus one while the I/O thread is still handing them out
+	size_t		 items_count;  //!< Number of items
+	int			 statuses[];   //!< HTTP status of each item, in the order of the batch
+} k_ghost_io_batch_t;
+
+typedef struct
+{
+	void				   *next_job;		   //!< Pointer to the next job in the worker queue
+	int						client_fd;		   //!< Client waiting for the response, -1 for a status synchronization
+	k_ghost_io_interface_t *interface_p;	   //!< Interface the request was admitted for, NULL for a status synchronization
+	k_ghost_io_batch_t	   *batch_p;		   //!< Batch the request is an item of, NULL for a single request
+	size_t					item;			   //!< Index of the item in its batch
+	uint32_t				name_hash;		   //!< Hash of the interface name, picks the worker
+	size_t					name_len;		   //!< Length of the interface name
+	char				   *request_body;	   //!< NUL terminated request body, stored after the name. NULL for a status synchronization
+	char					interface_name[];  //!< NUL terminated name of the addressed interface
+} k_ghost_io_job_t;
+
+typedef struct
+{
+	pthread_t		  thread;  //!< Thread running the jobs
+	pthread_mutex_t	  lock;	   //!< Lock of the job queue
+	pthread_cond_t	  cond;	   //!< Signaled when a job is queued or the worker is stopped
+	k_ghost_io_job_t *head;	   //!< Oldest queued job, NULL if the queue is empty
+	k_ghost_io_job_t *tail;	   //!< Newest queued job
+	int				  stop;	   //!< Set to make the thread exit once the queue is empty
+} k_ghost_io_worker_t;
+
+typedef enum
+{
+	K_GHOST_IO_FAULT_NONE,	 //!< Request run as usual
+	K_GHOST_IO_FAULT_RESET,	 //!< Connection reset without an answer
+	K_GHOST_IO_FAULT_ERROR,	 //!< Request answered with 500 without being run
+	K_GHOST_IO_FAULT_DELAY,	 //!< Request run later, on a timer
+} k_ghost_io_fault_kind_t;
+
+typedef enum
+{
+	K_GHOST_IO_BODY_HEADERS,	 //!< Headers not complete yet
+	K_GHOST_IO_BODY_LENGTH,		 //!< Body of known length, body_left bytes to go
+	K_GHOST_IO_BODY_CHUNK_SIZE,	 //!< Chunked body: size line of the next chunk
+	K_GHOST_IO_BODY_CHUNK_EXT,	 //!< Chunked body: extensions at the end of the size line, ignored
+	K_GHOST_IO_BODY_CHUNK_DATA,	 //!< Chunked body: data of the current chunk, body_left bytes to go
+	K_GHOST_IO_BODY_CHUNK_END,	 //!< Chunked body: line break closing the data of a chunk
+	K_GHOST_IO_BODY_TRAILER,	 //!< Chunked body: trailer fields after the last chunk, ignored
+	K_GHOST_IO_BODY_COMPLETE,	 //!< Request complete
+} k_ghost_io_body_state_t;
+
+typedef struct
+{
+	char				   *buffer;				 //!< Headers, then the body of buffered requests, decoded. NUL terminated
+	size_t					buffer_len;			 //!< Number of bytes in the buffer
+	size_t					buffer_capacity;	 //!< Size of the buffer, terminator excluded
+	size_t					header_len;			 //!< Length of the headers, blank line included. 0 until they are complete
+	k_ghost_io_body_state_t state;				 //!< Decoding state of the request
+	size_t					body_left;			 //!< Bytes left in the body or in the current chunk
+	int						chunk_digits;		 //!< Number of digits of the chunk size line read so far
+	int						line_len;			 //!< Length of the current trailer line
+	k_ghost_io_interface_t *stream_interface_p;	 //!< Interface the body is streamed to and was admitted for, NULL for a buffered request
+	k_ghost_io_stream_t		stream;				 //!< Progress of the streamed upload
+} k_ghost_io_connection_t;
+
+typedef enum
+{
+	K_GHOST_IO_RESPONSE_NONE,				  //!< No response
+	K_GHOST_IO_RESPONSE_CONTINUE,			  //!< 100 Continue, interim response before the body of a request
+	K_GHOST_IO_RESPONSE_OK,					  //!< 200 OK
+	K_GHOST_IO_RESPONSE_ACCEPTED,			  //!< 202 Accepted
+	K_GHOST_IO_RESPONSE_NO_CONTENT,			  //!< 204 No Content
+	K_GHOST_IO_RESPONSE_BAD_REQUEST,		  //!< 400 Bad Request
+	K_GHOST_IO_RESPONSE_NOT_FOUND,			  //!< 404 Not Found
+	K_GHOST_IO_RESPONSE_CONTENT_TOO_LARGE,	  //!< 413 Content Too Large
+	K_GHOST_IO_RESPONSE_INTERNAL_ERROR,		  //!< 500 Internal Server Error
+	K_GHOST_IO_RESPONSE_SERVICE_UNAVAILABLE,  //!< 503 Service Unavailable
+	K_GHOST_IO_RESPONSE_GATEWAY_TIMEOUT,	  //!< 504 Gateway Timeout
+	K_GHOST_IO_RESPONSE_SSE_STREAM,			  //!< 200 OK opening an event stream, the connection is kept open
+	K_GHOST_IO_RESPONSE_COUNT,				  //!< Number of fixed responses
+} k_ghost_io_response_id_t;
+
+typedef enum
+{
+	K_GHOST_IO_HEADER_CONTENT_LENGTH,	  //!< Content-Length
+	K_GHOST_IO_HEADER_TRANSFER_ENCODING,  //!< Transfer-Encoding
+	K_GHOST_IO_HEADER_EXPECT,			  //!< Expect
+	K_GHOST_IO_HEADER_LAST_EVENT_ID,	  //!< Last-Event-ID
+	K_GHOST_IO_HEADER_ACCEPT,			  //!< Accept
+	K_GHOST_IO_HEADER_COUNT,			  //!< Number of well-known headers
+} k_ghost_io_header_id_t;
+
+typedef struct
+{
+	const char *value;	//!< Value of the header, leading and trailing whitespace excluded. NULL if the header is missing
+	size_t		len;	//!< Length of the value
+} k_ghost_io_header_value_t;
+
+typedef struct
+{
+	size_t					  header_len;						//!< Length of the headers, blank line included
+	k_ghost_io_header_value_t values[K_GHOST_IO_HEADER_COUNT];	//!< Well-known headers, indexed by k_ghost_io_header_id_t. First occurrence
+} k_ghost_io_headers_t;
+
+typedef struct
+{
+	int							   socket_fd;							  //!< File descriptor for the server socket
+	pthread_t					   system_thread;						  //!< Thread for handling system operations
+	fd_set						   readfds;								  //!< File descriptor set for read operations with select
+	k_ghost_io_sse_clients_list_t *sse_clients;							  //!< Pointer to the linked list of SSE clients
+	k_ghost_io_interface_t		  *interfaces;							  //!< Pointer to the registered interfaces. Readers only follow next_cb
+	k_ghost_io_interface_table_t  *interface_table;						  //!< Hash index of the registered interfaces, replaced as a whole on every change
+	pthread_mutex_t				   registry_lock;						  //!< Serializes the registry writers, readers never take it
+	uint64_t					   registry_epoch;						  //!< Advanced every time memory is unlinked from the registry
+	uint32_t					   overflow_readers;					  //!< Readers in a read section without a reader slot
+	k_ghost_io_reader_slot_t	   reader_slots[K_GHOST_IO_MAX_READERS];  //!< Epochs of the registry readers
+	k_ghost_io_retired_t		  *retired;								  //!< Memory waiting for the readers to move on
+	size_t						   retired_count;						  //!< Number of retired entries
+	size_t						   retired_capacity;					  //!< Number of entries that fit in retired
+	pthread_mutex_t				   pending_lock;						  //!< Lock of the pending requests list, completions come from any thread
+	k_ghost_io_pending_request_t  *pending_requests;					  //!< Requests whose response was deferred by the callback
+	k_ghost_io_token_t			   last_token;							  //!< Last token handed out
+	unsigned int				   worker_count;						  //!< Number of workers running the callbacks, 0 to run them on the I/O thread
+	k_ghost_io_worker_t			  *workers;								  //!< Worker pool, NULL until started
+	int							   wake_fds[2];							  //!< Pipe waking the I/O thread up from select, read end first
+	pthread_mutex_t				   sse_lock;							  //!< Lock of the SSE clients list and of their queues, events come from any thread
+	k_ghost_io_limits_t			   limits;								  //!< Admission limits, 0 for no limit
+	unsigned int				   inflight_requests;					  //!< REST requests accepted and not answered yet
+	size_t						   sse_queued_bytes;					  //!< Event bytes queued for slow SSE clients
+	uint64_t					   shed_requests;						  //!< Requests answered with 503
+	uint64_t					   dropped_events;						  //!< Events dropped for slow SSE clients
+	int							   server_headers;						  //!< Set to add the Date and Server headers to the responses
+	pthread_mutex_t				   generator_lock;						  //!< Lock of the generators list
+	k_ghost_io_generator_t		  *generators;							  //!< Signal generators, in no particular order
+	k_ghost_io_timer_wheel_t	   timers;								  //!< Timers run by the I/O thread
+	k_ghost_io_clock_t			   clock;								  //!< Clock of the timers, possibly scaled or paused
+	pthread_mutex_t				   playback_lock;						  //!< Lock of the playbacks list
+	k_ghost_io_playback_t		  *playbacks;							  //!< Recordings being replayed, in no particular order
+	k_ghost_io_recorder_t		   recorder;							  //!< Capture of the traffic, inactive unless started
+	pthread_mutex_t				   state_lock;							  //!< Lock of the states list and of their values
+	k_ghost_io_state_t			  *states;								  //!< States published by the library, in no particular order
+	pthread_mutex_t				   farm_lock;							  //!< Lock of the device farms list and of their values
+	k_ghost_io_farm_t			  *farms;								  //!< Device farms, in no particular order
+	pthread_mutex_t				   fault_lock;							  //!< Lock of the fault profiles list and of their random draws
+	k_ghost_io_fault_t			  *faults;								  //!< Fault profiles of the interfaces, in no particular order
+	k_ghost_io_link_profile_t	   sse_link;							  //!< Link of the SSE clients connecting from now on, guarded by the SSE lock
 } k_ghost_io_ctx_t;
 
 /* Constant ------------------------------------------------------------------*/
 /* Variable ------------------------------------------------------------------*/
+extern k_ghost_io_ctx_t k_ghost_io_ctx;
+extern const char	   *k_ghost_io_rest_request_header;
+extern const char	   *k_ghost_io_rest_route_prefix;
+extern const char	   *k_ghost_io_faults_request_header;
+
 /* Function Declaration ------------------------------------------------------*/
 /**
  * @brief Thread's main function.
@@ -40,10 +500,11 @@ void *k_ghost_io_thread_func(void *arg);
 /**
  * @brief Add the SSE client to the linked list.
  * @param sse_client_fd File descriptor of the SSE client to be added.
+ * @param query Query string of the request, after the '?'. NULL if there is none
  *
  * @return 0 in case of success, -1 in case of failure.
  */
-int k_ghost_io_add_sse_client(int sse_client_fd);
+int k_ghost_io_add_sse_client(int sse_client_fd, const char *query);
 
 /**
  * @brief Remove the SSE client from the linked list.
@@ -51,6 +512,102 @@ int k_ghost_io_add_sse_client(int sse_client_fd);
  */
 void k_ghost_io_remove_sse_client(int sse_client_fd);
 
+/**
+ * @brief Route a complete request to the endpoint it is addressed to.
+ *
+ * @param client_fd File descriptor of the client
+ * @param request NUL terminated request, headers and body
+ * @param header_len Length of the headers found by k_ghost_io_scan_headers, blank line included. The body starts right after
+ *
+ * @return 0 if the I/O thread must keep watching the connection (SSE), 1 if it was closed or handed over.
+ */
+int k_ghost_io_manage_request(int client_fd, const char *request, size_t header_len);
+
+/**
+ * @brief Feed the bytes read from a client to the request being received on its connection.
+ *
+ * Requests that fit in a single read are routed right away without any allocation. The others are kept in a connection
+ * state until they are complete: bodies of stream interfaces are handed to the callback as they arrive, the other ones
+ * are buffered, up to K_GHOST_IO_MAX_REQUEST_SIZE.
+ *
+ * @param connection_pp State of the connection, NULL when no request is in progress. Allocated and freed as needed
+ * @param client_fd File descriptor of the client
+ * @param data Bytes read, NUL terminated
+ * @param len Number of bytes read
+ *
+ * @return 0 if the I/O thread must keep watching the connection, 1 if it was closed or handed over.
+ */
+int k_ghost_io_feed_connection(k_ghost_io_connection_t **connection_pp, int client_fd, const char *data, size_t len);
+
+/**
+ * @brief Drop the request in progress on a connection closed by the client. Streamed uploads are reported as aborted.
+ *
+ * @param connection_pp State of the connection, set to NULL
+ */
+void k_ghost_io_abort_connection(k_ghost_io_connection_t **connection_pp);
+
+/**
+ * @brief Find the stream interface a request is addressed to through the URI path.
+ *
+ * @param request Request, starting with the request line
+ *
+ * @return Stream interface, NULL if the request is not addressed to one
+ */
+k_ghost_io_interface_t *k_ghost_io_find_stream_interface(const char *request);
+
+/**
+ * @brief Make the last call of a streamed upload and answer the client, like for a request dispatched in one go.
+ *
+ * @param client_fd File descriptor of the client
+ * @param interface_p Interface the body was streamed to
+ * @param stream_p Progress of the upload, done is set by this function
+ *
+ * @return 1 if the response was deferred by the callback, 0 if it was sent.
+ */
+int k_ghost_io_finish_stream(int client_fd, k_ghost_io_interface_t *interface_p, k_ghost_io_stream_t *stream_p);
+
+/**
+ * @brief Send one of the fixed responses, with a single send.
+ *
+ * @param client_fd File descriptor of the client
+ * @param response_id Response to send
+ * @param flags Flags of the send call
+ */
+void k_ghost_io_send_static_response(int client_fd, k_ghost_io_response_id_t response_id, int flags);
+
+/**
+ * @brief Write the headers of a response: status line, Date/Server if enabled, extra fields and body framing.
+ *
+ * @param head Buffer of K_GHOST_IO_RESPONSE_HEAD_SIZE bytes receiving the headers, blank line included. Not NUL terminated
+ * @param status HTTP status code. Codes missing from the table of fixed responses get an empty reason phrase
+ * @param fields Optional. Extra header fields, each terminated by CRLF
+ * @param body_len Length of the JSON body following the headers, 0 for no body
+ *
+ * @return Length of the headers
+ */
+size_t k_ghost_io_format_response_head(char *head, int status, const char *fields, size_t body_len);
+
+/**
+ * @brief Find the blank line ending the headers of a request.
+ *
+ * @param data Request bytes
+ * @param len Number of bytes
+ *
+ * @return Position of the "\r\n\r\n" sequence, NULL if the headers are not complete
+ */
+const char *k_ghost_io_find_header_end(const char *data, size_t len);
+
+/**
+ * @brief Walk the headers of a request in a single pass, picking the well-known headers on the way.
+ *
+ * @param data Request bytes, starting with the request line
+ * @param len Number of bytes
+ * @param headers_p Set to the length of the headers and to the values of the well-known headers
+ *
+ * @return 0 if the headers are complete, -1 otherwise.
+ */
+int k_ghost_io_scan_headers(const char *data, size_t len, k_ghost_io_headers_t *headers_p);
+
 /**
  * @brief Add a new client to the list of known clients
  *
@@ -59,13 +616,161 @@ void k_ghost_io_remove_sse_client(int sse_client_fd);
  */
 void k_ghost_io_add_connection(int *client_a, int new_connection_fd);
 
+/**
+ * @brief Allocate memory from an arena. The memory is released all at once by k_ghost_io_arena_reset.
+ *
+ * @param arena_p Arena to allocate from
+ * @param size Number of bytes to allocate
+ *
+ * @return Pointer to the allocated memory, aligned for any type. NULL in case of failure.
+ */
+void *k_ghost_io_arena_alloc(k_ghost_io_arena_t *arena_p, size_t size);
+
+/**
+ * @brief Release all the allocations of an arena, keeping its memory for the next use.
+ *
+ * If the allocations did not fit in a single block, the blocks are merged in a single one so that the next use needs no allocation.
+ *
+ * @param arena_p Arena to reset
+ */
+void k_ghost_io_arena_reset(k_ghost_io_arena_t *arena_p);
+
+/**
+ * @brief Give back the memory of an arena to the system.
+ *
+ * @param arena_p Arena to free
+ */
+void k_ghost_io_arena_free(k_ghost_io_arena_t *arena_p);
+
+/**
+ * @brief Check if a pointer was allocated from an arena.
+ *
+ * @param arena_p Arena to check
+ * @param ptr Pointer to check
+ *
+ * @return 1 if the pointer belongs to the arena, 0 otherwise.
+ */
+int k_ghost_io_arena_owns(const k_ghost_io_arena_t *arena_p, const void *ptr);
+
+/**
+ * @brief Compute the hash used to index interface names.
+ *
+ * @param name Pointer to the interface name, not necessarily NUL terminated
+ * @param name_len Length of the interface name
+ *
+ * @return 32 bit FNV-1a hash of the name
+ */
+uint32_t k_ghost_io_hash_name(const char *name, size_t name_len);
+
+/**
+ * @brief Draw a pseudo-random number (xorshift64*).
+ *
+ * @param state_p State of the generator, never 0, advanced
+ *
+ * @return Uniformly distributed number in [0, 1)
+ */
+double k_ghost_io_random(uint64_t *state_p);
+
+/**
+ * @brief Look up a registered interface through the hash index.
+ *
+ * @param name Pointer to the interface name, not necessarily NUL terminated
+ * @param name_len Length of the interface name
+ *
+ * @return Pointer to the registered interface, NULL if not found
+ */
+k_ghost_io_interface_t *k_ghost_io_find_interface(const char *name, size_t name_len);
+
+/**
+ * @brief Skip the JSON whitespace at the cursor.
+ *
+ * @param cursor Position in a NUL terminated JSON text
+ *
+ * @return Position of the first non whitespace character
+ */
+const char *k_ghost_io_json_skip_whitespace(const char *cursor);
+
+/**
+ * @brief Write a JSON string, quotes included, escaping what JSON requires.
+ *
+ * @param out Where to write, room for 6 bytes per byte of the value and the quotes
+ * @param value Value, ending at its NUL or after value_size bytes
+ * @param value_size Size of the buffer holding the value
+ *
+ * @return End of the written text, not NUL terminated
+ */
+char *k_ghost_io_json_write_string(char *out, const char *value, size_t value_size);
+
+/**
+ * @brief Skip a JSON string, escapes included.
+ *
+ * @param cursor Position of the opening quote
+ *
+ * @return Position right after the closing quote, NULL if the string is not terminated
+ */
+const char *k_ghost_io_json_skip_string(const char *cursor);
+
+/**
+ * @brief Skip a JSON value of any type without decoding it.
+ *
+ * @param cursor Position of the first character of the value
+ *
+ * @return Position right after the value, NULL if the value is malformed
+ */
+const char *k_ghost_io_json_skip_value(const char *cursor);
+
+/**
+ * @brief Check that the fields of a schema fit in its command struct and have a size matching their type.
+ *
+ * @param schema_p Schema to check
+ *
+ * @return 0 if the schema is valid, -1 otherwise.
+ */
+int k_ghost_io_check_schema(const k_ghost_io_schema_t *schema_p);
+
+/**
+ * @brief Decode a JSON object into a command struct in a single pass, without building a cJSON tree.
+ *
+ * Keys that are not in the schema are skipped. The command must be zeroed by the caller, fields missing from the body keep their value.
+ *
+ * @param schema_p Schema of the command, checked with k_ghost_io_check_schema
+ * @param json_text NUL terminated JSON text
+ * @param command_p Command struct to fill
+ *
+ * @return 0 on success, -1 if the text is malformed or a field does not match the schema.
+ */
+int k_ghost_io_decode_command(const k_ghost_io_schema_t *schema_p, const char *json_text, void *command_p);
+
+/**
+ * @brief Find the top level "interface" member of a JSON request body without building a cJSON tree.
+ *
+ * @param request_body NUL terminated request body
+ * @param interface_pp Pointer filled with the start of the interface name, inside the body
+ * @param interface_len_p Pointer filled with the length of the interface name
+ *
+ * @return 0 if the interface name was found, -1 if the body must be fully parsed to know it.
+ */
+int k_ghost_io_scan_interface_key(const char *request_body, const char **interface_pp, size_t *interface_len_p);
+
 /**
  * @brief Manage REST requests
  *
  * @param client_fd File descriptor of the client that sent a new REST request
  * @param request Pointer to the request data
+ * @param header_len Length of the headers, blank line included. 0 if they are incomplete
  */
-void k_ghost_io_manage_rest_request(int client_fd, const char *request);
+void k_ghost_io_manage_rest_request(int client_fd, const char *request, size_t header_len);
+
+/**
+ * @brief Manage REST requests addressed to an interface through the URI path (e.g. POST /api/simulate/<interface>)
+ *
+ * The interface is resolved from the request line. Requests to unknown interfaces are rejected with 404 without parsing the body.
+ *
+ * @param client_fd File descriptor of the client that sent a new REST request
+ * @param request Pointer to the request data
+ * @param header_len Length of the headers, blank line included. 0 if they are incomplete
+ */
+void k_ghost_io_manage_rest_route_request(int client_fd, const char *request, size_t header_len);
 
 /**
  * @brief Manage the requests to unknown endpoints
@@ -74,6 +779,547 @@ void k_ghost_io_manage_rest_request(int client_fd, const char *request);
  */
 void k_ghost_io_manage_unknown_endpoint(int client_fd);
 
+/**
+ * @brief Enter a read section of the interface registry. Memory reachable from the registry is not freed until the section ends.
+ *
+ * Sections can be nested. Never blocks: a thread that finds no free reader slot holds back every reclamation instead.
+ */
+void k_ghost_io_registry_read_begin(void);
+
+/**
+ * @brief Leave a read section of the interface registry.
+ *
+ * Pointers found inside the section must not be used anymore: the memory retired meanwhile is freed by the next
+ * reclamation once every section that could see it has ended.
+ */
+void k_ghost_io_registry_read_end(void);
+
+/**
+ * @brief Make room for memory to be retired, so that k_ghost_io_registry_retire cannot fail. Must hold the registry lock.
+ *
+ * @param count Number of pointers about to be retired
+ *
+ * @return 0 on success, -1 in case of allocation failure.
+ */
+int k_ghost_io_registry_reserve(size_t count);
+
+/**
+ * @brief Hand memory unlinked from the registry over to the reclamation. Must hold the registry lock.
+ *
+ * @param ptr Pointer to free once no reader can see it anymore
+ */
+void k_ghost_io_registry_retire(void *ptr);
+
+/**
+ * @brief Free the retired memory that no reader can see anymore. Must hold the registry lock.
+ *
+ * Memory retired while a reader sits in a section started before it is kept for a later reclamation.
+ */
+void k_ghost_io_registry_reclaim(void);
+
+/**
+ * @brief Account for a new REST request, unless it would exceed the admission limits.
+ *
+ * @param interface_p Interface the request is addressed to, NULL to only account for the global limit
+ *
+ * @return 0 if the request is admitted and must be released with k_ghost_io_release_request once answered, -1 if it must be shed.
+ */
+int k_ghost_io_admit_request(k_ghost_io_interface_t *interface_p);
+
+/**
+ * @brief Account for the response of an admitted request.
+ *
+ * An admitted request keeps its interface: the entry of an interface unregistered meanwhile is only retired with its last answer.
+ *
+ * @param interface_p Interface the request was admitted for, NULL if it was admitted without one
+ */
+void k_ghost_io_release_request(k_ghost_io_interface_t *interface_p);
+
+/**
+ * @brief Tell whether an interface kept by an admitted request was unregistered since.
+ *
+ * @param interface_p Interface the request was admitted for
+ *
+ * @return 1 if the interface is no longer registered, 0 otherwise.
+ */
+int k_ghost_io_interface_removed(const k_ghost_io_interface_t *interface_p);
+
+/**
+ * @brief Account for an item of a batch, unless it would exceed the admission limits. Refused items are counted as shed.
+ *
+ * @param interface_p Interface the item is addressed to
+ *
+ * @return 0 if the item is admitted and must be released with k_ghost_io_release_request once run, -1 if it must be shed.
+ */
+int k_ghost_io_admit_batch_item(k_ghost_io_interface_t *interface_p);
+
+/**
+ * @brief Answer a request with 503 Service Unavailable and count it as shed. The connection is left open.
+ *
+ * @param client_fd File descriptor of the client
+ */
+void k_ghost_io_shed_request(int client_fd);
+
+/**
+ * @brief Check if the SSE queues leave room for a new subscriber.
+ *
+ * @return 0 if the subscriber is admitted, -1 if it must be shed.
+ */
+int k_ghost_io_admit_sse_client(void);
+
+/**
+ * @brief Account for event bytes queued for a slow SSE client. Must hold the SSE lock.
+ *
+ * @param count Number of bytes to queue
+ * @param force Set to queue the bytes even over the limit, for the end of an event already partially sent
+ *
+ * @return 0 if the bytes can be queued, -1 if the event must be dropped. Dropped events are counted.
+ */
+int k_ghost_io_reserve_sse_bytes(size_t count, int force);
+
+/**
+ * @brief Account for queued event bytes sent or discarded. Must hold the SSE lock.
+ *
+ * @param count Number of bytes that left the queues
+ */
+void k_ghost_io_release_sse_bytes(size_t count);
+
+/**
+ * @brief Wake the I/O thread up, so that it looks again at what it has to wait for.
+ */
+void k_ghost_io_wake(void);
+
+/**
+ * @brief Add the SSE clients with queued data to a select write set.
+ *
+ * @param writefds Set to add the clients to
+ *
+ * @return Highest file descriptor added, -1 if none.
+ */
+int k_ghost_io_watch_sse_clients(fd_set *writefds);
+
+/**
+ * @brief Send the queued data of the SSE clients whose socket is writable.
+ *
+ * @param writefds Set of the writable clients, as returned by select
+ */
+void k_ghost_io_flush_sse_clients(const fd_set *writefds);
+
+/**
+ * @brief Publish the whole states at their next period, e.g. for a new SSE client.
+ */
+void k_ghost_io_force_states(void);
+
+/**
+ * @brief Size of a buffer holding an event with every field of a state, as formatted by k_ghost_io_format_member.
+ *
+ * @param schema_p Fields of the state
+ *
+ * @return Size of the buffer, NUL included
+ */
+size_t k_ghost_io_state_event_size(const k_ghost_io_schema_t *schema_p);
+
+/**
+ * @brief Tell whether a member moved far enough from its published value to be published again.
+ *
+ * @param field_p Field of the member
+ * @param deadband Smallest change of a numeric member worth publishing, 0 on any change
+ * @param current_p Member as last set
+ * @param published_p Member as last published
+ *
+ * @return 1 if the member must be published, 0 otherwise
+ */
+int k_ghost_io_state_moved(const k_ghost_io_field_t *field_p, double deadband, const void *current_p, const void *published_p);
+
+/**
+ * @brief Append a member to the event being formatted, as "name":value followed by a comma.
+ *
+ * @param field_p Field of the member
+ * @param out Where to write the member
+ * @param member_p Member to write
+ *
+ * @return End of the written text
+ */
+char *k_ghost_io_format_member(const k_ghost_io_field_t *field_p, char *out, const void *member_p);
+
+/**
+ * @brief Check that string members read from outside, e.g. from a snapshot, are NUL terminated within their field.
+ *
+ * @param field_p Field of the members, nothing to check unless it is a string
+ * @param members First member
+ * @param count Number of members, one after the other
+ *
+ * @return 0 if every member is terminated, -1 otherwise.
+ */
+int k_ghost_io_check_string_members(const k_ghost_io_field_t *field_p, const char *members, size_t count);
+
+/**
+ * @brief Publish every instance of the device farms in full at their next tick, e.g. for a new SSE client.
+ */
+void k_ghost_io_force_farms(void);
+
+/**
+ * @brief Answer a request routed to an instance of a device farm: set the fields of its body, reply with the whole instance.
+ *
+ * @param client_fd File descriptor of the client, not closed
+ * @param name Name the request was routed to, e.g. "anemometer/0042". Not NUL terminated
+ * @param name_len Length of the name
+ * @param request_body NUL terminated body of the request
+ *
+ * @return 0 if the name is an instance and a response was sent, -1 otherwise.
+ */
+int k_ghost_io_manage_farm_request(int client_fd, const char *name, size_t name_len, const char *request_body);
+
+/**
+ * @brief Write event data to an SSE client without blocking. Must hold the SSE lock.
+ *
+ * What the socket cannot take is queued and sent by the I/O thread once the socket is writable again. If the queues are
+ * over their limit, the event is dropped for this client instead.
+ *
+ * @param client_p SSE client to write to
+ * @param data Event data
+ * @param len Length of the event data
+ */
+void k_ghost_io_sse_write(k_ghost_io_sse_client_entry_t *client_p, const char *data, size_t len);
+
+/**
+ * @brief Create the emulated link of a new SSE client, from the default link and the query of its request.
+ *
+ * @param sse_client_fd File descriptor of the client, seeds the jitter
+ * @param query Query string, after the '?' and up to the end of the request target. NULL if there is none
+ *
+ * @return Shaper of the client, NULL if its stream is not shaped.
+ */
+k_ghost_io_sse_shaper_t *k_ghost_io_new_shaper(int sse_client_fd, const char *query);
+
+/**
+ * @brief Put an event on the emulated link of an SSE client, it is written once it has arrived. Must hold the SSE lock.
+ *
+ * @param client_p SSE client, with a shaper
+ * @param data Event, as written to the stream
+ * @param len Length of the event
+ */
+void k_ghost_io_shape_event(k_ghost_io_sse_client_entry_t *client_p, const char *data, size_t len);
+
+/**
+ * @brief Stop the deliveries of a shaper whose client is being removed. Must hold the SSE lock.
+ *
+ * @param shaper_p Shaper of the client
+ */
+void k_ghost_io_stop_shaper(k_ghost_io_sse_shaper_t *shaper_p);
+
+/**
+ * @brief Free a stopped shaper, once a delivery in progress is over. Must not hold the SSE lock.
+ *
+ * @param shaper_p Shaper of the client
+ */
+void k_ghost_io_free_shaper(k_ghost_io_sse_shaper_t *shaper_p);
+
+/**
+ * @brief Apply the fault profile of an interface to a request admitted for it.
+ *
+ * @param client_fd File descriptor of the client
+ * @param interface_p Interface the request is addressed to
+ * @param request_body NUL terminated request body, copied if the request is delayed
+ * @param response_pending_p Set to 1 if the connection is kept for a delayed request, 0 if it can be closed and the request released
+ *
+ * @return 0 if a fault was injected, -1 if the request must be run as usual.
+ */
+int k_ghost_io_inject_fault(int client_fd, k_ghost_io_interface_t *interface_p, const char *request_body, int *response_pending_p);
+
+/**
+ * @brief Draw the fault a request to an interface suffers, according to the fault profile of the interface.
+ *
+ * @param interface_p Interface the request is addressed to
+ * @param delay_ns_p Set to the delay before the request is run, for K_GHOST_IO_FAULT_DELAY
+ *
+ * @return Fault to inject, K_GHOST_IO_FAULT_NONE if the request must be run as usual.
+ */
+k_ghost_io_fault_kind_t k_ghost_io_draw_fault(const k_ghost_io_interface_t *interface_p, uint64_t *delay_ns_p);
+
+/**
+ * @brief Keep a job aside and hand it to the workers once a delay has elapsed, or run it right away without them.
+ *
+ * @param job_p Job of the request, freed once run. Left to the caller on failure
+ * @param delay_ns Delay before the job is run, in nanoseconds
+ *
+ * @return 0 on success, -1 if the job could not be kept.
+ */
+int k_ghost_io_delay_job(k_ghost_io_job_t *job_p, uint64_t delay_ns);
+
+/**
+ * @brief Draw how many times an event about an interface is sent to a client, according to the fault profile of the interface.
+ *
+ * @param interface_name Name of the interface, not NUL terminated
+ * @param name_len Length of the name
+ *
+ * @return 1 without faults, 0 if the event is dropped, 2 if it is duplicated.
+ */
+int k_ghost_io_draw_event_copies(const char *interface_name, size_t name_len);
+
+/**
+ * @brief Process a request on the fault control endpoint and close the connection.
+ *
+ * @param client_fd File descriptor of the client
+ * @param request NUL terminated request, headers included
+ * @param header_len Length of the headers, blank line included. 0 if they are incomplete
+ */
+void k_ghost_io_manage_faults_request(int client_fd, const char *request, size_t header_len);
+
+/**
+ * @brief Start a record of the snapshot being written.
+ *
+ * @param writer_p Snapshot being written
+ * @param kind Kind of record
+ * @param name Interface name
+ * @param data_len Length of the data, appended next with k_ghost_io_snapshot_append
+ *
+ * @return 0 on success, -1 if the name is too long for a record: the data must not be appended.
+ */
+int k_ghost_io_snapshot_record(k_ghost_io_snapshot_writer_t *writer_p, k_ghost_io_snapshot_kind_t kind, const char *name, size_t data_len);
+
+/**
+ * @brief Append bytes to the snapshot being written, or only count them once it outgrows the buffer.
+ *
+ * @param writer_p Snapshot being written
+ * @param data Bytes to append
+ * @param len Number of bytes
+ */
+void k_ghost_io_snapshot_append(k_ghost_io_snapshot_writer_t *writer_p, const void *data, size_t len);
+
+/**
+ * @brief Write a record per state: time to its next publication, then its values as last set.
+ *
+ * @param writer_p Snapshot being written
+ */
+void k_ghost_io_snapshot_states(k_ghost_io_snapshot_writer_t *writer_p);
+
+/**
+ * @brief Check a state record before any record of the snapshot is restored.
+ *
+ * @param interface_name Name of the interface
+ * @param data Data of the record
+ * @param data_len Length of the data
+ *
+ * @return 0 if the record can be restored or matches no state, -1 if it does not fit the schema or holds unterminated strings.
+ */
+int k_ghost_io_check_state_record(const char *interface_name, const char *data, size_t data_len);
+
+/**
+ * @brief Restore a state from its record. The whole state is published again at the restored time.
+ *
+ * @param interface_name Name of the interface
+ * @param data Data of the record
+ * @param data_len Length of the data
+ *
+ * @return 0 on success, -1 if the interface has no state or the record does not match its schema.
+ */
+int k_ghost_io_restore_state(const char *interface_name, const char *data, size_t data_len);
+
+/**
+ * @brief Write a record per device farm: time to its next tick, then the columns of its values as last set.
+ *
+ * @param writer_p Snapshot being written
+ */
+void k_ghost_io_snapshot_farms(k_ghost_io_snapshot_writer_t *writer_p);
+
+/**
+ * @brief Check a device farm record before any record of the snapshot is restored.
+ *
+ * @param farm_name Name of the farm
+ * @param data Data of the record
+ * @param data_len Length of the data
+ *
+ * @return 0 if the record can be restored or matches no farm, -1 if it does not fit the schema and count or holds unterminated strings.
+ */
+int k_ghost_io_check_farm_record(const char *farm_name, const char *data, size_t data_len);
+
+/**
+ * @brief Restore a device farm from its record. Every instance is published again at the restored time.
+ *
+ * @param farm_name Name of the farm
+ * @param data Data of the record
+ * @param data_len Length of the data
+ *
+ * @return 0 on success, -1 if there is no such farm or the record does not match its schema and count.
+ */
+int k_ghost_io_restore_farm(const char *farm_name, const char *data, size_t data_len);
+
+/**
+ * @brief Write a record per generator: time since its start, time to its next event, state of its random draws and
+ * gusts of its channels.
+ *
+ * @param writer_p Snapshot being written
+ */
+void k_ghost_io_snapshot_generators(k_ghost_io_snapshot_writer_t *writer_p);
+
+/**
+ * @brief Restore a generator from its record.
+ *
+ * @param interface_name Name of the interface
+ * @param data Data of the record
+ * @param data_len Length of the data
+ *
+ * @return 0 on success, -1 if the interface has no generator or the record does not match its channels.
+ */
+int k_ghost_io_restore_generator(const char *interface_name, const char *data, size_t data_len);
+
+/**
+ * @brief Write a record per fault profile: state of its random draws.
+ *
+ * @param writer_p Snapshot being written
+ */
+void k_ghost_io_snapshot_faults(k_ghost_io_snapshot_writer_t *writer_p);
+
+/**
+ * @brief Restore a fault profile from its record.
+ *
+ * @param interface_name Name of the interface
+ * @param data Data of the record
+ * @param data_len Length of the data
+ *
+ * @return 0 on success, -1 if the interface has no fault profile or the record is malformed.
+ */
+int k_ghost_io_restore_faults(const char *interface_name, const char *data, size_t data_len);
+
+/**
+ * @brief Append an entry to the traffic capture, if one is running. Lock-free, can be called from any thread.
+ *
+ * @param kind Kind of entry
+ * @param name Interface name, NULL if none
+ * @param name_len Length of the interface name, 0 if none
+ * @param data Request body or event data
+ * @param data_len Length of the data
+ */
+void k_ghost_io_record(k_ghost_io_trace_kind_t kind, const char *name, size_t name_len, const char *data, size_t data_len);
+
+/**
+ * @brief Read the library clock the timers are scheduled with: the monotonic clock, unless scaled or paused. Never blocks,
+ * the pace is read without the clock lock.
+ *
+ * @return Current time in nanoseconds
+ */
+uint64_t k_ghost_io_now_ns(void);
+
+/**
+ * @brief Turn the time until the next timer, on the library clock, into the time the I/O thread has to wait for.
+ *
+ * With an unbounded clock, the clock jumps to the timer instead and the thread does not wait.
+ *
+ * @param wait_ns Time until the next timer, -1 if no timer is armed
+ *
+ * @return Real time to wait in nanoseconds, -1 to wait until woken up.
+ */
+int64_t k_ghost_io_clock_wait(int64_t wait_ns);
+
+/**
+ * @brief Arm a timer with a nanosecond resolution delay and period. See k_ghost_io_schedule.
+ *
+ * @param delay_ns Time from now to the first run
+ * @param period_ns Time between two runs, 0 for a one-shot timer
+ * @param timer_cb Callback to run
+ * @param user_data_p User data passed to the callback
+ *
+ * @return Handle of the timer, 0 in case of failure.
+ */
+k_ghost_io_timer_t k_ghost_io_schedule_ns(uint64_t delay_ns, uint64_t period_ns, k_ghost_io_timer_callback_t timer_cb, void *user_data_p);
+
+/**
+ * @brief Tell how long until a timer runs.
+ *
+ * @param timer Handle of the timer
+ *
+ * @return Nanoseconds until the next run, 0 if it is due or the timer is not armed.
+ */
+uint64_t k_ghost_io_timer_remaining_ns(k_ghost_io_timer_t timer);
+
+/**
+ * @brief Move the next run of an armed timer, keeping its period and its handle.
+ *
+ * @param timer Handle of the timer
+ * @param delay_ns Time from now to the next run
+ *
+ * @return 0 on success, -1 if the timer is not armed.
+ */
+int k_ghost_io_rearm_ns(k_ghost_io_timer_t timer, uint64_t delay_ns);
+
+/**
+ * @brief Run the callbacks of the timers that are due, and tell how long the I/O thread can wait for the next one.
+ *
+ * @param now_ns Current time, as returned by k_ghost_io_now_ns
+ *
+ * @return Nanoseconds until the wheel needs to run again, -1 if no timer is armed.
+ */
+int64_t k_ghost_io_run_timers(uint64_t now_ns);
+
+/**
+ * @brief Start the worker threads configured with k_ghost_io_set_worker_count.
+ *
+ * @return 0 on success (or if there are no workers to start), -1 on failure.
+ */
+int k_ghost_io_start_workers(void);
+
+/**
+ * @brief Stop the first workers of the pool, waiting for them to run the jobs left in their queues, and free the pool.
+ *
+ * @param workers_count Number of workers to stop, all the started ones at most
+ */
+void k_ghost_io_stop_workers(unsigned int workers_count);
+
+/**
+ * @brief Build the job of a request, not queued yet.
+ *
+ * @param interface_p Interface the request is addressed to, kept by the job until it is answered unless it is a status synchronization
+ * @param client_fd Client to answer, -1 for status synchronizations
+ * @param request_body Request body, copied in the job. NULL for status synchronizations
+ *
+ * @return New job, to be freed by the caller. NULL in case of allocation failure.
+ */
+k_ghost_io_job_t *k_ghost_io_new_job(k_ghost_io_interface_t *interface_p, int client_fd, const char *request_body);
+
+/**
+ * @brief Queue a job on the worker its interface is sharded to.
+ *
+ * @param job_p Job built with k_ghost_io_new_job, freed by the worker once run. Left to the caller on failure
+ *
+ * @return 0 if the job was queued, -1 if there are no workers.
+ */
+int k_ghost_io_queue_job(k_ghost_io_job_t *job_p);
+
+/**
+ * @brief Queue a request on the worker the interface is sharded to.
+ *
+ * @param interface_p Interface the request is addressed to, kept by the job until it is answered unless it is a status synchronization
+ * @param client_fd Client to answer, -1 for status synchronizations
+ * @param request_body Request body, copied in the job. NULL for status synchronizations
+ *
+ * @return 0 if the job was queued, -1 if there are no workers or in case of allocation failure.
+ */
+int k_ghost_io_submit_job(k_ghost_io_interface_t *interface_p, int client_fd, const char *request_body);
+
+/**
+ * @brief Take the next job off a worker queue, run it and free it.
+ *
+ * Body of the worker threads, also called directly to drain a queue when there is no thread to do it.
+ *
+ * @param worker_p Worker to take the job from
+ * @param wait Set to wait for a job if the queue is empty, until the worker is stopped
+ *
+ * @return 0 if a job was run, -1 if the queue was empty.
+ */
+int k_ghost_io_worker_run_job(k_ghost_io_worker_t *worker_p, int wait);
+
+/**
+ * @brief Run a queued job: dispatch the request or the status synchronization it holds.
+ *
+ * A request keeps the interface it was admitted for: if the interface was unregistered while the job was queued, it is
+ * answered with 404, or reported as 204 in its batch, without running the callback. Status synchronizations are not
+ * admitted, their interface is looked up again by name inside a registry read section and skipped if it is gone.
+ *
+ * @param job_p Job to run, not freed
+ */
+void k_ghost_io_run_job(const k_ghost_io_job_t *job_p);
+
 #ifdef __cplusplus
 }
 #endif
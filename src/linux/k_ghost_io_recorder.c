@@ -0,0 +1,392 @@
+/**
+ * @file k_ghost_io_recorder.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_TRACE_MAGIC "KGIOTRC1"
+
+#define K_GHOST_IO_RECORDER_MASK ((uint64_t)K_GHOST_IO_RECORDER_BUFFER_SIZE - 1)
+
+#define K_GHOST_IO_RECORDER_STAGE_SIZE (64 * 1024)	//!< Entries gathered before a write to the file
+
+#define K_GHOST_IO_RECORDER_COMMIT_SIZE 8  //!< Commit word in front of each entry of the buffer, padded for the entry alignment
+
+#define K_GHOST_IO_RECORDER_PADDING 0x80000000U	 //!< Flag of the commit word of the space skipped at the end of the buffer
+
+#define K_GHOST_IO_RECORDER_IDLE_NS 1000000	 //!< Sleep of the flush thread when the buffer is empty
+
+#define K_GHOST_IO_REPLAY_REQUEST_HEAD_SIZE 512	 //!< Room for the head of a replayed request
+
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Reserve room for an entry in the buffer, skipping the end of the buffer if the entry does not fit there.
+ *
+ * @param recorder_p Recorder
+ * @param size Size of the entry, commit word included, a multiple of 8
+ *
+ * @return Start of the entry, NULL if the buffer is full
+ */
+static char *k_ghost_io_recorder_reserve(k_ghost_io_recorder_t *recorder_p, uint64_t size);
+
+/**
+ * @brief Write the committed entries to the file, in order, up to the first entry still being filled.
+ *
+ * @param recorder_p Recorder
+ *
+ * @return Number of bytes given back to the producers
+ */
+static uint64_t k_ghost_io_recorder_flush(k_ghost_io_recorder_t *recorder_p);
+
+/**
+ * @brief Write a whole buffer to a file, whatever the number of calls it takes.
+ *
+ * @param fd File descriptor
+ * @param data Data to write
+ * @param len Length of the data
+ */
+static void k_ghost_io_recorder_write(int fd, const char *data, size_t len);
+
+/**
+ * @brief Thread writing the entries to the file until the capture is stopped.
+ *
+ * @param arg Recorder
+ *
+ * @return NULL
+ */
+static void *k_ghost_io_recorder_thread_func(void *arg);
+
+/**
+ * @brief Send a request to a server on a new connection and read the response through.
+ *
+ * @param server_addr_p Address of the server
+ * @param head Request line and headers, blank line included
+ * @param head_len Length of the head
+ * @param body Body of the request
+ * @param body_len Length of the body
+ *
+ * @return 0 if the server answered, -1 otherwise
+ */
+static int k_ghost_io_replay_request(const struct sockaddr_in *server_addr_p, const char *head, size_t head_len, const char *body, size_t body_len);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+int k_ghost_io_start_recording(const char *path)
+{
+	int					   ret_code	  = -1;
+	k_ghost_io_recorder_t *recorder_p = &k_ghost_io_ctx.recorder;
+	pthread_mutex_lock(&recorder_p->lock);
+	if (path && !recorder_p->buffer)
+	{
+		recorder_p->buffer = calloc(1, K_GHOST_IO_RECORDER_BUFFER_SIZE);
+		recorder_p->stage  = recorder_p->buffer ? malloc(K_GHOST_IO_RECORDER_STAGE_SIZE) : NULL;
+		recorder_p->fd	   = recorder_p->stage ? open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+		if (recorder_p->fd >= 0)
+		{
+			k_ghost_io_recorder_write(recorder_p->fd, K_GHOST_IO_TRACE_MAGIC, sizeof(K_GHOST_IO_TRACE_MAGIC) - 1);
+			recorder_p->head	= 0;
+			recorder_p->tail	= 0;
+			recorder_p->dropped = 0;
+			recorder_p->stop	= 0;
+			if (0 == pthread_create(&recorder_p->thread, NULL, k_ghost_io_recorder_thread_func, recorder_p))
+			{
+				__atomic_store_n(&recorder_p->active, 1, __ATOMIC_SEQ_CST);
+				ret_code = 0;
+			}
+			else
+			{
+				close(recorder_p->fd);
+			}
+		}
+		if (0 != ret_code)
+		{
+			free(recorder_p->stage);
+			free(recorder_p->buffer);
+			recorder_p->stage  = NULL;
+			recorder_p->buffer = NULL;
+		}
+	}
+	pthread_mutex_unlock(&recorder_p->lock);
+	return ret_code;
+}
+
+int64_t k_ghost_io_stop_recording(void)
+{
+	int64_t				   dropped	  = -1;
+	k_ghost_io_recorder_t *recorder_p = &k_ghost_io_ctx.recorder;
+	pthread_mutex_lock(&recorder_p->lock);
+	if (recorder_p->buffer)
+	{
+		/* No entry is accepted from now on; the producers already past the check commit theirs before the last flush */
+		__atomic_store_n(&recorder_p->active, 0, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&recorder_p->writers, __ATOMIC_SEQ_CST))
+		{
+			sched_yield();
+		}
+		__atomic_store_n(&recorder_p->stop, 1, __ATOMIC_RELEASE);
+		pthread_join(recorder_p->thread, NULL);
+		close(recorder_p->fd);
+		dropped = (int64_t)__atomic_load_n(&recorder_p->dropped, __ATOMIC_RELAXED);
+		free(recorder_p->stage);
+		free(recorder_p->buffer);
+		recorder_p->stage  = NULL;
+		recorder_p->buffer = NULL;
+	}
+	pthread_mutex_unlock(&recorder_p->lock);
+	return dropped;
+}
+
+void k_ghost_io_record(const k_ghost_io_trace_kind_t kind, const char *name, const size_t name_len, const char *data, const size_t data_len)
+{
+	k_ghost_io_recorder_t *recorder_p = &k_ghost_io_ctx.recorder;
+	/* A single relaxed load when no capture is running */
+	if (__atomic_load_n(&recorder_p->active, __ATOMIC_RELAXED))
+	{
+		__atomic_add_fetch(&recorder_p->writers, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&recorder_p->active, __ATOMIC_SEQ_CST))
+		{
+			const size_t entry_len = sizeof(k_ghost_io_trace_entry_t) + name_len + data_len;
+			const size_t size	   = (K_GHOST_IO_RECORDER_COMMIT_SIZE + entry_len + 7) & ~(size_t)7;
+			char		*slot	   = name_len <= UINT16_MAX && data_len <= UINT32_MAX && size <= K_GHOST_IO_RECORDER_BUFFER_SIZE / 2
+										 ? k_ghost_io_recorder_reserve(recorder_p, size)
+										 : NULL;
+			if (slot)
+			{
+				const k_ghost_io_trace_entry_t entry = {k_ghost_io_now_ns(), (uint32_t)data_len, (uint16_t)name_len, (uint8_t)kind, 0};
+				char						  *out	 = slot + K_GHOST_IO_RECORDER_COMMIT_SIZE;
+				memcpy(out, &entry, sizeof(entry));
+				if (name_len)
+				{
+					memcpy(out + sizeof(entry), name, name_len);
+				}
+				memcpy(out + sizeof(entry) + name_len, data, data_len);
+				__atomic_store_n((uint32_t *)slot, (uint32_t)size, __ATOMIC_RELEASE);
+			}
+			else
+			{
+				__atomic_add_fetch(&recorder_p->dropped, 1, __ATOMIC_RELAXED);
+			}
+		}
+		__atomic_sub_fetch(&recorder_p->writers, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+int64_t k_ghost_io_replay_recording(const char *path, const char *host, const uint16_t port, const double speed)
+{
+	int64_t			   answered = -1;
+	struct sockaddr_in server_addr;
+	struct stat		   file_stat;
+	memset(&server_addr, 0, sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_port   = htons(port);
+	const int fd		   = path && host && speed >= 0.0 && 1 == inet_pton(AF_INET, host, &server_addr.sin_addr) ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+	if (fd >= 0 && 0 == fstat(fd, &file_stat) && (size_t)file_stat.st_size >= sizeof(K_GHOST_IO_TRACE_MAGIC) - 1)
+	{
+		const size_t map_size = (size_t)file_stat.st_size;
+		const char	*map	  = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED != map && 0 == memcmp(map, K_GHOST_IO_TRACE_MAGIC, sizeof(K_GHOST_IO_TRACE_MAGIC) - 1))
+		{
+			madvise((void *)map, map_size, MADV_SEQUENTIAL);
+			struct timespec start;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			uint64_t first_ns = UINT64_MAX;
+			size_t	 offset	  = sizeof(K_GHOST_IO_TRACE_MAGIC) - 1;
+			answered		  = 0;
+			while (map_size - offset >= sizeof(k_ghost_io_trace_entry_t))
+			{
+				k_ghost_io_trace_entry_t entry;
+				memcpy(&entry, map + offset, sizeof(entry));
+				const char *name = map + offset + sizeof(entry);
+				const char *data = name + entry.name_len;
+				if (map_size - offset - sizeof(entry) < (size_t)entry.name_len + entry.data_len)
+				{
+					/* Capture cut short, e.g. by a crash: the partial entry is ignored */
+					break;
+				}
+				offset += sizeof(entry) + entry.name_len + entry.data_len;
+				/* Threads may record slightly out of order, the timeline starts at the earliest entry */
+				first_ns = first_ns < entry.time_ns ? first_ns : entry.time_ns;
+				if (K_GHOST_IO_TRACE_REST == entry.kind || (K_GHOST_IO_TRACE_ROUTE == entry.kind && entry.name_len))
+				{
+					if (speed > 0.0)
+					{
+						/* Paced on the time of the recording, not on the end of the previous request */
+						const double	delay_ns = (double)(entry.time_ns - first_ns) / speed;
+						const uint64_t	due_ns	 = (uint64_t)start.tv_nsec + (delay_ns > 0.0 ? (uint64_t)delay_ns : 0);
+						struct timespec due		 = {.tv_sec = start.tv_sec + (time_t)(due_ns / K_GHOST_IO_NS_PER_S), .tv_nsec = (long)(due_ns % K_GHOST_IO_NS_PER_S)};
+						while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL))
+						{
+						}
+					}
+					char	  head[K_GHOST_IO_REPLAY_REQUEST_HEAD_SIZE];
+					const int head_len =
+						K_GHOST_IO_TRACE_ROUTE == entry.kind
+							? snprintf(head, sizeof(head), "%s%.*s HTTP/1.1\r\nContent-Type: application/json\r\nContent-Length: %u\r\n\r\n",
+									   k_ghost_io_rest_route_prefix, (int)entry.name_len, name, entry.data_len)
+							: snprintf(head, sizeof(head), "%sContent-Type: application/json\r\nContent-Length: %u\r\n\r\n", k_ghost_io_rest_request_header,
+									   entry.data_len);
+					if (head_len > 0 && (size_t)head_len < sizeof(head) &&
+						0 == k_ghost_io_replay_request(&server_addr, head, (size_t)head_len, data, entry.data_len))
+					{
+						answered++;
+					}
+				}
+			}
+		}
+		if (MAP_FAILED != map)
+		{
+			munmap((void *)map, map_size);
+		}
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	return answered;
+}
+
+static char *k_ghost_io_recorder_reserve(k_ghost_io_recorder_t *recorder_p, const uint64_t size)
+{
+	char	*slot	 = NULL;
+	uint64_t head	 = __atomic_load_n(&recorder_p->head, __ATOMIC_RELAXED);
+	uint64_t padding = 0;
+	int		 full	 = 0;
+	do
+	{
+		/* Entries are contiguous: one that would cross the end of the buffer starts over at its beginning */
+		const uint64_t offset = head & K_GHOST_IO_RECORDER_MASK;
+		padding				  = offset + size > K_GHOST_IO_RECORDER_BUFFER_SIZE ? K_GHOST_IO_RECORDER_BUFFER_SIZE - offset : 0;
+		full				  = head + padding + size - __atomic_load_n(&recorder_p->tail, __ATOMIC_ACQUIRE) > K_GHOST_IO_RECORDER_BUFFER_SIZE;
+	} while (!full && !__atomic_compare_exchange_n(&recorder_p->head, &head, head + padding + size, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+	if (!full)
+	{
+		if (padding)
+		{
+			__atomic_store_n((uint32_t *)(recorder_p->buffer + (head & K_GHOST_IO_RECORDER_MASK)), (uint32_t)padding | K_GHOST_IO_RECORDER_PADDING,
+							 __ATOMIC_RELEASE);
+		}
+		slot = recorder_p->buffer + ((head + padding) & K_GHOST_IO_RECORDER_MASK);
+	}
+	return slot;
+}
+
+static uint64_t k_ghost_io_recorder_flush(k_ghost_io_recorder_t *recorder_p)
+{
+	const uint64_t head	  = __atomic_load_n(&recorder_p->head, __ATOMIC_ACQUIRE);
+	const uint64_t start  = recorder_p->tail;
+	uint64_t	   tail	  = start;
+	size_t		   staged = 0;
+	uint32_t	   commit = 1;
+	while (tail < head && commit)
+	{
+		char *slot = recorder_p->buffer + (tail & K_GHOST_IO_RECORDER_MASK);
+		/* A zero commit word is an entry still being filled: the following ones wait for it, the order is kept */
+		commit = __atomic_load_n((uint32_t *)slot, __ATOMIC_ACQUIRE);
+		if (commit)
+		{
+			const uint64_t size = commit & ~K_GHOST_IO_RECORDER_PADDING;
+			if (!(commit & K_GHOST_IO_RECORDER_PADDING))
+			{
+				k_ghost_io_trace_entry_t entry;
+				memcpy(&entry, slot + K_GHOST_IO_RECORDER_COMMIT_SIZE, sizeof(entry));
+				const size_t entry_len = sizeof(entry) + entry.name_len + entry.data_len;
+				if (staged + entry_len > K_GHOST_IO_RECORDER_STAGE_SIZE)
+				{
+					k_ghost_io_recorder_write(recorder_p->fd, recorder_p->stage, staged);
+					staged = 0;
+				}
+				if (entry_len > K_GHOST_IO_RECORDER_STAGE_SIZE)
+				{
+					k_ghost_io_recorder_write(recorder_p->fd, slot + K_GHOST_IO_RECORDER_COMMIT_SIZE, entry_len);
+				}
+				else
+				{
+					memcpy(recorder_p->stage + staged, slot + K_GHOST_IO_RECORDER_COMMIT_SIZE, entry_len);
+					staged += entry_len;
+				}
+			}
+			/* Given back zeroed, so that the commit word of the next entry there reads 0 until committed */
+			memset(slot, 0, size);
+			tail += size;
+			__atomic_store_n(&recorder_p->tail, tail, __ATOMIC_RELEASE);
+		}
+	}
+	k_ghost_io_recorder_write(recorder_p->fd, recorder_p->stage, staged);
+	return tail - start;
+}
+
+static void k_ghost_io_recorder_write(const int fd, const char *data, size_t len)
+{
+	while (len)
+	{
+		const ssize_t written = write(fd, data, len);
+		if (written > 0)
+		{
+			data += written;
+			len -= (size_t)written;
+		}
+		else if (written < 0 && EINTR != errno)
+		{
+			/* Disk full or file gone: the capture goes on without the entries */
+			len = 0;
+		}
+	}
+}
+
+static void *k_ghost_io_recorder_thread_func(void *arg)
+{
+	k_ghost_io_recorder_t *recorder_p = (k_ghost_io_recorder_t *)arg;
+	while (!__atomic_load_n(&recorder_p->stop, __ATOMIC_ACQUIRE))
+	{
+		if (!k_ghost_io_recorder_flush(recorder_p))
+		{
+			const struct timespec idle = {.tv_sec = 0, .tv_nsec = K_GHOST_IO_RECORDER_IDLE_NS};
+			nanosleep(&idle, NULL);
+		}
+	}
+	/* Every producer committed its entry before the stop was requested */
+	k_ghost_io_recorder_flush(recorder_p);
+	return NULL;
+}
+
+static int k_ghost_io_replay_request(const struct sockaddr_in *server_addr_p, const char *head, const size_t head_len, const char *body, const size_t body_len)
+{
+	int		  ret_code = -1;
+	const int fd	   = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd >= 0)
+	{
+		if (0 == connect(fd, (const struct sockaddr *)server_addr_p, sizeof(*server_addr_p)) && (ssize_t)head_len == send(fd, head, head_len, MSG_NOSIGNAL) &&
+			(0 == body_len || (ssize_t)body_len == send(fd, body, body_len, MSG_NOSIGNAL)))
+		{
+			/* The server closes the connection once it has answered */
+			char	response[512];
+			ssize_t received = 0;
+			while ((received = recv(fd, response, sizeof(response), 0)) > 0)
+			{
+				ret_code = 0;
+			}
+		}
+		close(fd);
+	}
+	return ret_code;
+}
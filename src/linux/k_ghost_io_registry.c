@@ -0,0 +1,142 @@
+/**
+ * @file k_ghost_io_registry.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Claim a free reader slot for the calling thread.
+ *
+ * @return Claimed slot, NULL if all the slots are taken.
+ */
+static k_ghost_io_reader_slot_t *k_ghost_io_registry_claim_slot(void);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+static _Thread_local k_ghost_io_reader_slot_t *k_ghost_io_reader_slot;	  //!< Reader slot owned by this thread, NULL until the first read section
+static _Thread_local unsigned int			   k_ghost_io_read_depth;	  //!< Nesting level of the read sections of this thread
+static _Thread_local int					   k_ghost_io_read_overflow;  //!< Set if the current read section is tracked by the overflow counter
+
+/* Function Definition -------------------------------------------------------*/
+void k_ghost_io_registry_read_begin(void)
+{
+	if (0 == k_ghost_io_read_depth++)
+	{
+		if (!k_ghost_io_reader_slot)
+		{
+			k_ghost_io_reader_slot = k_ghost_io_registry_claim_slot();
+		}
+		if (k_ghost_io_reader_slot)
+		{
+			/* Announce the epoch before loading any pointer: the writers will not free what this thread may still see */
+			const uint64_t epoch = __atomic_load_n(&k_ghost_io_ctx.registry_epoch, __ATOMIC_SEQ_CST);
+			__atomic_store_n(&k_ghost_io_reader_slot->epoch, epoch + 1, __ATOMIC_SEQ_CST);
+			k_ghost_io_read_overflow = 0;
+		}
+		else
+		{
+			/* No slot left: hold back every reclamation until this section ends */
+			__atomic_add_fetch(&k_ghost_io_ctx.overflow_readers, 1, __ATOMIC_SEQ_CST);
+			k_ghost_io_read_overflow = 1;
+		}
+	}
+}
+
+void k_ghost_io_registry_read_end(void)
+{
+	if (k_ghost_io_read_depth && 0 == --k_ghost_io_read_depth)
+	{
+		if (k_ghost_io_read_overflow)
+		{
+			__atomic_sub_fetch(&k_ghost_io_ctx.overflow_readers, 1, __ATOMIC_SEQ_CST);
+		}
+		else
+		{
+			__atomic_store_n(&k_ghost_io_reader_slot->epoch, 0, __ATOMIC_RELEASE);
+		}
+	}
+}
+
+int k_ghost_io_registry_reserve(const size_t count)
+{
+	int ret_code = 0;
+	if (k_ghost_io_ctx.retired_count + count > k_ghost_io_ctx.retired_capacity)
+	{
+		const size_t		  capacity	= 2 * (k_ghost_io_ctx.retired_count + count);
+		k_ghost_io_retired_t *retired_p = realloc(k_ghost_io_ctx.retired, capacity * sizeof(k_ghost_io_retired_t));
+		if (retired_p)
+		{
+			k_ghost_io_ctx.retired			= retired_p;
+			k_ghost_io_ctx.retired_capacity = capacity;
+		}
+		else
+		{
+			ret_code = -1;
+		}
+	}
+	return ret_code;
+}
+
+void k_ghost_io_registry_retire(void *ptr)
+{
+	if (ptr && k_ghost_io_ctx.retired_count < k_ghost_io_ctx.retired_capacity)
+	{
+		/* Readers that entered after this point can only see the new pointers */
+		k_ghost_io_retired_t *retired_p = &k_ghost_io_ctx.retired[k_ghost_io_ctx.retired_count++];
+		retired_p->ptr					= ptr;
+		retired_p->epoch				= __atomic_fetch_add(&k_ghost_io_ctx.registry_epoch, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+void k_ghost_io_registry_reclaim(void)
+{
+	if (0 == __atomic_load_n(&k_ghost_io_ctx.overflow_readers, __ATOMIC_SEQ_CST))
+	{
+		/* Oldest epoch a reader may still be in. Memory retired before it is unreachable */
+		uint64_t oldest_epoch = UINT64_MAX;
+		for (size_t i = 0; i < K_GHOST_IO_MAX_READERS; i++)
+		{
+			const uint64_t epoch = __atomic_load_n(&k_ghost_io_ctx.reader_slots[i].epoch, __ATOMIC_SEQ_CST);
+			if (epoch && epoch - 1 < oldest_epoch)
+			{
+				oldest_epoch = epoch - 1;
+			}
+		}
+		size_t kept_count = 0;
+		for (size_t i = 0; i < k_ghost_io_ctx.retired_count; i++)
+		{
+			if (k_ghost_io_ctx.retired[i].epoch < oldest_epoch)
+			{
+				free(k_ghost_io_ctx.retired[i].ptr);
+			}
+			else
+			{
+				k_ghost_io_ctx.retired[kept_count++] = k_ghost_io_ctx.retired[i];
+			}
+		}
+		k_ghost_io_ctx.retired_count = kept_count;
+	}
+}
+
+static k_ghost_io_reader_slot_t *k_ghost_io_registry_claim_slot(void)
+{
+	k_ghost_io_reader_slot_t *slot_p = NULL;
+	for (size_t i = 0; i < K_GHOST_IO_MAX_READERS && !slot_p; i++)
+	{
+		uint32_t expected = 0;
+		if (__atomic_compare_exchange_n(&k_ghost_io_ctx.reader_slots[i].claimed, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		{
+			slot_p = &k_ghost_io_ctx.reader_slots[i];
+		}
+	}
+	return slot_p;
+}
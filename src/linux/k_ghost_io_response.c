@@ -0,0 +1,194 @@
+/**
+ * @file k_ghost_io_response.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_NO_BODY "Content-Length: 0\r\n\r\n"
+#define K_GHOST_IO_CONTENT_LENGTH_SIZE 40  //!< Room for the Content-Length header of any body and the blank line
+
+/**
+ * @brief Entry of the response table: the status line, the fields following it and the whole response, lengths included.
+ */
+#define K_GHOST_IO_RESPONSE(code, status_line, fields, date) \
+	{code, status_line, sizeof(status_line) - 1, fields, sizeof(fields) - 1, status_line fields, sizeof(status_line fields) - 1, date}
+
+/* Typedef -------------------------------------------------------------------*/
+typedef struct
+{
+	int			status;			  //!< HTTP status code, 0 for the responses not picked by status
+	const char *status_line;	  //!< Status line, CRLF included
+	size_t		status_line_len;  //!< Length of the status line
+	const char *fields;			  //!< Header fields following the status line, blank line included
+	size_t		fields_len;		  //!< Length of the fields
+	const char *response;		  //!< Whole response without Date and Server headers
+	size_t		response_len;	  //!< Length of the whole response
+	int			dated;			  //!< Set if the response gets the Date and Server headers when they are enabled
+} k_ghost_io_static_response_t;
+
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Get the Date and Server headers, formatted again only when the second changes.
+ *
+ * @param len_p Set to the length of the headers
+ *
+ * @return Headers, CRLF terminated. Owned by the calling thread
+ */
+static const char *k_ghost_io_date_headers(size_t *len_p);
+
+/**
+ * @brief Find the fixed response of a status code.
+ *
+ * @param status HTTP status code
+ *
+ * @return Entry of the response table, NULL if the code has none
+ */
+static const k_ghost_io_static_response_t *k_ghost_io_find_static_response(int status);
+
+/* Constant ------------------------------------------------------------------*/
+static const k_ghost_io_static_response_t k_ghost_io_static_responses[K_GHOST_IO_RESPONSE_COUNT] = {
+	[K_GHOST_IO_RESPONSE_NONE]				  = K_GHOST_IO_RESPONSE(0, "", "", 0),
+	[K_GHOST_IO_RESPONSE_CONTINUE]			  = K_GHOST_IO_RESPONSE(100, "HTTP/1.1 100 Continue\r\n", "\r\n", 0),
+	[K_GHOST_IO_RESPONSE_OK]				  = K_GHOST_IO_RESPONSE(200, "HTTP/1.1 200 OK\r\n", K_GHOST_IO_NO_BODY, 1),
+	[K_GHOST_IO_RESPONSE_ACCEPTED]			  = K_GHOST_IO_RESPONSE(202, "HTTP/1.1 202 Accepted\r\n", K_GHOST_IO_NO_BODY, 1),
+	[K_GHOST_IO_RESPONSE_NO_CONTENT]		  = K_GHOST_IO_RESPONSE(204, "HTTP/1.1 204 No Content\r\n", K_GHOST_IO_NO_BODY, 1),
+	[K_GHOST_IO_RESPONSE_BAD_REQUEST]		  = K_GHOST_IO_RESPONSE(400, "HTTP/1.1 400 Bad Request\r\n", K_GHOST_IO_NO_BODY, 1),
+	[K_GHOST_IO_RESPONSE_NOT_FOUND]			  = K_GHOST_IO_RESPONSE(404, "HTTP/1.1 404 Not Found\r\n", K_GHOST_IO_NO_BODY, 1),
+	[K_GHOST_IO_RESPONSE_CONTENT_TOO_LARGE]	  = K_GHOST_IO_RESPONSE(413, "HTTP/1.1 413 Content Too Large\r\n", K_GHOST_IO_NO_BODY, 1),
+	[K_GHOST_IO_RESPONSE_INTERNAL_ERROR]	  = K_GHOST_IO_RESPONSE(500, "HTTP/1.1 500 Internal Server Error\r\n", K_GHOST_IO_NO_BODY, 1),
+	[K_GHOST_IO_RESPONSE_SERVICE_UNAVAILABLE] = K_GHOST_IO_RESPONSE(503, "HTTP/1.1 503 Service Unavailable\r\n", K_GHOST_IO_NO_BODY, 1),
+	[K_GHOST_IO_RESPONSE_GATEWAY_TIMEOUT]	  = K_GHOST_IO_RESPONSE(504, "HTTP/1.1 504 Gateway Timeout\r\n", K_GHOST_IO_NO_BODY, 1),
+	[K_GHOST_IO_RESPONSE_SSE_STREAM]		  = K_GHOST_IO_RESPONSE(0, "HTTP/1.1 200 OK\r\n",
+																	"Content-Type: text/event-stream\r\n"
+																	"Cache-Control: no-cache\r\n"
+																	"Connection: keep-alive\r\n"
+																	"\r\n",
+																	1),
+};
+
+static const char k_ghost_io_json_content_type[] = "Content-Type: application/json\r\n";
+static const char k_ghost_io_content_length[]	 = "Content-Length: ";
+static const char k_ghost_io_day_names[7][4]	 = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char k_ghost_io_month_names[12][4]	 = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+/* Variable ------------------------------------------------------------------*/
+static _Thread_local time_t k_ghost_io_date_second = -1;  //!< Second the Date header of this thread was formatted for
+static _Thread_local char	k_ghost_io_date_buffer[96];	  //!< Date and Server headers of this thread
+static _Thread_local size_t k_ghost_io_date_len;		  //!< Length of the Date and Server headers
+
+/* Function Definition -------------------------------------------------------*/
+void k_ghost_io_set_server_headers(const int enabled)
+{
+	__atomic_store_n(&k_ghost_io_ctx.server_headers, enabled ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+void k_ghost_io_send_static_response(const int client_fd, const k_ghost_io_response_id_t response_id, const int flags)
+{
+	const k_ghost_io_static_response_t *response_p = &k_ghost_io_static_responses[response_id];
+	if (response_p->dated && __atomic_load_n(&k_ghost_io_ctx.server_headers, __ATOMIC_RELAXED))
+	{
+		/* Copied around the Date header: a few bytes of memcpy are cheaper than a second system call */
+		char		head[K_GHOST_IO_RESPONSE_HEAD_SIZE];
+		size_t		date_len = 0;
+		const char *date	 = k_ghost_io_date_headers(&date_len);
+		memcpy(head, response_p->status_line, response_p->status_line_len);
+		memcpy(head + response_p->status_line_len, date, date_len);
+		memcpy(head + response_p->status_line_len + date_len, response_p->fields, response_p->fields_len);
+		send(client_fd, head, response_p->status_line_len + date_len + response_p->fields_len, flags);
+	}
+	else if (response_p->response_len)
+	{
+		send(client_fd, response_p->response, response_p->response_len, flags);
+	}
+}
+
+size_t k_ghost_io_format_response_head(char *head, const int status, const char *fields, const size_t body_len)
+{
+	const k_ghost_io_static_response_t *response_p = k_ghost_io_find_static_response(status);
+	size_t								head_len   = 0;
+	if (response_p)
+	{
+		memcpy(head, response_p->status_line, response_p->status_line_len);
+		head_len = response_p->status_line_len;
+	}
+	else
+	{
+		head_len = (size_t)snprintf(head, K_GHOST_IO_RESPONSE_HEAD_SIZE, "HTTP/1.1 %d \r\n", status);
+	}
+	if (__atomic_load_n(&k_ghost_io_ctx.server_headers, __ATOMIC_RELAXED))
+	{
+		size_t		date_len = 0;
+		const char *date	 = k_ghost_io_date_headers(&date_len);
+		memcpy(head + head_len, date, date_len);
+		head_len += date_len;
+	}
+	if (body_len)
+	{
+		memcpy(head + head_len, k_ghost_io_json_content_type, sizeof(k_ghost_io_json_content_type) - 1);
+		head_len += sizeof(k_ghost_io_json_content_type) - 1;
+	}
+	const size_t fields_len = fields ? strlen(fields) : 0;
+	if (fields_len && fields_len < K_GHOST_IO_RESPONSE_HEAD_SIZE - head_len - K_GHOST_IO_CONTENT_LENGTH_SIZE)
+	{
+		memcpy(head + head_len, fields, fields_len);
+		head_len += fields_len;
+	}
+
+	/* Digits written by hand: snprintf would cost more than all the copies above */
+	char   digits[20];
+	size_t digits_count = 0;
+	size_t value		= body_len;
+	do
+	{
+		digits[digits_count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value);
+	memcpy(head + head_len, k_ghost_io_content_length, sizeof(k_ghost_io_content_length) - 1);
+	head_len += sizeof(k_ghost_io_content_length) - 1;
+	while (digits_count)
+	{
+		head[head_len++] = digits[--digits_count];
+	}
+	memcpy(head + head_len, "\r\n\r\n", 4);
+	return head_len + 4;
+}
+
+static const char *k_ghost_io_date_headers(size_t *len_p)
+{
+	const time_t now = time(NULL);
+	if (now != k_ghost_io_date_second)
+	{
+		/* IMF-fixdate, always in English whatever the locale of the process */
+		struct tm tm_now;
+		gmtime_r(&now, &tm_now);
+		k_ghost_io_date_len	   = (size_t)snprintf(k_ghost_io_date_buffer, sizeof(k_ghost_io_date_buffer),
+												  "Date: %s, %02d %s %04d %02d:%02d:%02d GMT\r\nServer: " K_GHOST_IO_SERVER_NAME "\r\n",
+												  k_ghost_io_day_names[tm_now.tm_wday], tm_now.tm_mday, k_ghost_io_month_names[tm_now.tm_mon], tm_now.tm_year + 1900,
+												  tm_now.tm_hour, tm_now.tm_min, tm_now.tm_sec);
+		k_ghost_io_date_second = now;
+	}
+	*len_p = k_ghost_io_date_len;
+	return k_ghost_io_date_buffer;
+}
+
+static const k_ghost_io_static_response_t *k_ghost_io_find_static_response(const int status)
+{
+	const k_ghost_io_static_response_t *response_p = NULL;
+	for (size_t i = 0; i < K_GHOST_IO_RESPONSE_COUNT && !response_p; i++)
+	{
+		if (status && status == k_ghost_io_static_responses[i].status)
+		{
+			response_p = &k_ghost_io_static_responses[i];
+		}
+	}
+	return response_p;
+}
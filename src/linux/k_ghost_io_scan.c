@@ -0,0 +1,157 @@
+/**
+ * @file k_ghost_io_scan.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <string.h>
+#include <strings.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+/* Typedef -------------------------------------------------------------------*/
+typedef struct
+{
+	const char			  *name;  //!< Name of the header, as it is usually written
+	size_t				   len;	  //!< Length of the name
+	k_ghost_io_header_id_t id;	  //!< Slot of the header in k_ghost_io_headers_t
+} k_ghost_io_known_header_t;
+
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Find the next carriage return, 32 or 16 bytes at a time when the target supports it.
+ *
+ * @param cursor Position to start from
+ * @param end End of the bytes to search
+ *
+ * @return Position of the carriage return, NULL if there is none before end
+ */
+static const char *k_ghost_io_find_cr(const char *cursor, const char *end);
+
+/**
+ * @brief Record a header line if it is one of the well-known headers.
+ *
+ * @param line Start of the header line
+ * @param line_end Position of the carriage return ending the line
+ * @param headers_p Headers found so far
+ */
+static void k_ghost_io_scan_field(const char *line, const char *line_end, k_ghost_io_headers_t *headers_p);
+
+/* Constant ------------------------------------------------------------------*/
+static const k_ghost_io_known_header_t k_ghost_io_known_headers[] = {
+	{"Content-Length", sizeof("Content-Length") - 1, K_GHOST_IO_HEADER_CONTENT_LENGTH},
+	{"Transfer-Encoding", sizeof("Transfer-Encoding") - 1, K_GHOST_IO_HEADER_TRANSFER_ENCODING},
+	{"Expect", sizeof("Expect") - 1, K_GHOST_IO_HEADER_EXPECT},
+	{"Last-Event-ID", sizeof("Last-Event-ID") - 1, K_GHOST_IO_HEADER_LAST_EVENT_ID},
+	{"Accept", sizeof("Accept") - 1, K_GHOST_IO_HEADER_ACCEPT},
+};
+
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+const char *k_ghost_io_find_header_end(const char *data, const size_t len)
+{
+	const char *header_end = NULL;
+	const char *end		   = data + len;
+	for (const char *cr = k_ghost_io_find_cr(data, end); cr && !header_end; cr = k_ghost_io_find_cr(cr + 1, end))
+	{
+		if (end - cr >= 4 && 0 == memcmp(cr, "\r\n\r\n", 4))
+		{
+			header_end = cr;
+		}
+	}
+	return header_end;
+}
+
+int k_ghost_io_scan_headers(const char *data, const size_t len, k_ghost_io_headers_t *headers_p)
+{
+	int			ret_code   = -1;
+	const char *end		   = data + len;
+	const char *line	   = data;
+	memset(headers_p, 0, sizeof(k_ghost_io_headers_t));
+	/* Every line is visited once: the line breaks are found by the vector search, the names are told apart by length first */
+	for (const char *cr = k_ghost_io_find_cr(data, end); cr && end - cr >= 2 && 0 != ret_code; cr = k_ghost_io_find_cr(cr + 1, end))
+	{
+		if ('\n' != cr[1])
+		{
+			continue;
+		}
+		if (cr == line && line != data)
+		{
+			headers_p->header_len = (size_t)(cr + 2 - data);
+			ret_code			  = 0;
+		}
+		else
+		{
+			if (line != data)
+			{
+				k_ghost_io_scan_field(line, cr, headers_p);
+			}
+			line = cr + 2;
+		}
+	}
+	return ret_code;
+}
+
+static const char *k_ghost_io_find_cr(const char *cursor, const char *end)
+{
+	const char *cr = NULL;
+#if defined(__AVX2__)
+	const __m256i cr_32 = _mm256_set1_epi8('\r');
+	for (; end - cursor >= 32 && !cr; cursor += 32)
+	{
+		const unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)cursor), cr_32));
+		cr						= mask ? cursor + __builtin_ctz(mask) : NULL;
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i cr_16 = _mm_set1_epi8('\r');
+	for (; end - cursor >= 16 && !cr; cursor += 16)
+	{
+		const unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)cursor), cr_16));
+		cr						= mask ? cursor + __builtin_ctz(mask) : NULL;
+	}
+#endif
+	if (!cr && cursor < end)
+	{
+		/* Tail shorter than a vector, or no vector unit at all */
+		cr = memchr(cursor, '\r', (size_t)(end - cursor));
+	}
+	return cr;
+}
+
+static void k_ghost_io_scan_field(const char *line, const char *line_end, k_ghost_io_headers_t *headers_p)
+{
+	const char *colon = memchr(line, ':', (size_t)(line_end - line));
+	if (colon)
+	{
+		const size_t name_len = (size_t)(colon - line);
+		for (size_t i = 0; i < sizeof(k_ghost_io_known_headers) / sizeof(k_ghost_io_known_headers[0]); i++)
+		{
+			const k_ghost_io_known_header_t *known_p = &k_ghost_io_known_headers[i];
+			if (name_len == known_p->len && !headers_p->values[known_p->id].value && 0 == strncasecmp(line, known_p->name, name_len))
+			{
+				const char *value	  = colon + 1;
+				const char *value_end = line_end;
+				while (value < value_end && (' ' == *value || '\t' == *value))
+				{
+					value++;
+				}
+				while (value_end > value && (' ' == value_end[-1] || '\t' == value_end[-1]))
+				{
+					value_end--;
+				}
+				headers_p->values[known_p->id].value = value;
+				headers_p->values[known_p->id].len	 = (size_t)(value_end - value);
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,174 @@
+/**
+ * @file k_ghost_io_shaper.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+/* Typedef -------------------------------------------------------------------*/
+typedef struct
+{
+	const char *name;	 //!< Query parameter, '=' included
+	size_t		offset;	 //!< Offset of the value in k_ghost_io_link_profile_t
+} k_ghost_io_link_param_t;
+
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Timer callback of a shaper: write the events that have arrived and arm the timer of the next one.
+ *
+ * @param user_data_p SSE client of the shaper
+ */
+static void k_ghost_io_deliver_events(void *user_data_p);
+
+/* Constant ------------------------------------------------------------------*/
+static const k_ghost_io_link_param_t k_ghost_io_link_params[] = {
+	{"bytes_per_s=", offsetof(k_ghost_io_link_profile_t, bytes_per_s)},
+	{"latency_us=", offsetof(k_ghost_io_link_profile_t, latency_us)},
+	{"jitter_us=", offsetof(k_ghost_io_link_profile_t, jitter_us)},
+};
+
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+void k_ghost_io_set_sse_link(const k_ghost_io_link_profile_t *link_p)
+{
+	const k_ghost_io_link_profile_t none = {0, 0, 0};
+	pthread_mutex_lock(&k_ghost_io_ctx.sse_lock);
+	k_ghost_io_ctx.sse_link = link_p ? *link_p : none;
+	pthread_mutex_unlock(&k_ghost_io_ctx.sse_lock);
+}
+
+k_ghost_io_sse_shaper_t *k_ghost_io_new_shaper(const int sse_client_fd, const char *query)
+{
+	k_ghost_io_sse_shaper_t	 *shaper_p = NULL;
+	k_ghost_io_link_profile_t profile;
+	pthread_mutex_lock(&k_ghost_io_ctx.sse_lock);
+	profile = k_ghost_io_ctx.sse_link;
+	pthread_mutex_unlock(&k_ghost_io_ctx.sse_lock);
+	const size_t query_len = query ? strcspn(query, " \r\n") : 0;
+	for (const char *param = query; param && param < query + query_len; param += strcspn(param, "& \r\n") + 1)
+	{
+		for (size_t i = 0; i < sizeof(k_ghost_io_link_params) / sizeof(k_ghost_io_link_params[0]); i++)
+		{
+			const size_t name_len = strlen(k_ghost_io_link_params[i].name);
+			char		*end	  = NULL;
+			if (0 == strncmp(param, k_ghost_io_link_params[i].name, name_len))
+			{
+				const unsigned long long value = strtoull(param + name_len, &end, 10);
+				if (end != param + name_len && ('\0' == *end || strchr("& \r\n", *end)))
+				{
+					*(uint64_t *)((char *)&profile + k_ghost_io_link_params[i].offset) = value;
+				}
+			}
+		}
+	}
+	if (profile.bytes_per_s || profile.latency_us || profile.jitter_us)
+	{
+		shaper_p = calloc(1, sizeof(k_ghost_io_sse_shaper_t));
+		if (shaper_p)
+		{
+			shaper_p->profile	= profile;
+			shaper_p->rng_state = (uint64_t)sse_client_fd | 1ULL << 32;
+		}
+	}
+	return shaper_p;
+}
+
+void k_ghost_io_shape_event(k_ghost_io_sse_client_entry_t *client_p, const char *data, const size_t len)
+{
+	k_ghost_io_sse_shaper_t *shaper_p = client_p->shaper;
+	/* Events on the link count against the limits of the queues, like the ones a slow socket holds back */
+	const int				 reserved = 0 == k_ghost_io_reserve_sse_bytes(len, 0);
+	k_ghost_io_link_event_t *event_p  = reserved ? malloc(sizeof(k_ghost_io_link_event_t) + len) : NULL;
+	if (event_p)
+	{
+		const k_ghost_io_link_profile_t *profile_p = &shaper_p->profile;
+		const uint64_t					 now_ns	   = k_ghost_io_now_ns();
+		/* The link carries one event at a time at its bandwidth, each then travels for the latency and its jitter */
+		const uint64_t start_ns	  = now_ns > shaper_p->free_ns ? now_ns : shaper_p->free_ns;
+		const uint64_t jitter_ns  = (uint64_t)((double)profile_p->jitter_us * 1000.0 * k_ghost_io_random(&shaper_p->rng_state));
+		shaper_p->free_ns		  = start_ns + (profile_p->bytes_per_s ? len * K_GHOST_IO_NS_PER_S / profile_p->bytes_per_s : 0);
+		const uint64_t deliver_ns = shaper_p->free_ns + profile_p->latency_us * 1000 + jitter_ns;
+		event_p->next_event		  = NULL;
+		event_p->len			  = len;
+		memcpy(event_p->data, data, len);
+		if (shaper_p->tail)
+		{
+			/* A stream keeps its order: an event held back by the jitter holds back the next ones too */
+			event_p->deliver_ns		   = deliver_ns > shaper_p->tail->deliver_ns ? deliver_ns : shaper_p->tail->deliver_ns;
+			shaper_p->tail->next_event = event_p;
+		}
+		else
+		{
+			event_p->deliver_ns = deliver_ns;
+			shaper_p->head		= event_p;
+		}
+		shaper_p->tail = event_p;
+		if (!shaper_p->timer)
+		{
+			shaper_p->timer = k_ghost_io_schedule_ns(shaper_p->head->deliver_ns - now_ns, 0, k_ghost_io_deliver_events, client_p);
+		}
+	}
+	else if (reserved)
+	{
+		k_ghost_io_release_sse_bytes(len);
+	}
+}
+
+void k_ghost_io_stop_shaper(k_ghost_io_sse_shaper_t *shaper_p)
+{
+	shaper_p->stopped = 1;
+	for (const k_ghost_io_link_event_t *event_p = shaper_p->head; event_p; event_p = event_p->next_event)
+	{
+		k_ghost_io_release_sse_bytes(event_p->len);
+	}
+}
+
+void k_ghost_io_free_shaper(k_ghost_io_sse_shaper_t *shaper_p)
+{
+	/* Stopped deliveries never arm the timer again, the last one armed is the only one left */
+	k_ghost_io_cancel(shaper_p->timer);
+	while (shaper_p->head)
+	{
+		k_ghost_io_link_event_t *event_p = shaper_p->head;
+		shaper_p->head					 = event_p->next_event;
+		free(event_p);
+	}
+	free(shaper_p);
+}
+
+static void k_ghost_io_deliver_events(void *user_data_p)
+{
+	k_ghost_io_sse_client_entry_t *client_p = user_data_p;
+	pthread_mutex_lock(&k_ghost_io_ctx.sse_lock);
+	k_ghost_io_sse_shaper_t *shaper_p = client_p->shaper;
+	if (!shaper_p->stopped)
+	{
+		const uint64_t now_ns = k_ghost_io_now_ns();
+		shaper_p->timer		  = 0;
+		while (shaper_p->head && shaper_p->head->deliver_ns <= now_ns)
+		{
+			/* Off the link, the event takes the usual way to the socket and is accounted for there */
+			k_ghost_io_link_event_t *event_p = shaper_p->head;
+			shaper_p->head					 = event_p->next_event;
+			k_ghost_io_release_sse_bytes(event_p->len);
+			k_ghost_io_sse_write(client_p, event_p->data, event_p->len);
+			free(event_p);
+		}
+		if (shaper_p->head)
+		{
+			shaper_p->timer = k_ghost_io_schedule_ns(shaper_p->head->deliver_ns - now_ns, 0, k_ghost_io_deliver_events, client_p);
+		}
+		else
+		{
+			shaper_p->tail = NULL;
+		}
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.sse_lock);
+}
@@ -0,0 +1,210 @@
+/**
+ * @file k_ghost_io_snapshot.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_SNAPSHOT_MAGIC "KGIOSNP1"
+
+#define K_GHOST_IO_SNAPSHOT_MAGIC_LEN (sizeof(K_GHOST_IO_SNAPSHOT_MAGIC) - 1)
+
+#define K_GHOST_IO_SNAPSHOT_ATTEMPTS 3	//!< Copies into the file tried before giving up on stores being added meanwhile
+
+#define K_GHOST_IO_SNAPSHOT_TMP_SUFFIX ".XXXXXX"	 //!< Temporary file the snapshot is written to before it replaces the target
+
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Check that a snapshot starts with the magic and is made of whole records.
+ *
+ * @param snapshot Snapshot to check
+ * @param size Size of the snapshot
+ *
+ * @return 0 if the snapshot is well formed, -1 otherwise
+ */
+static int k_ghost_io_check_snapshot(const char *snapshot, size_t size);
+
+/**
+ * @brief Go through the records of a well formed snapshot, to check them against the current stores or to restore them.
+ *
+ * @param snapshot Snapshot checked with k_ghost_io_check_snapshot
+ * @param size Size of the snapshot
+ * @param apply Set to restore the records, clear to only check the ones that could leave a store inconsistent
+ *
+ * @return 0 if every record was checked or restored, -1 otherwise.
+ */
+static int k_ghost_io_restore_records(const char *snapshot, size_t size, int apply);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+size_t k_ghost_io_snapshot(void *buffer, const size_t size)
+{
+	k_ghost_io_snapshot_writer_t writer = {buffer, buffer ? size : 0, 0};
+	k_ghost_io_snapshot_append(&writer, K_GHOST_IO_SNAPSHOT_MAGIC, K_GHOST_IO_SNAPSHOT_MAGIC_LEN);
+	k_ghost_io_snapshot_states(&writer);
+	k_ghost_io_snapshot_farms(&writer);
+	k_ghost_io_snapshot_generators(&writer);
+	k_ghost_io_snapshot_faults(&writer);
+	return writer.offset;
+}
+
+int k_ghost_io_restore(const void *snapshot, const size_t size)
+{
+	int ret_code = -1;
+	/* Checked in full first, a truncated or corrupt snapshot restores nothing rather than half of the simulation */
+	if (snapshot && 0 == k_ghost_io_check_snapshot(snapshot, size) && 0 == k_ghost_io_restore_records(snapshot, size, 0))
+	{
+		ret_code = k_ghost_io_restore_records(snapshot, size, 1);
+	}
+	return ret_code;
+}
+
+int k_ghost_io_save_snapshot(const char *path)
+{
+	int			 ret_code = -1;
+	const size_t path_len = path ? strlen(path) : 0;
+	char		*tmp_path = path ? malloc(path_len + sizeof(K_GHOST_IO_SNAPSHOT_TMP_SUFFIX)) : NULL;
+	if (tmp_path)
+	{
+		memcpy(tmp_path, path, path_len);
+		memcpy(tmp_path + path_len, K_GHOST_IO_SNAPSHOT_TMP_SUFFIX, sizeof(K_GHOST_IO_SNAPSHOT_TMP_SUFFIX));
+	}
+	/* Written next to the target, which is replaced only once the snapshot is complete: a failed save keeps the previous one */
+	const int fd   = tmp_path ? mkstemp(tmp_path) : -1;
+	size_t	  size = fd >= 0 && 0 == fcntl(fd, F_SETFD, FD_CLOEXEC) && 0 == fchmod(fd, 0644) ? k_ghost_io_snapshot(NULL, 0) : 0;
+	/* Written straight into the mapping of the file. A store added since the measure makes the snapshot outgrow it: measured again */
+	for (int attempt = 0; size && ret_code && attempt < K_GHOST_IO_SNAPSHOT_ATTEMPTS && 0 == ftruncate(fd, (off_t)size); attempt++)
+	{
+		char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (MAP_FAILED != map)
+		{
+			const size_t written = k_ghost_io_snapshot(map, size);
+			munmap(map, size);
+			/* A store removed meanwhile leaves a shorter snapshot, complete all the same */
+			ret_code = written <= size && 0 == ftruncate(fd, (off_t)written) ? 0 : -1;
+			size	 = written;
+		}
+	}
+	if (fd >= 0)
+	{
+		const int closed = close(fd);
+		if (0 != ret_code || 0 != closed || 0 != rename(tmp_path, path))
+		{
+			unlink(tmp_path);
+			ret_code = -1;
+		}
+	}
+	free(tmp_path);
+	return ret_code;
+}
+
+int k_ghost_io_load_snapshot(const char *path)
+{
+	int			ret_code = -1;
+	struct stat file_stat;
+	const int	fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+	if (fd >= 0 && 0 == fstat(fd, &file_stat) && file_stat.st_size > 0)
+	{
+		const size_t map_size = (size_t)file_stat.st_size;
+		const char	*map	  = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED != map)
+		{
+			ret_code = k_ghost_io_restore(map, map_size);
+			munmap((void *)map, map_size);
+		}
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	return ret_code;
+}
+
+int k_ghost_io_snapshot_record(k_ghost_io_snapshot_writer_t *writer_p, const k_ghost_io_snapshot_kind_t kind, const char *name, const size_t data_len)
+{
+	int			 ret_code = -1;
+	const size_t name_len = strlen(name);
+	if (name_len <= UINT16_MAX && data_len <= UINT32_MAX)
+	{
+		const k_ghost_io_snapshot_record_t record = {(uint32_t)data_len, (uint16_t)name_len, (uint8_t)kind, 0};
+		k_ghost_io_snapshot_append(writer_p, &record, sizeof(record));
+		k_ghost_io_snapshot_append(writer_p, name, name_len);
+		ret_code = 0;
+	}
+	return ret_code;
+}
+
+void k_ghost_io_snapshot_append(k_ghost_io_snapshot_writer_t *writer_p, const void *data, const size_t len)
+{
+	if (writer_p->buffer && writer_p->offset <= writer_p->size && len <= writer_p->size - writer_p->offset)
+	{
+		memcpy(writer_p->buffer + writer_p->offset, data, len);
+	}
+	writer_p->offset += len;
+}
+
+static int k_ghost_io_check_snapshot(const char *snapshot, const size_t size)
+{
+	size_t offset = K_GHOST_IO_SNAPSHOT_MAGIC_LEN;
+	int	   valid  = size >= K_GHOST_IO_SNAPSHOT_MAGIC_LEN && 0 == memcmp(snapshot, K_GHOST_IO_SNAPSHOT_MAGIC, K_GHOST_IO_SNAPSHOT_MAGIC_LEN);
+	while (valid && size - offset >= sizeof(k_ghost_io_snapshot_record_t))
+	{
+		k_ghost_io_snapshot_record_t record;
+		memcpy(&record, snapshot + offset, sizeof(record));
+		valid = size - offset - sizeof(record) >= (size_t)record.name_len + record.data_len;
+		offset += sizeof(record) + record.name_len + record.data_len;
+	}
+	return valid && offset == size ? 0 : -1;
+}
+
+static int k_ghost_io_restore_records(const char *snapshot, const size_t size, const int apply)
+{
+	int ret_code = 0;
+	for (size_t offset = K_GHOST_IO_SNAPSHOT_MAGIC_LEN; offset < size;)
+	{
+		k_ghost_io_snapshot_record_t record;
+		memcpy(&record, snapshot + offset, sizeof(record));
+		char	   *name		= strndup(snapshot + offset + sizeof(record), record.name_len);
+		const char *record_data = snapshot + offset + sizeof(record) + record.name_len;
+		int			restored	= -1;
+		switch (name ? record.kind : 0)
+		{
+			case K_GHOST_IO_SNAPSHOT_STATE:
+				restored = apply ? k_ghost_io_restore_state(name, record_data, record.data_len) : k_ghost_io_check_state_record(name, record_data, record.data_len);
+				break;
+			case K_GHOST_IO_SNAPSHOT_GENERATOR:
+				restored = apply ? k_ghost_io_restore_generator(name, record_data, record.data_len) : 0;
+				break;
+			case K_GHOST_IO_SNAPSHOT_FAULTS:
+				restored = apply ? k_ghost_io_restore_faults(name, record_data, record.data_len) : 0;
+				break;
+			case K_GHOST_IO_SNAPSHOT_FARM:
+				restored = apply ? k_ghost_io_restore_farm(name, record_data, record.data_len) : k_ghost_io_check_farm_record(name, record_data, record.data_len);
+				break;
+			default:
+				/* Unknown kinds are reported once restored, they do not prevent the restore of the other records */
+				restored = apply ? -1 : 0;
+				break;
+		}
+		if (0 != restored)
+		{
+			ret_code = -1;
+		}
+		free(name);
+		offset += sizeof(record) + record.name_len + record.data_len;
+	}
+	return ret_code;
+}
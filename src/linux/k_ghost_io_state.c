@@ -0,0 +1,440 @@
+/**
+ * @file k_ghost_io_state.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_STATE_TEXT_SIZE 32  //!< Room for a formatted number or literal
+
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Find the state of an interface. Must hold the state lock.
+ *
+ * @param interface_name Name of the interface
+ *
+ * @return Pointer to the link pointing to the state, pointing to NULL if there is none
+ */
+static k_ghost_io_state_t **k_ghost_io_find_state(const char *interface_name);
+
+/**
+ * @brief Check a snapshot record against a state: size of the values and termination of the strings. Must hold the state lock.
+ *
+ * @param state_p State the record is for
+ * @param data Data of the record
+ * @param data_len Length of the data
+ *
+ * @return 1 if the record can be restored, 0 otherwise.
+ */
+static int k_ghost_io_state_record_valid(const k_ghost_io_state_t *state_p, const char *data, size_t data_len);
+
+/**
+ * @brief Mask of all the fields of a state.
+ *
+ * @param schema_p Fields of the state
+ *
+ * @return One bit set per field
+ */
+static uint64_t k_ghost_io_all_fields(const k_ghost_io_schema_t *schema_p);
+
+/**
+ * @brief Read a numeric member of a state, whatever its size.
+ *
+ * @param field_p Field of the member
+ * @param member_p Member to read
+ *
+ * @return Value of the member
+ */
+static double k_ghost_io_read_number(const k_ghost_io_field_t *field_p, const void *member_p);
+
+/**
+ * @brief Timer callback of a state: publish the fields that moved in a single event.
+ *
+ * @param user_data_p State to publish
+ */
+static void k_ghost_io_publish_state(void *user_data_p);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+k_ghost_io_register_ret_code_t k_ghost_io_add_state(const char *interface_name, const k_ghost_io_state_schema_t *state_schema_p, const uint64_t period_us)
+{
+	k_ghost_io_register_ret_code_t ret_code = K_GHOST_REGISTER_RET_CODE_ERROR;
+	const k_ghost_io_schema_t	  *schema_p = state_schema_p ? &state_schema_p->schema : NULL;
+	if (interface_name && period_us && 0 == k_ghost_io_check_schema(schema_p) && schema_p->fields_count)
+	{
+		/* Both copies of the values in one block, the published one rounded up so members stay aligned */
+		const size_t values_size = (schema_p->command_size + 7) & ~(size_t)7;
+		const size_t event_size	 = k_ghost_io_state_event_size(schema_p);
+		k_ghost_io_state_t *state_p = calloc(1, sizeof(k_ghost_io_state_t) + 2 * values_size);
+		char			   *name_p	= state_p ? strdup(interface_name) : NULL;
+		char			   *event	= name_p ? malloc(event_size) : NULL;
+		if (event)
+		{
+			state_p->interface_name = name_p;
+			state_p->schema_p		= schema_p;
+			state_p->state_fields	= state_schema_p->state_fields;
+			state_p->forced			= k_ghost_io_all_fields(schema_p);
+			state_p->event			= event;
+			state_p->event_size		= event_size;
+			state_p->published		= state_p->current + values_size;
+			pthread_mutex_lock(&k_ghost_io_ctx.state_lock);
+			if (*k_ghost_io_find_state(interface_name))
+			{
+				ret_code = K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED;
+			}
+			else
+			{
+				const uint64_t period_ns = period_us * 1000;
+				state_p->timer			 = k_ghost_io_schedule_ns(period_ns, period_ns, k_ghost_io_publish_state, state_p);
+				if (state_p->timer)
+				{
+					state_p->next_state	  = k_ghost_io_ctx.states;
+					k_ghost_io_ctx.states = state_p;
+					state_p				  = NULL;
+					ret_code			  = K_GHOST_REGISTER_RET_CODE_OK;
+				}
+			}
+			pthread_mutex_unlock(&k_ghost_io_ctx.state_lock);
+		}
+		if (state_p)
+		{
+			free(event);
+			free(name_p);
+			free(state_p);
+		}
+	}
+	return ret_code;
+}
+
+int k_ghost_io_set_state(const char *interface_name, const void *state_p)
+{
+	int ret_code = -1;
+	if (interface_name && state_p)
+	{
+		pthread_mutex_lock(&k_ghost_io_ctx.state_lock);
+		k_ghost_io_state_t *found_p = *k_ghost_io_find_state(interface_name);
+		if (found_p)
+		{
+			memcpy(found_p->current, state_p, found_p->schema_p->command_size);
+			ret_code = 0;
+		}
+		pthread_mutex_unlock(&k_ghost_io_ctx.state_lock);
+	}
+	return ret_code;
+}
+
+int k_ghost_io_get_state(const char *interface_name, void *state_p)
+{
+	int ret_code = -1;
+	if (interface_name && state_p)
+	{
+		pthread_mutex_lock(&k_ghost_io_ctx.state_lock);
+		const k_ghost_io_state_t *found_p = *k_ghost_io_find_state(interface_name);
+		if (found_p)
+		{
+			memcpy(state_p, found_p->current, found_p->schema_p->command_size);
+			ret_code = 0;
+		}
+		pthread_mutex_unlock(&k_ghost_io_ctx.state_lock);
+	}
+	return ret_code;
+}
+
+void k_ghost_io_remove_state(const char *interface_name)
+{
+	if (interface_name)
+	{
+		pthread_mutex_lock(&k_ghost_io_ctx.state_lock);
+		k_ghost_io_state_t **link_pp = k_ghost_io_find_state(interface_name);
+		k_ghost_io_state_t	*state_p = *link_pp;
+		if (state_p)
+		{
+			*link_pp = state_p->next_state;
+		}
+		pthread_mutex_unlock(&k_ghost_io_ctx.state_lock);
+		if (state_p)
+		{
+			/* Waits for a publication in progress, the state is no longer found by the next ones */
+			k_ghost_io_cancel(state_p->timer);
+			free(state_p->event);
+			free(state_p->interface_name);
+			free(state_p);
+		}
+	}
+}
+
+size_t k_ghost_io_state_event_size(const k_ghost_io_schema_t *schema_p)
+{
+	size_t event_size = 3;
+	for (size_t i = 0; i < schema_p->fields_count; i++)
+	{
+		const k_ghost_io_field_t *field_p = &schema_p->fields[i];
+		event_size += strlen(field_p->name) + 4 + (K_GHOST_IO_FIELD_STRING == field_p->type ? 6 * field_p->size + 2 : K_GHOST_IO_STATE_TEXT_SIZE);
+	}
+	return event_size;
+}
+
+void k_ghost_io_force_states(void)
+{
+	pthread_mutex_lock(&k_ghost_io_ctx.state_lock);
+	for (k_ghost_io_state_t *state_p = k_ghost_io_ctx.states; state_p; state_p = state_p->next_state)
+	{
+		state_p->forced = k_ghost_io_all_fields(state_p->schema_p);
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.state_lock);
+}
+
+int k_ghost_io_state_moved(const k_ghost_io_field_t *field_p, const double deadband, const void *current_p, const void *published_p)
+{
+	int moved = 0;
+	switch (field_p->type)
+	{
+		case K_GHOST_IO_FIELD_BOOL:
+			moved = *(const bool *)current_p != *(const bool *)published_p;
+			break;
+		case K_GHOST_IO_FIELD_STRING:
+			moved = 0 != strncmp(current_p, published_p, field_p->size);
+			break;
+		case K_GHOST_IO_FIELD_INT:
+			/* Compared exactly without a deadband, doubles cannot hold every 64-bit integer */
+			if (deadband > 0.0)
+			{
+				moved = fabs(k_ghost_io_read_number(field_p, current_p) - k_ghost_io_read_number(field_p, published_p)) > deadband;
+			}
+			else
+			{
+				moved = 0 != memcmp(current_p, published_p, field_p->size);
+			}
+			break;
+		case K_GHOST_IO_FIELD_DOUBLE:
+		default:
+		{
+			const double current   = k_ghost_io_read_number(field_p, current_p);
+			const double published = k_ghost_io_read_number(field_p, published_p);
+			/* Not a number only moves when it comes or goes, the same infinity gives not a number and never moves */
+			if (isnan(current) || isnan(published))
+			{
+				moved = isnan(current) != isnan(published);
+			}
+			else
+			{
+				moved = fabs(current - published) > deadband;
+			}
+			break;
+		}
+	}
+	return moved;
+}
+
+char *k_ghost_io_format_member(const k_ghost_io_field_t *field_p, char *out, const void *member_p)
+{
+	out	   = k_ghost_io_json_write_string(out, field_p->name, strlen(field_p->name));
+	*out++ = ':';
+	switch (field_p->type)
+	{
+		case K_GHOST_IO_FIELD_BOOL:
+			out += sprintf(out, "%s", *(const bool *)member_p ? "true" : "false");
+			break;
+		case K_GHOST_IO_FIELD_STRING:
+			out = k_ghost_io_json_write_string(out, member_p, field_p->size);
+			break;
+		case K_GHOST_IO_FIELD_INT:
+		{
+			int64_t member = 0;
+			if (sizeof(int64_t) == field_p->size)
+			{
+				memcpy(&member, member_p, sizeof(member));
+			}
+			else
+			{
+				member = (int64_t)k_ghost_io_read_number(field_p, member_p);
+			}
+			out += sprintf(out, "%lld", (long long)member);
+			break;
+		}
+		case K_GHOST_IO_FIELD_DOUBLE:
+		default:
+		{
+			/* JSON has no infinity nor not a number, they are published as null */
+			const double value = k_ghost_io_read_number(field_p, member_p);
+			if (isfinite(value))
+			{
+				out += sprintf(out, sizeof(float) == field_p->size ? "%.7g" : "%.15g", value);
+			}
+			else
+			{
+				out += sprintf(out, "null");
+			}
+			break;
+		}
+	}
+	*out++ = ',';
+	return out;
+}
+
+int k_ghost_io_check_string_members(const k_ghost_io_field_t *field_p, const char *members, const size_t count)
+{
+	int ret_code = 0;
+	for (size_t i = 0; K_GHOST_IO_FIELD_STRING == field_p->type && i < count && 0 == ret_code; i++)
+	{
+		ret_code = memchr(members + i * field_p->size, '\0', field_p->size) ? 0 : -1;
+	}
+	return ret_code;
+}
+
+void k_ghost_io_snapshot_states(k_ghost_io_snapshot_writer_t *writer_p)
+{
+	pthread_mutex_lock(&k_ghost_io_ctx.state_lock);
+	for (const k_ghost_io_state_t *state_p = k_ghost_io_ctx.states; state_p; state_p = state_p->next_state)
+	{
+		const size_t values_size = state_p->schema_p->command_size;
+		if (0 == k_ghost_io_snapshot_record(writer_p, K_GHOST_IO_SNAPSHOT_STATE, state_p->interface_name, sizeof(uint64_t) + values_size))
+		{
+			const uint64_t remaining_ns = k_ghost_io_timer_remaining_ns(state_p->timer);
+			k_ghost_io_snapshot_append(writer_p, &remaining_ns, sizeof(remaining_ns));
+			k_ghost_io_snapshot_append(writer_p, state_p->current, values_size);
+		}
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.state_lock);
+}
+
+int k_ghost_io_check_state_record(const char *interface_name, const char *data, const size_t data_len)
+{
+	pthread_mutex_lock(&k_ghost_io_ctx.state_lock);
+	const k_ghost_io_state_t *found_p  = *k_ghost_io_find_state(interface_name);
+	const int				  ret_code = !found_p || k_ghost_io_state_record_valid(found_p, data, data_len) ? 0 : -1;
+	pthread_mutex_unlock(&k_ghost_io_ctx.state_lock);
+	return ret_code;
+}
+
+int k_ghost_io_restore_state(const char *interface_name, const char *data, const size_t data_len)
+{
+	int ret_code = -1;
+	pthread_mutex_lock(&k_ghost_io_ctx.state_lock);
+	k_ghost_io_state_t *found_p = *k_ghost_io_find_state(interface_name);
+	if (found_p && k_ghost_io_state_record_valid(found_p, data, data_len))
+	{
+		uint64_t remaining_ns = 0;
+		memcpy(&remaining_ns, data, sizeof(remaining_ns));
+		memcpy(found_p->current, data + sizeof(remaining_ns), found_p->schema_p->command_size);
+		/* The clients saw the values before the restore, the whole state is theirs again at the next period */
+		found_p->forced = k_ghost_io_all_fields(found_p->schema_p);
+		ret_code		= k_ghost_io_rearm_ns(found_p->timer, remaining_ns);
+	}
+	pthread_mutex_unlock(&k_ghost_io_ctx.state_lock);
+	return ret_code;
+}
+
+static k_ghost_io_state_t **k_ghost_io_find_state(const char *interface_name)
+{
+	k_ghost_io_state_t **link_pp = &k_ghost_io_ctx.states;
+	while (*link_pp && 0 != strcmp((*link_pp)->interface_name, interface_name))
+	{
+		link_pp = (k_ghost_io_state_t **)&(*link_pp)->next_state;
+	}
+	return link_pp;
+}
+
+static int k_ghost_io_state_record_valid(const k_ghost_io_state_t *state_p, const char *data, const size_t data_len)
+{
+	int valid = sizeof(uint64_t) + state_p->schema_p->command_size == data_len;
+	/* Strings from a corrupt or foreign file would be read past their member once published */
+	for (size_t i = 0; valid && i < state_p->schema_p->fields_count; i++)
+	{
+		const k_ghost_io_field_t *field_p = &state_p->schema_p->fields[i];
+		valid							  = 0 == k_ghost_io_check_string_members(field_p, data + sizeof(uint64_t) + field_p->offset, 1);
+	}
+	return valid;
+}
+
+static uint64_t k_ghost_io_all_fields(const k_ghost_io_schema_t *schema_p)
+{
+	/* Shifting by the width of the type is undefined, a full schema gets all the bits */
+	return schema_p->fields_count < 64 ? ((uint64_t)1 << schema_p->fields_count) - 1 : UINT64_MAX;
+}
+
+static double k_ghost_io_read_number(const k_ghost_io_field_t *field_p, const void *member_p)
+{
+	double value = 0.0;
+	if (K_GHOST_IO_FIELD_DOUBLE == field_p->type && sizeof(float) == field_p->size)
+	{
+		float member = 0.0f;
+		memcpy(&member, member_p, sizeof(member));
+		value = member;
+	}
+	else if (K_GHOST_IO_FIELD_DOUBLE == field_p->type)
+	{
+		memcpy(&value, member_p, sizeof(value));
+	}
+	else
+	{
+		int64_t member = 0;
+		switch (field_p->size)
+		{
+			case sizeof(int8_t):
+				member = *(const int8_t *)member_p;
+				break;
+			case sizeof(int16_t):
+			{
+				int16_t narrow = 0;
+				memcpy(&narrow, member_p, sizeof(narrow));
+				member = narrow;
+				break;
+			}
+			case sizeof(int32_t):
+			{
+				int32_t narrow = 0;
+				memcpy(&narrow, member_p, sizeof(narrow));
+				member = narrow;
+				break;
+			}
+			default:
+				memcpy(&member, member_p, sizeof(member));
+				break;
+		}
+		value = (double)member;
+	}
+	return value;
+}
+
+static void k_ghost_io_publish_state(void *user_data_p)
+{
+	k_ghost_io_state_t		  *state_p	= user_data_p;
+	const k_ghost_io_schema_t *schema_p = state_p->schema_p;
+	char					  *out		= state_p->event;
+	*out++								= '{';
+	pthread_mutex_lock(&k_ghost_io_ctx.state_lock);
+	for (size_t i = 0; i < schema_p->fields_count; i++)
+	{
+		const k_ghost_io_field_t *field_p	  = &schema_p->fields[i];
+		const double			  deadband	  = state_p->state_fields ? state_p->state_fields[i].deadband : 0.0;
+		const char				 *current_p	  = state_p->current + field_p->offset;
+		char					 *published_p = state_p->published + field_p->offset;
+		if ((state_p->forced >> i & 1) || k_ghost_io_state_moved(field_p, deadband, current_p, published_p))
+		{
+			/* The published value follows only the published changes, slow drifts add up until they cross the deadband */
+			memcpy(published_p, current_p, field_p->size);
+			out = k_ghost_io_format_member(field_p, out, current_p);
+		}
+	}
+	state_p->forced = 0;
+	pthread_mutex_unlock(&k_ghost_io_ctx.state_lock);
+	if (out != state_p->event + 1)
+	{
+		/* The last comma closes the object */
+		out[-1] = '}';
+		*out	= '\0';
+		k_ghost_io_send_interface_event(state_p->interface_name, state_p->event);
+	}
+}
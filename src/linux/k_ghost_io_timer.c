@@ -0,0 +1,404 @@
+/**
+ * @file k_ghost_io_timer.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <stdlib.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_TIMER_MIN_CAPACITY 64
+
+#define K_GHOST_IO_TIMER_SLOT_MASK (K_GHOST_IO_TIMER_SLOTS - 1)
+
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Find the node of an armed timer. Must hold the wheel lock.
+ *
+ * @param wheel_p Timer wheel
+ * @param timer Handle of the timer
+ *
+ * @return Index + 1 of the node, 0 if the handle is stale or the timer is not armed
+ */
+static uint32_t k_ghost_io_timer_find(const k_ghost_io_timer_wheel_t *wheel_p, k_ghost_io_timer_t timer);
+
+/**
+ * @brief Take a node from the free list, growing the pool if it is empty. Must hold the wheel lock.
+ *
+ * @param wheel_p Timer wheel
+ *
+ * @return Index + 1 of the node, 0 in case of allocation failure
+ */
+static uint32_t k_ghost_io_timer_alloc(k_ghost_io_timer_wheel_t *wheel_p);
+
+/**
+ * @brief Give a node back to the free list, invalidating its handle. Must hold the wheel lock.
+ *
+ * @param wheel_p Timer wheel
+ * @param node Index + 1 of the node
+ */
+static void k_ghost_io_timer_release(k_ghost_io_timer_wheel_t *wheel_p, uint32_t node);
+
+/**
+ * @brief Put a node in the slot matching its expiry: the closer the expiry, the finer the level. Must hold the wheel lock.
+ *
+ * @param wheel_p Timer wheel
+ * @param node Index + 1 of the node
+ * @param first_tick Earliest tick the node can run at: the current tick while it is being processed, the next one otherwise
+ */
+static void k_ghost_io_timer_link(k_ghost_io_timer_wheel_t *wheel_p, uint32_t node, uint64_t first_tick);
+
+/**
+ * @brief Take a node out of its slot. Must hold the wheel lock.
+ *
+ * @param wheel_p Timer wheel
+ * @param node Index + 1 of the node
+ */
+static void k_ghost_io_timer_unlink(k_ghost_io_timer_wheel_t *wheel_p, uint32_t node);
+
+/**
+ * @brief Find the next tick at which a slot of the wheel has to be processed, either run or cascaded. Must hold the wheel lock.
+ *
+ * @param wheel_p Timer wheel, with at least one armed timer
+ *
+ * @return Tick of the next slot to process
+ */
+static uint64_t k_ghost_io_timer_next_tick(const k_ghost_io_timer_wheel_t *wheel_p);
+
+/**
+ * @brief Spread the timers of the current slot of a level over the finer levels. Must hold the wheel lock.
+ *
+ * @param wheel_p Timer wheel
+ * @param level Level to cascade, at least 1
+ */
+static void k_ghost_io_timer_cascade(k_ghost_io_timer_wheel_t *wheel_p, unsigned int level);
+
+/**
+ * @brief Run the timers of the current slot of the first level. Must hold the wheel lock, released while the callbacks run.
+ *
+ * @param wheel_p Timer wheel
+ */
+static void k_ghost_io_timer_expire(k_ghost_io_timer_wheel_t *wheel_p);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+static _Thread_local int k_ghost_io_in_timer_callback;	//!< Set while this thread runs a timer callback
+
+/* Function Definition -------------------------------------------------------*/
+k_ghost_io_timer_t k_ghost_io_schedule(const uint64_t delay_us, const uint64_t period_us, k_ghost_io_timer_callback_t timer_cb, void *user_data_p)
+{
+	return k_ghost_io_schedule_ns(delay_us * 1000, period_us * 1000, timer_cb, user_data_p);
+}
+
+int k_ghost_io_cancel(const k_ghost_io_timer_t timer)
+{
+	int						  ret_code = -1;
+	k_ghost_io_timer_wheel_t *wheel_p  = &k_ghost_io_ctx.timers;
+	pthread_mutex_lock(&wheel_p->lock);
+	const uint32_t node = k_ghost_io_timer_find(wheel_p, timer);
+	if (node)
+	{
+		k_ghost_io_timer_unlink(wheel_p, node);
+		k_ghost_io_timer_release(wheel_p, node);
+		ret_code = 0;
+	}
+	pthread_mutex_unlock(&wheel_p->lock);
+	if (!k_ghost_io_in_timer_callback)
+	{
+		/* The callback may be running on the I/O thread right now, the caller must be able to release its data on return */
+		pthread_mutex_lock(&wheel_p->callback_lock);
+		pthread_mutex_unlock(&wheel_p->callback_lock);
+	}
+	return ret_code;
+}
+
+k_ghost_io_timer_t k_ghost_io_schedule_ns(const uint64_t delay_ns, const uint64_t period_ns, k_ghost_io_timer_callback_t timer_cb, void *user_data_p)
+{
+	k_ghost_io_timer_t		  timer	  = 0;
+	k_ghost_io_timer_wheel_t *wheel_p = &k_ghost_io_ctx.timers;
+	if (timer_cb)
+	{
+		const uint64_t now_ns = k_ghost_io_now_ns();
+		pthread_mutex_lock(&wheel_p->lock);
+		const uint32_t node = k_ghost_io_timer_alloc(wheel_p);
+		if (node)
+		{
+			if (!wheel_p->armed_count && now_ns / K_GHOST_IO_TIMER_TICK_NS > wheel_p->now_tick)
+			{
+				/* Nothing to run in between: the wheel jumps straight to the present instead of walking the idle ticks */
+				wheel_p->now_tick = now_ns / K_GHOST_IO_TIMER_TICK_NS;
+			}
+			k_ghost_io_timer_node_t *node_p = &wheel_p->nodes[node - 1];
+			node_p->expires_ns				= now_ns + delay_ns;
+			node_p->period_ns				= period_ns;
+			node_p->timer_cb				= timer_cb;
+			node_p->user_data_p				= user_data_p;
+			k_ghost_io_timer_link(wheel_p, node, wheel_p->now_tick + 1);
+			timer = (k_ghost_io_timer_t)node_p->generation << 32 | node;
+		}
+		pthread_mutex_unlock(&wheel_p->lock);
+		if (timer)
+		{
+			/* The I/O thread may be waiting with no timeout, or a longer one */
+			k_ghost_io_wake();
+		}
+	}
+	return timer;
+}
+
+uint64_t k_ghost_io_timer_remaining_ns(const k_ghost_io_timer_t timer)
+{
+	uint64_t				  remaining_ns = 0;
+	k_ghost_io_timer_wheel_t *wheel_p	   = &k_ghost_io_ctx.timers;
+	const uint64_t			  now_ns	   = k_ghost_io_now_ns();
+	pthread_mutex_lock(&wheel_p->lock);
+	const uint32_t node = k_ghost_io_timer_find(wheel_p, timer);
+	if (node && wheel_p->nodes[node - 1].expires_ns > now_ns)
+	{
+		remaining_ns = wheel_p->nodes[node - 1].expires_ns - now_ns;
+	}
+	pthread_mutex_unlock(&wheel_p->lock);
+	return remaining_ns;
+}
+
+int k_ghost_io_rearm_ns(const k_ghost_io_timer_t timer, const uint64_t delay_ns)
+{
+	int						  ret_code = -1;
+	k_ghost_io_timer_wheel_t *wheel_p  = &k_ghost_io_ctx.timers;
+	const uint64_t			  now_ns   = k_ghost_io_now_ns();
+	pthread_mutex_lock(&wheel_p->lock);
+	const uint32_t node = k_ghost_io_timer_find(wheel_p, timer);
+	if (node)
+	{
+		k_ghost_io_timer_unlink(wheel_p, node);
+		if (!wheel_p->armed_count && now_ns / K_GHOST_IO_TIMER_TICK_NS > wheel_p->now_tick)
+		{
+			wheel_p->now_tick = now_ns / K_GHOST_IO_TIMER_TICK_NS;
+		}
+		/* Same node and period, the handle stays valid */
+		wheel_p->nodes[node - 1].expires_ns = now_ns + delay_ns;
+		k_ghost_io_timer_link(wheel_p, node, wheel_p->now_tick + 1);
+		ret_code = 0;
+	}
+	pthread_mutex_unlock(&wheel_p->lock);
+	if (0 == ret_code)
+	{
+		k_ghost_io_wake();
+	}
+	return ret_code;
+}
+
+int64_t k_ghost_io_run_timers(const uint64_t now_ns)
+{
+	int64_t					  wait_ns	  = -1;
+	k_ghost_io_timer_wheel_t *wheel_p	  = &k_ghost_io_ctx.timers;
+	const uint64_t			  target_tick = now_ns / K_GHOST_IO_TIMER_TICK_NS;
+	pthread_mutex_lock(&wheel_p->lock);
+	wheel_p->now_ns = now_ns;
+	while (wheel_p->armed_count && wheel_p->now_tick < target_tick)
+	{
+		/* Straight to the next slot holding timers: empty ticks cost nothing, however long the thread slept */
+		const uint64_t next_tick = k_ghost_io_timer_next_tick(wheel_p);
+		wheel_p->now_tick		 = next_tick < target_tick ? next_tick : target_tick;
+		if (next_tick <= target_tick)
+		{
+			for (unsigned int level = 1;
+				 level < K_GHOST_IO_TIMER_LEVELS && 0 == ((wheel_p->now_tick >> ((level - 1) * K_GHOST_IO_TIMER_SLOT_BITS)) & K_GHOST_IO_TIMER_SLOT_MASK); level++)
+			{
+				k_ghost_io_timer_cascade(wheel_p, level);
+			}
+			k_ghost_io_timer_expire(wheel_p);
+		}
+	}
+	if (!wheel_p->armed_count)
+	{
+		wheel_p->now_tick = target_tick > wheel_p->now_tick ? target_tick : wheel_p->now_tick;
+	}
+	else
+	{
+		const uint64_t next_ns = k_ghost_io_timer_next_tick(wheel_p) * K_GHOST_IO_TIMER_TICK_NS;
+		wait_ns				   = next_ns > now_ns ? (int64_t)(next_ns - now_ns) : 0;
+	}
+	pthread_mutex_unlock(&wheel_p->lock);
+	return wait_ns;
+}
+
+static uint32_t k_ghost_io_timer_find(const k_ghost_io_timer_wheel_t *wheel_p, const k_ghost_io_timer_t timer)
+{
+	uint32_t node = (uint32_t)timer;
+	if (node && (node > wheel_p->capacity || (uint32_t)(timer >> 32) != wheel_p->nodes[node - 1].generation || !wheel_p->nodes[node - 1].slot))
+	{
+		node = 0;
+	}
+	return node;
+}
+
+static uint32_t k_ghost_io_timer_alloc(k_ghost_io_timer_wheel_t *wheel_p)
+{
+	if (!wheel_p->free_head)
+	{
+		const uint32_t			 capacity = wheel_p->capacity ? wheel_p->capacity * 2 : K_GHOST_IO_TIMER_MIN_CAPACITY;
+		k_ghost_io_timer_node_t *nodes	  = capacity > wheel_p->capacity ? realloc(wheel_p->nodes, capacity * sizeof(k_ghost_io_timer_node_t)) : NULL;
+		if (nodes)
+		{
+			for (uint32_t i = wheel_p->capacity; i < capacity; i++)
+			{
+				nodes[i] = (k_ghost_io_timer_node_t){.next = i + 2 <= capacity ? i + 2 : 0};
+			}
+			wheel_p->free_head = wheel_p->capacity + 1;
+			wheel_p->nodes	   = nodes;
+			wheel_p->capacity  = capacity;
+		}
+	}
+	const uint32_t node = wheel_p->free_head;
+	if (node)
+	{
+		wheel_p->free_head			  = wheel_p->nodes[node - 1].next;
+		wheel_p->nodes[node - 1].next = 0;
+	}
+	return node;
+}
+
+static void k_ghost_io_timer_release(k_ghost_io_timer_wheel_t *wheel_p, const uint32_t node)
+{
+	k_ghost_io_timer_node_t *node_p = &wheel_p->nodes[node - 1];
+	node_p->generation++;
+	node_p->timer_cb	= NULL;
+	node_p->user_data_p = NULL;
+	node_p->next		= wheel_p->free_head;
+	wheel_p->free_head	= node;
+}
+
+static void k_ghost_io_timer_link(k_ghost_io_timer_wheel_t *wheel_p, const uint32_t node, const uint64_t first_tick)
+{
+	k_ghost_io_timer_node_t *node_p = &wheel_p->nodes[node - 1];
+	/* Rounded up: a timer may run up to a tick late, never early. Timers due in the past run at the first tick */
+	uint64_t expires_tick = (node_p->expires_ns + K_GHOST_IO_TIMER_TICK_NS - 1) / K_GHOST_IO_TIMER_TICK_NS;
+	expires_tick		  = expires_tick > first_tick ? expires_tick : first_tick;
+	uint64_t delta		  = expires_tick - wheel_p->now_tick;
+	if (delta >= K_GHOST_IO_TIMER_MAX_TICKS)
+	{
+		/* Beyond the reach of the wheel: parked in the farthest slot, linked again from there */
+		delta		 = K_GHOST_IO_TIMER_MAX_TICKS - 1;
+		expires_tick = wheel_p->now_tick + delta;
+	}
+	unsigned int level = 0;
+	while (delta >> ((level + 1) * K_GHOST_IO_TIMER_SLOT_BITS))
+	{
+		level++;
+	}
+	const unsigned int index = (unsigned int)(expires_tick >> (level * K_GHOST_IO_TIMER_SLOT_BITS)) & K_GHOST_IO_TIMER_SLOT_MASK;
+	node_p->slot			 = level * K_GHOST_IO_TIMER_SLOTS + index + 1;
+	node_p->prev			 = 0;
+	node_p->next			 = wheel_p->heads[level][index];
+	if (node_p->next)
+	{
+		wheel_p->nodes[node_p->next - 1].prev = node;
+	}
+	wheel_p->heads[level][index] = node;
+	wheel_p->occupied[level] |= 1ULL << index;
+	wheel_p->armed_count++;
+}
+
+static void k_ghost_io_timer_unlink(k_ghost_io_timer_wheel_t *wheel_p, const uint32_t node)
+{
+	k_ghost_io_timer_node_t *node_p = &wheel_p->nodes[node - 1];
+	const unsigned int		 level	= (node_p->slot - 1) / K_GHOST_IO_TIMER_SLOTS;
+	const unsigned int		 index	= (node_p->slot - 1) % K_GHOST_IO_TIMER_SLOTS;
+	if (node_p->prev)
+	{
+		wheel_p->nodes[node_p->prev - 1].next = node_p->next;
+	}
+	else
+	{
+		wheel_p->heads[level][index] = node_p->next;
+	}
+	if (node_p->next)
+	{
+		wheel_p->nodes[node_p->next - 1].prev = node_p->prev;
+	}
+	if (!wheel_p->heads[level][index])
+	{
+		wheel_p->occupied[level] &= ~(1ULL << index);
+	}
+	node_p->slot = 0;
+	node_p->next = 0;
+	node_p->prev = 0;
+	wheel_p->armed_count--;
+}
+
+static uint64_t k_ghost_io_timer_next_tick(const k_ghost_io_timer_wheel_t *wheel_p)
+{
+	uint64_t next_tick = UINT64_MAX;
+	for (unsigned int level = 0; level < K_GHOST_IO_TIMER_LEVELS; level++)
+	{
+		if (wheel_p->occupied[level])
+		{
+			/* Slots are visited in the order the ticks reach them, starting right after the current one */
+			const unsigned int shift   = level * K_GHOST_IO_TIMER_SLOT_BITS;
+			const uint64_t	   current = wheel_p->now_tick >> shift;
+			const unsigned int start   = (unsigned int)(current + 1) & K_GHOST_IO_TIMER_SLOT_MASK;
+			const uint64_t	   rotated = start ? wheel_p->occupied[level] >> start | wheel_p->occupied[level] << (K_GHOST_IO_TIMER_SLOTS - start)
+											   : wheel_p->occupied[level];
+			const uint64_t	   tick	   = (current + 1 + (uint64_t)__builtin_ctzll(rotated)) << shift;
+			next_tick				   = tick < next_tick ? tick : next_tick;
+		}
+	}
+	return next_tick;
+}
+
+static void k_ghost_io_timer_cascade(k_ghost_io_timer_wheel_t *wheel_p, const unsigned int level)
+{
+	const unsigned int index = (unsigned int)(wheel_p->now_tick >> (level * K_GHOST_IO_TIMER_SLOT_BITS)) & K_GHOST_IO_TIMER_SLOT_MASK;
+	while (wheel_p->heads[level][index])
+	{
+		const uint32_t node = wheel_p->heads[level][index];
+		k_ghost_io_timer_unlink(wheel_p, node);
+		k_ghost_io_timer_link(wheel_p, node, wheel_p->now_tick);
+	}
+}
+
+static void k_ghost_io_timer_expire(k_ghost_io_timer_wheel_t *wheel_p)
+{
+	const unsigned int index = (unsigned int)wheel_p->now_tick & K_GHOST_IO_TIMER_SLOT_MASK;
+	/* One node at a time from the head: the lock is released around each callback, which may arm or cancel any timer */
+	while (wheel_p->heads[0][index])
+	{
+		const uint32_t			 node	= wheel_p->heads[0][index];
+		k_ghost_io_timer_node_t *node_p = &wheel_p->nodes[node - 1];
+		k_ghost_io_timer_unlink(wheel_p, node);
+		if ((node_p->expires_ns + K_GHOST_IO_TIMER_TICK_NS - 1) / K_GHOST_IO_TIMER_TICK_NS > wheel_p->now_tick)
+		{
+			/* Parked beyond the reach of the wheel, not due yet */
+			k_ghost_io_timer_link(wheel_p, node, wheel_p->now_tick + 1);
+			continue;
+		}
+		k_ghost_io_timer_callback_t timer_cb	= node_p->timer_cb;
+		void					   *user_data_p = node_p->user_data_p;
+		if (node_p->period_ns)
+		{
+			/* Armed again before the callback runs, so that the callback can cancel it. Missed periods are skipped */
+			node_p->expires_ns += node_p->period_ns;
+			if (node_p->expires_ns <= wheel_p->now_ns)
+			{
+				node_p->expires_ns += (wheel_p->now_ns - node_p->expires_ns) / node_p->period_ns * node_p->period_ns + node_p->period_ns;
+			}
+			k_ghost_io_timer_link(wheel_p, node, wheel_p->now_tick + 1);
+		}
+		else
+		{
+			k_ghost_io_timer_release(wheel_p, node);
+		}
+		pthread_mutex_lock(&wheel_p->callback_lock);
+		pthread_mutex_unlock(&wheel_p->lock);
+		k_ghost_io_in_timer_callback = 1;
+		timer_cb(user_data_p);
+		k_ghost_io_in_timer_callback = 0;
+		pthread_mutex_lock(&wheel_p->lock);
+		pthread_mutex_unlock(&wheel_p->callback_lock);
+	}
+}
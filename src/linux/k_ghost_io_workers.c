@@ -0,0 +1,174 @@
+/**
+ * @file k_ghost_io_workers.c
+ * @ingroup k_ghost_io
+ * @{
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+/* Typedef -------------------------------------------------------------------*/
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Worker thread body: run the queued jobs until the worker is stopped.
+ *
+ * @param arg Worker the thread belongs to
+ *
+ * @return Always NULL
+ */
+static void *k_ghost_io_worker_thread_func(void *arg);
+
+/* Constant ------------------------------------------------------------------*/
+/* Variable ------------------------------------------------------------------*/
+/* Function Definition -------------------------------------------------------*/
+int k_ghost_io_start_workers(void)
+{
+	int ret_code = 0;
+	if (k_ghost_io_ctx.worker_count && !k_ghost_io_ctx.workers)
+	{
+		k_ghost_io_ctx.workers = calloc(k_ghost_io_ctx.worker_count, sizeof(k_ghost_io_worker_t));
+		if (k_ghost_io_ctx.workers)
+		{
+			for (unsigned int i = 0; i < k_ghost_io_ctx.worker_count && 0 == ret_code; i++)
+			{
+				k_ghost_io_worker_t *worker_p = &k_ghost_io_ctx.workers[i];
+				pthread_mutex_init(&worker_p->lock, NULL);
+				pthread_cond_init(&worker_p->cond, NULL);
+				if (0 != pthread_create(&worker_p->thread, NULL, k_ghost_io_worker_thread_func, worker_p))
+				{
+					pthread_cond_destroy(&worker_p->cond);
+					pthread_mutex_destroy(&worker_p->lock);
+					k_ghost_io_stop_workers(i);
+					ret_code = -1;
+				}
+			}
+		}
+		else
+		{
+			ret_code = -1;
+		}
+	}
+	return ret_code;
+}
+
+k_ghost_io_job_t *k_ghost_io_new_job(k_ghost_io_interface_t *interface_p, const int client_fd, const char *request_body)
+{
+	/* Name and body are copied: the request buffer is reused as soon as the I/O thread moves on */
+	const k_ghost_io_interface_entry_t *entry_p	  = (const k_ghost_io_interface_entry_t *)interface_p;
+	const size_t						body_size = request_body ? strlen(request_body) + 1 : 0;
+	k_ghost_io_job_t				   *job_p	  = malloc(sizeof(k_ghost_io_job_t) + entry_p->name_len + 1 + body_size);
+	if (job_p)
+	{
+		job_p->next_job		= NULL;
+		job_p->client_fd	= client_fd;
+		job_p->interface_p	= request_body ? interface_p : NULL;
+		job_p->batch_p		= NULL;
+		job_p->item			= 0;
+		job_p->name_hash	= entry_p->name_hash;
+		job_p->name_len		= entry_p->name_len;
+		job_p->request_body = NULL;
+		memcpy(job_p->interface_name, interface_p->interface_name, entry_p->name_len + 1);
+		if (request_body)
+		{
+			job_p->request_body = job_p->interface_name + entry_p->name_len + 1;
+			memcpy(job_p->request_body, request_body, body_size);
+		}
+	}
+	return job_p;
+}
+
+int k_ghost_io_queue_job(k_ghost_io_job_t *job_p)
+{
+	int ret_code = -1;
+	if (k_ghost_io_ctx.workers)
+	{
+		/* Same interface, same worker: commands to an interface are run in the order they were received */
+		k_ghost_io_worker_t *worker_p = &k_ghost_io_ctx.workers[job_p->name_hash % k_ghost_io_ctx.worker_count];
+		pthread_mutex_lock(&worker_p->lock);
+		if (worker_p->tail)
+		{
+			worker_p->tail->next_job = job_p;
+		}
+		else
+		{
+			worker_p->head = job_p;
+		}
+		worker_p->tail = job_p;
+		pthread_cond_signal(&worker_p->cond);
+		pthread_mutex_unlock(&worker_p->lock);
+		ret_code = 0;
+	}
+	return ret_code;
+}
+
+int k_ghost_io_submit_job(k_ghost_io_interface_t *interface_p, const int client_fd, const char *request_body)
+{
+	int				  ret_code = -1;
+	k_ghost_io_job_t *job_p	   = k_ghost_io_ctx.workers && interface_p ? k_ghost_io_new_job(interface_p, client_fd, request_body) : NULL;
+	if (job_p)
+	{
+		ret_code = k_ghost_io_queue_job(job_p);
+		if (0 != ret_code)
+		{
+			free(job_p);
+		}
+	}
+	return ret_code;
+}
+
+int k_ghost_io_worker_run_job(k_ghost_io_worker_t *worker_p, const int wait)
+{
+	int ret_code = -1;
+	pthread_mutex_lock(&worker_p->lock);
+	while (wait && !worker_p->head && !worker_p->stop)
+	{
+		pthread_cond_wait(&worker_p->cond, &worker_p->lock);
+	}
+	k_ghost_io_job_t *job_p = worker_p->head;
+	if (job_p)
+	{
+		worker_p->head = job_p->next_job;
+		if (!worker_p->head)
+		{
+			worker_p->tail = NULL;
+		}
+	}
+	pthread_mutex_unlock(&worker_p->lock);
+	if (job_p)
+	{
+		k_ghost_io_run_job(job_p);
+		free(job_p);
+		ret_code = 0;
+	}
+	return ret_code;
+}
+
+void k_ghost_io_stop_workers(const unsigned int workers_count)
+{
+	for (unsigned int i = 0; i < workers_count; i++)
+	{
+		k_ghost_io_worker_t *worker_p = &k_ghost_io_ctx.workers[i];
+		pthread_mutex_lock(&worker_p->lock);
+		worker_p->stop = 1;
+		pthread_cond_signal(&worker_p->cond);
+		pthread_mutex_unlock(&worker_p->lock);
+		pthread_join(worker_p->thread, NULL);
+		pthread_cond_destroy(&worker_p->cond);
+		pthread_mutex_destroy(&worker_p->lock);
+	}
+	free(k_ghost_io_ctx.workers);
+	k_ghost_io_ctx.workers = NULL;
+}
+
+static void *k_ghost_io_worker_thread_func(void *arg)
+{
+	k_ghost_io_worker_t *worker_p = (k_ghost_io_worker_t *)arg;
+	while (0 == k_ghost_io_worker_run_job(worker_p, 1))
+	{
+	}
+	return NULL;
+}
@@ -0,0 +1,168 @@
+/**
+ * @file k_ghost_io_bench.c
+ * @brief Microbenchmark of the request header scanning, not part of the test suite.
+ *
+ * Compares the cost per request of k_ghost_io_scan_headers with a line by line scan based on strstr and strncasecmp,
+ * and the cost of writing the headers of a response with k_ghost_io_format_response_head and with snprintf.
+ * Run it by hand: ./k_ghost_io_bench [iterations]
+ */
+
+/* Include -------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "k_ghost_io_priv.h"
+
+/* Macro ---------------------------------------------------------------------*/
+#define K_GHOST_IO_BENCH_DEFAULT_ITERATIONS 1000000
+
+/* Typedef -------------------------------------------------------------------*/
+typedef size_t (*k_ghost_io_bench_scan_t)(const char *request, size_t len);
+
+/* Function Declaration ------------------------------------------------------*/
+/**
+ * @brief Scan a request the way it was done before the single pass scanner: strstr for every line, strncasecmp for every header.
+ *
+ * @param request Request to scan
+ * @param len Length of the request
+ *
+ * @return Length of the headers, 0 if incomplete
+ */
+static size_t k_ghost_io_bench_scan_strstr(const char *request, size_t len);
+
+/**
+ * @brief Scan a request with k_ghost_io_scan_headers.
+ *
+ * @param request Request to scan
+ * @param len Length of the request
+ *
+ * @return Length of the headers, 0 if incomplete
+ */
+static size_t k_ghost_io_bench_scan_vector(const char *request, size_t len);
+
+/**
+ * @brief Write the headers of a 200 response with a JSON body the way it was done before the response table.
+ *
+ * @param request Unused
+ * @param len Length of the body
+ *
+ * @return Length of the headers
+ */
+static size_t k_ghost_io_bench_head_snprintf(const char *request, size_t len);
+
+/**
+ * @brief Write the headers of a 200 response with a JSON body with k_ghost_io_format_response_head.
+ *
+ * @param request Unused
+ * @param len Length of the body
+ *
+ * @return Length of the headers
+ */
+static size_t k_ghost_io_bench_head_table(const char *request, size_t len);
+
+/**
+ * @brief Time a scan function over a request.
+ *
+ * @param name Name printed with the result
+ * @param scan Scan function
+ * @param request Request to scan
+ * @param iterations Number of scans
+ */
+static void k_ghost_io_bench_run(const char *name, k_ghost_io_bench_scan_t scan, const char *request, long iterations);
+
+/* Constant ------------------------------------------------------------------*/
+static const char k_ghost_io_bench_request[] =
+	"POST /api/simulate/motor HTTP/1.1\r\n"
+	"Host: localhost:8080\r\n"
+	"Connection: keep-alive\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/126.0.0.0 Safari/537.36\r\n"
+	"Accept: application/json, text/plain, */*\r\n"
+	"Accept-Encoding: gzip, deflate, br, zstd\r\n"
+	"Accept-Language: en-US,en;q=0.9\r\n"
+	"Content-Type: application/json\r\n"
+	"Origin: http://localhost:8080\r\n"
+	"Referer: http://localhost:8080/dashboard\r\n"
+	"Content-Length: 13\r\n"
+	"\r\n"
+	"{\"speed\": 12}";
+
+static const char *k_ghost_io_bench_headers[] = {"Content-Length:", "Transfer-Encoding:", "Expect:", "Last-Event-ID:", "Accept:"};
+
+/* Variable ------------------------------------------------------------------*/
+k_ghost_io_ctx_t	   k_ghost_io_ctx;		   //!< Read by the response formatting, the rest of the library is not linked
+static volatile size_t k_ghost_io_bench_sink;  //!< Keeps the compiler from dropping the scans
+
+/* Function Definition -------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+	const long iterations = argc > 1 ? atol(argv[1]) : K_GHOST_IO_BENCH_DEFAULT_ITERATIONS;
+	printf("request: %zu bytes, %ld iterations\n", strlen(k_ghost_io_bench_request), iterations);
+	k_ghost_io_bench_run("strstr + strncasecmp", k_ghost_io_bench_scan_strstr, k_ghost_io_bench_request, iterations);
+	k_ghost_io_bench_run("k_ghost_io_scan_headers", k_ghost_io_bench_scan_vector, k_ghost_io_bench_request, iterations);
+	k_ghost_io_bench_run("response head snprintf", k_ghost_io_bench_head_snprintf, k_ghost_io_bench_request, iterations);
+	k_ghost_io_bench_run("response head table", k_ghost_io_bench_head_table, k_ghost_io_bench_request, iterations);
+	k_ghost_io_set_server_headers(1);
+	k_ghost_io_bench_run("response head table+Date", k_ghost_io_bench_head_table, k_ghost_io_bench_request, iterations);
+	return 0;
+}
+
+static size_t k_ghost_io_bench_scan_strstr(const char *request, const size_t len)
+{
+	size_t		header_len = 0;
+	const char *header_end = strstr(request, "\r\n\r\n");
+	(void)len;
+	if (header_end)
+	{
+		header_len = (size_t)(header_end - request) + 4;
+		for (const char *line = strstr(request, "\r\n"); line && line < header_end; line = strstr(line + 2, "\r\n"))
+		{
+			for (size_t i = 0; i < sizeof(k_ghost_io_bench_headers) / sizeof(k_ghost_io_bench_headers[0]); i++)
+			{
+				if (0 == strncasecmp(line + 2, k_ghost_io_bench_headers[i], strlen(k_ghost_io_bench_headers[i])))
+				{
+					header_len += i;
+					break;
+				}
+			}
+		}
+	}
+	return header_len;
+}
+
+static size_t k_ghost_io_bench_scan_vector(const char *request, const size_t len)
+{
+	k_ghost_io_headers_t headers;
+	return 0 == k_ghost_io_scan_headers(request, len, &headers) ? headers.header_len + headers.values[K_GHOST_IO_HEADER_CONTENT_LENGTH].len : 0;
+}
+
+static size_t k_ghost_io_bench_head_snprintf(const char *request, const size_t len)
+{
+	char head[K_GHOST_IO_RESPONSE_HEAD_SIZE];
+	(void)request;
+	return (size_t)snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n", 200, "OK", len);
+}
+
+static size_t k_ghost_io_bench_head_table(const char *request, const size_t len)
+{
+	char head[K_GHOST_IO_RESPONSE_HEAD_SIZE];
+	(void)request;
+	return k_ghost_io_format_response_head(head, 200, NULL, len);
+}
+
+static void k_ghost_io_bench_run(const char *name, const k_ghost_io_bench_scan_t scan, const char *request, const long iterations)
+{
+	struct timespec start;
+	struct timespec stop;
+	const size_t	len = strlen(request);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < iterations; i++)
+	{
+		k_ghost_io_bench_sink = scan(request, len);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	const double elapsed_ns = (double)(stop.tv_sec - start.tv_sec) * 1e9 + (double)(stop.tv_nsec - start.tv_nsec);
+	printf("%-24s %8.1f ns/request\n", name, iterations > 0 ? elapsed_ns / (double)iterations : 0.0);
+}
@@ -24,3 +24,5 @@ DEFINE_FAKE_VALUE_FUNC(ssize_t, recv, int, void *, size_t, int)
 DEFINE_FAKE_VALUE_FUNC(int, close, int)
 DEFINE_FAKE_VALUE_FUNC(int, setsockopt, int, int, int, const void *, socklen_t)
 DEFINE_FAKE_VALUE_FUNC(ssize_t, send, int, const void *, size_t, int)
+DEFINE_FAKE_VALUE_FUNC(ssize_t, writev, int, const struct iovec *, int)
+DEFINE_FAKE_VALUE_FUNC(int, connect, int, const struct sockaddr *, socklen_t)
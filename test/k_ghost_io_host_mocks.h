@@ -13,6 +13,7 @@ extern "C"
 /* Include -------------------------------------------------------------------*/
 #include <pthread.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "fff.h"
@@ -33,6 +34,8 @@ DECLARE_FAKE_VALUE_FUNC(ssize_t, recv, int, void *, size_t, int)
 DECLARE_FAKE_VALUE_FUNC(int, close, int)
 DECLARE_FAKE_VALUE_FUNC(int, setsockopt, int, int, int, const void *, socklen_t)
 DECLARE_FAKE_VALUE_FUNC(ssize_t, send, int, const void *, size_t, int)
+DECLARE_FAKE_VALUE_FUNC(ssize_t, writev, int, const struct iovec *, int)
+DECLARE_FAKE_VALUE_FUNC(int, connect, int, const struct sockaddr *, socklen_t)
 
 #ifdef __cplusplus
 }
@@ -1,8 +1,19 @@
 #include "k_ghost_io.h"
 
+#include <algorithm>
+#include <cmath>
+#include <dlfcn.h>
+#include <fstream>
+#include <glob.h>
+#include <sstream>
+#include <thread>
 #include <gtest/gtest.h>
+#include <regex>
+#include <string>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <vector>
 
 #include "fff.h"
 #include "k_ghost_io_host_mocks.h"
@@ -10,6 +21,16 @@
 
 extern k_ghost_io_ctx_t k_ghost_io_ctx;
 
+/* Context as initialized by the library, its locks included, restored around every test */
+static const k_ghost_io_ctx_t initialCtx = k_ghost_io_ctx;
+
+/* Length of the headers the I/O thread hands to the handlers along with the request, 0 if they are incomplete */
+static size_t headerLen(const std::string &request)
+{
+	const size_t end = request.find("\r\n\r\n");
+	return std::string::npos == end ? 0 : end + 4;
+}
+
 class KGhostIOTest : public ::testing::Test
 {
    protected:
@@ -24,7 +45,9 @@ class KGhostIOTest : public ::testing::Test
 		RESET_FAKE(close);
 		RESET_FAKE(setsockopt);
 		RESET_FAKE(send);
-		memset(&k_ghost_io_ctx, 0, sizeof(k_ghost_io_ctx_t));
+		RESET_FAKE(writev);
+		RESET_FAKE(connect);
+		memcpy(&k_ghost_io_ctx, &initialCtx, sizeof(k_ghost_io_ctx_t));
 	}
 
 	void TearDown() override
@@ -37,7 +60,44 @@ class KGhostIOTest : public ::testing::Test
 			free(interface_p);
 			interface_p = next;
 		}
-		memset(&k_ghost_io_ctx, 0, sizeof(k_ghost_io_ctx_t));
+		free(k_ghost_io_ctx.interface_table);
+		for (unsigned int i = 0; k_ghost_io_ctx.workers && i < k_ghost_io_ctx.worker_count; i++)
+		{
+			while (k_ghost_io_ctx.workers[i].head)
+			{
+				k_ghost_io_job_t *job_p		   = k_ghost_io_ctx.workers[i].head;
+				k_ghost_io_ctx.workers[i].head = (k_ghost_io_job_t *)job_p->next_job;
+				free(job_p);
+			}
+		}
+		free(k_ghost_io_ctx.workers);
+		for (size_t i = 0; i < k_ghost_io_ctx.retired_count; i++)
+		{
+			free(k_ghost_io_ctx.retired[i].ptr);
+		}
+		free(k_ghost_io_ctx.retired);
+		while (k_ghost_io_ctx.generators)
+		{
+			k_ghost_io_remove_generator(k_ghost_io_ctx.generators->interface_name);
+		}
+		while (k_ghost_io_ctx.playbacks)
+		{
+			k_ghost_io_remove_playback(k_ghost_io_ctx.playbacks->interface_name);
+		}
+		while (k_ghost_io_ctx.states)
+		{
+			k_ghost_io_remove_state(k_ghost_io_ctx.states->interface_name);
+		}
+		while (k_ghost_io_ctx.farms)
+		{
+			k_ghost_io_remove_farm(k_ghost_io_ctx.farms->farm_name);
+		}
+		while (k_ghost_io_ctx.faults)
+		{
+			k_ghost_io_set_faults(k_ghost_io_ctx.faults->interface_name, nullptr);
+		}
+		free(k_ghost_io_ctx.timers.nodes);
+		memcpy(&k_ghost_io_ctx, &initialCtx, sizeof(k_ghost_io_ctx_t));
 	}
 };
 
@@ -127,7 +187,7 @@ TEST_F(KGhostIOTest, KGhostIOAddSseClientSuccess)
 	int							   sse_client_fd  = 5;
 	k_ghost_io_sse_clients_list_t *sse_client_ptr = k_ghost_io_ctx.sse_clients;
 	EXPECT_EQ(sse_client_ptr, nullptr);
-	EXPECT_EQ(k_ghost_io_add_sse_client(sse_client_fd), 0);
+	EXPECT_EQ(k_ghost_io_add_sse_client(sse_client_fd, nullptr), 0);
 	sse_client_ptr = k_ghost_io_ctx.sse_clients;
 	EXPECT_NE(sse_client_ptr, nullptr);
 	EXPECT_EQ(sse_client_ptr->sse_client_fd, sse_client_fd);
@@ -141,13 +201,13 @@ TEST_F(KGhostIOTest, KGhostIOAdd2SseClientsSuccess)
 	int							   sse_client_fd2 = 9;
 	k_ghost_io_sse_clients_list_t *sse_client_ptr = k_ghost_io_ctx.sse_clients;
 	EXPECT_EQ(sse_client_ptr, nullptr);
-	EXPECT_EQ(k_ghost_io_add_sse_client(sse_client_fd1), 0);
+	EXPECT_EQ(k_ghost_io_add_sse_client(sse_client_fd1, nullptr), 0);
 	sse_client_ptr = k_ghost_io_ctx.sse_clients;
 	EXPECT_NE(sse_client_ptr, nullptr);
 	EXPECT_EQ(sse_client_ptr->sse_client_fd, sse_client_fd1);
 	EXPECT_EQ(sse_client_ptr->next_client, nullptr);
 
-	EXPECT_EQ(k_ghost_io_add_sse_client(sse_client_fd2), 0);
+	EXPECT_EQ(k_ghost_io_add_sse_client(sse_client_fd2, nullptr), 0);
 	sse_client_ptr = k_ghost_io_ctx.sse_clients;
 	EXPECT_NE(sse_client_ptr, nullptr);
 	EXPECT_EQ(sse_client_ptr->sse_client_fd, sse_client_fd2);
@@ -165,7 +225,7 @@ TEST_F(KGhostIOTest, KGhostIORemoveSingleSseClientSuccess)
 	int							   sse_client_fd  = 5;
 	k_ghost_io_sse_clients_list_t *sse_client_ptr = k_ghost_io_ctx.sse_clients;
 	EXPECT_EQ(sse_client_ptr, nullptr);
-	k_ghost_io_add_sse_client(sse_client_fd);
+	k_ghost_io_add_sse_client(sse_client_fd, nullptr);
 	k_ghost_io_remove_sse_client(sse_client_fd);
 	sse_client_ptr = k_ghost_io_ctx.sse_clients;
 	EXPECT_EQ(sse_client_ptr, nullptr);
@@ -176,8 +236,8 @@ TEST_F(KGhostIOTest, KGhostIORemoveHeadSseClientSuccess)
 	int							   sse_client_fd1 = 5;
 	int							   sse_client_fd2 = 9;
 	k_ghost_io_sse_clients_list_t *sse_client_ptr = k_ghost_io_ctx.sse_clients;
-	k_ghost_io_add_sse_client(sse_client_fd1);
-	k_ghost_io_add_sse_client(sse_client_fd2);
+	k_ghost_io_add_sse_client(sse_client_fd1, nullptr);
+	k_ghost_io_add_sse_client(sse_client_fd2, nullptr);
 	k_ghost_io_remove_sse_client(sse_client_fd2);
 	sse_client_ptr = k_ghost_io_ctx.sse_clients;
 	EXPECT_NE(sse_client_ptr, nullptr);
@@ -191,8 +251,8 @@ TEST_F(KGhostIOTest, KGhostIORemoveTailSseClientSuccess)
 	int							   sse_client_fd1 = 5;
 	int							   sse_client_fd2 = 9;
 	k_ghost_io_sse_clients_list_t *sse_client_ptr = k_ghost_io_ctx.sse_clients;
-	k_ghost_io_add_sse_client(sse_client_fd1);
-	k_ghost_io_add_sse_client(sse_client_fd2);
+	k_ghost_io_add_sse_client(sse_client_fd1, nullptr);
+	k_ghost_io_add_sse_client(sse_client_fd2, nullptr);
 	k_ghost_io_remove_sse_client(sse_client_fd1);
 	sse_client_ptr = k_ghost_io_ctx.sse_clients;
 	EXPECT_NE(sse_client_ptr, nullptr);
@@ -207,9 +267,9 @@ TEST_F(KGhostIOTest, KGhostIORemoveCentralSseClientSuccess)
 	int							   sse_client_fd2 = 9;
 	int							   sse_client_fd3 = 12;
 	k_ghost_io_sse_clients_list_t *sse_client_ptr = k_ghost_io_ctx.sse_clients;
-	k_ghost_io_add_sse_client(sse_client_fd1);
-	k_ghost_io_add_sse_client(sse_client_fd2);
-	k_ghost_io_add_sse_client(sse_client_fd3);
+	k_ghost_io_add_sse_client(sse_client_fd1, nullptr);
+	k_ghost_io_add_sse_client(sse_client_fd2, nullptr);
+	k_ghost_io_add_sse_client(sse_client_fd3, nullptr);
 	k_ghost_io_remove_sse_client(sse_client_fd2);
 	sse_client_ptr = k_ghost_io_ctx.sse_clients;
 	EXPECT_NE(sse_client_ptr, nullptr);
@@ -255,7 +315,7 @@ TEST_F(KGhostIOTest, KGhostIOManageRestRequest)
 		"Content-Length: 0\r\n"
 		"\r\n"
 		"{}";
-	k_ghost_io_manage_rest_request(5, request.c_str());
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
 	EXPECT_EQ(send_fake.call_count, 1);
 	EXPECT_EQ(close_fake.call_count, 1);
 	EXPECT_EQ(send_fake.arg0_val, 5);
@@ -346,7 +406,7 @@ TEST_F(KGhostIOTest, KGhostIOCallRestCBForRegisteredInterface)
 			return 0;
 		},
 		[]() {}, nullptr);
-	k_ghost_io_manage_rest_request(5, request.c_str());
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
 	EXPECT_EQ(send_fake.call_count, 1);
 	EXPECT_EQ(close_fake.call_count, 1);
 	EXPECT_EQ(send_fake.arg0_val, 5);
@@ -366,7 +426,7 @@ TEST_F(KGhostIOTest, KGhostIOCallRestCBForRegisteredInterfaceInternalError)
 		"{\"interface\": \"test_interface\"}";
 	static int cbCalled = 0;
 	k_ghost_io_register_interface("test_interface", [](const cJSON *input, void *user_data_p) { return -1; }, []() {}, nullptr);
-	k_ghost_io_manage_rest_request(5, request.c_str());
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
 	EXPECT_EQ(send_fake.call_count, 1);
 	EXPECT_EQ(close_fake.call_count, 1);
 	EXPECT_EQ(send_fake.arg0_val, 5);
@@ -374,6 +434,38 @@ TEST_F(KGhostIOTest, KGhostIOCallRestCBForRegisteredInterfaceInternalError)
 	EXPECT_EQ(send_fake.arg2_val, strlen("HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n"));
 }
 
+TEST_F(KGhostIOTest, KGhostIOCallRestCBUsingCJSONAllocations)
+{
+	std::string request =
+		"POST /api/system/manage HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Content-Type: application/json\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n"
+		"{\"interface\": \"test_interface\", \"values\": [1, 2, 3]}";
+	static std::string printed;
+	k_ghost_io_register_interface(
+		"test_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			/* Allocations made by the callback are regular heap allocations */
+			cJSON *copy = cJSON_CreateObject();
+			cJSON_AddNumberToObject(copy, "size", cJSON_GetArraySize(cJSON_GetObjectItem(input, "values")));
+			char *text = cJSON_PrintUnformatted(copy);
+			printed	   = text;
+			cJSON_free(text);
+			cJSON_Delete(copy);
+			return 0;
+		},
+		[]() {}, nullptr);
+	for (int i = 0; i < 3; i++)
+	{
+		k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
+		EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+		EXPECT_EQ(printed, "{\"size\":3}");
+	}
+}
+
 TEST_F(KGhostIOTest, KGhostIOCallRestCBForMultipleRegisteredInterface)
 {
 	std::string request1 =
@@ -407,14 +499,14 @@ TEST_F(KGhostIOTest, KGhostIOCallRestCBForMultipleRegisteredInterface)
 			return 0;
 		},
 		[]() {}, nullptr);
-	k_ghost_io_manage_rest_request(5, request1.c_str());
+	k_ghost_io_manage_rest_request(5, request1.c_str(), headerLen(request1));
 	EXPECT_EQ(send_fake.call_count, 1);
 	EXPECT_EQ(close_fake.call_count, 1);
 	EXPECT_EQ(send_fake.arg0_val, 5);
 	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
 	EXPECT_EQ(send_fake.arg2_val, strlen("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n"));
 	EXPECT_EQ(cbCalled, 1);
-	k_ghost_io_manage_rest_request(5, request1.c_str());
+	k_ghost_io_manage_rest_request(5, request1.c_str(), headerLen(request1));
 	EXPECT_EQ(send_fake.call_count, 2);
 	EXPECT_EQ(close_fake.call_count, 2);
 	EXPECT_EQ(send_fake.arg0_val, 5);
@@ -432,7 +524,7 @@ TEST_F(KGhostIOTest, KGhostIOCallRestCBForUnknownInterface)
 		"Content-Length: 0\r\n"
 		"\r\n"
 		"{\"interface\": \"unknown_interface\"}";
-	k_ghost_io_manage_rest_request(5, request.c_str());
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
 	EXPECT_EQ(send_fake.call_count, 1);
 	EXPECT_EQ(close_fake.call_count, 1);
 	EXPECT_EQ(send_fake.arg0_val, 5);
@@ -448,7 +540,7 @@ TEST_F(KGhostIOTest, KGhostIOCallRestCBForInvalidRequest)
 		"Content-Type: application/json\r\n"
 		"Content-Length: 0\r\n"
 		"\r\n";
-	k_ghost_io_manage_rest_request(5, request.c_str());
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
 	EXPECT_EQ(send_fake.call_count, 1);
 	EXPECT_EQ(close_fake.call_count, 1);
 	EXPECT_EQ(send_fake.arg0_val, 5);
@@ -463,7 +555,7 @@ TEST_F(KGhostIOTest, KGhostIOCallRestCBForMissingBodyRequest)
 		"Host: localhost\r\n"
 		"Content-Type: application/json\r\n"
 		"Content-Length: 0";
-	k_ghost_io_manage_rest_request(5, request.c_str());
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
 	EXPECT_EQ(send_fake.call_count, 1);
 	EXPECT_EQ(close_fake.call_count, 1);
 	EXPECT_EQ(send_fake.arg0_val, 5);
@@ -473,7 +565,7 @@ TEST_F(KGhostIOTest, KGhostIOCallRestCBForMissingBodyRequest)
 
 TEST_F(KGhostIOTest, KGhostIOCallRestCBForNullRequest)
 {
-	k_ghost_io_manage_rest_request(5, nullptr);
+	k_ghost_io_manage_rest_request(5, nullptr, 0);
 	EXPECT_EQ(send_fake.call_count, 1);
 	EXPECT_EQ(close_fake.call_count, 1);
 	EXPECT_EQ(send_fake.arg0_val, 5);
@@ -481,157 +573,2891 @@ TEST_F(KGhostIOTest, KGhostIOCallRestCBForNullRequest)
 	EXPECT_EQ(send_fake.arg2_val, strlen("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n"));
 }
 
-TEST_F(KGhostIOTest, KGhostIOCallSyncCb)
+TEST_F(KGhostIOTest, KGhostIORouteRequestToRegisteredInterface)
 {
-	static int syncCbCalled = 0;
-	k_ghost_io_register_interface("test_interface", [](const cJSON *input, void *user_data_p) { return 0; }, []() { syncCbCalled++; }, nullptr);
-	EXPECT_EQ(syncCbCalled, 0);
-	k_ghost_io_add_sse_client(5);
-	EXPECT_EQ(syncCbCalled, 1);
-	k_ghost_io_remove_sse_client(5);
+	std::string request =
+		"POST /api/simulate/test_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Content-Type: application/json\r\n"
+		"Content-Length: 13\r\n"
+		"\r\n"
+		"{\"speed\": 12}";
+	static int cbCalled = 0;
+	k_ghost_io_register_interface(
+		"test_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			cbCalled++;
+			EXPECT_EQ(cJSON_GetNumberValue(cJSON_GetObjectItem(input, "speed")), 12);
+			return 0;
+		},
+		[]() {}, nullptr);
+	k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_EQ(send_fake.arg0_val, 5);
+	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(cbCalled, 1);
 }
 
-TEST_F(KGhostIOTest, KGhostIOCallSendEventNoSSEClients)
+TEST_F(KGhostIOTest, KGhostIORouteRequestWithEmptyBody)
 {
-	k_ghost_io_send_event("test");
-	EXPECT_EQ(send_fake.call_count, 0);
+	std::string request =
+		"POST /api/simulate/test_interface?reset=1 HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n";
+	static int cbCalled = 0;
+	k_ghost_io_register_interface(
+		"test_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			cbCalled++;
+			EXPECT_TRUE(cJSON_IsObject(input));
+			return -1;
+		},
+		[]() {}, nullptr);
+	k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(cbCalled, 1);
 }
 
-TEST_F(KGhostIOTest, KGhostIOCallSendEventOneSSEClient)
+TEST_F(KGhostIOTest, KGhostIORouteRequestToUnknownInterface)
 {
-	k_ghost_io_add_sse_client(5);
-	k_ghost_io_send_event("test");
-	EXPECT_EQ(send_fake.call_count, 2);
-	EXPECT_EQ(send_fake.arg0_val, 5);
-	EXPECT_EQ(send_fake.arg2_val, strlen("data: test\r\n\r\n"));
-	k_ghost_io_remove_sse_client(5);
+	std::string request =
+		"POST /api/simulate/test_interface2 HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Content-Length: 9\r\n"
+		"\r\n"
+		"not json";
+	k_ghost_io_register_interface("test_interface", [](const cJSON *input, void *user_data_p) { return 0; }, []() {}, nullptr);
+	k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
 }
 
-TEST_F(KGhostIOTest, KGhostIOCallSendEventMultipleSSEClients)
+TEST_F(KGhostIOTest, KGhostIORouteRequestInvalidBody)
 {
-	k_ghost_io_add_sse_client(5);
-	k_ghost_io_add_sse_client(6);
-	k_ghost_io_add_sse_client(7);
-	k_ghost_io_send_event("test");
-	EXPECT_EQ(send_fake.call_count, 6);
-	EXPECT_EQ(send_fake.arg0_history[3], 7);
-	EXPECT_EQ(send_fake.arg0_history[4], 6);
-	EXPECT_EQ(send_fake.arg0_history[5], 5);
-	EXPECT_EQ(send_fake.arg2_val, strlen("data: test\r\n\r\n"));
-	k_ghost_io_remove_sse_client(5);
-	k_ghost_io_remove_sse_client(6);
-	k_ghost_io_remove_sse_client(7);
+	std::string request =
+		"POST /api/simulate/test_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Content-Length: 9\r\n"
+		"\r\n"
+		"not json";
+	k_ghost_io_register_interface("test_interface", [](const cJSON *input, void *user_data_p) { return 0; }, []() {}, nullptr);
+	k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n");
 }
 
-TEST_F(KGhostIOTest, KGhostIORegisterCallbackWithUserParam)
+TEST_F(KGhostIOTest, KGhostIOScanInterfaceKey)
 {
-	struct kGhostUserParamTest_s
-	{
-		int value;
-	};
-	kGhostUserParamTest_s user_param = {0};
-	std::string			  request =
-		"POST /api/system/manage HTTP/1.1\r\n"
+	const char *interface	  = nullptr;
+	size_t		interface_len = 0;
+	EXPECT_EQ(k_ghost_io_scan_interface_key(" { \"interface\" : \"anemometer\", \"speed\": 3}", &interface, &interface_len), 0);
+	EXPECT_EQ(std::string(interface, interface_len), "anemometer");
+	EXPECT_EQ(k_ghost_io_scan_interface_key("{\"cfg\": {\"interface\": \"nested\", \"s\": \"}]\\\"\"}, \"list\": [1, [2, 3]], \"on\": true, \"interface\": \"top\"}",
+											&interface, &interface_len),
+			  0);
+	EXPECT_EQ(std::string(interface, interface_len), "top");
+	EXPECT_EQ(k_ghost_io_scan_interface_key("{\"Interface\": \"anemometer\"}", &interface, &interface_len), 0);
+	EXPECT_EQ(std::string(interface, interface_len), "anemometer");
+}
+
+TEST_F(KGhostIOTest, KGhostIOScanInterfaceKeyUndecided)
+{
+	const char *interface	  = nullptr;
+	size_t		interface_len = 0;
+	EXPECT_EQ(k_ghost_io_scan_interface_key("", &interface, &interface_len), -1);
+	EXPECT_EQ(k_ghost_io_scan_interface_key("[{\"interface\": \"anemometer\"}]", &interface, &interface_len), -1);
+	EXPECT_EQ(k_ghost_io_scan_interface_key("{\"speed\": 3}", &interface, &interface_len), -1);
+	EXPECT_EQ(k_ghost_io_scan_interface_key("{\"interface\": \"anemo\\u006deter\"}", &interface, &interface_len), -1);
+	EXPECT_EQ(k_ghost_io_scan_interface_key("{\"interface\": 3}", &interface, &interface_len), -1);
+	EXPECT_EQ(k_ghost_io_scan_interface_key("{\"speed\": {\"interface\": \"anemometer\"", &interface, &interface_len), -1);
+	EXPECT_EQ(k_ghost_io_scan_interface_key(nullptr, &interface, &interface_len), -1);
+}
+
+TEST_F(KGhostIOTest, KGhostIOUnknownInterfaceNotParsed)
+{
+	std::string request =
+		"POST /api/simulate HTTP/1.1\r\n"
 		"Host: localhost\r\n"
-		"Content-Type: application/json\r\n"
 		"Content-Length: 0\r\n"
 		"\r\n"
-		"{\"interface\": \"test_interface\"}";
+		"{\"interface\": \"unknown_interface\", \"speed\": }";
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n");
+}
+
+TEST_F(KGhostIOTest, KGhostIOEscapedInterfaceNameFallsBackToParser)
+{
+	std::string request =
+		"POST /api/simulate HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n"
+		"{\"interface\": \"test\\\"interface\"}";
 	static int cbCalled = 0;
 	k_ghost_io_register_interface(
-		"test_interface",
+		"test\"interface",
 		[](const cJSON *input, void *user_data_p)
 		{
 			cbCalled++;
-			auto user_param_p = static_cast<kGhostUserParamTest_s *>(user_data_p);
-			user_param_p->value++;
 			return 0;
 		},
-		[]() {}, &user_param);
-	EXPECT_EQ(user_param.value, 0);
-	k_ghost_io_manage_rest_request(5, request.c_str());
+		[]() {}, nullptr);
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
 	EXPECT_EQ(send_fake.call_count, 1);
-	EXPECT_EQ(close_fake.call_count, 1);
-	EXPECT_EQ(send_fake.arg0_val, 5);
 	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
-	EXPECT_EQ(send_fake.arg2_val, strlen("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n"));
 	EXPECT_EQ(cbCalled, 1);
-	EXPECT_EQ(user_param.value, 1);
 }
 
-TEST_F(KGhostIOTest, KGhostIOUnregisterFirstInterface)
+TEST_F(KGhostIOTest, KGhostIOCallRawCBForRegisteredInterface)
 {
-	k_ghost_io_register_interface("test_interface_1", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
-	k_ghost_io_register_interface("test_interface_2", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
-	k_ghost_io_register_interface("test_interface_3", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
-	const k_ghost_io_interface_t *interface = k_ghost_io_ctx.interfaces;
-	EXPECT_STREQ(interface->interface_name, "test_interface_3");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_STREQ(interface->interface_name, "test_interface_2");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_STREQ(interface->interface_name, "test_interface_1");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_EQ(interface, nullptr);
-	k_ghost_io_unregister_interface("test_interface_3");
-	interface = k_ghost_io_ctx.interfaces;
-	EXPECT_STREQ(interface->interface_name, "test_interface_2");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_STREQ(interface->interface_name, "test_interface_1");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_EQ(interface, nullptr);
+	std::string request =
+		"POST /api/simulate HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n"
+		"{\"interface\": \"test_interface\", \"speed\": 12}";
+	static std::string receivedBody;
+	EXPECT_EQ(k_ghost_io_register_raw_interface(
+				  "test_interface",
+				  [](const char *body_p, size_t body_len, void *user_data_p)
+				  {
+					  receivedBody.assign(body_p, body_len);
+					  return 0;
+				  },
+				  nullptr, nullptr),
+			  K_GHOST_REGISTER_RET_CODE_OK);
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(receivedBody, "{\"interface\": \"test_interface\", \"speed\": 12}");
 }
 
-TEST_F(KGhostIOTest, KGhostIOUnregisterMiddleInterface)
+TEST_F(KGhostIOTest, KGhostIORegisterRawCallbackNullCallback)
 {
-	k_ghost_io_register_interface("test_interface_1", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
-	k_ghost_io_register_interface("test_interface_2", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
-	k_ghost_io_register_interface("test_interface_3", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
-	const k_ghost_io_interface_t *interface = k_ghost_io_ctx.interfaces;
-	EXPECT_STREQ(interface->interface_name, "test_interface_3");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_STREQ(interface->interface_name, "test_interface_2");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_STREQ(interface->interface_name, "test_interface_1");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_EQ(interface, nullptr);
-	k_ghost_io_unregister_interface("test_interface_2");
-	interface = k_ghost_io_ctx.interfaces;
-	EXPECT_STREQ(interface->interface_name, "test_interface_3");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_STREQ(interface->interface_name, "test_interface_1");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_EQ(interface, nullptr);
+	EXPECT_EQ(k_ghost_io_register_raw_interface("test_interface", nullptr, nullptr, nullptr), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_ctx.interfaces, nullptr);
 }
 
-TEST_F(KGhostIOTest, KGhostIOUnregisterLastInterface)
+TEST_F(KGhostIOTest, KGhostIOBatchRequest)
 {
-	k_ghost_io_register_interface("test_interface_1", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
-	k_ghost_io_register_interface("test_interface_2", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
-	k_ghost_io_register_interface("test_interface_3", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
-	const k_ghost_io_interface_t *interface = k_ghost_io_ctx.interfaces;
-	EXPECT_STREQ(interface->interface_name, "test_interface_3");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_STREQ(interface->interface_name, "test_interface_2");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_STREQ(interface->interface_name, "test_interface_1");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_EQ(interface, nullptr);
-	k_ghost_io_unregister_interface("test_interface_1");
-	interface = k_ghost_io_ctx.interfaces;
-	EXPECT_STREQ(interface->interface_name, "test_interface_3");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_STREQ(interface->interface_name, "test_interface_2");
-	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
-	EXPECT_EQ(interface, nullptr);
+	std::string request =
+		"POST /api/simulate HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Content-Type: application/json\r\n"
+		"\r\n"
+		"[{\"interface\": \"ok_interface\", \"value\": 1},"
+		" {\"interface\": \"failing_interface\"},"
+		" {\"interface\": \"unknown_interface\"},"
+		" 42,"
+		" {\"interface\": \"raw_interface\", \"value\": 2},"
+		" {\"interface\": \"ok_interface\", \"value\": 3}]";
+	static std::string response;
+	static int		   okCalls = 0;
+	static std::string rawBody;
+	send_fake.custom_fake = [](int, const void *buf, size_t len, int)
+	{
+		response.assign(static_cast<const char *>(buf), len);
+		return static_cast<ssize_t>(len);
+	};
+	k_ghost_io_register_interface(
+		"ok_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			okCalls++;
+			EXPECT_EQ(cJSON_GetNumberValue(cJSON_GetObjectItem(input, "value")), okCalls == 1 ? 1 : 3);
+			return 0;
+		},
+		nullptr, nullptr);
+	k_ghost_io_register_interface("failing_interface", [](const cJSON *input, void *user_data_p) { return -1; }, nullptr, nullptr);
+	k_ghost_io_register_raw_interface(
+		"raw_interface",
+		[](const char *body_p, size_t body_len, void *user_data_p)
+		{
+			rawBody.assign(body_p, body_len);
+			return 0;
+		},
+		nullptr, nullptr);
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_EQ(response, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 25\r\n\r\n[200,500,204,400,200,200]");
+	EXPECT_EQ(okCalls, 2);
+	EXPECT_EQ(rawBody, "{\"interface\":\"raw_interface\",\"value\":2}");
 }
 
-TEST(UnregisterInterface, UnregisterAllInterfaces)
+TEST_F(KGhostIOTest, KGhostIOEmptyBatchRequest)
 {
-	k_ghost_io_register_interface("test_interface_1", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
-	k_ghost_io_register_interface("test_interface_2", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
-	k_ghost_io_register_interface("test_interface_3", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
-	k_ghost_io_unregister_interface("test_interface_1");
-	k_ghost_io_unregister_interface("test_interface_2");
-	k_ghost_io_unregister_interface("test_interface_3");
-	EXPECT_EQ(k_ghost_io_ctx.interfaces, nullptr);
-}
\ No newline at end of file
+	std::string request =
+		"POST /api/simulate HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"[]";
+	static std::string response;
+	send_fake.custom_fake = [](int, const void *buf, size_t len, int)
+	{
+		response.assign(static_cast<const char *>(buf), len);
+		return static_cast<ssize_t>(len);
+	};
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(response, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 2\r\n\r\n[]");
+}
+
+TEST_F(KGhostIOTest, KGhostIODeferredResponse)
+{
+	std::string request =
+		"POST /api/simulate/slow_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{}";
+	static std::string		  response;
+	static k_ghost_io_token_t token = 0;
+	send_fake.custom_fake			= [](int, const void *buf, size_t len, int)
+	{
+		response.assign(static_cast<const char *>(buf), len);
+		return static_cast<ssize_t>(len);
+	};
+	k_ghost_io_register_interface(
+		"slow_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			token = k_ghost_io_defer();
+			EXPECT_NE(token, 0u);
+			EXPECT_EQ(k_ghost_io_defer(), token);
+			return K_GHOST_IO_CB_PENDING;
+		},
+		nullptr, nullptr);
+	k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 0);
+	EXPECT_EQ(close_fake.call_count, 0);
+	EXPECT_EQ(k_ghost_io_complete(token, 200, "{\"done\":true}"), 0);
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(send_fake.arg0_val, 5);
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_EQ(close_fake.arg0_val, 5);
+	EXPECT_EQ(response, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 13\r\n\r\n{\"done\":true}");
+	EXPECT_EQ(k_ghost_io_complete(token, 200, nullptr), -1);
+	EXPECT_EQ(send_fake.call_count, 1);
+}
+
+TEST_F(KGhostIOTest, KGhostIODeferredResponseWithoutBody)
+{
+	std::string request =
+		"POST /api/simulate HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{\"interface\": \"slow_interface\"}";
+	static k_ghost_io_token_t token = 0;
+	k_ghost_io_register_interface(
+		"slow_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			token = k_ghost_io_defer();
+			return K_GHOST_IO_CB_PENDING;
+		},
+		nullptr, nullptr);
+	k_ghost_io_manage_rest_request(7, request.c_str(), headerLen(request));
+	EXPECT_EQ(close_fake.call_count, 0);
+	EXPECT_EQ(k_ghost_io_complete(token, 504, nullptr), 0);
+	EXPECT_EQ(std::string((char *)send_fake.arg1_val, send_fake.arg2_val), "HTTP/1.1 504 Gateway Timeout\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(close_fake.arg0_val, 7);
+}
+
+TEST_F(KGhostIOTest, KGhostIOPendingWithoutDefer)
+{
+	std::string request =
+		"POST /api/simulate/slow_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{}";
+	k_ghost_io_register_interface("slow_interface", [](const cJSON *input, void *user_data_p) { return K_GHOST_IO_CB_PENDING; }, nullptr, nullptr);
+	k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n");
+}
+
+TEST_F(KGhostIOTest, KGhostIODeferThenAnswerSynchronously)
+{
+	std::string request =
+		"POST /api/simulate/fast_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{}";
+	static k_ghost_io_token_t token = 0;
+	k_ghost_io_register_interface(
+		"fast_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			token = k_ghost_io_defer();
+			return 0;
+		},
+		nullptr, nullptr);
+	k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_EQ(k_ghost_io_complete(token, 200, nullptr), -1);
+	EXPECT_EQ(k_ghost_io_ctx.pending_requests, nullptr);
+}
+
+TEST_F(KGhostIOTest, KGhostIODeferThenCompleteInCallback)
+{
+	std::string request =
+		"POST /api/simulate/fast_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{}";
+	k_ghost_io_register_interface(
+		"fast_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			EXPECT_EQ(k_ghost_io_complete(k_ghost_io_defer(), 202, nullptr), 0);
+			return 0;
+		},
+		nullptr, nullptr);
+	k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_EQ(std::string((char *)send_fake.arg1_val, send_fake.arg2_val), "HTTP/1.1 202 Accepted\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(k_ghost_io_ctx.pending_requests, nullptr);
+	EXPECT_EQ(k_ghost_io_ctx.inflight_requests, 0u);
+}
+
+TEST_F(KGhostIOTest, KGhostIODeferOutsideCallback)
+{
+	EXPECT_EQ(k_ghost_io_defer(), 0u);
+	EXPECT_EQ(k_ghost_io_complete(0, 200, nullptr), -1);
+}
+
+static std::string writevOutput;
+
+static ssize_t writevCapture(int, const struct iovec *iov, int iovcnt)
+{
+	ssize_t written = 0;
+	writevOutput.clear();
+	for (int i = 0; i < iovcnt; i++)
+	{
+		writevOutput.append(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+		written += static_cast<ssize_t>(iov[i].iov_len);
+	}
+	return written;
+}
+
+TEST_F(KGhostIOTest, KGhostIOResponseCallback)
+{
+	std::string request =
+		"POST /api/simulate/echo_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{\"speed\": 12}";
+	writev_fake.custom_fake = writevCapture;
+	k_ghost_io_register_response_interface(
+		"echo_interface",
+		[](const cJSON *input, cJSON *response, void *user_data_p)
+		{
+			cJSON_AddNumberToObject(response, "speed", cJSON_GetNumberValue(cJSON_GetObjectItem(input, "speed")) * 2);
+			cJSON_AddStringToObject(response, "unit", "rpm");
+			return 0;
+		},
+		nullptr, nullptr);
+	for (int i = 0; i < 2; i++)
+	{
+		/* The first response sizes the per-thread buffer, the second one is printed into it */
+		k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+		EXPECT_EQ(writev_fake.call_count, i + 1);
+		EXPECT_EQ(writev_fake.arg0_val, 5);
+		EXPECT_EQ(writev_fake.arg2_val, 2);
+		EXPECT_EQ(writevOutput, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 25\r\n\r\n{\"speed\":24,\"unit\":\"rpm\"}");
+	}
+	EXPECT_EQ(send_fake.call_count, 0);
+	EXPECT_EQ(close_fake.call_count, 2);
+}
+
+TEST_F(KGhostIOTest, KGhostIOResponseCallbackFailure)
+{
+	std::string request =
+		"POST /api/simulate HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{\"interface\": \"failing_interface\", \"fail\": true}";
+	writev_fake.custom_fake = writevCapture;
+	k_ghost_io_register_response_interface(
+		"failing_interface",
+		[](const cJSON *input, cJSON *response, void *user_data_p)
+		{
+			if (cJSON_IsTrue(cJSON_GetObjectItem(input, "fail")))
+			{
+				cJSON_AddStringToObject(response, "error", "overheat");
+			}
+			return -1;
+		},
+		nullptr, nullptr);
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(writevOutput, "HTTP/1.1 500 Internal Server Error\r\nContent-Type: application/json\r\nContent-Length: 20\r\n\r\n{\"error\":\"overheat\"}");
+
+	/* Failure without details: no body */
+	std::string silentRequest =
+		"POST /api/simulate/failing_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{}";
+	k_ghost_io_manage_rest_route_request(6, silentRequest.c_str(), headerLen(silentRequest));
+	EXPECT_EQ(writev_fake.call_count, 1);
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n");
+}
+
+TEST_F(KGhostIOTest, KGhostIOResponseCallbackInBatch)
+{
+	std::string request =
+		"POST /api/simulate HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"[{\"interface\": \"echo_interface\"}]";
+	static std::string response;
+	send_fake.custom_fake = [](int, const void *buf, size_t len, int)
+	{
+		response.assign(static_cast<const char *>(buf), len);
+		return static_cast<ssize_t>(len);
+	};
+	k_ghost_io_register_response_interface(
+		"echo_interface",
+		[](const cJSON *input, cJSON *response, void *user_data_p)
+		{
+			cJSON_AddNumberToObject(response, "value", 1);
+			return 0;
+		},
+		nullptr, nullptr);
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(writev_fake.call_count, 0);
+	EXPECT_EQ(response, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 5\r\n\r\n[200]");
+}
+
+TEST_F(KGhostIOTest, KGhostIORegisterResponseCallbackNullCallback)
+{
+	EXPECT_EQ(k_ghost_io_register_response_interface("echo_interface", nullptr, nullptr, nullptr), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_ctx.interfaces, nullptr);
+}
+
+typedef struct
+{
+	double	speed;
+	int32_t gear;
+	int8_t	trim;
+	bool	enabled;
+	float	ratio;
+	char	mode[8];
+} motor_command_t;
+
+static const k_ghost_io_field_t motor_fields[] = {
+	K_GHOST_IO_REQUIRED_FIELD(motor_command_t, speed, K_GHOST_IO_FIELD_DOUBLE, 0, 100),
+	K_GHOST_IO_FIELD(motor_command_t, gear, K_GHOST_IO_FIELD_INT, -1, 5),
+	K_GHOST_IO_FIELD(motor_command_t, trim, K_GHOST_IO_FIELD_INT, 0, 0),
+	K_GHOST_IO_FIELD(motor_command_t, enabled, K_GHOST_IO_FIELD_BOOL, 0, 0),
+	K_GHOST_IO_FIELD(motor_command_t, ratio, K_GHOST_IO_FIELD_DOUBLE, 0, 0),
+	K_GHOST_IO_FIELD(motor_command_t, mode, K_GHOST_IO_FIELD_STRING, 0, 0),
+};
+
+static const k_ghost_io_schema_t motor_schema = {motor_fields, sizeof(motor_fields) / sizeof(motor_fields[0]), sizeof(motor_command_t)};
+
+TEST(Schema, DecodeCommand)
+{
+	motor_command_t command = {};
+	EXPECT_EQ(k_ghost_io_decode_command(&motor_schema,
+										" { \"interface\": \"motor\", \"speed\": 42.5, \"gear\": -1, \"trim\": -128, \"extra\": {\"a\": [1, \"}\"]},"
+										" \"enabled\": true, \"ratio\": 0.5, \"mode\": \"a\\\"\\u00e9\\n\" } ",
+										&command),
+			  0);
+	EXPECT_EQ(command.speed, 42.5);
+	EXPECT_EQ(command.gear, -1);
+	EXPECT_EQ(command.trim, -128);
+	EXPECT_TRUE(command.enabled);
+	EXPECT_EQ(command.ratio, 0.5f);
+	EXPECT_STREQ(command.mode, "a\"\xc3\xa9\n");
+}
+
+TEST(Schema, DecodeCommandNumbers)
+{
+	motor_command_t command = {};
+	EXPECT_EQ(k_ghost_io_decode_command(&motor_schema, "{\"speed\": -0.0, \"ratio\": -2.5E+2}", &command), 0);
+	EXPECT_EQ(command.ratio, -250.0f);
+	EXPECT_EQ(k_ghost_io_decode_command(&motor_schema, "{\"speed\": 1e-400, \"ratio\": 0}", &command), -1);
+	EXPECT_EQ(k_ghost_io_decode_command(&motor_schema, "{\"speed\": 5e1}", &command), 0);
+	EXPECT_EQ(command.speed, 50.0);
+}
+
+TEST(Schema, DecodeCommandRejectsInvalidValues)
+{
+	const char *invalid_bodies[] = {
+		"{\"gear\": 1}",						  // Missing required field
+		"{\"speed\": 101}",						  // Out of range
+		"{\"speed\": \"fast\"}",				  // Wrong type
+		"{\"speed\": 1, \"gear\": 1.5}",		  // Not an integer
+		"{\"speed\": 1, \"trim\": 128}",		  // Does not fit the member
+		"{\"speed\": 1, \"enabled\": 1}",		  // Not a bool
+		"{\"speed\": 1, \"mode\": \"too long\"}", // Does not fit with its terminator
+		"{\"speed\": 1, \"mode\": \"\\x\"}",	  // Invalid escape
+		"{\"speed\": 1,}",						  // Trailing comma
+		"{\"speed\": 1} x",						  // Trailing garbage
+		"[{\"speed\": 1}]",						  // Not an object
+		"{\"speed\" 1}",						  // Missing colon
+		"{\"speed\": 1, \"ratio\": 0x1p3}",		  // Not a JSON number
+		"{\"speed\": 1, \"ratio\": -inf}",		  // Not a JSON number
+		"{\"speed\": 1, \"ratio\": -nan}",		  // Not a JSON number
+		"{\"speed\": 1, \"ratio\": 01}",		  // Leading zero
+		"{\"speed\": 1, \"ratio\": 1.}",		  // Fraction without digits
+		"{\"speed\": 1, \"ratio\": 1e}",		  // Exponent without digits
+		"{\"speed\": 1, \"ratio\": 1e39}",		  // Does not fit a float
+		"{\"speed\": 1e999}",					  // Does not fit a double
+	};
+	for (const char *body : invalid_bodies)
+	{
+		motor_command_t command = {};
+		EXPECT_EQ(k_ghost_io_decode_command(&motor_schema, body, &command), -1) << body;
+	}
+}
+
+TEST(Schema, CheckSchema)
+{
+	static const k_ghost_io_field_t wrong_size[] = {K_GHOST_IO_FIELD(motor_command_t, trim, K_GHOST_IO_FIELD_DOUBLE, 0, 0)};
+	static const k_ghost_io_field_t wrong_bool[] = {K_GHOST_IO_FIELD(motor_command_t, gear, K_GHOST_IO_FIELD_BOOL, 0, 0)};
+	const k_ghost_io_schema_t		wrong_size_schema	= {wrong_size, 1, sizeof(motor_command_t)};
+	const k_ghost_io_schema_t		wrong_bool_schema	= {wrong_bool, 1, sizeof(motor_command_t)};
+	const k_ghost_io_schema_t		too_small_schema	= {motor_fields, 6, sizeof(double)};
+	const k_ghost_io_schema_t		empty_schema		= {nullptr, 0, 0};
+	EXPECT_EQ(k_ghost_io_check_schema(&motor_schema), 0);
+	EXPECT_EQ(k_ghost_io_check_schema(&empty_schema), 0);
+	EXPECT_EQ(k_ghost_io_check_schema(&wrong_size_schema), -1);
+	EXPECT_EQ(k_ghost_io_check_schema(&wrong_bool_schema), -1);
+	EXPECT_EQ(k_ghost_io_check_schema(&too_small_schema), -1);
+	EXPECT_EQ(k_ghost_io_check_schema(nullptr), -1);
+}
+
+TEST_F(KGhostIOTest, KGhostIOTypedCallback)
+{
+	std::string request =
+		"POST /api/simulate HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{\"interface\": \"motor\", \"speed\": 12, \"mode\": \"eco\"}";
+	static motor_command_t received = {};
+	EXPECT_EQ(k_ghost_io_register_typed_interface(
+				  "motor", &motor_schema,
+				  [](const void *command_p, void *user_data_p)
+				  {
+					  received = *static_cast<const motor_command_t *>(command_p);
+					  return 0;
+				  },
+				  nullptr, nullptr),
+			  K_GHOST_REGISTER_RET_CODE_OK);
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
+	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(received.speed, 12);
+	EXPECT_EQ(received.gear, 0);
+	EXPECT_STREQ(received.mode, "eco");
+
+	std::string invalidRequest =
+		"POST /api/simulate/motor HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{\"speed\": 500}";
+	received.speed = 0;
+	k_ghost_io_manage_rest_route_request(5, invalidRequest.c_str(), headerLen(invalidRequest));
+	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(received.speed, 0);
+}
+
+TEST_F(KGhostIOTest, KGhostIORegisterTypedCallbackInvalidSchema)
+{
+	static const k_ghost_io_field_t wrong_size[] = {K_GHOST_IO_FIELD(motor_command_t, trim, K_GHOST_IO_FIELD_DOUBLE, 0, 0)};
+	const k_ghost_io_schema_t		schema		 = {wrong_size, 1, sizeof(motor_command_t)};
+	EXPECT_EQ(k_ghost_io_register_typed_interface("motor", &schema, [](const void *, void *) { return 0; }, nullptr, nullptr), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_register_typed_interface("motor", &motor_schema, nullptr, nullptr, nullptr), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_ctx.interfaces, nullptr);
+}
+
+TEST_F(KGhostIOTest, KGhostIOSetWorkerCount)
+{
+	EXPECT_EQ(k_ghost_io_set_worker_count(K_GHOST_IO_MAX_WORKERS + 1), -1);
+	EXPECT_EQ(k_ghost_io_set_worker_count(4), 0);
+	pthread_create_fake.return_val = 0;
+	EXPECT_EQ(k_ghost_io_start_workers(), 0);
+	EXPECT_EQ(pthread_create_fake.call_count, 4);
+	ASSERT_NE(k_ghost_io_ctx.workers, nullptr);
+	k_ghost_io_ctx.socket_fd = 3;
+	EXPECT_EQ(k_ghost_io_set_worker_count(2), -1);
+	EXPECT_EQ(k_ghost_io_ctx.worker_count, 4u);
+}
+
+TEST_F(KGhostIOTest, KGhostIOWorkerRunsRequestsInOrder)
+{
+	std::string request =
+		"POST /api/simulate/worker_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n";
+	static std::vector<double> values;
+	k_ghost_io_set_worker_count(2);
+	k_ghost_io_start_workers();
+	k_ghost_io_register_interface(
+		"worker_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			values.push_back(cJSON_GetNumberValue(cJSON_GetObjectItem(input, "value")));
+			return 0;
+		},
+		nullptr, nullptr);
+	for (int i = 1; i <= 3; i++)
+	{
+		std::string body = "{\"value\": " + std::to_string(i) + "}";
+		k_ghost_io_manage_rest_route_request(4 + i, (request + body).c_str(), request.size());
+	}
+	EXPECT_EQ(send_fake.call_count, 0);
+	EXPECT_EQ(close_fake.call_count, 0);
+	EXPECT_TRUE(values.empty());
+
+	/* All the commands to an interface are queued on the same worker */
+	const k_ghost_io_interface_t *interface_p = k_ghost_io_find_interface("worker_interface", strlen("worker_interface"));
+	const uint32_t				  name_hash	  = reinterpret_cast<const k_ghost_io_interface_entry_t *>(interface_p)->name_hash;
+	k_ghost_io_worker_t			 *worker_p	  = &k_ghost_io_ctx.workers[name_hash % 2];
+	EXPECT_EQ(k_ghost_io_ctx.workers[(name_hash + 1) % 2].head, nullptr);
+	while (0 == k_ghost_io_worker_run_job(worker_p, 0))
+	{
+	}
+	EXPECT_EQ(values, std::vector<double>({1, 2, 3}));
+	EXPECT_EQ(send_fake.call_count, 3);
+	EXPECT_EQ(close_fake.call_count, 3);
+	EXPECT_EQ(close_fake.arg0_history[0], 5);
+	EXPECT_EQ(close_fake.arg0_history[2], 7);
+	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(worker_p->tail, nullptr);
+}
+
+TEST_F(KGhostIOTest, KGhostIOWorkerInterfaceUnregisteredWhileQueued)
+{
+	std::string request =
+		"POST /api/simulate HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{\"interface\": \"worker_interface\"}";
+	static int cbCalled = 0;
+	k_ghost_io_set_worker_count(1);
+	k_ghost_io_start_workers();
+	k_ghost_io_register_interface(
+		"worker_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			cbCalled++;
+			return 0;
+		},
+		nullptr, nullptr);
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
+	k_ghost_io_unregister_interface("worker_interface");
+	EXPECT_EQ(k_ghost_io_worker_run_job(&k_ghost_io_ctx.workers[0], 0), 0);
+	EXPECT_EQ(k_ghost_io_worker_run_job(&k_ghost_io_ctx.workers[0], 0), -1);
+	EXPECT_EQ(cbCalled, 0);
+	EXPECT_EQ(std::string((char *)send_fake.arg1_val, send_fake.arg2_val), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(close_fake.arg0_val, 5);
+}
+
+TEST_F(KGhostIOTest, KGhostIOWorkerKeepsBatchItemsInOrder)
+{
+	std::string batchRequest =
+		"POST /api/simulate HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"[{\"interface\": \"worker_interface\", \"value\": 1}, {\"interface\": \"unknown_interface\"}]";
+	std::string request =
+		"POST /api/simulate/worker_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{\"value\": 2}";
+	static std::vector<double> values;
+	values.clear();
+	k_ghost_io_set_worker_count(1);
+	k_ghost_io_start_workers();
+	k_ghost_io_register_interface(
+		"worker_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			values.push_back(cJSON_GetNumberValue(cJSON_GetObjectItem(input, "value")));
+			return 0;
+		},
+		nullptr, nullptr);
+	k_ghost_io_manage_rest_request(5, batchRequest.c_str(), headerLen(batchRequest));
+	k_ghost_io_manage_rest_route_request(6, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 0);
+	EXPECT_EQ(close_fake.call_count, 0);
+	EXPECT_TRUE(values.empty());
+
+	/* The batch item was queued first, the batch is answered as soon as it has run */
+	EXPECT_EQ(k_ghost_io_worker_run_job(&k_ghost_io_ctx.workers[0], 0), 0);
+	EXPECT_EQ(values, std::vector<double>({1}));
+	EXPECT_EQ(std::string((char *)send_fake.arg1_val, send_fake.arg2_val), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 9\r\n\r\n[200,204]");
+	EXPECT_EQ(close_fake.arg0_val, 5);
+	EXPECT_EQ(k_ghost_io_worker_run_job(&k_ghost_io_ctx.workers[0], 0), 0);
+	EXPECT_EQ(values, std::vector<double>({1, 2}));
+	EXPECT_EQ(close_fake.arg0_val, 6);
+	EXPECT_EQ(k_ghost_io_worker_run_job(&k_ghost_io_ctx.workers[0], 0), -1);
+}
+
+TEST_F(KGhostIOTest, KGhostIOWorkerRunsSyncCb)
+{
+	static int syncCbCalled = 0;
+	k_ghost_io_set_worker_count(1);
+	k_ghost_io_start_workers();
+	k_ghost_io_register_interface("worker_interface", [](const cJSON *, void *user_data_p) { return 0; }, []() { syncCbCalled++; }, nullptr);
+	k_ghost_io_add_sse_client(5, nullptr);
+	EXPECT_EQ(syncCbCalled, 0);
+	EXPECT_EQ(k_ghost_io_worker_run_job(&k_ghost_io_ctx.workers[0], 0), 0);
+	EXPECT_EQ(syncCbCalled, 1);
+	EXPECT_EQ(close_fake.call_count, 0);
+	free(k_ghost_io_ctx.sse_clients);
+}
+
+TEST_F(KGhostIOTest, KGhostIOCallSyncCb)
+{
+	static int syncCbCalled = 0;
+	k_ghost_io_register_interface("test_interface", [](const cJSON *input, void *user_data_p) { return 0; }, []() { syncCbCalled++; }, nullptr);
+	EXPECT_EQ(syncCbCalled, 0);
+	k_ghost_io_add_sse_client(5, nullptr);
+	EXPECT_EQ(syncCbCalled, 1);
+	k_ghost_io_remove_sse_client(5);
+}
+
+TEST_F(KGhostIOTest, KGhostIOCallSendEventNoSSEClients)
+{
+	k_ghost_io_send_event("test");
+	EXPECT_EQ(send_fake.call_count, 0);
+}
+
+TEST_F(KGhostIOTest, KGhostIOCallSendEventOneSSEClient)
+{
+	k_ghost_io_add_sse_client(5, nullptr);
+	k_ghost_io_send_event("test");
+	EXPECT_EQ(send_fake.call_count, 2);
+	EXPECT_EQ(send_fake.arg0_val, 5);
+	EXPECT_EQ(send_fake.arg2_val, strlen("data: test\r\n\r\n"));
+	k_ghost_io_remove_sse_client(5);
+}
+
+TEST_F(KGhostIOTest, KGhostIOCallSendEventMultipleSSEClients)
+{
+	k_ghost_io_add_sse_client(5, nullptr);
+	k_ghost_io_add_sse_client(6, nullptr);
+	k_ghost_io_add_sse_client(7, nullptr);
+	k_ghost_io_send_event("test");
+	EXPECT_EQ(send_fake.call_count, 6);
+	EXPECT_EQ(send_fake.arg0_history[3], 7);
+	EXPECT_EQ(send_fake.arg0_history[4], 6);
+	EXPECT_EQ(send_fake.arg0_history[5], 5);
+	EXPECT_EQ(send_fake.arg2_val, strlen("data: test\r\n\r\n"));
+	k_ghost_io_remove_sse_client(5);
+	k_ghost_io_remove_sse_client(6);
+	k_ghost_io_remove_sse_client(7);
+}
+
+TEST_F(KGhostIOTest, KGhostIORegisterCallbackWithUserParam)
+{
+	struct kGhostUserParamTest_s
+	{
+		int value;
+	};
+	kGhostUserParamTest_s user_param = {0};
+	std::string			  request =
+		"POST /api/system/manage HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Content-Type: application/json\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n"
+		"{\"interface\": \"test_interface\"}";
+	static int cbCalled = 0;
+	k_ghost_io_register_interface(
+		"test_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			cbCalled++;
+			auto user_param_p = static_cast<kGhostUserParamTest_s *>(user_data_p);
+			user_param_p->value++;
+			return 0;
+		},
+		[]() {}, &user_param);
+	EXPECT_EQ(user_param.value, 0);
+	k_ghost_io_manage_rest_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_EQ(send_fake.arg0_val, 5);
+	EXPECT_STREQ((char *)send_fake.arg1_val, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(send_fake.arg2_val, strlen("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n"));
+	EXPECT_EQ(cbCalled, 1);
+	EXPECT_EQ(user_param.value, 1);
+}
+
+TEST_F(KGhostIOTest, KGhostIOUnregisterFirstInterface)
+{
+	k_ghost_io_register_interface("test_interface_1", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	k_ghost_io_register_interface("test_interface_2", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	k_ghost_io_register_interface("test_interface_3", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	const k_ghost_io_interface_t *interface = k_ghost_io_ctx.interfaces;
+	EXPECT_STREQ(interface->interface_name, "test_interface_3");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_STREQ(interface->interface_name, "test_interface_2");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_STREQ(interface->interface_name, "test_interface_1");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_EQ(interface, nullptr);
+	k_ghost_io_unregister_interface("test_interface_3");
+	interface = k_ghost_io_ctx.interfaces;
+	EXPECT_STREQ(interface->interface_name, "test_interface_2");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_STREQ(interface->interface_name, "test_interface_1");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_EQ(interface, nullptr);
+}
+
+TEST_F(KGhostIOTest, KGhostIOUnregisterMiddleInterface)
+{
+	k_ghost_io_register_interface("test_interface_1", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	k_ghost_io_register_interface("test_interface_2", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	k_ghost_io_register_interface("test_interface_3", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	const k_ghost_io_interface_t *interface = k_ghost_io_ctx.interfaces;
+	EXPECT_STREQ(interface->interface_name, "test_interface_3");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_STREQ(interface->interface_name, "test_interface_2");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_STREQ(interface->interface_name, "test_interface_1");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_EQ(interface, nullptr);
+	k_ghost_io_unregister_interface("test_interface_2");
+	interface = k_ghost_io_ctx.interfaces;
+	EXPECT_STREQ(interface->interface_name, "test_interface_3");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_STREQ(interface->interface_name, "test_interface_1");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_EQ(interface, nullptr);
+}
+
+TEST_F(KGhostIOTest, KGhostIOUnregisterLastInterface)
+{
+	k_ghost_io_register_interface("test_interface_1", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	k_ghost_io_register_interface("test_interface_2", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	k_ghost_io_register_interface("test_interface_3", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	const k_ghost_io_interface_t *interface = k_ghost_io_ctx.interfaces;
+	EXPECT_STREQ(interface->interface_name, "test_interface_3");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_STREQ(interface->interface_name, "test_interface_2");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_STREQ(interface->interface_name, "test_interface_1");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_EQ(interface, nullptr);
+	k_ghost_io_unregister_interface("test_interface_1");
+	interface = k_ghost_io_ctx.interfaces;
+	EXPECT_STREQ(interface->interface_name, "test_interface_3");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_STREQ(interface->interface_name, "test_interface_2");
+	interface = static_cast<k_ghost_io_interface_t *>(interface->next_cb);
+	EXPECT_EQ(interface, nullptr);
+}
+
+TEST(Arena, AllocAlignedFromSingleBlock)
+{
+	k_ghost_io_arena_t arena = {0};
+	char			  *a	 = static_cast<char *>(k_ghost_io_arena_alloc(&arena, 3));
+	char			  *b	 = static_cast<char *>(k_ghost_io_arena_alloc(&arena, 24));
+	ASSERT_NE(a, nullptr);
+	ASSERT_NE(b, nullptr);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(a) % alignof(max_align_t), 0u);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(b) % alignof(max_align_t), 0u);
+	EXPECT_GE(b - a, 3);
+	EXPECT_TRUE(k_ghost_io_arena_owns(&arena, a));
+	EXPECT_TRUE(k_ghost_io_arena_owns(&arena, b + 23));
+	EXPECT_EQ(arena.head->next, nullptr);
+	k_ghost_io_arena_reset(&arena);
+	EXPECT_EQ(k_ghost_io_arena_alloc(&arena, 3), a);
+	k_ghost_io_arena_free(&arena);
+	EXPECT_EQ(arena.head, nullptr);
+}
+
+TEST(Arena, ResetMergesBlocks)
+{
+	k_ghost_io_arena_t arena = {0};
+	for (int i = 0; i < 10; i++)
+	{
+		EXPECT_NE(k_ghost_io_arena_alloc(&arena, K_GHOST_IO_ARENA_BLOCK_SIZE / 2 + 1), nullptr);
+	}
+	EXPECT_NE(arena.head->next, nullptr);
+	k_ghost_io_arena_reset(&arena);
+	EXPECT_EQ(arena.head->next, nullptr);
+	EXPECT_GE(arena.head->size, 10u * K_GHOST_IO_ARENA_BLOCK_SIZE);
+	k_ghost_io_arena_block_t *block_p = arena.head;
+	for (int i = 0; i < 10; i++)
+	{
+		EXPECT_NE(k_ghost_io_arena_alloc(&arena, K_GHOST_IO_ARENA_BLOCK_SIZE / 2 + 1), nullptr);
+	}
+	EXPECT_EQ(arena.head, block_p);
+	EXPECT_FALSE(k_ghost_io_arena_owns(&arena, &arena));
+	k_ghost_io_arena_free(&arena);
+}
+
+TEST_F(KGhostIOTest, KGhostIOFindInterfaceManyRegistered)
+{
+	char name[32];
+	for (int i = 0; i < 1000; i++)
+	{
+		snprintf(name, sizeof(name), "channel_%d", i);
+		EXPECT_EQ(k_ghost_io_register_interface(name, [](const cJSON *, void *user_data_p) { return 0; }, nullptr, nullptr), K_GHOST_REGISTER_RET_CODE_OK);
+	}
+	EXPECT_EQ(k_ghost_io_ctx.interface_table->count, 1000u);
+	EXPECT_GE(k_ghost_io_ctx.interface_table->capacity, 2000u);
+	for (int i = 0; i < 1000; i++)
+	{
+		snprintf(name, sizeof(name), "channel_%d", i);
+		const k_ghost_io_interface_t *interface_p = k_ghost_io_find_interface(name, strlen(name));
+		ASSERT_NE(interface_p, nullptr);
+		EXPECT_STREQ(interface_p->interface_name, name);
+	}
+	EXPECT_EQ(k_ghost_io_find_interface("channel_1000", strlen("channel_1000")), nullptr);
+	EXPECT_EQ(k_ghost_io_find_interface("channel_1", strlen("channel_")), nullptr);
+}
+
+TEST_F(KGhostIOTest, KGhostIOFindInterfaceAfterUnregister)
+{
+	char name[32];
+	for (int i = 0; i < 100; i++)
+	{
+		snprintf(name, sizeof(name), "channel_%d", i);
+		k_ghost_io_register_interface(name, [](const cJSON *, void *user_data_p) { return 0; }, nullptr, nullptr);
+	}
+	for (int i = 0; i < 100; i += 2)
+	{
+		snprintf(name, sizeof(name), "channel_%d", i);
+		k_ghost_io_unregister_interface(name);
+	}
+	EXPECT_EQ(k_ghost_io_ctx.interface_table->count, 50u);
+	for (int i = 0; i < 100; i++)
+	{
+		snprintf(name, sizeof(name), "channel_%d", i);
+		if (i % 2)
+		{
+			EXPECT_NE(k_ghost_io_find_interface(name, strlen(name)), nullptr);
+		}
+		else
+		{
+			EXPECT_EQ(k_ghost_io_find_interface(name, strlen(name)), nullptr);
+		}
+	}
+}
+
+TEST_F(KGhostIOTest, KGhostIOUnregisterDuringReadSection)
+{
+	k_ghost_io_register_interface("test_interface_1", [](const cJSON *, void *user_data_p) { return 0; }, nullptr, nullptr);
+	k_ghost_io_register_interface("test_interface_2", [](const cJSON *, void *user_data_p) { return 0; }, nullptr, nullptr);
+	EXPECT_EQ(k_ghost_io_ctx.retired_count, 0u);
+
+	k_ghost_io_registry_read_begin();
+	k_ghost_io_interface_t		 *interface_p = k_ghost_io_find_interface("test_interface_1", strlen("test_interface_1"));
+	k_ghost_io_interface_table_t *table_p	  = k_ghost_io_ctx.interface_table;
+	ASSERT_NE(interface_p, nullptr);
+	k_ghost_io_unregister_interface("test_interface_1");
+
+	/* New readers no longer find the interface, the current one can still use what it got */
+	EXPECT_EQ(k_ghost_io_find_interface("test_interface_1", strlen("test_interface_1")), nullptr);
+	EXPECT_NE(k_ghost_io_ctx.interface_table, table_p);
+	EXPECT_EQ(k_ghost_io_ctx.retired_count, 3u);
+	EXPECT_STREQ(interface_p->interface_name, "test_interface_1");
+	EXPECT_EQ(table_p->count, 2u);
+	k_ghost_io_registry_read_end();
+
+	/* Reclaimed by the next writer once the reader is gone */
+	k_ghost_io_unregister_interface("unknown_interface");
+	EXPECT_EQ(k_ghost_io_ctx.retired_count, 0u);
+	EXPECT_EQ(k_ghost_io_ctx.interface_table->count, 1u);
+	EXPECT_EQ(k_ghost_io_ctx.interfaces->next_cb, nullptr);
+}
+
+TEST_F(KGhostIOTest, KGhostIONestedReadSections)
+{
+	k_ghost_io_register_interface("test_interface_1", [](const cJSON *, void *user_data_p) { return 0; }, nullptr, nullptr);
+	k_ghost_io_registry_read_begin();
+	k_ghost_io_registry_read_begin();
+	k_ghost_io_registry_read_end();
+	k_ghost_io_unregister_interface("test_interface_1");
+	EXPECT_EQ(k_ghost_io_ctx.retired_count, 3u);
+	k_ghost_io_registry_read_end();
+	k_ghost_io_registry_reclaim();
+	EXPECT_EQ(k_ghost_io_ctx.retired_count, 0u);
+}
+
+TEST_F(KGhostIOTest, KGhostIOUnregisterUnknownInterface)
+{
+	k_ghost_io_register_interface("test_interface_1", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	k_ghost_io_unregister_interface("test_interface_2");
+	k_ghost_io_unregister_interface(nullptr);
+	EXPECT_NE(k_ghost_io_ctx.interfaces, nullptr);
+	EXPECT_EQ(k_ghost_io_ctx.interface_table->count, 1u);
+}
+
+TEST(UnregisterInterface, UnregisterAllInterfaces)
+{
+	k_ghost_io_register_interface("test_interface_1", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	k_ghost_io_register_interface("test_interface_2", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	k_ghost_io_register_interface("test_interface_3", [](const cJSON *, void *user_data_p) { return 0; }, []() {}, nullptr);
+	k_ghost_io_unregister_interface("test_interface_1");
+	k_ghost_io_unregister_interface("test_interface_2");
+	k_ghost_io_unregister_interface("test_interface_3");
+	EXPECT_EQ(k_ghost_io_ctx.interfaces, nullptr);
+}
+static std::string sendOutput;
+
+static ssize_t sendCapture(int, const void *buf, size_t len, int)
+{
+	sendOutput.assign(static_cast<const char *>(buf), len);
+	return static_cast<ssize_t>(len);
+}
+
+TEST_F(KGhostIOTest, KGhostIOShedRequestsOverInflightLimit)
+{
+	std::string request =
+		"POST /api/simulate/slow_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{}";
+	static k_ghost_io_token_t token	 = 0;
+	k_ghost_io_stats_t		  stats	 = {};
+	k_ghost_io_limits_t		  limits = {};
+	limits.max_inflight_requests	 = 1;
+	EXPECT_EQ(k_ghost_io_set_limits(&limits), 0);
+	EXPECT_EQ(k_ghost_io_set_limits(nullptr), -1);
+	send_fake.custom_fake = sendCapture;
+	k_ghost_io_register_interface(
+		"slow_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			token = k_ghost_io_defer();
+			return K_GHOST_IO_CB_PENDING;
+		},
+		nullptr, nullptr);
+	k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.inflight_requests, 1u);
+
+	/* The first request is still waiting for its response, the second one is refused right away */
+	k_ghost_io_manage_rest_route_request(6, request.c_str(), headerLen(request));
+	EXPECT_EQ(sendOutput, "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(close_fake.arg0_val, 6);
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.inflight_requests, 1u);
+	EXPECT_EQ(stats.shed_requests, 1u);
+
+	/* The items of a batch are admitted one by one, a shed item is reported among the statuses */
+	std::string batchRequest =
+		"POST /api/simulate HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"[{\"interface\": \"slow_interface\"}]";
+	k_ghost_io_manage_rest_request(7, batchRequest.c_str(), headerLen(batchRequest));
+	EXPECT_NE(sendOutput.find("\r\n\r\n[503]"), std::string::npos);
+	EXPECT_EQ(close_fake.arg0_val, 7);
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.shed_requests, 2u);
+
+	EXPECT_EQ(k_ghost_io_complete(token, 200, nullptr), 0);
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.inflight_requests, 0u);
+	EXPECT_EQ(reinterpret_cast<k_ghost_io_interface_entry_t *>(k_ghost_io_find_interface("slow_interface", strlen("slow_interface")))->pending_count, 0u);
+	k_ghost_io_manage_rest_route_request(8, request.c_str(), headerLen(request));
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.inflight_requests, 1u);
+	EXPECT_EQ(stats.shed_requests, 2u);
+	EXPECT_EQ(k_ghost_io_complete(token, 200, nullptr), 0);
+
+	/* A deferred request keeps the interface it was admitted for, not the one registered under its name since */
+	limits.max_inflight_requests = 0;
+	EXPECT_EQ(k_ghost_io_set_limits(&limits), 0);
+	k_ghost_io_manage_rest_route_request(9, request.c_str(), headerLen(request));
+	const k_ghost_io_token_t removedToken = token;
+	k_ghost_io_unregister_interface("slow_interface");
+	k_ghost_io_register_interface(
+		"slow_interface",
+		[](const cJSON *input, void *user_data_p)
+		{
+			token = k_ghost_io_defer();
+			return K_GHOST_IO_CB_PENDING;
+		},
+		nullptr, nullptr);
+	k_ghost_io_manage_rest_route_request(10, request.c_str(), headerLen(request));
+	const k_ghost_io_interface_entry_t *entry_p = reinterpret_cast<k_ghost_io_interface_entry_t *>(k_ghost_io_find_interface("slow_interface", strlen("slow_interface")));
+	EXPECT_EQ(entry_p->pending_count, 1u);
+	sendOutput.clear();
+	EXPECT_EQ(k_ghost_io_complete(removedToken, 200, nullptr), 0);
+	EXPECT_EQ(sendOutput.rfind("HTTP/1.1 200 OK\r\n", 0), 0u);
+	EXPECT_EQ(close_fake.arg0_val, 9);
+	EXPECT_EQ(entry_p->pending_count, 1u);
+	EXPECT_EQ(k_ghost_io_complete(token, 200, nullptr), 0);
+	EXPECT_EQ(entry_p->pending_count, 0u);
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.inflight_requests, 0u);
+}
+
+TEST_F(KGhostIOTest, KGhostIOShedRequestsOverInterfaceLimit)
+{
+	std::string request =
+		"POST /api/simulate/busy_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{}";
+	std::string otherRequest =
+		"POST /api/simulate/idle_interface HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n"
+		"{}";
+	k_ghost_io_stats_t	stats	 = {};
+	k_ghost_io_limits_t limits	 = {};
+	limits.max_interface_pending = 2;
+	limits.retry_after_s		 = 7;
+	k_ghost_io_set_limits(&limits);
+	send_fake.custom_fake = sendCapture;
+	k_ghost_io_set_worker_count(1);
+	k_ghost_io_start_workers();
+	k_ghost_io_register_interface("busy_interface", [](const cJSON *, void *) { return 0; }, nullptr, nullptr);
+	k_ghost_io_register_interface("idle_interface", [](const cJSON *, void *) { return 0; }, nullptr, nullptr);
+	k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+	k_ghost_io_manage_rest_route_request(6, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 0);
+	k_ghost_io_manage_rest_route_request(7, request.c_str(), headerLen(request));
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(sendOutput, "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 7\r\nContent-Length: 0\r\n\r\n");
+
+	/* The limit is per interface, the others are still served */
+	k_ghost_io_manage_rest_route_request(8, otherRequest.c_str(), headerLen(otherRequest));
+	EXPECT_EQ(send_fake.call_count, 1);
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.inflight_requests, 3u);
+	EXPECT_EQ(stats.shed_requests, 1u);
+
+	while (0 == k_ghost_io_worker_run_job(&k_ghost_io_ctx.workers[0], 0))
+	{
+	}
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.inflight_requests, 0u);
+	EXPECT_EQ(reinterpret_cast<k_ghost_io_interface_entry_t *>(k_ghost_io_find_interface("busy_interface", strlen("busy_interface")))->pending_count, 0u);
+	EXPECT_EQ(send_fake.call_count, 4);
+	EXPECT_EQ(sendOutput, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+}
+
+TEST_F(KGhostIOTest, KGhostIOSseQueueForSlowClients)
+{
+	static std::string sent;
+	static ssize_t	   accepted_bytes = 0;
+	k_ghost_io_stats_t stats		  = {};
+	EXPECT_EQ(k_ghost_io_add_sse_client(5, nullptr), 0);
+	send_fake.custom_fake = [](int fd, const void *buf, size_t len, int flags)
+	{
+		if (5 != fd)
+		{
+			return sendCapture(fd, buf, len, flags);
+		}
+		EXPECT_TRUE(flags & MSG_DONTWAIT);
+		ssize_t ret = static_cast<ssize_t>(len) < accepted_bytes ? static_cast<ssize_t>(len) : accepted_bytes;
+		if (ret > 0)
+		{
+			sent.append(static_cast<const char *>(buf), static_cast<size_t>(ret));
+		}
+		else
+		{
+			errno = EAGAIN;
+			ret	  = -1;
+		}
+		return ret;
+	};
+
+	/* The socket only takes part of the event, the rest is queued even over the limit to keep the stream consistent */
+	k_ghost_io_limits_t limits	= {};
+	limits.max_sse_queued_bytes = 10;
+	k_ghost_io_set_limits(&limits);
+	accepted_bytes = 4;
+	k_ghost_io_send_event("temperature");
+	EXPECT_EQ(sent, "data");
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.sse_queued_bytes, strlen("data: temperature\r\n\r\n") - 4);
+
+	/* Queued data goes first: nothing is written until the queue is flushed, and over the limit new events are dropped */
+	accepted_bytes = 100;
+	k_ghost_io_send_event("pressure");
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(sent, "data");
+	EXPECT_EQ(stats.dropped_events, 1u);
+
+	/* New subscribers are refused while the clients are not keeping up */
+	EXPECT_EQ(k_ghost_io_add_sse_client(6, nullptr), -1);
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.shed_requests, 1u);
+	EXPECT_EQ(sendOutput, "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(k_ghost_io_ctx.sse_clients->sse_client_fd, 5);
+
+	fd_set writefds;
+	FD_ZERO(&writefds);
+	EXPECT_EQ(k_ghost_io_watch_sse_clients(&writefds), 5);
+	EXPECT_TRUE(FD_ISSET(5, &writefds));
+	k_ghost_io_flush_sse_clients(&writefds);
+	EXPECT_EQ(sent, "data: temperature\r\n\r\n");
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.sse_queued_bytes, 0u);
+	FD_ZERO(&writefds);
+	EXPECT_EQ(k_ghost_io_watch_sse_clients(&writefds), -1);
+
+	k_ghost_io_send_event("pressure");
+	EXPECT_EQ(sent, "data: temperature\r\n\r\ndata: pressure\r\n\r\n");
+	k_ghost_io_remove_sse_client(5);
+}
+
+static std::vector<std::pair<int, std::string>> sseOutput;
+
+static ssize_t sseCapture(int fd, const void *buf, size_t len, int)
+{
+	sseOutput.emplace_back(fd, std::string(static_cast<const char *>(buf), len));
+	return static_cast<ssize_t>(len);
+}
+
+TEST_F(KGhostIOTest, KGhostIOSseSubscriptionFilter)
+{
+	EXPECT_EQ(k_ghost_io_add_sse_client(5, "interface=motor,fan&debug=1&interface=pump HTTP/1.1\r\n"), 0);
+	EXPECT_STREQ(reinterpret_cast<k_ghost_io_sse_client_entry_t *>(k_ghost_io_ctx.sse_clients)->interfaces, "motor,fan,pump");
+	EXPECT_EQ(k_ghost_io_add_sse_client(6, "debug=1 HTTP/1.1\r\n"), 0);
+	EXPECT_EQ(reinterpret_cast<k_ghost_io_sse_client_entry_t *>(k_ghost_io_ctx.sse_clients)->interfaces, nullptr);
+	EXPECT_EQ(k_ghost_io_add_sse_client(7, "interface= HTTP/1.1\r\n"), 0);
+	EXPECT_EQ(reinterpret_cast<k_ghost_io_sse_client_entry_t *>(k_ghost_io_ctx.sse_clients)->interfaces, nullptr);
+	k_ghost_io_remove_sse_client(5);
+	k_ghost_io_remove_sse_client(6);
+	k_ghost_io_remove_sse_client(7);
+}
+
+TEST_F(KGhostIOTest, KGhostIOSendInterfaceEvent)
+{
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, "interface=motor HTTP/1.1\r\n");
+	k_ghost_io_add_sse_client(6, nullptr);
+	k_ghost_io_add_sse_client(7, "interface=motorbike,fan HTTP/1.1\r\n");
+	send_fake.custom_fake = sseCapture;
+
+	k_ghost_io_send_interface_event("motor", "{\"speed\":3}");
+	ASSERT_EQ(sseOutput.size(), 2u);
+	EXPECT_EQ(sseOutput[0].first, 6);
+	EXPECT_EQ(sseOutput[1].first, 5);
+	EXPECT_EQ(sseOutput[1].second, "event: motor\r\ndata: {\"speed\":3}\r\n\r\n");
+
+	/* Unnamed events still go to every client */
+	sseOutput.clear();
+	k_ghost_io_send_event("{}");
+	ASSERT_EQ(sseOutput.size(), 3u);
+	EXPECT_EQ(sseOutput[0].second, "data: {}\r\n\r\n");
+
+	sseOutput.clear();
+	k_ghost_io_send_interface_event(nullptr, "{}");
+	k_ghost_io_send_interface_event("fan", nullptr);
+	EXPECT_TRUE(sseOutput.empty());
+	k_ghost_io_remove_sse_client(5);
+	k_ghost_io_remove_sse_client(6);
+	k_ghost_io_remove_sse_client(7);
+}
+
+TEST_F(KGhostIOTest, KGhostIOSseSubscriptionSyncsSubscribedInterfaces)
+{
+	static int motorSyncs = 0;
+	static int fanSyncs	  = 0;
+	k_ghost_io_register_interface("motor", [](const cJSON *, void *) { return 0; }, []() { motorSyncs++; }, nullptr);
+	k_ghost_io_register_interface("fan", [](const cJSON *, void *) { return 0; }, []() { fanSyncs++; }, nullptr);
+	k_ghost_io_add_sse_client(5, "interface=fan HTTP/1.1\r\n");
+	EXPECT_EQ(motorSyncs, 0);
+	EXPECT_EQ(fanSyncs, 1);
+	k_ghost_io_add_sse_client(6, nullptr);
+	EXPECT_EQ(motorSyncs, 1);
+	EXPECT_EQ(fanSyncs, 2);
+	k_ghost_io_remove_sse_client(5);
+	k_ghost_io_remove_sse_client(6);
+}
+
+static std::string streamBody;
+static std::vector<int> streamDone;
+
+static int streamCapture(k_ghost_io_stream_t *stream_p, const char *chunk_p, size_t chunk_len, void *)
+{
+	if (chunk_p)
+	{
+		EXPECT_EQ(stream_p->offset, streamBody.size());
+		streamBody.append(chunk_p, chunk_len);
+	}
+	else
+	{
+		streamDone.push_back(stream_p->done);
+	}
+	return 0;
+}
+
+TEST_F(KGhostIOTest, KGhostIOFeedConnectionSingleRead)
+{
+	std::string request =
+		"POST /api/simulate/motor HTTP/1.1\r\n"
+		"Content-Length: 13\r\n"
+		"\r\n"
+		"{\"speed\": 12}";
+	k_ghost_io_connection_t *connection_p = nullptr;
+	static int				 cbCalled	  = 0;
+	k_ghost_io_register_interface(
+		"motor",
+		[](const cJSON *input, void *)
+		{
+			cbCalled++;
+			EXPECT_EQ(cJSON_GetNumberValue(cJSON_GetObjectItem(input, "speed")), 12);
+			return 0;
+		},
+		nullptr, nullptr);
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, request.c_str(), request.size()), 1);
+	EXPECT_EQ(connection_p, nullptr);
+	EXPECT_EQ(cbCalled, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+}
+
+TEST_F(KGhostIOTest, KGhostIOFeedConnectionAcrossReads)
+{
+	const char				*reads[]	  = {"POST /api/simulate/motor HTTP/1.1\r\nContent-Le", "ngth: 13\r\n\r", "\n{\"spee", "d\": 12}"};
+	k_ghost_io_connection_t *connection_p = nullptr;
+	static int				 cbCalled	  = 0;
+	k_ghost_io_register_interface(
+		"motor",
+		[](const cJSON *input, void *)
+		{
+			cbCalled++;
+			EXPECT_EQ(cJSON_GetNumberValue(cJSON_GetObjectItem(input, "speed")), 12);
+			return 0;
+		},
+		nullptr, nullptr);
+	for (size_t i = 0; i < 3; i++)
+	{
+		EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, reads[i], strlen(reads[i])), 0);
+		EXPECT_NE(connection_p, nullptr);
+	}
+	EXPECT_EQ(cbCalled, 0);
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, reads[3], strlen(reads[3])), 1);
+	EXPECT_EQ(connection_p, nullptr);
+	EXPECT_EQ(cbCalled, 1);
+	EXPECT_EQ(close_fake.call_count, 1);
+}
+
+TEST_F(KGhostIOTest, KGhostIOFeedConnectionChunkedBody)
+{
+	const char *reads[] = {"POST /api/simulate/motor HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5;ext=1\r\n{\"spe\r\n",
+						   "8\r\ned\": 12}\r", "\n0\r\nX-Checksum: 1\r\n", "\r\n"};
+	k_ghost_io_connection_t *connection_p = nullptr;
+	static std::string		 body;
+	k_ghost_io_register_raw_interface(
+		"motor",
+		[](const char *request_body, size_t body_len, void *)
+		{
+			body.assign(request_body, body_len);
+			return 0;
+		},
+		nullptr, nullptr);
+	for (size_t i = 0; i < 3; i++)
+	{
+		EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, reads[i], strlen(reads[i])), 0);
+	}
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, reads[3], strlen(reads[3])), 1);
+	EXPECT_EQ(connection_p, nullptr);
+	EXPECT_EQ(body, "{\"speed\": 12}");
+}
+
+TEST_F(KGhostIOTest, KGhostIOFeedConnectionInvalidFraming)
+{
+	const char *requests[] = {"POST /api/simulate/motor HTTP/1.1\r\nContent-Length: 12x\r\n\r\n",
+							  "POST /api/simulate/motor HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n",
+							  "POST /api/simulate/motor HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n"};
+	send_fake.custom_fake = sendCapture;
+	for (const char *request : requests)
+	{
+		k_ghost_io_connection_t *connection_p = nullptr;
+		sendOutput.clear();
+		EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, request, strlen(request)), 1);
+		EXPECT_EQ(connection_p, nullptr);
+		EXPECT_EQ(sendOutput, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n");
+	}
+	EXPECT_EQ(close_fake.call_count, 3);
+}
+
+TEST_F(KGhostIOTest, KGhostIOFeedConnectionTooLarge)
+{
+	std::string				 headers	  = "POST /api/simulate/motor HTTP/1.1\r\nContent-Length: 70000\r\n\r\n";
+	std::string				 body(K_GHOST_IO_MAX_REQUEST_SIZE, 'a');
+	k_ghost_io_connection_t *connection_p = nullptr;
+	k_ghost_io_register_raw_interface("motor", [](const char *, size_t, void *) { return 0; }, nullptr, nullptr);
+	send_fake.custom_fake = sendCapture;
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, headers.c_str(), headers.size()), 0);
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, body.c_str(), body.size()), 1);
+	EXPECT_EQ(connection_p, nullptr);
+	EXPECT_EQ(sendOutput, "HTTP/1.1 413 Content Too Large\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(close_fake.call_count, 1);
+}
+
+TEST_F(KGhostIOTest, KGhostIOStreamUpload)
+{
+	std::string headers =
+		"POST /api/simulate/waveform HTTP/1.1\r\n"
+		"Content-Length: 100000\r\n"
+		"Expect: 100-continue\r\n"
+		"\r\n";
+	std::string				 chunk(1000, 'w');
+	k_ghost_io_connection_t *connection_p = nullptr;
+	k_ghost_io_stats_t		 stats		  = {};
+	streamBody.clear();
+	streamDone.clear();
+	send_fake.custom_fake = sendCapture;
+	EXPECT_EQ(k_ghost_io_register_stream_interface("waveform", streamCapture, nullptr, nullptr), K_GHOST_REGISTER_RET_CODE_OK);
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, headers.c_str(), headers.size()), 0);
+	EXPECT_EQ(sendOutput, "HTTP/1.1 100 Continue\r\n\r\n");
+	ASSERT_NE(connection_p, nullptr);
+	EXPECT_EQ(connection_p->stream.total_len, 100000u);
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.inflight_requests, 1u);
+
+	/* Larger than K_GHOST_IO_MAX_REQUEST_SIZE: never buffered, every read goes straight to the callback */
+	for (int i = 0; i < 99; i++)
+	{
+		EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, chunk.c_str(), chunk.size()), 0);
+	}
+	EXPECT_EQ(streamBody.size(), 99000u);
+	EXPECT_TRUE(streamDone.empty());
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, chunk.c_str(), chunk.size()), 1);
+	EXPECT_EQ(connection_p, nullptr);
+	EXPECT_EQ(streamBody, std::string(100000, 'w'));
+	EXPECT_EQ(streamDone, std::vector<int>{1});
+	EXPECT_EQ(sendOutput, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(close_fake.call_count, 1);
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.inflight_requests, 0u);
+}
+
+TEST_F(KGhostIOTest, KGhostIOStreamChunkedUpload)
+{
+	const char *reads[] = {"POST /api/simulate/waveform HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n4\r\nabcd\r\n", "6\r\nef", "ghij\r\n0\r\n\r\n"};
+	k_ghost_io_connection_t *connection_p = nullptr;
+	streamBody.clear();
+	streamDone.clear();
+	k_ghost_io_register_stream_interface("waveform", streamCapture, nullptr, nullptr);
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, reads[0], strlen(reads[0])), 0);
+	EXPECT_EQ(connection_p->stream.total_len, 0u);
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, reads[1], strlen(reads[1])), 0);
+	EXPECT_EQ(streamBody, "abcdef");
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, reads[2], strlen(reads[2])), 1);
+	EXPECT_EQ(streamBody, "abcdefghij");
+	EXPECT_EQ(streamDone, std::vector<int>{1});
+}
+
+TEST_F(KGhostIOTest, KGhostIOStreamUploadAborted)
+{
+	std::string				 request	  = "POST /api/simulate/waveform HTTP/1.1\r\nContent-Length: 10\r\n\r\n01234";
+	k_ghost_io_connection_t *connection_p = nullptr;
+	k_ghost_io_stats_t		 stats		  = {};
+	streamBody.clear();
+	streamDone.clear();
+	k_ghost_io_register_stream_interface("waveform", streamCapture, nullptr, nullptr);
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, request.c_str(), request.size()), 0);
+	EXPECT_EQ(streamBody, "01234");
+
+	/* Client gone before the end of the body */
+	k_ghost_io_abort_connection(&connection_p);
+	EXPECT_EQ(connection_p, nullptr);
+	EXPECT_EQ(streamDone, std::vector<int>{-1});
+	k_ghost_io_get_stats(&stats);
+	EXPECT_EQ(stats.inflight_requests, 0u);
+	EXPECT_EQ(reinterpret_cast<k_ghost_io_interface_entry_t *>(k_ghost_io_find_interface("waveform", strlen("waveform")))->pending_count, 0u);
+}
+
+TEST_F(KGhostIOTest, KGhostIOStreamUploadRefusedByCallback)
+{
+	std::string				 headers	  = "POST /api/simulate/waveform HTTP/1.1\r\nContent-Length: 10\r\n\r\n";
+	k_ghost_io_connection_t *connection_p = nullptr;
+	static std::vector<int>	 done;
+	send_fake.custom_fake = sendCapture;
+	k_ghost_io_register_stream_interface(
+		"waveform",
+		[](k_ghost_io_stream_t *stream_p, const char *chunk_p, size_t, void *)
+		{
+			if (!chunk_p)
+			{
+				done.push_back(stream_p->done);
+			}
+			return chunk_p ? -1 : 0;
+		},
+		nullptr, nullptr);
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, headers.c_str(), headers.size()), 0);
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, "01234", 5), 1);
+	EXPECT_EQ(connection_p, nullptr);
+	EXPECT_EQ(done, std::vector<int>{-1});
+	EXPECT_EQ(sendOutput, "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(close_fake.call_count, 1);
+}
+
+TEST_F(KGhostIOTest, KGhostIOStreamWholeBody)
+{
+	std::string request =
+		"POST /api/simulate/waveform HTTP/1.1\r\n"
+		"Content-Length: 10\r\n"
+		"\r\n"
+		"0123456789";
+	k_ghost_io_connection_t *connection_p = nullptr;
+	streamBody.clear();
+	streamDone.clear();
+	k_ghost_io_register_stream_interface("waveform", streamCapture, nullptr, nullptr);
+	EXPECT_EQ(k_ghost_io_register_stream_interface("other", nullptr, nullptr, nullptr), K_GHOST_REGISTER_RET_CODE_ERROR);
+
+	/* Received in a single read: delivered as one chunk, without any connection state */
+	EXPECT_EQ(k_ghost_io_feed_connection(&connection_p, 5, request.c_str(), request.size()), 1);
+	EXPECT_EQ(connection_p, nullptr);
+	EXPECT_EQ(streamBody, "0123456789");
+	EXPECT_EQ(streamDone, std::vector<int>{1});
+	EXPECT_EQ(close_fake.call_count, 1);
+}
+
+TEST_F(KGhostIOTest, KGhostIOScanHeaders)
+{
+	std::string request =
+		"GET /api/sse?interface=motor HTTP/1.1\r\n"
+		"Host: localhost:8080\r\n"
+		"ACCEPT:text/event-stream \r\n"
+		"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\r\n"
+		"last-event-id:   42\r\n"
+		"Accept: application/json\r\n"
+		"X-Content-Length: 7\r\n"
+		"\r\n"
+		"body\r\n\r\n";
+	k_ghost_io_headers_t headers;
+	ASSERT_EQ(k_ghost_io_scan_headers(request.c_str(), request.size(), &headers), 0);
+	EXPECT_EQ(headers.header_len, request.size() - strlen("body\r\n\r\n"));
+	EXPECT_EQ(std::string(headers.values[K_GHOST_IO_HEADER_ACCEPT].value, headers.values[K_GHOST_IO_HEADER_ACCEPT].len), "text/event-stream");
+	EXPECT_EQ(std::string(headers.values[K_GHOST_IO_HEADER_LAST_EVENT_ID].value, headers.values[K_GHOST_IO_HEADER_LAST_EVENT_ID].len), "42");
+	EXPECT_EQ(headers.values[K_GHOST_IO_HEADER_CONTENT_LENGTH].value, nullptr);
+	EXPECT_EQ(headers.values[K_GHOST_IO_HEADER_EXPECT].value, nullptr);
+
+	/* Incomplete headers, whatever the position of the cut */
+	for (size_t len = 0; len < headers.header_len; len++)
+	{
+		EXPECT_EQ(k_ghost_io_scan_headers(request.c_str(), len, &headers), -1) << len;
+	}
+}
+
+TEST_F(KGhostIOTest, KGhostIOFindHeaderEnd)
+{
+	/* Blank line at every position relative to the vector width, with lone carriage returns around it */
+	for (size_t offset = 0; offset < 80; offset++)
+	{
+		std::string request = "POST / HTTP/1.1\r\n" + std::string(offset, 'x') + "\rx\r\n\r\n\r\r\n";
+		const char *end		= k_ghost_io_find_header_end(request.c_str(), request.size());
+		EXPECT_EQ(end, strstr(request.c_str(), "\r\n\r\n")) << offset;
+		EXPECT_EQ(k_ghost_io_find_header_end(request.c_str(), (size_t)(end - request.c_str()) + 3), nullptr) << offset;
+	}
+	EXPECT_EQ(k_ghost_io_find_header_end("", 0), nullptr);
+}
+
+TEST_F(KGhostIOTest, KGhostIOStaticResponses)
+{
+	send_fake.custom_fake = sendCapture;
+	k_ghost_io_manage_unknown_endpoint(5);
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(sendOutput, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+	k_ghost_io_send_static_response(5, K_GHOST_IO_RESPONSE_CONTINUE, 0);
+	EXPECT_EQ(sendOutput, "HTTP/1.1 100 Continue\r\n\r\n");
+	k_ghost_io_send_static_response(5, K_GHOST_IO_RESPONSE_NONE, 0);
+	EXPECT_EQ(send_fake.call_count, 2);
+
+	/* Status codes without a fixed response still get a valid status line */
+	char		head[K_GHOST_IO_RESPONSE_HEAD_SIZE];
+	size_t		head_len = k_ghost_io_format_response_head(head, 418, "X-Teapot: 1\r\n", 2);
+	EXPECT_EQ(std::string(head, head_len), "HTTP/1.1 418 \r\nContent-Type: application/json\r\nX-Teapot: 1\r\nContent-Length: 2\r\n\r\n");
+	head_len = k_ghost_io_format_response_head(head, 504, nullptr, 0);
+	EXPECT_EQ(std::string(head, head_len), "HTTP/1.1 504 Gateway Timeout\r\nContent-Length: 0\r\n\r\n");
+}
+
+TEST_F(KGhostIOTest, KGhostIOServerHeaders)
+{
+	send_fake.custom_fake = sendCapture;
+	k_ghost_io_set_server_headers(1);
+	k_ghost_io_send_static_response(5, K_GHOST_IO_RESPONSE_NO_CONTENT, 0);
+	const std::regex dated(
+		"HTTP/1\\.1 204 No Content\r\n"
+		"Date: (Mon|Tue|Wed|Thu|Fri|Sat|Sun), [0-9]{2} [A-Z][a-z]{2} [0-9]{4} [0-9]{2}:[0-9]{2}:[0-9]{2} GMT\r\n"
+		"Server: k_ghost_io\r\n"
+		"Content-Length: 0\r\n\r\n");
+	EXPECT_TRUE(std::regex_match(sendOutput, dated)) << sendOutput;
+
+	/* Interim responses are left as they are */
+	k_ghost_io_send_static_response(5, K_GHOST_IO_RESPONSE_CONTINUE, 0);
+	EXPECT_EQ(sendOutput, "HTTP/1.1 100 Continue\r\n\r\n");
+
+	char		 head[K_GHOST_IO_RESPONSE_HEAD_SIZE];
+	const size_t head_len = k_ghost_io_format_response_head(head, 200, nullptr, 0);
+	EXPECT_NE(std::string(head, head_len).find("\r\nServer: k_ghost_io\r\nContent-Length: 0\r\n\r\n"), std::string::npos);
+	k_ghost_io_set_server_headers(0);
+	k_ghost_io_send_static_response(5, K_GHOST_IO_RESPONSE_NO_CONTENT, 0);
+	EXPECT_EQ(sendOutput, "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n");
+}
+
+TEST_F(KGhostIOTest, KGhostIOGeneratorWaveforms)
+{
+	const k_ghost_io_channel_t channels[] = {
+		{"sine", K_GHOST_IO_WAVE_SINE, 1.0, 2.0, 1.0, 0.0, K_GHOST_IO_NOISE_NONE, 0.0},
+		{"square", K_GHOST_IO_WAVE_SQUARE, 1.0, 2.0, 1.0, 0.0, K_GHOST_IO_NOISE_NONE, 0.0},
+		{"triangle", K_GHOST_IO_WAVE_TRIANGLE, 1.0, 2.0, 1.0, 0.0, K_GHOST_IO_NOISE_NONE, 0.0},
+		{"ramp", K_GHOST_IO_WAVE_RAMP, 1.0, 2.0, 1.0, 0.0, K_GHOST_IO_NOISE_NONE, 0.0},
+		{"level", K_GHOST_IO_WAVE_CONSTANT, 7.5, 2.0, 1.0, 0.0, K_GHOST_IO_NOISE_NONE, 0.0},
+	};
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+	ASSERT_EQ(k_ghost_io_add_generator("wind", channels, 5, 4.0), K_GHOST_REGISTER_RET_CODE_OK);
+	const uint64_t start_ns = k_ghost_io_ctx.generators->start_ns;
+	const uint64_t late_ns	= 2 * K_GHOST_IO_TIMER_TICK_NS;
+
+	for (uint64_t i = 0; i < 4; i++)
+	{
+		EXPECT_GT(k_ghost_io_run_timers(start_ns + i * 250000000 + late_ns), 0);
+	}
+	EXPECT_GT(k_ghost_io_run_timers(start_ns + 760000000), 0);
+	ASSERT_EQ(sseOutput.size(), 4u);
+	EXPECT_EQ(sseOutput[0].second, "event: wind\r\ndata: {\"sine\":1,\"square\":3,\"triangle\":-1,\"ramp\":-1,\"level\":7.5}\r\n\r\n");
+	EXPECT_EQ(sseOutput[1].second, "event: wind\r\ndata: {\"sine\":3,\"square\":3,\"triangle\":1,\"ramp\":0,\"level\":7.5}\r\n\r\n");
+	EXPECT_EQ(sseOutput[2].second, "event: wind\r\ndata: {\"sine\":1,\"square\":-1,\"triangle\":3,\"ramp\":1,\"level\":7.5}\r\n\r\n");
+	EXPECT_EQ(sseOutput[3].second, "event: wind\r\ndata: {\"sine\":-1,\"square\":-1,\"triangle\":1,\"ramp\":2,\"level\":7.5}\r\n\r\n");
+
+	/* A stalled thread gets a single event, sampled at the latest tick it missed (2.25 s) */
+	sseOutput.clear();
+	/* The wheel may ask to be run earlier than the next event, to move the timer to a finer level */
+	const int64_t wait_ns = k_ghost_io_run_timers(start_ns + 2300000000);
+	EXPECT_GT(wait_ns, 0);
+	EXPECT_LE(wait_ns, 200000000 + late_ns);
+	ASSERT_EQ(sseOutput.size(), 1u);
+	EXPECT_EQ(sseOutput[0].second, "event: wind\r\ndata: {\"sine\":3,\"square\":3,\"triangle\":1,\"ramp\":0,\"level\":7.5}\r\n\r\n");
+
+	k_ghost_io_remove_generator("wind");
+	EXPECT_EQ(k_ghost_io_ctx.generators, nullptr);
+	EXPECT_EQ(k_ghost_io_run_timers(start_ns + 2600000000), -1);
+	EXPECT_EQ(sseOutput.size(), 1u);
+	k_ghost_io_remove_sse_client(5);
+}
+
+TEST_F(KGhostIOTest, KGhostIOGeneratorNoiseAndGusts)
+{
+	const k_ghost_io_channel_t channels[] = {
+		{"uniform", K_GHOST_IO_WAVE_CONSTANT, 10.0, 0.0, 0.0, 0.0, K_GHOST_IO_NOISE_UNIFORM, 0.5},
+		{"gaussian", K_GHOST_IO_WAVE_CONSTANT, 0.0, 0.0, 0.0, 0.0, K_GHOST_IO_NOISE_GAUSSIAN, 1.0},
+		{"gust", K_GHOST_IO_WAVE_GUST, 4.0, 6.0, 1.0, 0.0, K_GHOST_IO_NOISE_NONE, 0.0},
+	};
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+	ASSERT_EQ(k_ghost_io_add_generator("anemometer", channels, 3, 100.0), K_GHOST_REGISTER_RET_CODE_OK);
+	const uint64_t start_ns = k_ghost_io_ctx.generators->start_ns;
+	const int	   samples	= 1000;
+	double		   sum		= 0.0;
+	double		   sum_sq	= 0.0;
+	double		   gust_max = 0.0;
+	for (int i = 0; i < samples; i++)
+	{
+		k_ghost_io_run_timers(start_ns + (uint64_t)i * 10000000 + 2 * K_GHOST_IO_TIMER_TICK_NS);
+		ASSERT_EQ(sseOutput.size(), (size_t)i + 1);
+		double uniform	= 0.0;
+		double gaussian = 0.0;
+		double gust		= 0.0;
+		ASSERT_EQ(sscanf(sseOutput.back().second.c_str(), "event: anemometer\r\ndata: {\"uniform\":%lf,\"gaussian\":%lf,\"gust\":%lf}", &uniform, &gaussian, &gust),
+				  3);
+		EXPECT_GE(uniform, 9.5);
+		EXPECT_LE(uniform, 10.5);
+		EXPECT_GE(gust, 4.0);
+		EXPECT_LE(gust, 10.0);
+		gust_max = gust > gust_max ? gust : gust_max;
+		sum += gaussian;
+		sum_sq += gaussian * gaussian;
+	}
+	EXPECT_NEAR(sum / samples, 0.0, 0.15);
+	EXPECT_NEAR(sum_sq / samples, 1.0, 0.2);
+	EXPECT_GT(gust_max, 5.0);
+	k_ghost_io_remove_sse_client(5);
+}
+
+TEST_F(KGhostIOTest, KGhostIOGeneratorEscapesNames)
+{
+	const k_ghost_io_channel_t channels[] = {
+		{"a\"b", K_GHOST_IO_WAVE_CONSTANT, 1.0, 0.0, 0.0, 0.0, K_GHOST_IO_NOISE_NONE, 0.0},
+		{"\\\n\"\"\"", K_GHOST_IO_WAVE_CONSTANT, 2.0, 0.0, 0.0, 0.0, K_GHOST_IO_NOISE_NONE, 0.0},
+	};
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+	ASSERT_EQ(k_ghost_io_add_generator("fan", channels, 2, 100.0), K_GHOST_REGISTER_RET_CODE_OK);
+	k_ghost_io_run_timers(k_ghost_io_ctx.generators->start_ns + 2 * K_GHOST_IO_TIMER_TICK_NS);
+	ASSERT_EQ(sseOutput.size(), 1u);
+	EXPECT_EQ(sseOutput[0].second, "event: fan\r\ndata: {\"a\\\"b\":1,\"\\\\\\u000a\\\"\\\"\\\"\":2}\r\n\r\n");
+	k_ghost_io_remove_generator("fan");
+	k_ghost_io_remove_sse_client(5);
+}
+
+TEST_F(KGhostIOTest, KGhostIOAddGeneratorInvalid)
+{
+	const k_ghost_io_channel_t channel = {"speed", K_GHOST_IO_WAVE_SINE, 0.0, 1.0, 1.0, 0.0, K_GHOST_IO_NOISE_NONE, 0.0};
+	const k_ghost_io_channel_t unnamed = {nullptr, K_GHOST_IO_WAVE_SINE, 0.0, 1.0, 1.0, 0.0, K_GHOST_IO_NOISE_NONE, 0.0};
+	EXPECT_EQ(k_ghost_io_add_generator(nullptr, &channel, 1, 10.0), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_generator("fan", nullptr, 1, 10.0), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_generator("fan", &channel, 0, 10.0), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_generator("fan", &channel, 1, 0.0), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_generator("fan", &channel, 1, 2e6), K_GHOST_REGISTER_RET_CODE_ERROR);
+	/* One event per timer tick at most */
+	EXPECT_EQ(k_ghost_io_add_generator("fan", &channel, 1, 1e9 / K_GHOST_IO_TIMER_TICK_NS + 1.0), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_generator("fan", &unnamed, 1, 10.0), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_ctx.generators, nullptr);
+	EXPECT_EQ(k_ghost_io_add_generator("fan", &channel, 1, 10.0), K_GHOST_REGISTER_RET_CODE_OK);
+	EXPECT_EQ(k_ghost_io_add_generator("fan", &channel, 1, 20.0), K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED);
+	k_ghost_io_remove_generator("pump");
+	EXPECT_NE(k_ghost_io_ctx.generators, nullptr);
+}
+
+static void timerCount(void *user_data_p)
+{
+	(*static_cast<int *>(user_data_p))++;
+}
+
+TEST_F(KGhostIOTest, KGhostIOTimerOneShot)
+{
+	int			   runs	   = 0;
+	const uint64_t base_ns = k_ghost_io_now_ns();
+	EXPECT_EQ(k_ghost_io_schedule(1000, 0, nullptr, nullptr), 0u);
+	EXPECT_EQ(k_ghost_io_run_timers(base_ns), -1);
+	const k_ghost_io_timer_t timer = k_ghost_io_schedule(1000, 0, timerCount, &runs);
+	EXPECT_NE(timer, 0u);
+	const int64_t wait_ns = k_ghost_io_run_timers(base_ns);
+	EXPECT_GE(wait_ns, 1000000);
+	EXPECT_LE(wait_ns, 1500000);
+	EXPECT_GT(k_ghost_io_run_timers(base_ns + 900000), 0);
+	EXPECT_EQ(runs, 0);
+	EXPECT_EQ(k_ghost_io_run_timers(base_ns + 2000000), -1);
+	EXPECT_EQ(runs, 1);
+	EXPECT_EQ(k_ghost_io_run_timers(base_ns + 3000000), -1);
+	EXPECT_EQ(runs, 1);
+
+	/* The node is reused, the stale handle must not reach the new timer */
+	const k_ghost_io_timer_t reused = k_ghost_io_schedule(1000, 0, timerCount, &runs);
+	EXPECT_NE(reused, timer);
+	EXPECT_EQ(k_ghost_io_cancel(timer), -1);
+	EXPECT_EQ(k_ghost_io_cancel(reused), 0);
+	EXPECT_EQ(k_ghost_io_cancel(reused), -1);
+	EXPECT_EQ(k_ghost_io_cancel(0), -1);
+}
+
+TEST_F(KGhostIOTest, KGhostIOTimerPeriodic)
+{
+	int						 runs	 = 0;
+	const uint64_t			 base_ns = k_ghost_io_now_ns();
+	const k_ghost_io_timer_t timer	 = k_ghost_io_schedule(0, 10000, timerCount, &runs);
+	for (uint64_t i = 0; i < 10; i++)
+	{
+		k_ghost_io_run_timers(base_ns + i * 10000000 + 1000000);
+		EXPECT_EQ(runs, (int)i + 1);
+	}
+	/* Half a second without running: the missed periods are skipped */
+	k_ghost_io_run_timers(base_ns + 600000000);
+	EXPECT_EQ(runs, 11);
+	k_ghost_io_run_timers(base_ns + 611000000);
+	EXPECT_EQ(runs, 12);
+	EXPECT_EQ(k_ghost_io_cancel(timer), 0);
+	EXPECT_EQ(k_ghost_io_run_timers(base_ns + 700000000), -1);
+	EXPECT_EQ(runs, 12);
+}
+
+TEST_F(KGhostIOTest, KGhostIOTimerLongDelays)
+{
+	int			   runs[3] = {0, 0, 0};
+	const uint64_t base_ns = k_ghost_io_now_ns();
+	const uint64_t hour_ns = 3600 * K_GHOST_IO_NS_PER_S;
+	k_ghost_io_schedule(10000000, 0, timerCount, &runs[0]);
+	k_ghost_io_schedule(3600000000, 0, timerCount, &runs[1]);
+	k_ghost_io_schedule(40 * 3600000000ULL, 0, timerCount, &runs[2]);
+	k_ghost_io_run_timers(base_ns + 9990000000);
+	EXPECT_EQ(runs[0], 0);
+	k_ghost_io_run_timers(base_ns + 10010000000);
+	EXPECT_EQ(runs[0], 1);
+	k_ghost_io_run_timers(base_ns + hour_ns - 1000000);
+	EXPECT_EQ(runs[1], 0);
+	k_ghost_io_run_timers(base_ns + hour_ns + 1000000);
+	EXPECT_EQ(runs[1], 1);
+	/* Beyond the reach of the wheel */
+	k_ghost_io_run_timers(base_ns + 39 * hour_ns);
+	EXPECT_EQ(runs[2], 0);
+	EXPECT_EQ(k_ghost_io_run_timers(base_ns + 40 * hour_ns + 1000000), -1);
+	EXPECT_EQ(runs[0] + runs[1] + runs[2], 3);
+}
+
+struct TimerProbe
+{
+	uint64_t delay_ns;
+	uint64_t ran_ns;
+	int		 runs;
+};
+
+static void timerProbe(void *user_data_p)
+{
+	TimerProbe *probe_p = static_cast<TimerProbe *>(user_data_p);
+	probe_p->ran_ns		= k_ghost_io_ctx.timers.now_ns;
+	probe_p->runs++;
+}
+
+TEST_F(KGhostIOTest, KGhostIOTimerManyTimers)
+{
+	const size_t					count = 20000;
+	std::vector<TimerProbe>			probes(count);
+	std::vector<k_ghost_io_timer_t> timers(count);
+	uint32_t						seed	 = 12345;
+	const uint64_t					first_ns = k_ghost_io_now_ns();
+	for (size_t i = 0; i < count; i++)
+	{
+		seed			   = seed * 1103515245 + 12345;
+		probes[i].delay_ns = (uint64_t)(seed >> 8) % 5000000 * 1000;
+		timers[i]		   = k_ghost_io_schedule(probes[i].delay_ns / 1000, 0, timerProbe, &probes[i]);
+		ASSERT_NE(timers[i], 0u);
+	}
+	const uint64_t last_ns = k_ghost_io_now_ns();
+	for (size_t i = 1; i < count; i += 2)
+	{
+		EXPECT_EQ(k_ghost_io_cancel(timers[i]), 0);
+	}
+	for (uint64_t now_ns = first_ns; now_ns < last_ns + 5100000000; now_ns += 1000000)
+	{
+		k_ghost_io_run_timers(now_ns);
+	}
+	EXPECT_EQ(k_ghost_io_ctx.timers.armed_count, 0u);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (i % 2)
+		{
+			EXPECT_EQ(probes[i].runs, 0);
+		}
+		else
+		{
+			ASSERT_EQ(probes[i].runs, 1) << i;
+			EXPECT_GE(probes[i].ran_ns, first_ns + probes[i].delay_ns);
+			EXPECT_LE(probes[i].ran_ns, last_ns + probes[i].delay_ns + 1000000 + K_GHOST_IO_TIMER_TICK_NS);
+		}
+	}
+}
+
+static k_ghost_io_timer_t selfCancelTimer;
+static int				  selfCancelRuns;
+
+TEST_F(KGhostIOTest, KGhostIOTimerCallbacksArmAndCancel)
+{
+	static int chained = 0;
+	selfCancelRuns	   = 0;
+	chained			   = 0;
+	const uint64_t base_ns = k_ghost_io_now_ns();
+	selfCancelTimer		   = k_ghost_io_schedule(
+		  0, 1000,
+		  [](void *)
+		  {
+			  if (3 == ++selfCancelRuns)
+			  {
+				  EXPECT_EQ(k_ghost_io_cancel(selfCancelTimer), 0);
+			  }
+		  },
+		  nullptr);
+	k_ghost_io_schedule(500, 0, [](void *) { k_ghost_io_schedule(500, 0, timerCount, &chained); }, nullptr);
+	for (uint64_t i = 1; i <= 10; i++)
+	{
+		k_ghost_io_run_timers(base_ns + i * 1000000);
+	}
+	EXPECT_EQ(selfCancelRuns, 3);
+	EXPECT_EQ(chained, 1);
+	EXPECT_EQ(k_ghost_io_ctx.timers.armed_count, 0u);
+}
+
+TEST_F(KGhostIOTest, KGhostIOClockPauseAndStep)
+{
+	EXPECT_EQ(k_ghost_io_step_clock(1000), -1);
+	k_ghost_io_pause_clock();
+	const uint64_t paused_us = k_ghost_io_get_time_us();
+	usleep(2000);
+	EXPECT_EQ(k_ghost_io_get_time_us(), paused_us);
+	EXPECT_EQ(k_ghost_io_clock_wait(5000000), -1);
+	EXPECT_EQ(k_ghost_io_clock_wait(-1), -1);
+
+	/* Timers follow the steps, whatever the real time elapsed */
+	int runs = 0;
+	k_ghost_io_schedule(10000, 0, timerCount, &runs);
+	EXPECT_EQ(k_ghost_io_step_clock(9000), 0);
+	k_ghost_io_run_timers(k_ghost_io_now_ns());
+	EXPECT_EQ(runs, 0);
+	EXPECT_EQ(k_ghost_io_step_clock(1000 + K_GHOST_IO_TIMER_TICK_NS / 1000), 0);
+	EXPECT_EQ(k_ghost_io_run_timers(k_ghost_io_now_ns()), -1);
+	EXPECT_EQ(runs, 1);
+	EXPECT_EQ(k_ghost_io_get_time_us(), paused_us + 10000 + K_GHOST_IO_TIMER_TICK_NS / 1000);
+
+	/* Read without the lock of the clock, a writer holding it does not hold the readers */
+	pthread_mutex_lock(&k_ghost_io_ctx.clock.lock);
+	EXPECT_EQ(k_ghost_io_get_time_us(), paused_us + 10000 + K_GHOST_IO_TIMER_TICK_NS / 1000);
+	pthread_mutex_unlock(&k_ghost_io_ctx.clock.lock);
+
+	/* Resumed from where it was paused, at the pace of the system clock */
+	k_ghost_io_resume_clock();
+	EXPECT_EQ(k_ghost_io_ctx.clock.mode, K_GHOST_IO_CLOCK_SCALED);
+	EXPECT_EQ(k_ghost_io_clock_wait(5000000), 5000000);
+	EXPECT_GE(k_ghost_io_get_time_us(), paused_us + 10000 + K_GHOST_IO_TIMER_TICK_NS / 1000);
+	EXPECT_LT(k_ghost_io_get_time_us(), paused_us + 1000000);
+	EXPECT_EQ(k_ghost_io_step_clock(1000), -1);
+}
+
+TEST_F(KGhostIOTest, KGhostIOClockScale)
+{
+	EXPECT_EQ(k_ghost_io_set_time_scale(-1.0), -1);
+	EXPECT_EQ(k_ghost_io_set_time_scale(NAN), -1);
+	EXPECT_EQ(k_ghost_io_set_time_scale(INFINITY), -1);
+	EXPECT_EQ(k_ghost_io_ctx.clock.mode, K_GHOST_IO_CLOCK_SYSTEM);
+
+	const uint64_t before_us = k_ghost_io_get_time_us();
+	ASSERT_EQ(k_ghost_io_set_time_scale(100.0), 0);
+	usleep(2000);
+	EXPECT_GE(k_ghost_io_get_time_us() - before_us, 200000u);
+	EXPECT_EQ(k_ghost_io_clock_wait(500000000), 5000000);
+	EXPECT_EQ(k_ghost_io_clock_wait(1), 1);
+
+	/* The scale set while paused applies once resumed; the clock never goes backwards */
+	k_ghost_io_pause_clock();
+	const uint64_t paused_us = k_ghost_io_get_time_us();
+	EXPECT_EQ(k_ghost_io_set_time_scale(0.5), 0);
+	EXPECT_EQ(k_ghost_io_get_time_us(), paused_us);
+	k_ghost_io_resume_clock();
+	EXPECT_EQ(k_ghost_io_clock_wait(1000000), 2000000);
+	EXPECT_GE(k_ghost_io_get_time_us(), paused_us);
+	EXPECT_EQ(k_ghost_io_set_time_scale(1e-300), 0);
+	EXPECT_EQ(k_ghost_io_clock_wait(1000000), INT64_MAX);
+}
+
+TEST_F(KGhostIOTest, KGhostIOClockUnbounded)
+{
+	const k_ghost_io_channel_t channels[] = {
+		{"speed", K_GHOST_IO_WAVE_RAMP, 0.0, 1.0, 1.0 / 3600.0, 0.5, K_GHOST_IO_NOISE_NONE, 0.0},
+	};
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+	ASSERT_EQ(k_ghost_io_set_time_scale(K_GHOST_IO_TIME_SCALE_UNBOUNDED), 0);
+	ASSERT_EQ(k_ghost_io_add_generator("wind", channels, 1, 1.0), K_GHOST_REGISTER_RET_CODE_OK);
+	const uint64_t start_ns = k_ghost_io_ctx.generators->start_ns;
+
+	/* An hour of simulation, run the way the I/O thread does: the clock jumps from one timer to the next */
+	size_t loops = 0;
+	while (k_ghost_io_now_ns() < start_ns + 3600 * K_GHOST_IO_NS_PER_S)
+	{
+		EXPECT_EQ(k_ghost_io_clock_wait(k_ghost_io_run_timers(k_ghost_io_now_ns())), 0);
+		loops++;
+	}
+	k_ghost_io_run_timers(k_ghost_io_now_ns());
+	ASSERT_EQ(sseOutput.size(), 3601u);
+	EXPECT_LT(loops, 4 * 3601u);
+	EXPECT_EQ(sseOutput[0].second, "event: wind\r\ndata: {\"speed\":0}\r\n\r\n");
+	EXPECT_EQ(sseOutput[900].second, "event: wind\r\ndata: {\"speed\":0.5}\r\n\r\n");
+	EXPECT_EQ(sseOutput[3600].second, "event: wind\r\ndata: {\"speed\":0}\r\n\r\n");
+	EXPECT_LT(k_ghost_io_now_ns(), start_ns + 3600 * K_GHOST_IO_NS_PER_S + K_GHOST_IO_TIMER_TICK_NS);
+}
+
+static std::string writeRecording(const std::string &content)
+{
+	char path[] = "/tmp/k_ghost_io_recording_XXXXXX";
+	int	 fd		= mkstemp(path);
+	EXPECT_GE(fd, 0);
+	EXPECT_EQ(write(fd, content.data(), content.size()), (ssize_t)content.size());
+	close(fd);
+	return path;
+}
+
+TEST_F(KGhostIOTest, KGhostIOPlaybackCsv)
+{
+	const std::string path	= writeRecording("time,speed,direction\r\n10.0,1.5,180\n# gust\n\n10.5,2,\n11.0,bad,90\n12.0,3");
+	const std::string empty = writeRecording("time,speed\n# nothing recorded\n");
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+	EXPECT_EQ(k_ghost_io_add_playback("wind", path.c_str(), 0.0, 0), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_playback("wind", "/nonexistent/recording.csv", 1.0, 0), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_playback("wind", empty.c_str(), 1.0, 1), K_GHOST_REGISTER_RET_CODE_ERROR);
+	ASSERT_EQ(k_ghost_io_add_playback("wind", path.c_str(), 2.0, 0), K_GHOST_REGISTER_RET_CODE_OK);
+	EXPECT_EQ(k_ghost_io_add_playback("wind", path.c_str(), 1.0, 0), K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED);
+	const uint64_t start_ns = k_ghost_io_ctx.playbacks->start_ns;
+	const uint64_t late_ns	= 2 * K_GHOST_IO_TIMER_TICK_NS;
+
+	/* Twice the original pace: one record every 250 ms, then 500 ms */
+	EXPECT_GT(k_ghost_io_run_timers(start_ns + late_ns), 0);
+	EXPECT_GT(k_ghost_io_run_timers(start_ns + 240000000), 0);
+	EXPECT_EQ(sseOutput.size(), 1u);
+	EXPECT_GT(k_ghost_io_run_timers(start_ns + 250000000 + late_ns), 0);
+	EXPECT_GT(k_ghost_io_run_timers(start_ns + 500000000 + late_ns), 0);
+	EXPECT_EQ(k_ghost_io_run_timers(start_ns + 1000000000 + late_ns), -1);
+	ASSERT_EQ(sseOutput.size(), 4u);
+	EXPECT_EQ(sseOutput[0].second, "event: wind\r\ndata: {\"speed\":1.5,\"direction\":180}\r\n\r\n");
+	EXPECT_EQ(sseOutput[1].second, "event: wind\r\ndata: {\"speed\":2,\"direction\":null}\r\n\r\n");
+	EXPECT_EQ(sseOutput[2].second, "event: wind\r\ndata: {\"speed\":null,\"direction\":90}\r\n\r\n");
+	EXPECT_EQ(sseOutput[3].second, "event: wind\r\ndata: {\"speed\":3,\"direction\":null}\r\n\r\n");
+
+	k_ghost_io_remove_playback("wind");
+	EXPECT_EQ(k_ghost_io_ctx.playbacks, nullptr);
+	unlink(path.c_str());
+	unlink(empty.c_str());
+}
+
+TEST_F(KGhostIOTest, KGhostIOPlaybackEscapesNames)
+{
+	const std::string path = writeRecording("time,\"\"\"\",a\\b\x01\n0,1,2\n");
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+	ASSERT_EQ(k_ghost_io_add_playback("wind", path.c_str(), 1.0, 0), K_GHOST_REGISTER_RET_CODE_OK);
+	k_ghost_io_run_timers(k_ghost_io_ctx.playbacks->start_ns + 2 * K_GHOST_IO_TIMER_TICK_NS);
+	ASSERT_EQ(sseOutput.size(), 1u);
+	EXPECT_EQ(sseOutput[0].second, "event: wind\r\ndata: {\"\\\"\\\"\\\"\\\"\":1,\"a\\\\b\\u0001\":2}\r\n\r\n");
+	k_ghost_io_remove_playback("wind");
+	unlink(path.c_str());
+}
+
+TEST_F(KGhostIOTest, KGhostIOPlaybackBinaryLoop)
+{
+	/* Two channels, records from byte 24; the last record is truncated */
+	const double	  records[] = {0.0, 1.0, 2.0, 0.001, 3.0, NAN, 0.002};
+	std::string		  content("KGIOREC1\x02\0\0\0\x04\0\0\0a\0b\0\0\0\0\0", 24);
+	const std::string path		= writeRecording(content.append(reinterpret_cast<const char *>(records), sizeof(records)));
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+	ASSERT_EQ(k_ghost_io_add_playback("vane", path.c_str(), 1.0, 1), K_GHOST_REGISTER_RET_CODE_OK);
+	const uint64_t start_ns = k_ghost_io_ctx.playbacks->start_ns;
+
+	/* Started over a tick after the last record */
+	for (uint64_t now_ns = start_ns; now_ns < start_ns + 3000000; now_ns += K_GHOST_IO_TIMER_TICK_NS)
+	{
+		EXPECT_GT(k_ghost_io_run_timers(now_ns), 0);
+	}
+	ASSERT_GE(sseOutput.size(), 5u);
+	EXPECT_EQ(sseOutput[0].second, "event: vane\r\ndata: {\"a\":1,\"b\":2}\r\n\r\n");
+	EXPECT_EQ(sseOutput[1].second, "event: vane\r\ndata: {\"a\":3,\"b\":null}\r\n\r\n");
+	EXPECT_EQ(sseOutput[2].second, sseOutput[0].second);
+	EXPECT_EQ(sseOutput[3].second, sseOutput[1].second);
+	EXPECT_EQ(sseOutput[4].second, sseOutput[0].second);
+
+	k_ghost_io_remove_playback("vane");
+	EXPECT_EQ(k_ghost_io_ctx.timers.armed_count, 0u);
+	unlink(path.c_str());
+}
+
+/* The recorder needs its flush thread for real */
+static int realThreadCreate(pthread_t *thread, const pthread_attr_t *attr, thread_cb_t thread_cb, void *arg)
+{
+	using create_t				  = int (*)(pthread_t *, const pthread_attr_t *, thread_cb_t, void *);
+	static const create_t create = reinterpret_cast<create_t>(dlsym(RTLD_NEXT, "pthread_create"));
+	return create(thread, attr, thread_cb, arg);
+}
+
+/* Real workers, the I/O thread fails to start */
+static int ioThreadCreateFails(pthread_t *thread, const pthread_attr_t *attr, thread_cb_t thread_cb, void *arg)
+{
+	return arg == &k_ghost_io_ctx ? -1 : realThreadCreate(thread, attr, thread_cb, arg);
+}
+
+TEST_F(KGhostIOTest, KGhostIOInitStopsWorkersOnFailure)
+{
+	socket_fake.return_val			= 3;
+	pthread_create_fake.custom_fake = ioThreadCreateFails;
+	k_ghost_io_set_worker_count(2);
+	EXPECT_EQ(k_ghost_io_init(), -1);
+	EXPECT_EQ(pthread_create_fake.call_count, 3);
+	EXPECT_EQ(k_ghost_io_ctx.workers, nullptr);
+	EXPECT_EQ(k_ghost_io_ctx.socket_fd, 0);
+	EXPECT_EQ(close_fake.arg0_val, 3);
+}
+
+struct TraceEntry
+{
+	uint64_t	time_ns;
+	int			kind;
+	std::string name;
+	std::string data;
+};
+
+static std::vector<TraceEntry> readTrace(const std::string &path)
+{
+	std::ifstream			file(path, std::ios::binary);
+	std::stringstream		stream;
+	std::vector<TraceEntry> entries;
+	stream << file.rdbuf();
+	const std::string content = stream.str();
+	EXPECT_EQ(content.substr(0, 8), "KGIOTRC1");
+	size_t offset = 8;
+	while (offset + sizeof(k_ghost_io_trace_entry_t) <= content.size())
+	{
+		k_ghost_io_trace_entry_t entry;
+		memcpy(&entry, content.data() + offset, sizeof(entry));
+		offset += sizeof(entry);
+		entries.push_back({entry.time_ns, entry.kind, content.substr(offset, entry.name_len), content.substr(offset + entry.name_len, entry.data_len)});
+		offset += entry.name_len + entry.data_len;
+	}
+	EXPECT_EQ(offset, content.size());
+	return entries;
+}
+
+TEST_F(KGhostIOTest, KGhostIORecordAndReplay)
+{
+	const std::string path = writeRecording("");
+	const std::string rest_request =
+		"POST /api/simulate HTTP/1.1\r\n"
+		"Content-Length: 22\r\n"
+		"\r\n"
+		"{\"interface\":\"nobody\"}";
+	const std::string route_request =
+		"POST /api/simulate/pump HTTP/1.1\r\n"
+		"Content-Length: 12\r\n"
+		"\r\n"
+		"{\"speed\":12}";
+	k_ghost_io_register_interface("pump", [](const cJSON *, void *) { return 0; }, []() {}, nullptr);
+	pthread_create_fake.custom_fake = realThreadCreate;
+	EXPECT_EQ(k_ghost_io_stop_recording(), -1);
+	ASSERT_EQ(k_ghost_io_start_recording(path.c_str()), 0);
+	EXPECT_EQ(k_ghost_io_start_recording(path.c_str()), -1);
+	k_ghost_io_manage_rest_request(5, rest_request.c_str(), headerLen(rest_request));
+	k_ghost_io_manage_rest_route_request(5, route_request.c_str(), headerLen(route_request));
+	k_ghost_io_send_interface_event("pump", "{\"flow\":3}");
+	k_ghost_io_send_event("{\"alarm\":true}");
+	EXPECT_EQ(k_ghost_io_stop_recording(), 0);
+	k_ghost_io_send_event("{\"alarm\":false}");
+
+	const std::vector<TraceEntry> entries = readTrace(path);
+	ASSERT_EQ(entries.size(), 4u);
+	EXPECT_EQ(entries[0].kind, K_GHOST_IO_TRACE_REST);
+	EXPECT_EQ(entries[0].name, "");
+	EXPECT_EQ(entries[0].data, "{\"interface\":\"nobody\"}");
+	EXPECT_EQ(entries[1].kind, K_GHOST_IO_TRACE_ROUTE);
+	EXPECT_EQ(entries[1].name, "pump");
+	EXPECT_EQ(entries[1].data, "{\"speed\":12}");
+	EXPECT_EQ(entries[2].kind, K_GHOST_IO_TRACE_EVENT);
+	EXPECT_EQ(entries[2].name, "pump");
+	EXPECT_EQ(entries[2].data, "{\"flow\":3}");
+	EXPECT_EQ(entries[3].kind, K_GHOST_IO_TRACE_EVENT);
+	EXPECT_EQ(entries[3].name, "");
+	EXPECT_LE(entries[0].time_ns, entries[3].time_ns);
+
+	/* Both requests are sent again, each on its own connection; the events are not */
+	sseOutput.clear();
+	socket_fake.return_val	= 42;
+	send_fake.custom_fake	= sseCapture;
+	recv_fake.custom_fake	= [](int, void *, size_t, int) -> ssize_t
+	{
+		static int calls = 0;
+		return calls++ % 2 ? 0 : 1;
+	};
+	EXPECT_EQ(k_ghost_io_replay_recording(path.c_str(), "not an address", 8080, 0.0), -1);
+	EXPECT_EQ(k_ghost_io_replay_recording("/nonexistent/trace", "127.0.0.1", 8080, 0.0), -1);
+	EXPECT_EQ(k_ghost_io_replay_recording(path.c_str(), "127.0.0.1", 8080, 0.0), 2);
+	EXPECT_EQ(connect_fake.call_count, 2u);
+	ASSERT_EQ(sseOutput.size(), 4u);
+	EXPECT_EQ(sseOutput[0].first, 42);
+	EXPECT_EQ(sseOutput[0].second, "POST /api/simulate HTTP/1.1\r\nContent-Type: application/json\r\nContent-Length: 22\r\n\r\n");
+	EXPECT_EQ(sseOutput[1].second, "{\"interface\":\"nobody\"}");
+	EXPECT_EQ(sseOutput[2].second, "POST /api/simulate/pump HTTP/1.1\r\nContent-Type: application/json\r\nContent-Length: 12\r\n\r\n");
+	EXPECT_EQ(sseOutput[3].second, "{\"speed\":12}");
+	unlink(path.c_str());
+}
+
+TEST_F(KGhostIOTest, KGhostIORecordConcurrentProducers)
+{
+	const std::string path			= writeRecording("");
+	pthread_create_fake.custom_fake = realThreadCreate;
+	ASSERT_EQ(k_ghost_io_start_recording(path.c_str()), 0);
+	std::vector<std::thread> producers;
+	for (int t = 0; t < 4; t++)
+	{
+		producers.emplace_back(
+			[t]()
+			{
+				const std::string name = "sensor" + std::to_string(t);
+				for (int i = 0; i < 20000; i++)
+				{
+					const std::string data = std::to_string(i);
+					k_ghost_io_record(K_GHOST_IO_TRACE_EVENT, name.c_str(), name.size(), data.c_str(), data.size());
+				}
+			});
+	}
+	for (std::thread &producer : producers)
+	{
+		producer.join();
+	}
+	const int64_t dropped = k_ghost_io_stop_recording();
+	ASSERT_GE(dropped, 0);
+
+	/* Nothing lost without being counted, and the entries of each producer stay in order */
+	const std::vector<TraceEntry> entries = readTrace(path);
+	int							  last[4] = {-1, -1, -1, -1};
+	EXPECT_EQ(entries.size() + (size_t)dropped, 80000u);
+	for (const TraceEntry &entry : entries)
+	{
+		const int t = entry.name.back() - '0';
+		const int i = std::stoi(entry.data);
+		EXPECT_GT(i, last[t]);
+		last[t] = i;
+	}
+	unlink(path.c_str());
+}
+
+typedef struct
+{
+	double	temperature;
+	int32_t rpm;
+	bool	on;
+	char	mode[8];
+} pump_state_t;
+
+static const k_ghost_io_field_t pump_fields[] = {
+	K_GHOST_IO_FIELD(pump_state_t, temperature, K_GHOST_IO_FIELD_DOUBLE, 0, 0),
+	K_GHOST_IO_FIELD(pump_state_t, rpm, K_GHOST_IO_FIELD_INT, 0, 0),
+	K_GHOST_IO_FIELD(pump_state_t, on, K_GHOST_IO_FIELD_BOOL, 0, 0),
+	K_GHOST_IO_FIELD(pump_state_t, mode, K_GHOST_IO_FIELD_STRING, 0, 0),
+};
+static const k_ghost_io_state_field_t  pump_state_fields[] = {{0.5}, {10}, {0}, {0}};
+static const k_ghost_io_state_schema_t pump_schema		   = {{pump_fields, sizeof(pump_fields) / sizeof(pump_fields[0]), sizeof(pump_state_t)}, pump_state_fields};
+
+/* Step the paused clock by one period of the pump state and publish */
+static void publishPump(void)
+{
+	k_ghost_io_step_clock(10000);
+	k_ghost_io_run_timers(k_ghost_io_now_ns() + K_GHOST_IO_TIMER_TICK_NS);
+}
+
+TEST_F(KGhostIOTest, KGhostIOStateDeadband)
+{
+	k_ghost_io_pause_clock();
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+	ASSERT_EQ(k_ghost_io_add_state("pump", &pump_schema, 10000), K_GHOST_REGISTER_RET_CODE_OK);
+
+	/* The whole state first */
+	pump_state_t state = {20.5, 1000, true, "auto"};
+	EXPECT_EQ(k_ghost_io_set_state("pump", &state), 0);
+	publishPump();
+	ASSERT_EQ(sseOutput.size(), 1u);
+	EXPECT_EQ(sseOutput[0].second, "event: pump\r\ndata: {\"temperature\":20.5,\"rpm\":1000,\"on\":true,\"mode\":\"auto\"}\r\n\r\n");
+
+	/* Within the deadbands, from the last published values: nothing */
+	sseOutput.clear();
+	state.temperature = 20.9;
+	state.rpm		  = 1005;
+	k_ghost_io_set_state("pump", &state);
+	publishPump();
+	state.rpm = 995;
+	k_ghost_io_set_state("pump", &state);
+	publishPump();
+	EXPECT_TRUE(sseOutput.empty());
+
+	/* Only what moved, every change of the set since the last period in one event */
+	state.temperature = 21.1;
+	k_ghost_io_set_state("pump", &state);
+	publishPump();
+	state.rpm = 1011;
+	state.on  = false;
+	strcpy(state.mode, "m\"\n");
+	k_ghost_io_set_state("pump", &state);
+	state.temperature = NAN;
+	k_ghost_io_set_state("pump", &state);
+	publishPump();
+	ASSERT_EQ(sseOutput.size(), 2u);
+	EXPECT_EQ(sseOutput[0].second, "event: pump\r\ndata: {\"temperature\":21.1}\r\n\r\n");
+	EXPECT_EQ(sseOutput[1].second, "event: pump\r\ndata: {\"temperature\":null,\"rpm\":1011,\"on\":false,\"mode\":\"m\\\"\\u000a\"}\r\n\r\n");
+
+	/* A new client gets the whole state, still not a number is no change */
+	k_ghost_io_add_sse_client(6, nullptr);
+	sseOutput.clear();
+	publishPump();
+	ASSERT_EQ(sseOutput.size(), 2u);
+	EXPECT_EQ(sseOutput[0].first, 6);
+	EXPECT_EQ(sseOutput[1].second, "event: pump\r\ndata: {\"temperature\":null,\"rpm\":1011,\"on\":false,\"mode\":\"m\\\"\\u000a\"}\r\n\r\n");
+	sseOutput.clear();
+	publishPump();
+	EXPECT_TRUE(sseOutput.empty());
+
+	pump_state_t read = {};
+	EXPECT_EQ(k_ghost_io_get_state("pump", &read), 0);
+	EXPECT_EQ(read.rpm, 1011);
+	EXPECT_STREQ(read.mode, "m\"\n");
+
+	k_ghost_io_remove_state("pump");
+	EXPECT_EQ(k_ghost_io_set_state("pump", &state), -1);
+	EXPECT_EQ(k_ghost_io_get_state("pump", &read), -1);
+	publishPump();
+	EXPECT_TRUE(sseOutput.empty());
+	k_ghost_io_remove_sse_client(6);
+	k_ghost_io_remove_sse_client(5);
+}
+
+TEST_F(KGhostIOTest, KGhostIOStateWithoutDeadband)
+{
+	const k_ghost_io_state_schema_t exact_schema = {pump_schema.schema, nullptr};
+	k_ghost_io_pause_clock();
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+	ASSERT_EQ(k_ghost_io_add_state("pump", &exact_schema, 10000), K_GHOST_REGISTER_RET_CODE_OK);
+
+	/* Without publication parameters, the smallest change is published */
+	pump_state_t state = {20.5, 1000, true, "auto"};
+	k_ghost_io_set_state("pump", &state);
+	publishPump();
+	sseOutput.clear();
+	state.temperature = 20.6;
+	state.rpm		  = 1001;
+	k_ghost_io_set_state("pump", &state);
+	publishPump();
+	ASSERT_EQ(sseOutput.size(), 1u);
+	EXPECT_EQ(sseOutput[0].second, "event: pump\r\ndata: {\"temperature\":20.6,\"rpm\":1001}\r\n\r\n");
+
+	k_ghost_io_remove_state("pump");
+	k_ghost_io_remove_sse_client(5);
+}
+
+TEST_F(KGhostIOTest, KGhostIOStateInvalid)
+{
+	const k_ghost_io_state_schema_t empty_schema = {{pump_fields, 0, sizeof(pump_state_t)}, pump_state_fields};
+	const k_ghost_io_state_schema_t small_schema = {{pump_fields, 4, sizeof(double)}, pump_state_fields};
+	EXPECT_EQ(k_ghost_io_add_state(nullptr, &pump_schema, 10000), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_state("pump", nullptr, 10000), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_state("pump", &pump_schema, 0), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_state("pump", &empty_schema, 10000), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_state("pump", &small_schema, 10000), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_state("pump", &pump_schema, 10000), K_GHOST_REGISTER_RET_CODE_OK);
+	EXPECT_EQ(k_ghost_io_add_state("pump", &pump_schema, 10000), K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED);
+	EXPECT_EQ(k_ghost_io_set_state("valve", &pump_schema), -1);
+	EXPECT_EQ(k_ghost_io_set_state("pump", nullptr), -1);
+}
+
+static int faultyCalls = 0;
+
+static int faultyCallback(const cJSON *, void *)
+{
+	faultyCalls++;
+	return 0;
+}
+
+TEST_F(KGhostIOTest, KGhostIOFaultsRequests)
+{
+	const std::string request = "POST /api/simulate/motor HTTP/1.1\r\nContent-Length: 2\r\n\r\n{}";
+	faultyCalls				  = 0;
+	send_fake.custom_fake	  = sendCapture;
+	k_ghost_io_register_interface("motor", faultyCallback, nullptr, nullptr);
+
+	/* Answered with an error, the callback is not run */
+	k_ghost_io_fault_profile_t profile = {};
+	profile.error_rate				   = 1.0;
+	ASSERT_EQ(k_ghost_io_set_faults("motor", &profile), 0);
+	k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(faultyCalls, 0);
+	EXPECT_EQ(sendOutput.rfind("HTTP/1.1 500 Internal Server Error\r\n", 0), 0u);
+	EXPECT_EQ(close_fake.call_count, 1);
+
+	/* Reset: closed with a zero linger time, without an answer */
+	profile.error_rate = 0.0;
+	profile.reset_rate = 1.0;
+	ASSERT_EQ(k_ghost_io_set_faults("motor", &profile), 0);
+	k_ghost_io_manage_rest_route_request(6, request.c_str(), headerLen(request));
+	EXPECT_EQ(faultyCalls, 0);
+	EXPECT_EQ(send_fake.call_count, 1);
+	EXPECT_EQ(setsockopt_fake.arg0_val, 6);
+	EXPECT_EQ(setsockopt_fake.arg2_val, SO_LINGER);
+	EXPECT_EQ(close_fake.arg0_val, 6);
+
+	/* Delayed on a timer, the connection stays open meanwhile */
+	k_ghost_io_pause_clock();
+	profile.reset_rate = 0.0;
+	profile.delay_us   = 20000;
+	ASSERT_EQ(k_ghost_io_set_faults("motor", &profile), 0);
+	k_ghost_io_manage_rest_route_request(7, request.c_str(), headerLen(request));
+	EXPECT_EQ(faultyCalls, 0);
+	EXPECT_EQ(close_fake.call_count, 2);
+	k_ghost_io_step_clock(10000);
+	k_ghost_io_run_timers(k_ghost_io_now_ns());
+	EXPECT_EQ(faultyCalls, 0);
+	k_ghost_io_step_clock(10000 + K_GHOST_IO_TIMER_TICK_NS / 1000);
+	k_ghost_io_run_timers(k_ghost_io_now_ns());
+	EXPECT_EQ(faultyCalls, 1);
+	EXPECT_EQ(send_fake.arg0_val, 7);
+	EXPECT_EQ(sendOutput, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(close_fake.arg0_val, 7);
+
+	/* Rates out of range are refused and leave the profile as it was */
+	profile.error_rate = 1.5;
+	EXPECT_EQ(k_ghost_io_set_faults("motor", &profile), -1);
+	profile.error_rate = NAN;
+	EXPECT_EQ(k_ghost_io_set_faults("motor", &profile), -1);
+	ASSERT_NE(k_ghost_io_ctx.faults, nullptr);
+	EXPECT_EQ(k_ghost_io_ctx.faults->profile.error_rate, 0.0);
+
+	EXPECT_EQ(k_ghost_io_set_faults("motor", nullptr), 0);
+	EXPECT_EQ(k_ghost_io_ctx.faults, nullptr);
+	k_ghost_io_manage_rest_route_request(8, request.c_str(), headerLen(request));
+	EXPECT_EQ(faultyCalls, 2);
+	k_ghost_io_unregister_interface("motor");
+}
+
+TEST_F(KGhostIOTest, KGhostIOFaultsEvents)
+{
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+
+	k_ghost_io_fault_profile_t profile = {};
+	profile.drop_rate				   = 1.0;
+	ASSERT_EQ(k_ghost_io_set_faults("wind", &profile), 0);
+	k_ghost_io_send_interface_event("wind", "{}");
+	EXPECT_TRUE(sseOutput.empty());
+	/* Unnamed events and the other interfaces are left alone */
+	k_ghost_io_send_event("{}");
+	k_ghost_io_send_interface_event("rain", "{}");
+	EXPECT_EQ(sseOutput.size(), 2u);
+
+	profile.drop_rate	   = 0.0;
+	profile.duplicate_rate = 1.0;
+	ASSERT_EQ(k_ghost_io_set_faults("wind", &profile), 0);
+	sseOutput.clear();
+	k_ghost_io_send_interface_event("wind", "{}");
+	ASSERT_EQ(sseOutput.size(), 2u);
+	EXPECT_EQ(sseOutput[1].second, "event: wind\r\ndata: {}\r\n\r\n");
+
+	/* The same seed draws the same faults */
+	profile.drop_rate	   = 0.5;
+	profile.duplicate_rate = 0.0;
+	profile.seed		   = 7;
+	auto draw			   = []()
+	{
+		std::string pattern;
+		for (int i = 0; i < 64; i++)
+		{
+			sseOutput.clear();
+			k_ghost_io_send_interface_event("wind", "{}");
+			pattern += sseOutput.empty() ? '0' : '1';
+		}
+		return pattern;
+	};
+	ASSERT_EQ(k_ghost_io_set_faults("wind", &profile), 0);
+	const std::string first = draw();
+	ASSERT_EQ(k_ghost_io_set_faults("wind", &profile), 0);
+	EXPECT_EQ(draw(), first);
+	EXPECT_NE(first.find('0'), std::string::npos);
+	EXPECT_NE(first.find('1'), std::string::npos);
+	k_ghost_io_remove_sse_client(5);
+}
+
+TEST_F(KGhostIOTest, KGhostIOFaultsEndpoint)
+{
+	const std::string head = "POST /api/faults HTTP/1.1\r\nContent-Type: application/json\r\n\r\n";
+	send_fake.custom_fake  = sendCapture;
+	EXPECT_EQ(k_ghost_io_manage_request(5, (head + "{\"interface\":\"motor\",\"delay_us\":250000,\"error_rate\":0.1,\"seed\":42}").c_str(), head.size()), 1);
+	EXPECT_EQ(sendOutput, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(close_fake.arg0_val, 5);
+	ASSERT_NE(k_ghost_io_ctx.faults, nullptr);
+	EXPECT_STREQ(k_ghost_io_ctx.faults->interface_name, "motor");
+	EXPECT_EQ(k_ghost_io_ctx.faults->profile.delay_us, 250000u);
+	EXPECT_EQ(k_ghost_io_ctx.faults->profile.error_rate, 0.1);
+	EXPECT_EQ(k_ghost_io_ctx.faults->profile.seed, 42u);
+
+	/* Invalid profiles leave the current one in place */
+	k_ghost_io_manage_request(6, (head + "{\"interface\":\"motor\",\"error_rate\":2}").c_str(), head.size());
+	EXPECT_EQ(sendOutput.rfind("HTTP/1.1 400 Bad Request\r\n", 0), 0u);
+	k_ghost_io_manage_request(6, (head + "{\"drop_rate\":0.5}").c_str(), head.size());
+	EXPECT_EQ(sendOutput.rfind("HTTP/1.1 400 Bad Request\r\n", 0), 0u);
+	EXPECT_EQ(k_ghost_io_ctx.faults->profile.delay_us, 250000u);
+
+	/* A profile without faults removes it */
+	k_ghost_io_manage_request(7, (head + "{\"interface\":\"motor\"}").c_str(), head.size());
+	EXPECT_EQ(sendOutput, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+	EXPECT_EQ(k_ghost_io_ctx.faults, nullptr);
+}
+
+TEST_F(KGhostIOTest, KGhostIOSseLinkLatency)
+{
+	k_ghost_io_pause_clock();
+	const k_ghost_io_link_profile_t link = {0, 10000, 0};
+	k_ghost_io_set_sse_link(&link);
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+	ASSERT_NE(reinterpret_cast<k_ghost_io_sse_client_entry_t *>(k_ghost_io_ctx.sse_clients)->shaper, nullptr);
+
+	k_ghost_io_send_event("{\"a\":1}");
+	k_ghost_io_send_event("{\"a\":2}");
+	EXPECT_TRUE(sseOutput.empty());
+	k_ghost_io_step_clock(5000);
+	k_ghost_io_run_timers(k_ghost_io_now_ns());
+	EXPECT_TRUE(sseOutput.empty());
+	k_ghost_io_step_clock(5000 + K_GHOST_IO_TIMER_TICK_NS / 1000);
+	k_ghost_io_run_timers(k_ghost_io_now_ns());
+	ASSERT_EQ(sseOutput.size(), 2u);
+	EXPECT_EQ(sseOutput[0].second, "data: {\"a\":1}\r\n\r\n");
+	EXPECT_EQ(sseOutput[1].second, "data: {\"a\":2}\r\n\r\n");
+	EXPECT_EQ(k_ghost_io_ctx.sse_queued_bytes, 0u);
+
+	/* Events still on the link are dropped with the client */
+	k_ghost_io_send_event("{}");
+	EXPECT_EQ(k_ghost_io_ctx.sse_queued_bytes, 12u);
+	k_ghost_io_remove_sse_client(5);
+	EXPECT_EQ(k_ghost_io_ctx.sse_queued_bytes, 0u);
+	k_ghost_io_step_clock(20000);
+	k_ghost_io_run_timers(k_ghost_io_now_ns());
+	EXPECT_EQ(sseOutput.size(), 2u);
+
+	/* Clients without a link write straight to their socket */
+	k_ghost_io_set_sse_link(nullptr);
+	k_ghost_io_add_sse_client(6, nullptr);
+	send_fake.custom_fake = sseCapture;
+	EXPECT_EQ(reinterpret_cast<k_ghost_io_sse_client_entry_t *>(k_ghost_io_ctx.sse_clients)->shaper, nullptr);
+	sseOutput.clear();
+	k_ghost_io_send_event("{}");
+	EXPECT_EQ(sseOutput.size(), 1u);
+	k_ghost_io_remove_sse_client(6);
+}
+
+TEST_F(KGhostIOTest, KGhostIOSseLinkBandwidth)
+{
+	k_ghost_io_pause_clock();
+	sseOutput.clear();
+	/* "data: {}\r\n\r\n" is 12 bytes, 12 ms each at 1000 bytes per second */
+	k_ghost_io_add_sse_client(5, "bytes_per_s=1000 HTTP/1.1\r\n");
+	send_fake.custom_fake = sseCapture;
+	ASSERT_NE(reinterpret_cast<k_ghost_io_sse_client_entry_t *>(k_ghost_io_ctx.sse_clients)->shaper, nullptr);
+	for (int i = 0; i < 3; i++)
+	{
+		k_ghost_io_send_event("{}");
+	}
+	for (size_t expected = 1; expected <= 3; expected++)
+	{
+		k_ghost_io_step_clock(12000 + K_GHOST_IO_TIMER_TICK_NS / 1000);
+		k_ghost_io_run_timers(k_ghost_io_now_ns());
+		EXPECT_EQ(sseOutput.size(), expected);
+	}
+	k_ghost_io_remove_sse_client(5);
+
+	/* Jitter reorders nothing */
+	k_ghost_io_add_sse_client(6, "latency_us=1000&jitter_us=50000 HTTP/1.1\r\n");
+	sseOutput.clear();
+	for (int i = 0; i < 16; i++)
+	{
+		k_ghost_io_send_event(("{\"i\":" + std::to_string(i) + "}").c_str());
+	}
+	k_ghost_io_step_clock(60000);
+	k_ghost_io_run_timers(k_ghost_io_now_ns());
+	ASSERT_EQ(sseOutput.size(), 16u);
+	for (int i = 0; i < 16; i++)
+	{
+		EXPECT_EQ(sseOutput[i].second, "data: {\"i\":" + std::to_string(i) + "}\r\n\r\n");
+	}
+	k_ghost_io_remove_sse_client(6);
+
+	/* Malformed values fall back to the default link */
+	k_ghost_io_add_sse_client(7, "bytes_per_s=fast&latency_us=-&jitter_us HTTP/1.1\r\n");
+	EXPECT_EQ(reinterpret_cast<k_ghost_io_sse_client_entry_t *>(k_ghost_io_ctx.sse_clients)->shaper, nullptr);
+	k_ghost_io_remove_sse_client(7);
+}
+
+/* Number of files matching a glob pattern */
+static size_t countFiles(const std::string &pattern)
+{
+	glob_t matches;
+	size_t count = 0 == glob(pattern.c_str(), 0, nullptr, &matches) ? matches.gl_pathc : 0;
+	globfree(&matches);
+	return count;
+}
+
+TEST_F(KGhostIOTest, KGhostIOSnapshotRestore)
+{
+	const k_ghost_io_channel_t channel = {"speed", K_GHOST_IO_WAVE_SINE, 5.0, 1.0, 0.7, 0.0, K_GHOST_IO_NOISE_GAUSSIAN, 0.5};
+	k_ghost_io_pause_clock();
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+	ASSERT_EQ(k_ghost_io_add_state("pump", &pump_schema, 10000), K_GHOST_REGISTER_RET_CODE_OK);
+	ASSERT_EQ(k_ghost_io_add_generator("anemometer", &channel, 1, 100.0), K_GHOST_REGISTER_RET_CODE_OK);
+	k_ghost_io_fault_profile_t profile = {};
+	profile.drop_rate				   = 0.5;
+	ASSERT_EQ(k_ghost_io_set_faults("wind", &profile), 0);
+	pump_state_t state = {20.5, 1000, true, "auto"};
+	k_ghost_io_set_state("pump", &state);
+	publishPump();
+
+	const size_t	  size = k_ghost_io_snapshot(nullptr, 0);
+	std::vector<char> snapshot(size);
+	EXPECT_EQ(k_ghost_io_snapshot(snapshot.data(), 8), size);
+	ASSERT_EQ(k_ghost_io_snapshot(snapshot.data(), size), size);
+	EXPECT_EQ(std::string(snapshot.data(), 8), "KGIOSNP1");
+
+	/* Generator samples and fault draws from the snapshot on, the pump events apart */
+	auto run = [](size_t &pump_events)
+	{
+		std::string trace;
+		pump_events = 0;
+		for (int i = 0; i < 20; i++)
+		{
+			sseOutput.clear();
+			publishPump();
+			k_ghost_io_send_interface_event("wind", "{}");
+			for (const auto &output : sseOutput)
+			{
+				pump_events += output.second.rfind("event: pump\r\n", 0) == 0;
+				trace += output.second.rfind("event: pump\r\n", 0) == 0 ? "" : output.second;
+			}
+		}
+		return trace;
+	};
+	size_t			  pump_events = 0;
+	const std::string first		  = run(pump_events);
+	EXPECT_EQ(pump_events, 0u);
+	EXPECT_NE(first.find("event: anemometer"), std::string::npos);
+
+	/* The models move on, then back to the snapshot */
+	const pump_state_t moved = {80.0, 3000, false, "manual"};
+	k_ghost_io_set_state("pump", &moved);
+	k_ghost_io_step_clock(123456);
+	ASSERT_EQ(k_ghost_io_restore(snapshot.data(), size), 0);
+	pump_state_t read = {};
+	ASSERT_EQ(k_ghost_io_get_state("pump", &read), 0);
+	EXPECT_EQ(read.temperature, 20.5);
+	EXPECT_EQ(read.rpm, 1000);
+	EXPECT_STREQ(read.mode, "auto");
+	EXPECT_EQ(run(pump_events), first);
+	EXPECT_EQ(pump_events, 1u);
+
+	/* Same through a file */
+	const std::string path = writeRecording("");
+	ASSERT_EQ(k_ghost_io_save_snapshot(path.c_str()), 0);
+	k_ghost_io_set_state("pump", &moved);
+	k_ghost_io_step_clock(654321);
+	ASSERT_EQ(k_ghost_io_load_snapshot(path.c_str()), 0);
+	const std::string again = run(pump_events);
+	EXPECT_EQ(pump_events, 1u);
+	ASSERT_EQ(k_ghost_io_load_snapshot(path.c_str()), 0);
+	EXPECT_EQ(run(pump_events), again);
+	EXPECT_EQ(countFiles(path + ".??????"), 0u);
+
+	/* A save that fails leaves the target as it was and no temporary file behind */
+	const std::string dir = path + ".d";
+	ASSERT_EQ(mkdir(dir.c_str(), 0755), 0);
+	EXPECT_EQ(k_ghost_io_save_snapshot(dir.c_str()), -1);
+	struct stat dir_stat;
+	EXPECT_EQ(stat(dir.c_str(), &dir_stat), 0);
+	EXPECT_TRUE(S_ISDIR(dir_stat.st_mode));
+	EXPECT_EQ(countFiles(dir + ".??????"), 0u);
+	rmdir(dir.c_str());
+	unlink(path.c_str());
+
+	/* A truncated snapshot restores nothing */
+	k_ghost_io_set_state("pump", &moved);
+	EXPECT_EQ(k_ghost_io_restore(snapshot.data(), size - 1), -1);
+	EXPECT_EQ(k_ghost_io_restore(snapshot.data(), 4), -1);
+	EXPECT_EQ(k_ghost_io_restore(nullptr, size), -1);
+	k_ghost_io_get_state("pump", &read);
+	EXPECT_EQ(read.rpm, 3000);
+
+	/* Neither is one holding a string without its terminator */
+	std::vector<char> corrupt = snapshot;
+	const auto		  mode	  = std::search(corrupt.begin(), corrupt.end(), state.mode, state.mode + sizeof(state.mode));
+	ASSERT_NE(mode, corrupt.end());
+	std::fill(mode, mode + sizeof(state.mode), 'x');
+	EXPECT_EQ(k_ghost_io_restore(corrupt.data(), size), -1);
+	k_ghost_io_get_state("pump", &read);
+	EXPECT_EQ(read.rpm, 3000);
+	EXPECT_STREQ(read.mode, "manual");
+
+	/* Records without a match are reported, the other ones restored */
+	k_ghost_io_remove_generator("anemometer");
+	EXPECT_EQ(k_ghost_io_restore(snapshot.data(), size), -1);
+	k_ghost_io_get_state("pump", &read);
+	EXPECT_EQ(read.rpm, 1000);
+	EXPECT_EQ(k_ghost_io_load_snapshot("/nonexistent/snapshot"), -1);
+	k_ghost_io_remove_sse_client(5);
+}
+
+typedef struct
+{
+	double	speed;
+	int32_t heading;
+} anemometer_t;
+
+static const k_ghost_io_field_t anemometer_fields[] = {
+	K_GHOST_IO_FIELD(anemometer_t, speed, K_GHOST_IO_FIELD_DOUBLE, 0, 0),
+	K_GHOST_IO_FIELD(anemometer_t, heading, K_GHOST_IO_FIELD_INT, 0, 0),
+};
+static const k_ghost_io_state_field_t  anemometer_state_fields[] = {{0.5}, {0}};
+static const k_ghost_io_state_schema_t anemometer_schema		 = {{anemometer_fields, 2, sizeof(anemometer_t)}, anemometer_state_fields};
+
+typedef struct
+{
+	double	 step;
+	uint64_t elapsed_ns;
+} anemometer_model_t;
+
+/* Instance i gusts by i steps each tick */
+static void anemometerTick(void *const *columns, size_t count, uint64_t elapsed_ns, void *user_data_p)
+{
+	anemometer_model_t *model_p = static_cast<anemometer_model_t *>(user_data_p);
+	double			   *speed	= static_cast<double *>(columns[0]);
+	for (size_t i = 0; i < count; i++)
+	{
+		speed[i] += model_p->step * (double)i;
+	}
+	model_p->elapsed_ns = elapsed_ns;
+}
+
+TEST_F(KGhostIOTest, KGhostIOFarmTick)
+{
+	anemometer_model_t model = {0.0, 0};
+	k_ghost_io_pause_clock();
+	sseOutput.clear();
+	k_ghost_io_add_sse_client(5, nullptr);
+	send_fake.custom_fake = sseCapture;
+	ASSERT_EQ(k_ghost_io_add_farm("anemometer", &anemometer_schema, 3, 10000, anemometerTick, &model), K_GHOST_REGISTER_RET_CODE_OK);
+	EXPECT_EQ(k_ghost_io_add_farm("anemometer", &anemometer_schema, 3, 10000, anemometerTick, &model), K_GHOST_REGISTER_RET_CODE_ALREADY_REGISTERED);
+
+	/* Every instance first, named after its index */
+	publishPump();
+	ASSERT_EQ(sseOutput.size(), 3u);
+	EXPECT_EQ(sseOutput[0].second, "event: anemometer/0000\r\ndata: {\"speed\":0,\"heading\":0}\r\n\r\n");
+	EXPECT_EQ(sseOutput[2].second, "event: anemometer/0002\r\ndata: {\"speed\":0,\"heading\":0}\r\n\r\n");
+
+	/* Only the instances that moved further than the deadband from their last published values */
+	model.step = 0.25;
+	sseOutput.clear();
+	publishPump();
+	EXPECT_EQ(model.elapsed_ns, 10000000u);
+	EXPECT_TRUE(sseOutput.empty());
+	publishPump();
+	ASSERT_EQ(sseOutput.size(), 1u);
+	EXPECT_EQ(sseOutput[0].second, "event: anemometer/0002\r\ndata: {\"speed\":1}\r\n\r\n");
+	sseOutput.clear();
+	publishPump();
+	ASSERT_EQ(sseOutput.size(), 1u);
+	EXPECT_EQ(sseOutput[0].second, "event: anemometer/0001\r\ndata: {\"speed\":0.75}\r\n\r\n");
+
+	/* Set from the outside, published at the next tick */
+	model.step				 = 0.0;
+	const anemometer_t north = {0.0, 90};
+	EXPECT_EQ(k_ghost_io_set_farm_instance("anemometer", 0, &north), 0);
+	EXPECT_EQ(k_ghost_io_set_farm_instance("anemometer", 3, &north), -1);
+	EXPECT_EQ(k_ghost_io_set_farm_instance("vane", 0, &north), -1);
+	sseOutput.clear();
+	publishPump();
+	ASSERT_EQ(sseOutput.size(), 1u);
+	EXPECT_EQ(sseOutput[0].second, "event: anemometer/0000\r\ndata: {\"heading\":90}\r\n\r\n");
+	anemometer_t read = {};
+	EXPECT_EQ(k_ghost_io_get_farm_instance("anemometer", 1, &read), 0);
+	EXPECT_EQ(read.speed, 0.75);
+	EXPECT_EQ(k_ghost_io_get_farm_instance("anemometer", 3, &read), -1);
+
+	/* New clients get every instance, the farm name covers its instances */
+	k_ghost_io_add_sse_client(6, "interface=anemometer HTTP/1.1\r\n");
+	k_ghost_io_add_sse_client(7, "interface=anemometer/0001 HTTP/1.1\r\n");
+	k_ghost_io_add_sse_client(8, "interface=anemo HTTP/1.1\r\n");
+	sseOutput.clear();
+	publishPump();
+	size_t received[9] = {};
+	for (const auto &output : sseOutput)
+	{
+		received[output.first]++;
+	}
+	EXPECT_EQ(received[5], 3u);
+	EXPECT_EQ(received[6], 3u);
+	EXPECT_EQ(received[7], 1u);
+	EXPECT_EQ(received[8], 0u);
+
+	/* Removed: no tick, no event */
+	k_ghost_io_force_farms();
+	k_ghost_io_remove_farm("anemometer");
+	sseOutput.clear();
+	model.elapsed_ns = 0;
+	publishPump();
+	EXPECT_TRUE(sseOutput.empty());
+	EXPECT_EQ(model.elapsed_ns, 0u);
+	EXPECT_EQ(k_ghost_io_get_farm_instance("anemometer", 0, &read), -1);
+	for (int fd = 5; fd <= 8; fd++)
+	{
+		k_ghost_io_remove_sse_client(fd);
+	}
+}
+
+TEST_F(KGhostIOTest, KGhostIOFarmRequests)
+{
+	anemometer_model_t model = {0.0, 0};
+	send_fake.custom_fake	 = sendCapture;
+	EXPECT_EQ(k_ghost_io_add_farm(nullptr, &anemometer_schema, 3, 10000, anemometerTick, &model), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_farm("anemometer", &anemometer_schema, 0, 10000, anemometerTick, &model), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_farm("anemometer", &anemometer_schema, 3, 0, anemometerTick, &model), K_GHOST_REGISTER_RET_CODE_ERROR);
+	EXPECT_EQ(k_ghost_io_add_farm("anemometer", &anemometer_schema, 3, 10000, nullptr, &model), K_GHOST_REGISTER_RET_CODE_ERROR);
+	ASSERT_EQ(k_ghost_io_add_farm("anemometer", &anemometer_schema, 3, 10000, anemometerTick, &model), K_GHOST_REGISTER_RET_CODE_OK);
+
+	/* The fields of the body set, the whole instance answered */
+	const std::string request = "POST /api/simulate/anemometer/0001 HTTP/1.1\r\nContent-Length: 14\r\n\r\n{\"heading\":45}";
+	k_ghost_io_manage_rest_route_request(5, request.c_str(), headerLen(request));
+	EXPECT_EQ(close_fake.call_count, 1);
+	EXPECT_EQ(sendOutput.rfind("HTTP/1.1 200 OK\r\n", 0), 0u);
+	EXPECT_NE(sendOutput.find("\r\n\r\n{\"speed\":0,\"heading\":45}"), std::string::npos);
+	anemometer_t read = {};
+	EXPECT_EQ(k_ghost_io_get_farm_instance("anemometer", 1, &read), 0);
+	EXPECT_EQ(read.heading, 45);
+
+	/* Only canonical names of existing instances, well formed bodies */
+	const char *const unknown[] = {"anemometer/1", "anemometer/00001", "anemometer/0003", "anemometer/", "vane/0001", "anemometer"};
+	for (const char *name : unknown)
+	{
+		sendOutput.clear();
+		const std::string unknownRequest = std::string("POST /api/simulate/") + name + " HTTP/1.1\r\n\r\n{}";
+		k_ghost_io_manage_rest_route_request(5, unknownRequest.c_str(), headerLen(unknownRequest));
+		EXPECT_EQ(sendOutput, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n") << name;
+	}
+	const std::string malformedRequest = "POST /api/simulate/anemometer/0001 HTTP/1.1\r\n\r\n{\"heading\":";
+	k_ghost_io_manage_rest_route_request(5, malformedRequest.c_str(), headerLen(malformedRequest));
+	EXPECT_EQ(sendOutput, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n");
+	k_ghost_io_get_farm_instance("anemometer", 1, &read);
+	EXPECT_EQ(read.heading, 45);
+
+	/* Part of the snapshots */
+	const size_t	  size = k_ghost_io_snapshot(nullptr, 0);
+	std::vector<char> snapshot(size);
+	ASSERT_EQ(k_ghost_io_snapshot(snapshot.data(), size), size);
+	const anemometer_t moved = {12.5, 180};
+	k_ghost_io_set_farm_instance("anemometer", 1, &moved);
+	ASSERT_EQ(k_ghost_io_restore(snapshot.data(), size), 0);
+	k_ghost_io_get_farm_instance("anemometer", 1, &read);
+	EXPECT_EQ(read.speed, 0.0);
+	EXPECT_EQ(read.heading, 45);
+
+	/* A string column without its terminator restores nothing */
+	ASSERT_EQ(k_ghost_io_add_farm("pumps", &pump_schema, 2, 10000, [](void *const *, size_t, uint64_t, void *) {}, nullptr), K_GHOST_REGISTER_RET_CODE_OK);
+	const pump_state_t pump = {20.5, 1000, true, "auto"};
+	k_ghost_io_set_farm_instance("pumps", 0, &pump);
+	const size_t	  pumpsSize = k_ghost_io_snapshot(nullptr, 0);
+	std::vector<char> corrupt(pumpsSize);
+	ASSERT_EQ(k_ghost_io_snapshot(corrupt.data(), pumpsSize), pumpsSize);
+	const auto mode = std::search(corrupt.begin(), corrupt.end(), pump.mode, pump.mode + sizeof(pump.mode));
+	ASSERT_NE(mode, corrupt.end());
+	std::fill(mode, mode + sizeof(pump.mode), 'x');
+	k_ghost_io_set_farm_instance("anemometer", 1, &moved);
+	EXPECT_EQ(k_ghost_io_restore(corrupt.data(), pumpsSize), -1);
+	k_ghost_io_get_farm_instance("anemometer", 1, &read);
+	EXPECT_EQ(read.heading, 180);
+}